@@ -0,0 +1,690 @@
+/*******************************************************************************
+ *
+ *                              Delta Chat Core
+ *                      Copyright (C) 2017 Björn Petersen
+ *                   Contact: r10s@b44t.com, http://b44t.com
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see http://www.gnu.org/licenses/ .
+ *
+ ******************************************************************************/
+
+
+/* Benchmark the hot paths of the core on a synthetic database; if used as a lib,
+this file is obsolete.  The results are written as JSON so that runs can be
+compared by scripts, eg.
+$ ./bench --msgs 50000 --out before.json
+*/
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include "../src/mrmailbox.h"
+#include "../src/mrmailbox_internal.h"
+#include "../src/mrmimefactory.h"
+#include "../src/mrpgp.h"
+#include "../src/mrapeerstate.h"
+#include "../src/mrkeyring.h"
+
+
+#define BENCH_SELF_ADDR "self@bench.invalid"
+
+
+typedef struct bench_param_t
+{
+	const char* m_dbfile;
+	const char* m_outfile;
+	int         m_chats;
+	int         m_msgs;
+	int         m_contacts;
+	int         m_peerstates;
+	int         m_imf;
+	int         m_iterations;
+} bench_param_t;
+
+
+typedef struct bench_result_t
+{
+	const char* m_name;
+	int         m_iterations;
+	long        m_items;     /* number of objects returned by the last iteration, informational */
+	double      m_total_us;
+	double      m_min_us;
+	double      m_max_us;
+} bench_result_t;
+
+
+#define BENCH_MAX_RESULTS 16
+static bench_result_t s_results[BENCH_MAX_RESULTS];
+static int            s_results_cnt = 0;
+
+
+static const char* s_words[] = {
+	"hello", "meeting", "tomorrow", "coffee", "ramen", "train", "delayed", "photo",
+	"birthday", "project", "deadline", "weekend", "concert", "tickets", "office", "holiday",
+	"dinner", "garden", "bicycle", "library", "weather", "morning", "evening", "thanks"
+};
+#define BENCH_WORDS_CNT (sizeof(s_words)/sizeof(s_words[0]))
+
+
+static uintptr_t receive_event(mrmailbox_t* mailbox, int event, uintptr_t data1, uintptr_t data2)
+{
+	if( event == MR_EVENT_ERROR ) {
+		fprintf(stderr, "ERROR: %s\n", (char*)data2);
+	}
+	return 0;
+}
+
+
+static double now_us(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (double)ts.tv_sec*1000000.0 + (double)ts.tv_nsec/1000.0;
+}
+
+
+static bench_result_t* result_start(const char* name)
+{
+	if( s_results_cnt >= BENCH_MAX_RESULTS ) {
+		exit(60);
+	}
+	bench_result_t* r = &s_results[s_results_cnt++];
+	memset(r, 0, sizeof(bench_result_t));
+	r->m_name = name;
+	return r;
+}
+
+
+static void result_add(bench_result_t* r, double start_us, long items)
+{
+	double us = now_us() - start_us;
+	if( r->m_iterations == 0 || us < r->m_min_us ) { r->m_min_us = us; }
+	if( r->m_iterations == 0 || us > r->m_max_us ) { r->m_max_us = us; }
+	r->m_total_us += us;
+	r->m_items = items;
+	r->m_iterations++;
+}
+
+
+static char* random_text(int words)
+{
+	char* ret = NULL;
+	size_t bytes = words * 12 + 1;
+	int i;
+
+	ret = calloc(1, bytes);
+	if( ret == NULL ) {
+		exit(61);
+	}
+
+	for( i = 0; i < words; i++ ) {
+		if( i ) { strcat(ret, " "); }
+		strcat(ret, s_words[rand()%BENCH_WORDS_CNT]);
+	}
+	return ret;
+}
+
+
+/*******************************************************************************
+ * Generate the synthetic database
+ ******************************************************************************/
+
+
+static int generate_db(mrmailbox_t* mailbox, const bench_param_t* param, mrkey_t* public_key)
+{
+	int            success = 0, i;
+	sqlite3_stmt*  stmt = NULL;
+	mrsqlite3_t*   sql = mailbox->m_sql;
+	time_t         timestamp = time(NULL) - param->m_msgs;
+	uint32_t*      chat_contact = NULL;
+
+	chat_contact = calloc(param->m_chats + 1, sizeof(uint32_t));
+	if( chat_contact == NULL ) {
+		exit(62);
+	}
+
+	mrsqlite3_lock(sql);
+	mrsqlite3_begin_transaction__(sql);
+
+		mrsqlite3_set_config__(sql, "addr", BENCH_SELF_ADDR);
+		mrsqlite3_set_config__(sql, "configured_addr", BENCH_SELF_ADDR);
+		mrsqlite3_set_config__(sql, "displayname", "Bench");
+
+		/* contacts */
+		stmt = mrsqlite3_prepare_v2_(sql, "INSERT INTO contacts (name, addr, origin) VALUES (?, ?, ?);");
+		for( i = 0; i < param->m_contacts; i++ ) {
+			char* name = mr_mprintf("Contact %i", i);
+			char* addr = mr_mprintf("contact%i@bench.invalid", i);
+			sqlite3_reset(stmt);
+			sqlite3_bind_text(stmt, 1, name, -1, SQLITE_STATIC);
+			sqlite3_bind_text(stmt, 2, addr, -1, SQLITE_STATIC);
+			sqlite3_bind_int (stmt, 3, MR_ORIGIN_MANUALLY_CREATED);
+			sqlite3_step(stmt);
+			free(name);
+			free(addr);
+		}
+		sqlite3_finalize(stmt);
+
+		/* one-to-one chats, each with one of the contacts */
+		stmt = mrsqlite3_prepare_v2_(sql, "INSERT INTO chats (type, name) VALUES (?, ?);");
+		sqlite3_stmt* stmt2 = mrsqlite3_prepare_v2_(sql, "INSERT INTO chats_contacts (chat_id, contact_id) VALUES (?, ?);");
+		for( i = 0; i < param->m_chats; i++ ) {
+			char* name = mr_mprintf("Contact %i", i%param->m_contacts);
+			sqlite3_reset(stmt);
+			sqlite3_bind_int (stmt, 1, MR_CHAT_TYPE_NORMAL);
+			sqlite3_bind_text(stmt, 2, name, -1, SQLITE_STATIC);
+			sqlite3_step(stmt);
+			chat_contact[i] = MR_CONTACT_ID_LAST_SPECIAL + 1 + (i%param->m_contacts);
+			sqlite3_reset(stmt2);
+			sqlite3_bind_int (stmt2, 1, sqlite3_last_insert_rowid(sql->m_cobj));
+			sqlite3_bind_int (stmt2, 2, chat_contact[i]);
+			sqlite3_step(stmt2);
+			free(name);
+		}
+		sqlite3_finalize(stmt2);
+		sqlite3_finalize(stmt);
+
+		/* messages, spread randomly over the chats, every third message is outgoing */
+		stmt = mrsqlite3_prepare_v2_(sql,
+			"INSERT INTO msgs (rfc724_mid, server_folder, server_uid, chat_id, from_id, to_id, timestamp, type, state, txt)"
+			" VALUES (?, 'INBOX', ?, ?, ?, ?, ?, ?, ?, ?);");
+		for( i = 0; i < param->m_msgs; i++ ) {
+			int   chat_index = rand()%param->m_chats;
+			int   outgoing = (i%3)==0;
+			char* rfc724_mid = mr_mprintf("bench.%i@bench.invalid", i);
+			char* txt = random_text(4 + rand()%20);
+			sqlite3_reset(stmt);
+			sqlite3_bind_text(stmt, 1, rfc724_mid, -1, SQLITE_STATIC);
+			sqlite3_bind_int (stmt, 2, i+1);
+			sqlite3_bind_int (stmt, 3, MR_CHAT_ID_LAST_SPECIAL + 1 + chat_index);
+			sqlite3_bind_int (stmt, 4, outgoing? MR_CONTACT_ID_SELF : chat_contact[chat_index]);
+			sqlite3_bind_int (stmt, 5, outgoing? chat_contact[chat_index] : MR_CONTACT_ID_SELF);
+			sqlite3_bind_int64(stmt, 6, timestamp + i);
+			sqlite3_bind_int (stmt, 7, MR_MSG_TEXT);
+			sqlite3_bind_int (stmt, 8, outgoing? MR_STATE_OUT_DELIVERED : MR_STATE_IN_SEEN);
+			sqlite3_bind_text(stmt, 9, txt, -1, SQLITE_STATIC);
+			sqlite3_step(stmt);
+			free(rfc724_mid);
+			free(txt);
+		}
+		sqlite3_finalize(stmt);
+		stmt = NULL;
+
+		for( i = 0; i < param->m_chats; i++ ) {
+			mrmailbox_update_chat_last_msg__(mailbox, MR_CHAT_ID_LAST_SPECIAL + 1 + i);
+		}
+
+		/* peerstates, all sharing the same key, the key is not used for the benchmarks */
+		for( i = 0; i < param->m_peerstates; i++ ) {
+			mrapeerstate_t* peerstate = mrapeerstate_new();
+			peerstate->m_addr                = mr_mprintf("contact%i@bench.invalid", i);
+			peerstate->m_last_seen           = timestamp;
+			peerstate->m_last_seen_autocrypt = timestamp;
+			peerstate->m_prefer_encrypt      = MRA_PE_NOPREFERENCE;
+			peerstate->m_public_key          = mrkey_new();
+			mrkey_set_from_key(peerstate->m_public_key, public_key);
+			mrapeerstate_recalc_fingerprint(peerstate);
+			mrapeerstate_save_to_db__(peerstate, sql, 1);
+			mrapeerstate_unref(peerstate);
+		}
+
+		/* the messages were added behind the back of the full-text index, rebuild it on the next open */
+		mrsqlite3_set_config_int__(sql, "fts_backfill_below", -1);
+
+	mrsqlite3_commit__(sql);
+	mrsqlite3_unlock(sql);
+
+	success = 1;
+
+	free(chat_contact);
+	return success;
+}
+
+
+static void complete_fts(mrmailbox_t* mailbox)
+{
+	mrsqlite3_lock(mailbox->m_sql);
+		while( mrsqlite3_fts_backfill__(mailbox->m_sql, MR_FTS_BACKFILL_ROWS) ) {
+			;
+		}
+	mrsqlite3_unlock(mailbox->m_sql);
+}
+
+
+/*******************************************************************************
+ * The benchmarks
+ ******************************************************************************/
+
+
+static void bench_get_chatlist(mrmailbox_t* mailbox, const bench_param_t* param)
+{
+	bench_result_t* r = result_start("get_chatlist");
+	int i;
+	for( i = 0; i < param->m_iterations; i++ ) {
+		double start = now_us();
+			mrchatlist_t* chatlist = mrmailbox_get_chatlist(mailbox, 0, NULL);
+		result_add(r, start, mrchatlist_get_cnt(chatlist));
+		mrchatlist_unref(chatlist);
+	}
+}
+
+
+static void bench_get_chat_msgs(mrmailbox_t* mailbox, const bench_param_t* param)
+{
+	bench_result_t* r = result_start("get_chat_msgs");
+	int i;
+	for( i = 0; i < param->m_iterations; i++ ) {
+		uint32_t chat_id = MR_CHAT_ID_LAST_SPECIAL + 1 + (i%param->m_chats);
+		double start = now_us();
+			mrarray_t* msglist = mrmailbox_get_chat_msgs(mailbox, chat_id, 0, 0);
+		result_add(r, start, mrarray_get_cnt(msglist));
+		mrarray_unref(msglist);
+	}
+}
+
+
+static void bench_get_chat_msgs_page(mrmailbox_t* mailbox, const bench_param_t* param)
+{
+	/* load a page of IDs and the message objects for them, this is what a UI needs to show a chat */
+	bench_result_t* r = result_start("get_chat_msgs_page");
+	uint32_t        ids[100];
+	int             i, j, cnt;
+	for( i = 0; i < param->m_iterations; i++ ) {
+		uint32_t chat_id = MR_CHAT_ID_LAST_SPECIAL + 1 + (i%param->m_chats);
+		double start = now_us();
+			mrarray_t* msglist = mrmailbox_get_chat_msgs_page(mailbox, chat_id, MR_GCM_ADDDAYMARKER|MR_GCM_BEFORE, 0, 50);
+			cnt = 0;
+			for( j = 0; j < mrarray_get_cnt(msglist) && cnt < 100; j++ ) {
+				ids[cnt++] = mrarray_get_id(msglist, j);
+			}
+			mrarray_t* msgs = mrmailbox_get_msgs(mailbox, ids, cnt);
+		result_add(r, start, cnt);
+		for( j = 0; j < cnt; j++ ) {
+			mrmsg_unref((mrmsg_t*)mrarray_get_ptr(msgs, j));
+		}
+		mrarray_unref(msgs);
+		mrarray_unref(msglist);
+	}
+}
+
+
+static void bench_search_msgs(mrmailbox_t* mailbox, const bench_param_t* param)
+{
+	bench_result_t* r = result_start("search_msgs");
+	int i;
+	for( i = 0; i < param->m_iterations; i++ ) {
+		double start = now_us();
+			mrarray_t* msglist = mrmailbox_search_msgs(mailbox, 0, s_words[i%BENCH_WORDS_CNT]);
+		result_add(r, start, mrarray_get_cnt(msglist));
+		mrarray_unref(msglist);
+	}
+}
+
+
+static void bench_receive_imf(mrmailbox_t* mailbox, const bench_param_t* param)
+{
+	bench_result_t* r = result_start("receive_imf");
+	int i;
+	for( i = 0; i < param->m_imf; i++ ) {
+		char* txt = random_text(20 + rand()%80);
+		char* imf = mr_mprintf(
+			"Return-Path: <contact%i@bench.invalid>\r\n"
+			"Message-ID: <imf.%i.%i@bench.invalid>\r\n"
+			"Date: Mon, 2 Oct 2017 10:00:%02i +0000\r\n"
+			"From: Contact %i <contact%i@bench.invalid>\r\n"
+			"To: " BENCH_SELF_ADDR "\r\n"
+			"Subject: Chat: %s\r\n"
+			"Chat-Version: 1.0\r\n"
+			"MIME-Version: 1.0\r\n"
+			"Content-Type: text/plain; charset=utf-8\r\n"
+			"Content-Transfer-Encoding: 8bit\r\n"
+			"\r\n"
+			"%s\r\n",
+			i%param->m_contacts, (int)getpid(), i, i%60,
+			i%param->m_contacts, i%param->m_contacts,
+			s_words[i%BENCH_WORDS_CNT],
+			txt);
+		double start = now_us();
+			mrmailbox_receive_imf(mailbox, imf, strlen(imf), "INBOX", 1000000+i, 0);
+		result_add(r, start, 1);
+		free(imf);
+		free(txt);
+	}
+}
+
+
+static void bench_mimefactory_render(mrmailbox_t* mailbox, const bench_param_t* param)
+{
+	bench_result_t* r = result_start("mimefactory_render");
+	uint32_t        msg_id = 0;
+	sqlite3_stmt*   stmt;
+	int             i;
+
+	mrsqlite3_lock(mailbox->m_sql);
+		stmt = mrsqlite3_prepare_v2_(mailbox->m_sql, "SELECT MAX(id) FROM msgs WHERE from_id=?;");
+		sqlite3_bind_int(stmt, 1, MR_CONTACT_ID_SELF);
+		if( sqlite3_step(stmt) == SQLITE_ROW ) {
+			msg_id = sqlite3_column_int(stmt, 0);
+		}
+		sqlite3_finalize(stmt);
+	mrsqlite3_unlock(mailbox->m_sql);
+
+	for( i = 0; i < param->m_iterations && msg_id; i++ ) {
+		mrmimefactory_t factory;
+		mrmimefactory_init(&factory, mailbox);
+		double start = now_us();
+			if( mrmimefactory_load_msg(&factory, msg_id) ) {
+				mrmimefactory_render(&factory, 0);
+			}
+		result_add(r, start, factory.m_out? (long)factory.m_out->len : 0);
+		mrmimefactory_empty(&factory);
+	}
+}
+
+
+/* the text-scanning parameter functions as used before mrparam_t got its index,
+kept here as a reference for bench_param() */
+static char* textparam_find(char* packed, int key, char** ret_p2)
+{
+	char* p1 = packed;
+	while( 1 ) {
+		if( p1 == NULL || *p1 == 0 ) {
+			return NULL;
+		}
+		else if( *p1 == key && p1[1] == '=' ) {
+			break;
+		}
+		else if( (p1 = strchr(p1, '\n')) != NULL ) {
+			p1++;
+		}
+	}
+	if( (*ret_p2 = strchr(p1, '\n')) == NULL ) {
+		*ret_p2 = &p1[strlen(p1)];
+	}
+	return p1;
+}
+
+
+static char* textparam_get(char* packed, int key)
+{
+	char *p1, *p2, bak, *ret;
+	if( (p1 = textparam_find(packed, key, &p2)) == NULL ) {
+		return NULL;
+	}
+	bak = *p2;
+	*p2 = 0;
+	ret = safe_strdup(&p1[2]);
+	mr_rtrim(ret);
+	*p2 = bak;
+	return ret;
+}
+
+
+static int32_t textparam_get_int(char* packed, int key)
+{
+	char*   str = textparam_get(packed, key);
+	int32_t ret = str? atol(str) : 0;
+	free(str);
+	return ret;
+}
+
+
+static void textparam_set(char** packed, int key, const char* value)
+{
+	char *old1 = *packed, *old2 = NULL, *p1, *p2;
+	if( (p1 = textparam_find(old1, key, &p2)) != NULL ) {
+		*p1 = 0;
+		old2 = p2;
+	}
+	mr_rtrim(old1);
+	mr_ltrim(old2);
+	if( old1[0]==0 ) { old1 = NULL; }
+	if( old2 && old2[0]==0 ) { old2 = NULL; }
+	p1 = mr_mprintf("%s%s%c=%s%s%s", old1? old1 : "", old1? "\n" : "", key, value, old2? "\n" : "", old2? old2 : "");
+	free(*packed);
+	*packed = p1;
+}
+
+
+static void bench_param(const bench_param_t* param)
+{
+	/* what typically happens with the parameters of a message that is shown and then sent by a job */
+	#define BENCH_PARAM_PACKED "f=/storage/emulated/0/Download/photo.jpg\nm=image/jpeg\nw=1280\nh=960\nc=1\nN=Alice"
+	#define BENCH_PARAM_LOOPS  10000
+	bench_result_t* r_index = result_start("mrparam");
+	bench_result_t* r_text = result_start("mrparam_text");
+	mrparam_t*      p = mrparam_new();
+	long            sum;
+	int             i, j;
+
+	for( i = 0; i < param->m_iterations; i++ ) {
+		double start = now_us();
+			for( j = 0, sum = 0; j < BENCH_PARAM_LOOPS; j++ ) {
+				mrparam_set_packed(p, BENCH_PARAM_PACKED);
+				sum += mrparam_get_int(p, MRP_WIDTH, 0) + mrparam_get_int(p, MRP_HEIGHT, 0) + mrparam_get_int(p, MRP_DURATION, 0);
+				sum += mrparam_exists(p, MRP_GUARANTEE_E2EE);
+				free(mrparam_get(p, MRP_FILE, NULL));
+				free(mrparam_get(p, MRP_MIMETYPE, NULL));
+				mrparam_set_int(p, MRP_TIMES, j);
+				sum += strlen(mrparam_get_packed(p));
+			}
+		result_add(r_index, start, sum);
+
+		start = now_us();
+			for( j = 0, sum = 0; j < BENCH_PARAM_LOOPS; j++ ) {
+				char *packed = safe_strdup(BENCH_PARAM_PACKED), *p2, times[16];
+				sum += textparam_get_int(packed, MRP_WIDTH) + textparam_get_int(packed, MRP_HEIGHT) + textparam_get_int(packed, MRP_DURATION);
+				sum += textparam_find(packed, MRP_GUARANTEE_E2EE, &p2)? 1 : 0;
+				free(textparam_get(packed, MRP_FILE));
+				free(textparam_get(packed, MRP_MIMETYPE));
+				snprintf(times, sizeof(times), "%i", j);
+				textparam_set(&packed, MRP_TIMES, times);
+				sum += strlen(packed);
+				free(packed);
+			}
+		result_add(r_text, start, sum);
+	}
+
+	mrparam_unref(p);
+}
+
+
+static void bench_pgp(mrmailbox_t* mailbox, const bench_param_t* param, mrkey_t* public_key, mrkey_t* private_key)
+{
+	bench_result_t* r_encrypt = result_start("pgp_pk_encrypt");
+	bench_result_t* r_decrypt = result_start("pgp_pk_decrypt");
+	mrkeyring_t*    public_keys = mrkeyring_new();
+	mrkeyring_t*    private_keys = mrkeyring_new();
+	char*           plain = random_text(400);
+	int             i;
+
+	mrkeyring_add(public_keys, public_key);
+	mrkeyring_add(private_keys, private_key);
+
+	for( i = 0; i < param->m_iterations; i++ ) {
+		void*  ctext = NULL, *plain2 = NULL;
+		size_t ctext_bytes = 0, plain2_bytes = 0;
+		int    validation_errors = 0;
+
+		double start = now_us();
+			mrpgp_pk_encrypt(mailbox, plain, strlen(plain), public_keys, private_key, 1, &ctext, &ctext_bytes);
+		result_add(r_encrypt, start, ctext_bytes);
+
+		start = now_us();
+			mrpgp_pk_decrypt(mailbox, ctext, ctext_bytes, private_keys, public_key, 1, &plain2, &plain2_bytes, &validation_errors);
+		result_add(r_decrypt, start, plain2_bytes);
+
+		free(ctext);
+		free(plain2);
+	}
+
+	free(plain);
+	mrkeyring_unref(private_keys);
+	mrkeyring_unref(public_keys);
+}
+
+
+/*******************************************************************************
+ * Main
+ ******************************************************************************/
+
+
+static void write_json(FILE* f, const bench_param_t* param, double generate_us)
+{
+	int i;
+	fprintf(f, "{\n");
+	fprintf(f, "  \"params\": {\"chats\": %i, \"msgs\": %i, \"contacts\": %i, \"peerstates\": %i, \"imf\": %i, \"iterations\": %i},\n",
+		param->m_chats, param->m_msgs, param->m_contacts, param->m_peerstates, param->m_imf, param->m_iterations);
+	fprintf(f, "  \"generate_ms\": %.3f,\n", generate_us/1000.0);
+	fprintf(f, "  \"results\": [\n");
+	for( i = 0; i < s_results_cnt; i++ ) {
+		const bench_result_t* r = &s_results[i];
+		fprintf(f, "    {\"name\": \"%s\", \"iterations\": %i, \"items\": %li, \"total_ms\": %.3f, \"min_us\": %.1f, \"mean_us\": %.1f, \"max_us\": %.1f}%s\n",
+			r->m_name, r->m_iterations, r->m_items, r->m_total_us/1000.0,
+			r->m_min_us, r->m_iterations? r->m_total_us/r->m_iterations : 0.0, r->m_max_us,
+			i < s_results_cnt-1? "," : "");
+	}
+	fprintf(f, "  ]\n");
+	fprintf(f, "}\n");
+}
+
+
+static void print_usage(FILE* f, const char* argv0)
+{
+	fprintf(f, "Usage: %s [--db FILE] [--out FILE] [--chats N] [--msgs N] [--contacts N] [--peerstates N] [--imf N] [--iterations N]\n"
+		"  --db FILE       database to generate, deleted before, default: bench.db\n"
+		"  --out FILE      write the JSON results to FILE instead of stdout\n"
+		"  --chats N       number of chats to generate, default: 200\n"
+		"  --msgs N        number of messages to generate, default: 20000\n"
+		"  --contacts N    number of contacts to generate, default: 500\n"
+		"  --peerstates N  number of peerstates to generate, at most --contacts, default: 200\n"
+		"  --imf N         number of messages to parse and receive, default: 200\n"
+		"  --iterations N  number of runs of each benchmark, default: 20\n"
+		"  --help          show this help\n", argv0);
+}
+
+
+static int get_arg_int(int argc, char** argv, int* i, int* ret)
+{
+	if( *i+1 >= argc || atoi(argv[*i+1]) <= 0 ) {
+		fprintf(stderr, "ERROR: %s needs a positive number.\n", argv[*i]);
+		return 0;
+	}
+	*ret = atoi(argv[++(*i)]);
+	return 1;
+}
+
+
+int main(int argc, char ** argv)
+{
+	bench_param_t param;
+	mrmailbox_t*  mailbox = NULL;
+	mrkey_t*      public_key = mrkey_new(), *private_key = mrkey_new();
+	FILE*         out = stdout;
+	double        generate_start, generate_us;
+	int           i, ret = 1;
+
+	memset(&param, 0, sizeof(bench_param_t));
+	param.m_dbfile     = "bench.db";
+	param.m_chats      = 200;
+	param.m_msgs       = 20000;
+	param.m_contacts   = 500;
+	param.m_peerstates = 200;
+	param.m_imf        = 200;
+	param.m_iterations = 20;
+
+	for( i = 1; i < argc; i++ ) {
+		int ok = 1;
+		if(      strcmp(argv[i], "--chats")==0      ) { ok = get_arg_int(argc, argv, &i, &param.m_chats); }
+		else if( strcmp(argv[i], "--msgs")==0       ) { ok = get_arg_int(argc, argv, &i, &param.m_msgs); }
+		else if( strcmp(argv[i], "--contacts")==0   ) { ok = get_arg_int(argc, argv, &i, &param.m_contacts); }
+		else if( strcmp(argv[i], "--peerstates")==0 ) { ok = get_arg_int(argc, argv, &i, &param.m_peerstates); }
+		else if( strcmp(argv[i], "--imf")==0        ) { ok = get_arg_int(argc, argv, &i, &param.m_imf); }
+		else if( strcmp(argv[i], "--iterations")==0 ) { ok = get_arg_int(argc, argv, &i, &param.m_iterations); }
+		else if( strcmp(argv[i], "--db")==0  && i+1 < argc ) { param.m_dbfile  = argv[++i]; }
+		else if( strcmp(argv[i], "--out")==0 && i+1 < argc ) { param.m_outfile = argv[++i]; }
+		else if( strcmp(argv[i], "--help")==0 || strcmp(argv[i], "-h")==0 ) {
+			print_usage(stdout, argv[0]);
+			ret = 0;
+			goto cleanup;
+		}
+		else {
+			print_usage(stderr, argv[0]);
+			ok = 0;
+		}
+		if( !ok ) {
+			goto cleanup;
+		}
+	}
+
+	if( param.m_peerstates > param.m_contacts ) {
+		param.m_peerstates = param.m_contacts;
+	}
+
+	srand(1); /* the same data on every run */
+	unlink(param.m_dbfile); /* the database is always generated from scratch */
+
+	mailbox = mrmailbox_new(receive_event, NULL, "Bench");
+
+	generate_start = now_us();
+		if( !mrmailbox_open(mailbox, param.m_dbfile, NULL) ) {
+			fprintf(stderr, "ERROR: Cannot open %s.\n", param.m_dbfile);
+			goto cleanup;
+		}
+
+		mrpgp_create_keypair(mailbox, BENCH_SELF_ADDR, public_key, private_key);
+
+		generate_db(mailbox, &param, public_key);
+
+		mrmailbox_close(mailbox); /* reopen to rebuild the full-text index and the in-memory job index */
+		if( !mrmailbox_open(mailbox, param.m_dbfile, NULL) ) {
+			fprintf(stderr, "ERROR: Cannot reopen %s.\n", param.m_dbfile);
+			goto cleanup;
+		}
+		complete_fts(mailbox);
+	generate_us = now_us() - generate_start;
+
+	bench_get_chatlist(mailbox, &param);
+	bench_get_chat_msgs(mailbox, &param);
+	bench_get_chat_msgs_page(mailbox, &param);
+	bench_search_msgs(mailbox, &param);
+	bench_receive_imf(mailbox, &param);
+	bench_mimefactory_render(mailbox, &param);
+	bench_pgp(mailbox, &param, public_key, private_key);
+	bench_param(&param);
+
+	if( param.m_outfile ) {
+		if( (out=fopen(param.m_outfile, "w")) == NULL ) {
+			fprintf(stderr, "ERROR: Cannot write %s.\n", param.m_outfile);
+			out = stdout;
+			goto cleanup;
+		}
+	}
+
+	write_json(out, &param, generate_us);
+	ret = 0;
+
+cleanup:
+	if( out != stdout ) { fclose(out); }
+	if( mailbox ) {
+		mrmailbox_close(mailbox);
+		mrmailbox_unref(mailbox);
+	}
+	mrkey_unref(public_key);
+	mrkey_unref(private_key);
+	return ret;
+}
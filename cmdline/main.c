@@ -116,6 +116,10 @@ static uintptr_t receive_event(mrmailbox_t* mailbox, int event, uintptr_t data1,
 			printf("{{Received MR_EVENT_IMEX_FILE_WRITTEN(%s)}}\n", (char*)data1);
 			break;
 
+		case MR_EVENT_KEYGEN_PROGRESS:
+			printf("{{Received MR_EVENT_KEYGEN_PROGRESS(%i ‰)}}\n", (int)data1);
+			break;
+
 		default:
 			printf("{{Received MR_EVENT_%i(%i, %i)}}\n", (int)event, (int)data1, (int)data2);
 			break;
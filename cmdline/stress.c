@@ -28,7 +28,17 @@ $ valgrind --leak-check=full --tool=memcheck ./deltachat-core <db>
 
 #include <ctype.h>
 #include <assert.h>
+#include <unistd.h>
+#include <strings.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <zlib.h>
 #include "../src/mrmailbox_internal.h"
+#include "../src/mrimap.h"
+#include "../src/mrsmtp.h"
+#include "../src/mrloginparam.h"
 #include "../src/mrsimplify.h"
 #include "../src/mrmimeparser.h"
 #include "../src/mrmimefactory.h"
@@ -172,6 +182,400 @@ static const char* s_em_setupfile =
 "-----END PGP MESSAGE-----\n";
 
 
+/* stub servers listening on 127.0.0.1, used to test the protocol handling
+ ******************************************************************************/
+
+typedef struct stubserver_t
+{
+	int       m_listen_fd;
+	uint16_t  m_port;
+	pthread_t m_thread;
+	int       m_mode;        /* what the server should do, see the handlers */
+	int       m_connections; /* the counters are read after stop_stub_server() only */
+	int       m_compress_requests;
+	int       m_compressed_cmds;
+	int       m_temp_rejects;
+	int       m_messages;
+} stubserver_t;
+
+
+static void start_stub_server(stubserver_t* stub, void* (*handler)(void*), int mode)
+{
+	struct sockaddr_in addr;
+	socklen_t          addr_len = sizeof(addr);
+
+	memset(stub, 0, sizeof(stubserver_t));
+	stub->m_mode = mode;
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family      = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	addr.sin_port        = 0; /* let the system choose a free port */
+
+	stub->m_listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+	assert( stub->m_listen_fd >= 0 );
+	assert( bind(stub->m_listen_fd, (struct sockaddr*)&addr, sizeof(addr)) == 0 );
+	assert( listen(stub->m_listen_fd, 4) == 0 );
+	assert( getsockname(stub->m_listen_fd, (struct sockaddr*)&addr, &addr_len) == 0 );
+	stub->m_port = ntohs(addr.sin_port);
+
+	pthread_create(&stub->m_thread, NULL, handler, stub);
+}
+
+
+static void stop_stub_server(stubserver_t* stub)
+{
+	shutdown(stub->m_listen_fd, SHUT_RDWR); /* makes accept() in the handler return */
+	pthread_join(stub->m_thread, NULL);
+	close(stub->m_listen_fd);
+}
+
+
+static void stub_deflate_write(int fd, z_stream* out, const char* str)
+{
+	unsigned char buf[1024];
+
+	out->next_in  = (unsigned char*)str;
+	out->avail_in = strlen(str);
+	do {
+		out->next_out  = buf;
+		out->avail_out = sizeof(buf);
+		assert( deflate(out, Z_SYNC_FLUSH) == Z_OK );
+		assert( write(fd, buf, sizeof(buf)-out->avail_out) == (ssize_t)(sizeof(buf)-out->avail_out) );
+	} while( out->avail_out == 0 );
+}
+
+
+static void stub_imap_compressed(stubserver_t* stub, int fd)
+{
+	/* speak raw deflate (RFC 4978: zlib without header, windowBits -15) in both directions until the client closes the connection */
+	z_stream      in, out;
+	unsigned char buf[1024];
+	char          line[1024], reply[1200], tag[64], cmd[64], *p;
+	size_t        line_len = 0;
+	ssize_t       n;
+	int           r;
+
+	memset(&in, 0, sizeof(in));
+	memset(&out, 0, sizeof(out));
+	assert( inflateInit2(&in, -15) == Z_OK );
+	assert( deflateInit2(&out, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) == Z_OK );
+
+	while( (n=read(fd, buf, sizeof(buf))) > 0 )
+	{
+		in.next_in  = buf;
+		in.avail_in = n;
+		while( in.avail_in > 0 )
+		{
+			in.next_out  = (unsigned char*)line + line_len;
+			in.avail_out = sizeof(line) - 1 - line_len;
+			r = inflate(&in, Z_SYNC_FLUSH);
+			if( (r != Z_OK && r != Z_BUF_ERROR) || in.avail_out == 0 /*line too long*/ ) {
+				goto cleanup;
+			}
+			line_len = sizeof(line) - 1 - in.avail_out;
+			line[line_len] = 0;
+
+			while( (p=strchr(line, '\n')) != NULL )
+			{
+				*p = 0;
+				if( sscanf(line, "%63s %63s", tag, cmd) == 2 )
+				{
+					stub->m_compressed_cmds++;
+					if( strcasecmp(cmd, "NOOP")==0 ) {
+						snprintf(reply, sizeof(reply), "%s OK noop\r\n", tag);
+					}
+					else if( strcasecmp(cmd, "LOGOUT")==0 ) {
+						snprintf(reply, sizeof(reply), "* BYE\r\n%s OK bye\r\n", tag);
+					}
+					else {
+						snprintf(reply, sizeof(reply), "%s NO stub\r\n", tag);
+					}
+					stub_deflate_write(fd, &out, reply);
+					if( strcasecmp(cmd, "LOGOUT")==0 ) {
+						goto cleanup;
+					}
+				}
+				line_len -= p+1-line;
+				memmove(line, p+1, line_len+1);
+			}
+
+			if( r == Z_BUF_ERROR ) {
+				break; /* no progress possible, wait for more input */
+			}
+		}
+	}
+
+cleanup:
+	inflateEnd(&in);
+	deflateEnd(&out);
+}
+
+
+#define STUB_IMAP_COMPRESS_DROP   1 /* close the connection on COMPRESS, the state of the connection is unknown to the client then */
+#define STUB_IMAP_COMPRESS_REFUSE 2 /* answer COMPRESS with NO, the connection can be used without compression */
+#define STUB_IMAP_COMPRESS_OK     3 /* answer COMPRESS with OK and speak deflate from then on */
+static void* stub_imap_thread(void* arg)
+{
+	stubserver_t* stub = (stubserver_t*)arg;
+	int           fd;
+	FILE*         f;
+	char          line[1024], tag[64], cmd[64];
+
+	while( (fd=accept(stub->m_listen_fd, NULL, NULL)) >= 0 )
+	{
+		stub->m_connections++;
+		f = fdopen(dup(fd), "r");
+		dprintf(fd, "* OK [CAPABILITY IMAP4rev1 COMPRESS=DEFLATE] stub ready\r\n");
+		while( f && fgets(line, sizeof(line), f) )
+		{
+			if( sscanf(line, "%63s %63s", tag, cmd) != 2 ) {
+				continue;
+			}
+
+			if( strcasecmp(cmd, "LOGIN")==0 ) {
+				dprintf(fd, "%s OK [CAPABILITY IMAP4rev1 COMPRESS=DEFLATE] logged in\r\n", tag);
+			}
+			else if( strcasecmp(cmd, "COMPRESS")==0 ) {
+				stub->m_compress_requests++;
+				if( stub->m_mode == STUB_IMAP_COMPRESS_DROP ) {
+					break;
+				}
+				else if( stub->m_mode == STUB_IMAP_COMPRESS_OK ) {
+					dprintf(fd, "%s OK deflate active\r\n", tag); /* the client sends nothing before this answer, so nothing compressed is buffered in f */
+					stub_imap_compressed(stub, fd);
+					break;
+				}
+				dprintf(fd, "%s NO not now\r\n", tag);
+			}
+			else if( strcasecmp(cmd, "LOGOUT")==0 ) {
+				dprintf(fd, "* BYE\r\n%s OK bye\r\n", tag);
+				break;
+			}
+			else {
+				dprintf(fd, "%s NO stub\r\n", tag); /* eg. LIST and SELECT from the watch thread */
+			}
+		}
+		if( f ) {
+			fclose(f);
+		}
+		close(fd);
+	}
+
+	return NULL;
+}
+
+
+#define STUB_SMTP_PIPELINING 1 /* announce PIPELINING, the replies to MAIL and RCPT are sent only after DATA is received */
+#define STUB_SMTP_SIMPLE     2
+static void* stub_smtp_thread(void* arg)
+{
+	/* recipients starting with `ok` are accepted, `temp` is rejected temporarily on the first try, `perm` is rejected permanently */
+	stubserver_t*   stub = (stubserver_t*)arg;
+	int             fd, accepted = 0;
+	FILE*           f;
+	char            line[1024];
+	mrstrbuilder_t  replies;
+
+	while( (fd=accept(stub->m_listen_fd, NULL, NULL)) >= 0 )
+	{
+		stub->m_connections++;
+		f = fdopen(dup(fd), "r");
+		mrstrbuilder_init(&replies, 0);
+		dprintf(fd, "220 stub ready\r\n");
+		while( f && fgets(line, sizeof(line), f) )
+		{
+			if( strncasecmp(line, "EHLO", 4)==0 ) {
+				dprintf(fd, stub->m_mode==STUB_SMTP_PIPELINING? "250-stub\r\n250 PIPELINING\r\n" : "250 stub\r\n");
+				continue;
+			}
+			else if( strncasecmp(line, "MAIL FROM:", 10)==0 ) {
+				accepted = 0;
+				mrstrbuilder_cat(&replies, "250 ok\r\n");
+			}
+			else if( strncasecmp(line, "RCPT TO:<ok", 11)==0 ) {
+				accepted++;
+				mrstrbuilder_cat(&replies, "250 ok\r\n");
+			}
+			else if( strncasecmp(line, "RCPT TO:<temp", 13)==0 ) {
+				if( stub->m_temp_rejects++ == 0 ) {
+					mrstrbuilder_cat(&replies, "450 try again later\r\n");
+				}
+				else {
+					accepted++;
+					mrstrbuilder_cat(&replies, "250 ok\r\n");
+				}
+			}
+			else if( strncasecmp(line, "RCPT TO:", 8)==0 ) {
+				mrstrbuilder_cat(&replies, "550 no such user\r\n");
+			}
+			else if( strncasecmp(line, "DATA", 4)==0 ) {
+				mrstrbuilder_cat(&replies, accepted? "354 go ahead\r\n" : "554 no valid recipients\r\n");
+				dprintf(fd, "%s", replies.m_buf); /* in pipelining mode, this is the first reply the client gets */
+				mrstrbuilder_empty(&replies);
+				if( accepted ) {
+					while( fgets(line, sizeof(line), f) && strcmp(line, ".\r\n")!=0 ) {
+						;
+					}
+					stub->m_messages++;
+					dprintf(fd, "250 queued\r\n");
+				}
+				continue;
+			}
+			else if( strncasecmp(line, "RSET", 4)==0 ) {
+				mrstrbuilder_cat(&replies, "250 ok\r\n");
+			}
+			else if( strncasecmp(line, "QUIT", 4)==0 ) {
+				dprintf(fd, "221 bye\r\n");
+				break;
+			}
+			else {
+				mrstrbuilder_cat(&replies, "502 not implemented\r\n");
+			}
+
+			if( stub->m_mode != STUB_SMTP_PIPELINING || (strncasecmp(line, "MAIL", 4)!=0 && strncasecmp(line, "RCPT", 4)!=0) ) {
+				dprintf(fd, "%s", replies.m_buf);
+				mrstrbuilder_empty(&replies);
+			}
+		}
+		free(replies.m_buf);
+		if( f ) {
+			fclose(f);
+		}
+		close(fd);
+	}
+
+	return NULL;
+}
+
+
+static clist* stress_smtp_recipients(const char* addr1, const char* addr2, const char* addr3)
+{
+	clist* recipients = clist_new();
+	if( addr1 ) { clist_append(recipients, (void*)addr1); }
+	if( addr2 ) { clist_append(recipients, (void*)addr2); }
+	if( addr3 ) { clist_append(recipients, (void*)addr3); }
+	return recipients;
+}
+
+
+static void stress_smtp_send(mrmailbox_t* mailbox, int mode)
+{
+	const char*     msg = "Subject: stress\r\n\r\ntest\r\n";
+	stubserver_t    stub;
+	mrsmtp_t*       smtp = mrsmtp_new(mailbox);
+	mrloginparam_t* lp = mrloginparam_new();
+	clist*          recipients;
+	int             rcpt_codes[3];
+
+	start_stub_server(&stub, stub_smtp_thread, mode);
+
+		lp->m_addr         = safe_strdup("stress@127.0.0.1");
+		lp->m_send_server  = safe_strdup("127.0.0.1");
+		lp->m_send_port    = stub.m_port;
+		lp->m_server_flags = MR_SMTP_SOCKET_PLAIN;
+
+		assert( mrsmtp_connect(smtp, lp) );
+		assert( smtp->m_pipelining == (mode==STUB_SMTP_PIPELINING) );
+
+		/* accepted, rejected temporarily and permanently: the message is sent to the first recipient */
+		recipients = stress_smtp_recipients("ok@127.0.0.1", "temp@127.0.0.1", "perm@127.0.0.1");
+			assert( mrsmtp_send_msg(smtp, recipients, msg, strlen(msg), rcpt_codes) );
+			assert( rcpt_codes[0] == 250 && rcpt_codes[1] == 450 && rcpt_codes[2] == 550 );
+		clist_free(recipients);
+
+		/* retry to the recipient rejected temporarily */
+		recipients = stress_smtp_recipients("temp@127.0.0.1", NULL, NULL);
+			assert( mrsmtp_send_msg(smtp, recipients, msg, strlen(msg), rcpt_codes) );
+			assert( rcpt_codes[0] == 250 );
+		clist_free(recipients);
+
+		/* all recipients rejected: no error, the caller decides by the reply codes, the session stays usable */
+		recipients = stress_smtp_recipients("perm@127.0.0.1", NULL, NULL);
+			assert( mrsmtp_send_msg(smtp, recipients, msg, strlen(msg), rcpt_codes) );
+			assert( rcpt_codes[0] == 550 );
+		clist_free(recipients);
+
+		recipients = stress_smtp_recipients("ok@127.0.0.1", NULL, NULL);
+			assert( mrsmtp_send_msg(smtp, recipients, msg, strlen(msg), rcpt_codes) );
+			assert( rcpt_codes[0] == 250 );
+		clist_free(recipients);
+
+		mrsmtp_disconnect(smtp);
+
+	stop_stub_server(&stub);
+
+	assert( stub.m_connections == 1 );
+	assert( stub.m_messages == 3 );
+
+	mrloginparam_unref(lp);
+	mrsmtp_unref(smtp);
+}
+
+
+static char* stub_get_config(mrimap_t* imap, const char* key, const char* def)
+{
+	if( strcmp(key, "imap_compress")==0 )    { return safe_strdup("1"); }
+	if( strcmp(key, "imap_job_session")==0 ) { return safe_strdup("0"); }
+	return def? safe_strdup(def) : NULL;
+}
+static void stub_set_config(mrimap_t* imap, const char* key, const char* value) { }
+static void stub_receive_imf(mrimap_t* imap, const char* imf_raw_not_terminated, size_t imf_raw_bytes, const char* server_folder, uint32_t server_uid, uint32_t flags) { }
+static int  stub_flush_imf(mrimap_t* imap) { return 1; }
+static void stub_sync_flags(mrimap_t* imap, const char* server_folder, const mrarray_t* seen_uids, const mrarray_t* gone_uid_ranges) { }
+
+
+static void stress_imap_compress(mrmailbox_t* mailbox, int mode)
+{
+	stubserver_t    stub;
+	mrimap_t*       imap = mrimap_new(stub_get_config, stub_set_config, stub_receive_imf, stub_flush_imf, stub_sync_flags, NULL, mailbox);
+	mrloginparam_t* lp = mrloginparam_new();
+
+	start_stub_server(&stub, stub_imap_thread, mode);
+
+		lp->m_mail_server  = safe_strdup("127.0.0.1");
+		lp->m_mail_port    = stub.m_port;
+		lp->m_mail_user    = safe_strdup("stress");
+		lp->m_mail_pw      = safe_strdup("stress");
+		lp->m_server_flags = MR_IMAP_SOCKET_PLAIN;
+
+		assert( mrimap_connect(imap, lp) );
+		assert( imap->m_compress_enabled == (mode==STUB_IMAP_COMPRESS_OK) );
+		assert( imap->m_compress_failed == (mode==STUB_IMAP_COMPRESS_DROP) );
+
+		if( mode == STUB_IMAP_COMPRESS_OK ) {
+			uint64_t bytes_uncompressed, bytes_compressed;
+			pthread_mutex_lock(&imap->m_hEtpanmutex);
+				assert( imap->m_hEtpan );
+				assert( mailimap_noop(imap->m_hEtpan) == MAILIMAP_NO_ERROR ); /* the answer must be inflated correctly */
+			pthread_mutex_unlock(&imap->m_hEtpanmutex);
+			mrimap_get_bytes(imap, &bytes_uncompressed, &bytes_compressed);
+			assert( bytes_uncompressed > 0 );
+			assert( bytes_compressed > 0 );
+		}
+
+		mrimap_disconnect(imap);
+
+	stop_stub_server(&stub);
+
+	if( mode == STUB_IMAP_COMPRESS_DROP ) {
+		assert( stub.m_connections == 2 );      /* connected again ... */
+		assert( stub.m_compress_requests == 1 ); /* ... without compression */
+	}
+	else {
+		assert( stub.m_connections == 1 );
+		assert( stub.m_compress_requests == 1 );
+	}
+
+	if( mode == STUB_IMAP_COMPRESS_OK ) {
+		assert( stub.m_compressed_cmds >= 1 ); /* at least the NOOP */
+	}
+
+	mrloginparam_unref(lp);
+	mrimap_unref(imap);
+}
+
+
 void stress_functions(mrmailbox_t* mailbox)
 {
 	/* test mrsimplify and mrsaxparser (indirectly used by mrsimplify)
@@ -451,6 +855,93 @@ void stress_functions(mrmailbox_t* mailbox)
 		mrarray_unref(arr);
 	}
 
+	/* test mrhash_t
+	 **************************************************************************/
+
+	{
+		#define HASH_TEST_CNT 1000
+		mrhash_t h;
+		int      i, alloc;
+		#define HASH_DATA(i) ((void*)(uintptr_t)((i)+1)) /* NULL would delete the element */
+
+		/* insert, find, overwrite, delete */
+		mrhash_init(&h, MRHASH_INT, 0);
+		assert( mrhash_find(&h, NULL, 7) == NULL ); /* nothing allocated yet */
+		assert( mrhash_insert(&h, NULL, 7, HASH_DATA(7)) == NULL );
+		assert( mrhash_find(&h, NULL, 7) == HASH_DATA(7) );
+		assert( mrhash_find(&h, NULL, 8) == NULL );
+		assert( mrhash_insert(&h, NULL, 7, HASH_DATA(70)) == HASH_DATA(7) ); /* overwriting returns the old data ... */
+		assert( mrhash_find(&h, NULL, 7) == HASH_DATA(70) );
+		assert( mrhash_count(&h) == 1 );                                     /* ... and adds no element */
+		assert( mrhash_insert(&h, NULL, 7, NULL) == HASH_DATA(70) );
+		assert( mrhash_find(&h, NULL, 7) == NULL );
+		assert( mrhash_count(&h) == 0 );
+		assert( mrhash_first(&h) == NULL );
+		assert( mrhash_insert(&h, NULL, 7, NULL) == NULL ); /* deleting a missing key is fine */
+
+		/* removed elements are dropped on the next rebuild, so deleting and inserting again does not grow the table */
+		assert( mrhash_insert(&h, NULL, 1, HASH_DATA(1)) == NULL );
+		alloc = h.alloc;
+		for( i = 0; i < HASH_TEST_CNT; i++ ) {
+			assert( mrhash_insert(&h, NULL, 2, HASH_DATA(i)) == NULL );
+			assert( mrhash_find(&h, NULL, 2) == HASH_DATA(i) );
+			assert( mrhash_insert(&h, NULL, 2, NULL) == HASH_DATA(i) );
+		}
+		assert( h.alloc == alloc );
+		assert( mrhash_count(&h) == 1 );
+		assert( mrhash_find(&h, NULL, 1) == HASH_DATA(1) );
+		mrhash_clear(&h);
+
+		/* growth across several resizes, every element must be found afterwards */
+		mrhash_init(&h, MRHASH_INT, 0);
+		for( i = 0; i < HASH_TEST_CNT; i++ ) {
+			assert( mrhash_insert(&h, NULL, i, HASH_DATA(i)) == NULL );
+		}
+		assert( mrhash_count(&h) == HASH_TEST_CNT );
+		assert( h.alloc >= HASH_TEST_CNT );
+		for( i = 0; i < HASH_TEST_CNT; i += 2 ) {
+			mrhash_insert(&h, NULL, i, NULL);
+		}
+		for( i = 0; i < HASH_TEST_CNT; i++ ) {
+			assert( mrhash_find(&h, NULL, i) == ((i&1)? HASH_DATA(i) : NULL) );
+		}
+		{
+			mrhashelem_t* e;
+			int           cnt = 0, last = -1;
+			for( e = mrhash_first(&h); e; e = mrhash_next(e) ) {
+				assert( mrhash_keysize(e) > last ); /* the order of insertion is kept */
+				last = mrhash_keysize(e);
+				cnt++;
+			}
+			assert( cnt == HASH_TEST_CNT/2 );
+		}
+		mrhash_clear(&h);
+		assert( mrhash_count(&h) == 0 );
+
+		/* strings are compared case-insensitive */
+		mrhash_init(&h, MRHASH_STRING, 1);
+		mrhash_insert(&h, "Foo", 4, HASH_DATA(1));
+		assert( mrhash_find(&h, "fOO", 4) == HASH_DATA(1) );
+		assert( mrhash_find(&h, "foo2", 5) == NULL );
+		mrhash_clear(&h);
+
+		/* binary keys may contain null-bytes, all bytes are compared */
+		mrhash_init(&h, MRHASH_BINARY, 1);
+		{
+			char key1[] = { 'a', 0, 'b' }, key2[] = { 'a', 0, 'c' }, key3[] = { 'a', 0 };
+			mrhash_insert(&h, key1, sizeof(key1), HASH_DATA(1));
+			mrhash_insert(&h, key2, sizeof(key2), HASH_DATA(2));
+			key1[2] = 'x'; /* the key is copied */
+			assert( mrhash_find(&h, key1, sizeof(key1)) == NULL );
+			key1[2] = 'b';
+			assert( mrhash_find(&h, key1, sizeof(key1)) == HASH_DATA(1) );
+			assert( mrhash_find(&h, key2, sizeof(key2)) == HASH_DATA(2) );
+			assert( mrhash_find(&h, key3, sizeof(key3)) == NULL ); /* a prefix is a different key */
+			assert( mrhash_count(&h) == 2 );
+		}
+		mrhash_clear(&h);
+	}
+
 	/* test mrparam
 	 **************************************************************************/
 
@@ -472,14 +963,14 @@ void stress_functions(mrmailbox_t* mailbox)
 		mrparam_set_int(p1, 'b', 2);
 		mrparam_set    (p1, 'c', NULL);
 		mrparam_set_int(p1, 'd', 4);
-		assert( strcmp(p1->m_packed, "a=foo\nb=2\nd=4")==0 );
+		assert( strcmp(mrparam_get_packed(p1), "a=foo\nb=2\nd=4")==0 );
 
 		mrparam_set    (p1, 'b', NULL);
-		assert( strcmp(p1->m_packed, "a=foo\nd=4")==0 );
+		assert( strcmp(mrparam_get_packed(p1), "a=foo\nd=4")==0 );
 
 		mrparam_set    (p1, 'a', NULL);
 		mrparam_set    (p1, 'd', NULL);
-		assert( strcmp(p1->m_packed, "")==0 );
+		assert( strcmp(mrparam_get_packed(p1), "")==0 );
 
 		mrparam_unref(p1);
 	}
@@ -664,6 +1155,55 @@ void stress_functions(mrmailbox_t* mailbox)
 		mrkey_unref(bad_key);
 	}
 
+	{
+		/* the cache of parsed keys; the keys do not need to be valid for this */
+		#define CACHE_DATA_BYTES (MR_PGP_KEY_CACHE_MAX+64)
+		unsigned char cache_data[CACHE_DATA_BYTES];
+		mrkey_t*      cache_keys[MR_PGP_KEY_CACHE_MAX+1];
+		for( int i = 0; i < CACHE_DATA_BYTES; i++ ) {
+			cache_data[i] = (unsigned char)(i&0xFF);
+		}
+		for( int i = 0; i <= MR_PGP_KEY_CACHE_MAX; i++ ) {
+			cache_keys[i] = mrkey_new();
+			mrkey_set_from_binary(cache_keys[i], cache_data, 32+i, MR_PUBLIC); /* different lengths, different keys */
+		}
+
+		mrpgp_forget_cached_keys();
+		assert( mrpgp_cached_keys_count() == 0 );
+
+		const void* id = mrpgp_cached_keys_id(cache_keys[0]);
+		assert( id );
+		assert( mrpgp_is_key_cached(cache_keys[0]) );
+		assert( mrpgp_cached_keys_id(cache_keys[0]) == id ); /* a hit returns the same entry ... */
+		assert( mrpgp_cached_keys_count() == 1 );            /* ... and does not add another one */
+
+		for( int i = 1; i <= MR_PGP_KEY_CACHE_MAX; i++ ) {
+			mrpgp_cached_keys_id(cache_keys[i]);
+		}
+		assert( mrpgp_cached_keys_count() == MR_PGP_KEY_CACHE_MAX );
+		assert( !mrpgp_is_key_cached(cache_keys[0]) ); /* the least recently used entry is evicted */
+		assert( mrpgp_is_key_cached(cache_keys[1]) );
+		assert( mrpgp_is_key_cached(cache_keys[MR_PGP_KEY_CACHE_MAX]) );
+
+		/* saving an own keypair flushes the cache; use a separate database, not the one of the mailbox */
+		char*        dbfile = mr_get_fine_pathNfilename(mailbox->m_blobdir, "stress-keycache.db");
+		mrsqlite3_t* sql = mrsqlite3_new(mailbox);
+		assert( dbfile && sql );
+		assert( mrsqlite3_open__(sql, dbfile, MR_OPEN_NO_WAL) );
+		mrsqlite3_lock(sql);
+			assert( mrkey_save_self_keypair__(cache_keys[1], cache_keys[2], "cache@stress.de", 0, sql) );
+		mrsqlite3_unlock(sql);
+		assert( mrpgp_cached_keys_count() == 0 );
+		assert( !mrpgp_is_key_cached(cache_keys[1]) );
+		mrsqlite3_unref(sql);
+		unlink(dbfile);
+		free(dbfile);
+
+		for( int i = 0; i <= MR_PGP_KEY_CACHE_MAX; i++ ) {
+			mrkey_unref(cache_keys[i]);
+		}
+	}
+
 	{
 		mrkey_t *public_key = mrkey_new(), *private_key = mrkey_new();
 		mrpgp_create_keypair(mailbox, "foo@bar.de", public_key, private_key);
@@ -760,6 +1300,21 @@ void stress_functions(mrmailbox_t* mailbox)
 	}
 
 
+	/* test the IMAP connection setup using a stub server
+	 **************************************************************************/
+
+	stress_imap_compress(mailbox, STUB_IMAP_COMPRESS_DROP);
+	stress_imap_compress(mailbox, STUB_IMAP_COMPRESS_REFUSE);
+	stress_imap_compress(mailbox, STUB_IMAP_COMPRESS_OK);
+
+
+	/* test sending messages using a stub server
+	 **************************************************************************/
+
+	stress_smtp_send(mailbox, STUB_SMTP_PIPELINING);
+	stress_smtp_send(mailbox, STUB_SMTP_SIMPLE);
+
+
 	/* test out-of-band verification
 	 **************************************************************************/
 
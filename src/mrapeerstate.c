@@ -96,7 +96,11 @@ int mrapeerstate_load_by_addr__(mrapeerstate_t* peerstate, mrsqlite3_t* sql, con
 
 	mrapeerstate_empty(peerstate);
 
-	stmt = mrsqlite3_predefine__(sql, SELECT_fields_FROM_acpeerstates_WHERE_addr,
+	if( mrcache_get_peerstate(sql->m_cache, peerstate, addr) ) {
+		return 1;
+	}
+
+	stmt = mrsqlite3_predefine__(sql,
 		"SELECT " PEERSTATE_FIELDS
 		 " FROM acpeerstates "
 		 " WHERE addr=? COLLATE NOCASE;");
@@ -105,6 +109,7 @@ int mrapeerstate_load_by_addr__(mrapeerstate_t* peerstate, mrsqlite3_t* sql, con
 		goto cleanup;
 	}
 	mrapeerstate_set_from_stmt__(peerstate, stmt);
+	mrcache_put_peerstate(sql->m_cache, peerstate);
 
 	success = 1;
 
@@ -124,7 +129,7 @@ int mrapeerstate_load_by_fingerprint__(mrapeerstate_t* peerstate, mrsqlite3_t* s
 
 	mrapeerstate_empty(peerstate);
 
-	stmt = mrsqlite3_predefine__(sql, SELECT_fields_FROM_acpeerstates_WHERE_fingerprint,
+	stmt = mrsqlite3_predefine__(sql,
 		"SELECT " PEERSTATE_FIELDS
 		 " FROM acpeerstates "
 		 " WHERE fingerprint=? COLLATE NOCASE;");
@@ -150,15 +155,17 @@ int mrapeerstate_save_to_db__(const mrapeerstate_t* ths, mrsqlite3_t* sql, int c
 		return 0;
 	}
 
+	mrcache_remove_peerstate(sql->m_cache, ths->m_addr);
+
 	if( create ) {
-		stmt = mrsqlite3_predefine__(sql, INSERT_INTO_acpeerstates_a, "INSERT INTO acpeerstates (addr) VALUES(?);");
+		stmt = mrsqlite3_predefine__(sql, "INSERT INTO acpeerstates (addr) VALUES(?);");
 		sqlite3_bind_text(stmt, 1, ths->m_addr, -1, SQLITE_STATIC);
 		sqlite3_step(stmt);
 	}
 
 	if( (ths->m_to_save&MRA_SAVE_ALL) || create )
 	{
-		stmt = mrsqlite3_predefine__(sql, UPDATE_acpeerstates_SET_lcpp_WHERE_a,
+		stmt = mrsqlite3_predefine__(sql,
 			"UPDATE acpeerstates "
 			"   SET last_seen=?, last_seen_autocrypt=?, prefer_encrypted=?, "
 			"       public_key=?, gossip_timestamp=?, gossip_key=?, fingerprint=? "
@@ -177,7 +184,7 @@ int mrapeerstate_save_to_db__(const mrapeerstate_t* ths, mrsqlite3_t* sql, int c
 	}
 	else if( ths->m_to_save&MRA_SAVE_TIMESTAMPS )
 	{
-		stmt = mrsqlite3_predefine__(sql, UPDATE_acpeerstates_SET_l_WHERE_a,
+		stmt = mrsqlite3_predefine__(sql,
 			"UPDATE acpeerstates SET last_seen=?, last_seen_autocrypt=?, gossip_timestamp=? WHERE addr=?;");
 		sqlite3_bind_int64(stmt, 1, ths->m_last_seen);
 		sqlite3_bind_int64(stmt, 2, ths->m_last_seen_autocrypt);
@@ -377,12 +384,10 @@ void mrapeerstate_apply_header(mrapeerstate_t* ths, const mraheader_t* header, t
 			ths->m_to_save |= MRA_SAVE_ALL;
 		}
 
-		if( ths->m_public_key == NULL ) {
-			ths->m_public_key = mrkey_new();
-		}
-
-		if( !mrkey_equals(ths->m_public_key, header->m_public_key) )
+		if( ths->m_public_key == NULL || !mrkey_equals(ths->m_public_key, header->m_public_key) )
 		{
+			mrkey_unref(ths->m_public_key);
+			ths->m_public_key = mrkey_new();
 			mrkey_set_from_key(ths->m_public_key, header->m_public_key);
 			mrapeerstate_recalc_fingerprint(ths);
 			ths->m_to_save |= MRA_SAVE_ALL;
@@ -405,12 +410,10 @@ void mrapeerstate_apply_gossip(mrapeerstate_t* peerstate, const mraheader_t* gos
 		peerstate->m_gossip_timestamp    = message_time;
 		peerstate->m_to_save             |= MRA_SAVE_TIMESTAMPS;
 
-		if( peerstate->m_gossip_key == NULL ) {
-			peerstate->m_gossip_key = mrkey_new();
-		}
-
-		if( !mrkey_equals(peerstate->m_gossip_key, gossip_header->m_public_key) )
+		if( peerstate->m_gossip_key == NULL || !mrkey_equals(peerstate->m_gossip_key, gossip_header->m_public_key) )
 		{
+			mrkey_unref(peerstate->m_gossip_key);
+			peerstate->m_gossip_key = mrkey_new();
 			mrkey_set_from_key(peerstate->m_gossip_key, gossip_header->m_public_key);
 			mrapeerstate_recalc_fingerprint(peerstate);
 			peerstate->m_to_save |= MRA_SAVE_ALL;
@@ -0,0 +1,339 @@
+/*******************************************************************************
+ *
+ *                              Delta Chat Core
+ *                      Copyright (C) 2017 Björn Petersen
+ *                   Contact: r10s@b44t.com, http://b44t.com
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see http://www.gnu.org/licenses/ .
+ *
+ ******************************************************************************/
+
+
+
+#include "mrmailbox_internal.h"
+#include "mrapeerstate.h"
+#include "mrcache.h"
+
+
+/*******************************************************************************
+ * Copy objects
+ ******************************************************************************/
+
+
+static void copy_chat(mrchat_t* dst, const mrchat_t* src)
+{
+	mrchat_empty(dst);
+	dst->m_id              = src->m_id;
+	dst->m_type            = src->m_type;
+	dst->m_name            = src->m_name? safe_strdup(src->m_name) : NULL;
+	dst->m_draft_text      = src->m_draft_text? safe_strdup(src->m_draft_text) : NULL;
+	dst->m_draft_timestamp = src->m_draft_timestamp;
+	dst->m_archived        = src->m_archived;
+	dst->m_grpid           = src->m_grpid? safe_strdup(src->m_grpid) : NULL;
+	dst->m_blocked         = src->m_blocked;
+	mrparam_set_packed(dst->m_param, mrparam_get_packed(src->m_param));
+}
+
+
+static void copy_contact(mrcontact_t* dst, const mrcontact_t* src)
+{
+	mrcontact_empty(dst);
+	dst->m_id              = src->m_id;
+	dst->m_name            = src->m_name? safe_strdup(src->m_name) : NULL;
+	dst->m_authname        = src->m_authname? safe_strdup(src->m_authname) : NULL;
+	dst->m_addr            = src->m_addr? safe_strdup(src->m_addr) : NULL;
+	dst->m_blocked         = src->m_blocked;
+	dst->m_origin          = src->m_origin;
+}
+
+
+static mrkey_t* copy_key(const mrkey_t* src)
+{
+	/* the keys are copied and not shared by mrkey_ref(): the reference counter is not thread-safe and
+	the copies are unref'd by the callers after the database is unlocked */
+	mrkey_t* dst = NULL;
+	if( src ) {
+		dst = mrkey_new();
+		mrkey_set_from_key(dst, src);
+	}
+	return dst;
+}
+
+
+static void copy_peerstate(mrapeerstate_t* dst, const mrapeerstate_t* src)
+{
+	dst->m_addr                = src->m_addr? safe_strdup(src->m_addr) : NULL;
+	dst->m_last_seen           = src->m_last_seen;
+	dst->m_last_seen_autocrypt = src->m_last_seen_autocrypt;
+	dst->m_public_key          = copy_key(src->m_public_key);
+	dst->m_prefer_encrypt      = src->m_prefer_encrypt;
+	dst->m_gossip_timestamp    = src->m_gossip_timestamp;
+	dst->m_gossip_key          = copy_key(src->m_gossip_key);
+	dst->m_fingerprint         = src->m_fingerprint? safe_strdup(src->m_fingerprint) : NULL;
+	dst->m_to_save             = 0;
+}
+
+
+/*******************************************************************************
+ * Main interface
+ ******************************************************************************/
+
+
+mrcache_t* mrcache_new()
+{
+	mrcache_t* ths = NULL;
+
+	if( (ths=calloc(1, sizeof(mrcache_t)))==NULL ) {
+		exit(65); /* cannot allocate little memory, unrecoverable error */
+	}
+
+	mrhash_init(&ths->m_chats,      MRHASH_INT,    0);
+	mrhash_init(&ths->m_contacts,   MRHASH_INT,    0);
+	mrhash_init(&ths->m_peerstates, MRHASH_STRING, 1/*copy key*/);
+
+	return ths;
+}
+
+
+void mrcache_unref(mrcache_t* ths)
+{
+	if( ths == NULL ) {
+		return;
+	}
+
+	mrcache_clear(ths);
+	free(ths);
+}
+
+
+static void clear_chats(mrcache_t* ths)
+{
+	mrhashelem_t* elem;
+	for( elem = mrhash_first(&ths->m_chats); elem; elem = mrhash_next(elem) ) {
+		mrchat_unref((mrchat_t*)mrhash_data(elem));
+	}
+	mrhash_clear(&ths->m_chats);
+}
+
+
+static void clear_contacts(mrcache_t* ths)
+{
+	mrhashelem_t* elem;
+	for( elem = mrhash_first(&ths->m_contacts); elem; elem = mrhash_next(elem) ) {
+		mrcontact_unref((mrcontact_t*)mrhash_data(elem));
+	}
+	mrhash_clear(&ths->m_contacts);
+}
+
+
+static void clear_peerstates(mrcache_t* ths)
+{
+	mrhashelem_t* elem;
+	for( elem = mrhash_first(&ths->m_peerstates); elem; elem = mrhash_next(elem) ) {
+		mrapeerstate_unref((mrapeerstate_t*)mrhash_data(elem));
+	}
+	mrhash_clear(&ths->m_peerstates);
+}
+
+
+void mrcache_clear(mrcache_t* ths)
+{
+	if( ths == NULL ) {
+		return;
+	}
+
+	clear_chats(ths);
+	clear_contacts(ths);
+	clear_peerstates(ths);
+}
+
+
+int mrcache_get_count(const mrcache_t* ths)
+{
+	if( ths == NULL ) {
+		return 0;
+	}
+
+	return mrhash_count(&ths->m_chats) + mrhash_count(&ths->m_contacts) + mrhash_count(&ths->m_peerstates);
+}
+
+
+/*******************************************************************************
+ * Chats
+ ******************************************************************************/
+
+
+int mrcache_get_chat(mrcache_t* ths, mrchat_t* ret, uint32_t chat_id)
+{
+	mrchat_t* cached;
+
+	if( ths == NULL || ret == NULL ) {
+		return 0;
+	}
+
+	if( (cached=(mrchat_t*)mrhash_find(&ths->m_chats, NULL, chat_id))==NULL ) {
+		ths->m_misses++;
+		return 0;
+	}
+
+	copy_chat(ret, cached);
+	ths->m_hits++;
+	return 1;
+}
+
+
+void mrcache_put_chat(mrcache_t* ths, const mrchat_t* chat)
+{
+	mrchat_t* cached;
+
+	/* special chats are not cached as their names are created on loading, the same is true for the self-talk */
+	if( ths == NULL || chat == NULL || chat->m_id <= MR_CHAT_ID_LAST_SPECIAL || mrparam_exists(chat->m_param, MRP_SELFTALK) ) {
+		return;
+	}
+
+	if( mrhash_count(&ths->m_chats) >= MR_CACHE_SIZE ) {
+		clear_chats(ths);
+	}
+
+	cached = mrchat_new(chat->m_mailbox);
+	copy_chat(cached, chat);
+	mrchat_unref((mrchat_t*)mrhash_insert(&ths->m_chats, NULL, chat->m_id, cached)); /* unref the replaced object, if any */
+}
+
+
+/*******************************************************************************
+ * Contacts
+ ******************************************************************************/
+
+
+int mrcache_get_contact(mrcache_t* ths, mrcontact_t* ret, uint32_t contact_id)
+{
+	mrcontact_t* cached;
+
+	if( ths == NULL || ret == NULL ) {
+		return 0;
+	}
+
+	if( (cached=(mrcontact_t*)mrhash_find(&ths->m_contacts, NULL, contact_id))==NULL ) {
+		ths->m_misses++;
+		return 0;
+	}
+
+	copy_contact(ret, cached);
+	ths->m_hits++;
+	return 1;
+}
+
+
+void mrcache_put_contact(mrcache_t* ths, const mrcontact_t* contact)
+{
+	mrcontact_t* cached;
+
+	/* the name and the address of MR_CONTACT_ID_SELF are not read from the contacts table */
+	if( ths == NULL || contact == NULL || contact->m_id == MR_CONTACT_ID_SELF ) {
+		return;
+	}
+
+	if( mrhash_count(&ths->m_contacts) >= MR_CACHE_SIZE ) {
+		clear_contacts(ths);
+	}
+
+	cached = mrcontact_new();
+	copy_contact(cached, contact);
+	mrcontact_unref((mrcontact_t*)mrhash_insert(&ths->m_contacts, NULL, contact->m_id, cached));
+}
+
+
+/*******************************************************************************
+ * Peerstates
+ ******************************************************************************/
+
+
+int mrcache_get_peerstate(mrcache_t* ths, mrapeerstate_t* ret, const char* addr)
+{
+	mrapeerstate_t* cached;
+
+	if( ths == NULL || ret == NULL || addr == NULL ) {
+		return 0;
+	}
+
+	if( (cached=(mrapeerstate_t*)mrhash_find(&ths->m_peerstates, addr, strlen(addr)))==NULL ) {
+		ths->m_misses++;
+		return 0;
+	}
+
+	copy_peerstate(ret, cached);
+	ths->m_hits++;
+	return 1;
+}
+
+
+void mrcache_put_peerstate(mrcache_t* ths, const mrapeerstate_t* peerstate)
+{
+	mrapeerstate_t* cached;
+
+	if( ths == NULL || peerstate == NULL || peerstate->m_addr == NULL ) {
+		return;
+	}
+
+	if( mrhash_count(&ths->m_peerstates) >= MR_CACHE_SIZE ) {
+		clear_peerstates(ths);
+	}
+
+	cached = mrapeerstate_new();
+	copy_peerstate(cached, peerstate);
+	mrapeerstate_unref((mrapeerstate_t*)mrhash_insert(&ths->m_peerstates, cached->m_addr, strlen(cached->m_addr), cached));
+}
+
+
+void mrcache_remove_peerstate(mrcache_t* ths, const char* addr)
+{
+	if( ths == NULL || addr == NULL ) {
+		return;
+	}
+
+	mrapeerstate_unref((mrapeerstate_t*)mrhash_insert(&ths->m_peerstates, addr, strlen(addr), NULL));
+}
+
+
+/*******************************************************************************
+ * Invalidation
+ ******************************************************************************/
+
+
+void mrcache_row_changed(mrcache_t* ths, const char* table, uint32_t rowid)
+{
+	if( ths == NULL || table == NULL ) {
+		return;
+	}
+
+	if( strcmp(table, "chats")==0 ) {
+		if( !ths->m_keep_chats ) {
+			mrchat_unref((mrchat_t*)mrhash_insert(&ths->m_chats, NULL, rowid, NULL));
+		}
+	}
+	else if( strcmp(table, "contacts")==0 ) {
+		mrcontact_unref((mrcontact_t*)mrhash_insert(&ths->m_contacts, NULL, rowid, NULL));
+	}
+}
+
+
+void mrcache_keep_chats(mrcache_t* ths, int keep)
+{
+	if( ths == NULL ) {
+		return;
+	}
+
+	ths->m_keep_chats = keep;
+}
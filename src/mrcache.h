@@ -0,0 +1,87 @@
+/*******************************************************************************
+ *
+ *                              Delta Chat Core
+ *                      Copyright (C) 2017 Björn Petersen
+ *                   Contact: r10s@b44t.com, http://b44t.com
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see http://www.gnu.org/licenses/ .
+ *
+ ******************************************************************************/
+
+
+
+#ifndef __MRCACHE_H__
+#define __MRCACHE_H__
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/*** library-private **********************************************************/
+
+#include "mrhash.h"
+typedef struct _mrchat mrchat_t;
+typedef struct _mrcontact mrcontact_t;
+typedef struct mrapeerstate_t mrapeerstate_t;
+
+
+/**
+ * Library-internal.
+ *
+ * Decoded chats, contacts and peerstates of a write connection, see mrsqlite3_t::m_cache.
+ *
+ * The cache holds its own copies of the objects; the load functions copy them
+ * to the object given by the caller, so the caller may modify its object as usual.
+ * Chats and contacts are removed when their row is written, as reported by
+ * sqlite3_update_hook(), peerstates are removed by mrapeerstate_save_to_db__().
+ * On rollbacks, the whole cache is cleared as it may contain uncommitted data.
+ */
+typedef struct mrcache_t
+{
+	/** @privatesection */
+	#define    MR_CACHE_SIZE 256  /* per object type; if there are more objects, all objects of the type are removed */
+	mrhash_t   m_chats;           /**< mrchat_t objects by the chat ID */
+	mrhash_t   m_contacts;        /**< mrcontact_t objects by the contact ID */
+	mrhash_t   m_peerstates;      /**< mrapeerstate_t objects by the address, case-insensitive */
+	int        m_hits;            /**< statistics, number of loads answered by the cache */
+	int        m_misses;          /**< statistics, number of loads that had to query the database */
+	int        m_keep_chats;      /**< set by mrcache_keep_chats() while columns not loaded to mrchat_t are written */
+} mrcache_t;
+
+
+mrcache_t* mrcache_new              ();
+void       mrcache_unref            (mrcache_t*);
+void       mrcache_clear            (mrcache_t*);
+int        mrcache_get_count        (const mrcache_t*);
+
+/* all functions accept a NULL-cache, which is used for read-only connections; the get-functions return 1 if the object was copied from the cache */
+int        mrcache_get_chat         (mrcache_t*, mrchat_t* ret, uint32_t chat_id);
+void       mrcache_put_chat         (mrcache_t*, const mrchat_t*);
+
+int        mrcache_get_contact      (mrcache_t*, mrcontact_t* ret, uint32_t contact_id);
+void       mrcache_put_contact      (mrcache_t*, const mrcontact_t*);
+
+int        mrcache_get_peerstate    (mrcache_t*, mrapeerstate_t* ret, const char* addr);
+void       mrcache_put_peerstate    (mrcache_t*, const mrapeerstate_t*);
+void       mrcache_remove_peerstate (mrcache_t*, const char* addr);
+
+void       mrcache_row_changed      (mrcache_t*, const char* table, uint32_t rowid); /* called by the update hook of the connection */
+void       mrcache_keep_chats       (mrcache_t*, int keep); /* while set, written chats rows do not remove the chats from the cache */
+
+
+#ifdef __cplusplus
+} /* /extern "C" */
+#endif
+#endif /* __MRCACHE_H__ */
+
@@ -228,7 +228,7 @@ char* mrchat_get_subtitle(mrchat_t* chat)
 		int r;
 		mrsqlite3_lock(chat->m_mailbox->m_sql);
 
-			stmt = mrsqlite3_predefine__(chat->m_mailbox->m_sql, SELECT_a_FROM_chats_contacts_WHERE_i,
+			stmt = mrsqlite3_predefine__(chat->m_mailbox->m_sql,
 				"SELECT c.addr FROM chats_contacts cc "
 					" LEFT JOIN contacts c ON c.id=cc.contact_id "
 					" WHERE cc.chat_id=?;");
@@ -405,11 +405,10 @@ int mrchat_is_self_talk(mrchat_t* chat)
 int mrchat_update_param__(mrchat_t* ths)
 {
 	int success = 0;
-	sqlite3_stmt* stmt = mrsqlite3_prepare_v2_(ths->m_mailbox->m_sql, "UPDATE chats SET param=? WHERE id=?");
-	sqlite3_bind_text(stmt, 1, ths->m_param->m_packed, -1, SQLITE_STATIC);
+	sqlite3_stmt* stmt = mrsqlite3_predefine__(ths->m_mailbox->m_sql, "UPDATE chats SET param=? WHERE id=?;");
+	sqlite3_bind_text(stmt, 1, mrparam_get_packed(ths->m_param), -1, SQLITE_STATIC);
 	sqlite3_bind_int (stmt, 2, ths->m_id);
 	success = sqlite3_step(stmt)==SQLITE_DONE? 1 : 0;
-	sqlite3_finalize(stmt);
 	return success;
 }
 
@@ -453,7 +452,7 @@ static int mrchat_set_from_stmt__(mrchat_t* ths, sqlite3_stmt* row)
 	else if( ths->m_id == MR_CHAT_ID_ARCHIVED_LINK ) {
 		free(ths->m_name);
 		char* tempname = mrstock_str(MR_STR_ARCHIVEDCHATS);
-			ths->m_name = mr_mprintf("%s (%i)", tempname, mrmailbox_get_archived_count__(ths->m_mailbox));
+			ths->m_name = mr_mprintf("%s (%i)", tempname, mrmailbox_get_archived_count__(ths->m_mailbox->m_sql));
 		free(tempname);
 	}
 	else if( ths->m_id == MR_CHAT_ID_STARRED ) {
@@ -493,7 +492,11 @@ int mrchat_load_from_db__(mrchat_t* chat, uint32_t chat_id)
 
 	mrchat_empty(chat);
 
-	stmt = mrsqlite3_predefine__(chat->m_mailbox->m_sql, SELECT_itndd_FROM_chats_WHERE_i,
+	if( mrcache_get_chat(chat->m_mailbox->m_sql->m_cache, chat, chat_id) ) {
+		return 1;
+	}
+
+	stmt = mrsqlite3_predefine__(chat->m_mailbox->m_sql,
 		"SELECT " MR_CHAT_FIELDS " FROM chats c WHERE c.id=?;");
 	sqlite3_bind_int(stmt, 1, chat_id);
 
@@ -505,6 +508,7 @@ int mrchat_load_from_db__(mrchat_t* chat, uint32_t chat_id)
 		return 0;
 	}
 
+	mrcache_put_chat(chat->m_mailbox->m_sql->m_cache, chat);
 	return 1;
 }
 
@@ -36,10 +36,13 @@ struct _mrchatlist
 	#define         MR_CHATLIST_IDS_PER_RESULT 2
 	size_t          m_cnt;
 	mrarray_t*      m_chatNlastmsg_ids;
+
+	mrmsg_t**       m_lastmsgs;        /**< The last messages, loaded by mrchatlist_get_summary() in blocks of MR_MSGS_PER_QUERY chats. NULL until needed. */
+	uint8_t*        m_lastmsgs_loaded; /**< One flag for each block of m_lastmsgs. */
 };
 
 
-int             mrchatlist_load_from_db__   (mrchatlist_t*, int listflags, const char* query);
+int             mrchatlist_load_from_db__   (mrchatlist_t*, mrsqlite3_t*, int listflags, const char* query);
 
 
 #ifdef __cplusplus
@@ -90,6 +90,18 @@ void mrchatlist_empty(mrchatlist_t* chatlist)
 		return;
 	}
 
+	if( chatlist->m_lastmsgs ) {
+		size_t i;
+		for( i = 0; i < chatlist->m_cnt; i++ ) {
+			mrmsg_unref(chatlist->m_lastmsgs[i]);
+		}
+		free(chatlist->m_lastmsgs);
+		chatlist->m_lastmsgs = NULL;
+	}
+
+	free(chatlist->m_lastmsgs_loaded);
+	chatlist->m_lastmsgs_loaded = NULL;
+
 	chatlist->m_cnt = 0;
 	mrarray_empty(chatlist->m_chatNlastmsg_ids);
 }
@@ -162,6 +174,35 @@ uint32_t mrchatlist_get_msg_id(mrchatlist_t* chatlist, size_t index)
 }
 
 
+/* get the last message of the chat at the given index; as typically all visible
+items of a chatlist are summarized, the last messages of MR_MSGS_PER_QUERY
+neighbouring chats are loaded at once and kept until the chatlist is emptied.
+So the summary reflects the messages as they were on first access. */
+static mrmsg_t* get_lastmsg__(mrchatlist_t* chatlist, size_t index)
+{
+	size_t    block = index / MR_MSGS_PER_QUERY, first = block*MR_MSGS_PER_QUERY, i;
+	int       cnt = 0;
+	uint32_t  ids[MR_MSGS_PER_QUERY];
+
+	if( chatlist->m_lastmsgs == NULL ) {
+		if( (chatlist->m_lastmsgs=calloc(chatlist->m_cnt, sizeof(mrmsg_t*)))==NULL
+		 || (chatlist->m_lastmsgs_loaded=calloc(chatlist->m_cnt/MR_MSGS_PER_QUERY+1, sizeof(uint8_t)))==NULL ) {
+			exit(64);
+		}
+	}
+
+	if( !chatlist->m_lastmsgs_loaded[block] ) {
+		for( i = first; i < chatlist->m_cnt && cnt < MR_MSGS_PER_QUERY; i++ ) {
+			ids[cnt++] = mrarray_get_id(chatlist->m_chatNlastmsg_ids, i*MR_CHATLIST_IDS_PER_RESULT+1);
+		}
+		mrmsg_load_many_from_db__(&chatlist->m_lastmsgs[first], chatlist->m_mailbox, chatlist->m_mailbox->m_sql, ids, cnt, 0);
+		chatlist->m_lastmsgs_loaded[block] = 1;
+	}
+
+	return chatlist->m_lastmsgs[index];
+}
+
+
 /**
  * Get a summary for a chatlist index.
  *
@@ -225,12 +266,8 @@ mrlot_t* mrchatlist_get_summary(mrchatlist_t* chatlist, size_t index, mrchat_t*
 			}
 		}
 
-		if( lastmsg_id )
+		if( lastmsg_id && (lastmsg=get_lastmsg__(chatlist, index))!=NULL )
 		{
-
-			lastmsg = mrmsg_new();
-			mrmsg_load_from_db__(lastmsg, chatlist->m_mailbox, lastmsg_id);
-
 			if( lastmsg->m_from_id != MR_CONTACT_ID_SELF  &&  chat->m_type == MR_CHAT_TYPE_GROUP )
 			{
 				lastcontact = mrcontact_new();
@@ -272,7 +309,6 @@ mrlot_t* mrchatlist_get_summary(mrchatlist_t* chatlist, size_t index, mrchat_t*
 
 cleanup:
 	if( locked ) { mrsqlite3_unlock(chatlist->m_mailbox->m_sql); }
-	mrmsg_unref(lastmsg);
 	mrcontact_unref(lastcontact);
 	mrchat_unref(chat_to_delete);
 	return ret;
@@ -301,40 +337,41 @@ mrmailbox_t* mrchatlist_get_mailbox(mrchatlist_t* chatlist)
  * Library-internal.
  *
  * Calling this function is not thread-safe, locking is up to the caller.
+ * As the function does not write to the database, `sql` may be a reader as
+ * returned by mrsqlite3_lock_reader().
  *
  * @private @memberof mrchatlist_t
  */
-int mrchatlist_load_from_db__(mrchatlist_t* ths, int listflags, const char* query__)
+int mrchatlist_load_from_db__(mrchatlist_t* ths, mrsqlite3_t* sql, int listflags, const char* query__)
 {
 	int           success = 0;
 	int           add_archived_link_item = 0;
 	sqlite3_stmt* stmt = NULL;
 	char*         strLikeCmd = NULL, *query = NULL;
 
-	if( ths == NULL || ths->m_magic != MR_CHATLIST_MAGIC || ths->m_mailbox == NULL ) {
+	if( ths == NULL || ths->m_magic != MR_CHATLIST_MAGIC || ths->m_mailbox == NULL || sql == NULL ) {
 		goto cleanup;
 	}
 
 	mrchatlist_empty(ths);
 
-	/* select example with left join and minimum: http://stackoverflow.com/questions/7588142/mysql-left-join-min */
-	#define QUR1 "SELECT c.id, m.id FROM chats c " \
-	                " LEFT JOIN msgs m ON (c.id=m.chat_id AND m.timestamp=(SELECT MAX(timestamp) FROM msgs WHERE chat_id=c.id)) " \
+	/* the last message and the sort timestamp are maintained in the chats table by mrmailbox_update_chat_last_msg__(),
+	so this is a simple scan over chats_index3 */
+	#define QUR1 "SELECT c.id, c.last_msg_id FROM chats c " \
 	                " WHERE c.id>" MR_STRINGIFY(MR_CHAT_ID_LAST_SPECIAL) " AND c.blocked=0"
-	#define QUR2    " GROUP BY c.id " /* GROUP BY is needed as there may be several messages with the same timestamp */ \
-	                " ORDER BY MAX(c.draft_timestamp, IFNULL(m.timestamp,0)) DESC,m.id DESC;" /* the list starts with the newest chats */
+	#define QUR2    " ORDER BY c.last_timestamp DESC, c.last_msg_id DESC;" /* the list starts with the newest chats */
 
 	if( listflags & MR_GCL_ARCHIVED_ONLY )
 	{
 		/* show archived chats */
-		stmt = mrsqlite3_predefine__(ths->m_mailbox->m_sql, SELECT_ii_FROM_chats_LEFT_JOIN_msgs_WHERE_archived,
+		stmt = mrsqlite3_predefine__(sql,
 			QUR1 " AND c.archived=1 " QUR2);
 	}
 	else if( query__==NULL )
 	{
 		/* show normal chatlist  */
 		if( !(listflags & MR_GCL_NO_SPECIALS) ) {
-			uint32_t last_deaddrop_fresh_msg_id = mrmailbox_get_last_deaddrop_fresh_msg__(ths->m_mailbox);
+			uint32_t last_deaddrop_fresh_msg_id = mrmailbox_get_last_deaddrop_fresh_msg__(sql);
 			if( last_deaddrop_fresh_msg_id > 0 ) {
 				mrarray_add_id(ths->m_chatNlastmsg_ids, MR_CHAT_ID_DEADDROP); /* show deaddrop with the last fresh message */
 				mrarray_add_id(ths->m_chatNlastmsg_ids, last_deaddrop_fresh_msg_id);
@@ -342,7 +379,7 @@ int mrchatlist_load_from_db__(mrchatlist_t* ths, int listflags, const char* quer
 			add_archived_link_item = 1;
 		}
 
-		stmt = mrsqlite3_predefine__(ths->m_mailbox->m_sql, SELECT_ii_FROM_chats_LEFT_JOIN_msgs_WHERE_unarchived,
+		stmt = mrsqlite3_predefine__(sql,
 			QUR1 " AND c.archived=0 " QUR2);
 	}
 	else
@@ -355,7 +392,7 @@ int mrchatlist_load_from_db__(mrchatlist_t* ths, int listflags, const char* quer
 			goto cleanup;
 		}
 		strLikeCmd = mr_mprintf("%%%s%%", query);
-		stmt = mrsqlite3_predefine__(ths->m_mailbox->m_sql, SELECT_ii_FROM_chats_LEFT_JOIN_msgs_WHERE_query,
+		stmt = mrsqlite3_predefine__(sql,
 			QUR1 " AND c.name LIKE ? " QUR2);
 		sqlite3_bind_text(stmt, 1, strLikeCmd, -1, SQLITE_STATIC);
 	}
@@ -366,7 +403,7 @@ int mrchatlist_load_from_db__(mrchatlist_t* ths, int listflags, const char* quer
 		mrarray_add_id(ths->m_chatNlastmsg_ids, sqlite3_column_int(stmt, 1));
     }
 
-    if( add_archived_link_item && mrmailbox_get_archived_count__(ths->m_mailbox)>0 )
+    if( add_archived_link_item && mrmailbox_get_archived_count__(sql)>0 )
     {
 		mrarray_add_id(ths->m_chatNlastmsg_ids, MR_CHAT_ID_ARCHIVED_LINK);
 		mrarray_add_id(ths->m_chatNlastmsg_ids, 0);
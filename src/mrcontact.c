@@ -387,9 +387,9 @@ int mrcontact_load_from_db__(mrcontact_t* ths, mrsqlite3_t* sql, uint32_t contac
 		ths->m_name = mrstock_str(MR_STR_SELF);
 		ths->m_addr = mrsqlite3_get_config__(sql, "configured_addr", "");
 	}
-	else
+	else if( !mrcache_get_contact(sql->m_cache, ths, contact_id) )
 	{
-		stmt = mrsqlite3_predefine__(sql, SELECT_naob_FROM_contacts_i,
+		stmt = mrsqlite3_predefine__(sql,
 			"SELECT name, addr, origin, blocked, authname FROM contacts WHERE id=?;");
 		sqlite3_bind_int(stmt, 1, contact_id);
 		if( sqlite3_step(stmt) != SQLITE_ROW ) {
@@ -402,6 +402,8 @@ int mrcontact_load_from_db__(mrcontact_t* ths, mrsqlite3_t* sql, uint32_t contac
 		ths->m_origin           =                    sqlite3_column_int  (stmt, 2);
 		ths->m_blocked          =                    sqlite3_column_int  (stmt, 3);
 		ths->m_authname         = safe_strdup((char*)sqlite3_column_text (stmt, 4));
+
+		mrcache_put_contact(sql->m_cache, ths);
 	}
 
 	success = 1;
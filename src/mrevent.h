@@ -200,6 +200,20 @@ extern "C" {
 #define MR_EVENT_IMEX_FILE_WRITTEN        2052
 
 
+/**
+ * Inform about the generation of the own keypair.  After mrmailbox_configure_and_connect() succeeded,
+ * the keypair is generated in the background, if there is none yet; this may take some seconds.
+ *
+ * @param data1 Permille; 0=generation started, 1000=keypair generated and saved.  On errors, 1000 is not sent
+ *     and the generation is tried again later.
+ *
+ * @param data2 0
+ *
+ * @return 0
+ */
+#define MR_EVENT_KEYGEN_PROGRESS          2061
+
+
 /*******************************************************************************
  * The following events are functions that should be provided by the frontends
  ******************************************************************************/
@@ -39,10 +39,6 @@
 */
 #define Addr(X)  ((uintptr_t)X)
 
-static void*    sjhashMalloc(long bytes) { void* p=malloc(bytes); if( p) memset(p, 0, bytes); return p; }
-#define         sjhashMallocRaw(a) malloc((a))
-#define         sjhashFree(a) free((a))
-
 
 
 /* An array to map all upper-case characters into their corresponding
@@ -98,331 +94,206 @@ static int sjhashNoCase(const char *z, int n)
 
 
 
-/* Turn bulk memory into a hash table object by initializing the
- * fields of the Hash structure.
- *
- * "pNew" is a pointer to the hash table that is to be initialized.
- * keyClass is one of the constants SJHASH_INT, SJHASH_POINTER,
- * SJHASH_BINARY, or SJHASH_STRING.  The value of keyClass
- * determines what kind of key the hash table will use.  "copyKey" is
- * true if the hash table should make its own private copy of keys and
- * false if it should just use the supplied pointer.  CopyKey only makes
- * sense for SJHASH_STRING and SJHASH_BINARY and is ignored
- * for other key classes.
- */
-void mrhash_init(mrhash_t *pNew, int keyClass, int copyKey)
-{
-	assert( pNew!=0 );
-	assert( keyClass>=MRHASH_INT && keyClass<=MRHASH_BINARY );
-	pNew->keyClass = keyClass;
-
-	if( keyClass==MRHASH_POINTER || keyClass==MRHASH_INT ) copyKey = 0;
-
-	pNew->copyKey = copyKey;
-	pNew->first = 0;
-	pNew->count = 0;
-	pNew->htsize = 0;
-	pNew->ht = 0;
-}
-
-
-
-/* Remove all entries from a hash table.  Reclaim all memory.
- * Call this routine to delete a hash table or to reset a hash table
- * to the empty state.
- */
-void mrhash_clear(mrhash_t *pH)
-{
-	mrhashelem_t *elem;         /* For looping over all elements of the table */
-
-	if( pH == NULL ) {
-		return;
-	}
-
-	elem = pH->first;
-	pH->first = 0;
-	if( pH->ht ) sjhashFree(pH->ht);
-	pH->ht = 0;
-	pH->htsize = 0;
-	while( elem )
-	{
-		mrhashelem_t *next_elem = elem->next;
-		if( pH->copyKey && elem->pKey )
-		{
-			sjhashFree(elem->pKey);
-		}
-		sjhashFree(elem);
-		elem = next_elem;
-	}
-	pH->count = 0;
-}
-
-
-
-/* Hash and comparison functions when the mode is SJHASH_INT
- */
-static int intHash(const void *pKey, int nKey)
-{
-	return nKey ^ (nKey<<8) ^ (nKey>>8);
-}
 
-static int intCompare(const void *pKey1, int n1, const void *pKey2, int n2)
-{
-	return n2 - n1;
-}
-
-
-
-/* Hash and comparison functions when the mode is SJHASH_POINTER
+/* The hash table keeps its elements in an array in the order of insertion,
+ * followed by an open-addressing index into this array in the same allocation.
+ * Removed elements stay in the array with data set to NULL until the table is
+ * rebuilt, the element after the last one is a sentinel pointing to itself,
+ * this allows mrhash_next() to work without a pointer to the table.
  */
-static int ptrHash(const void *pKey, int nKey)
-{
-	uintptr_t x = Addr(pKey);
-	return x ^ (x<<8) ^ (x>>8);
-}
+#define INDEX_EMPTY   (-1)
+#define INITIAL_ALLOC 8
+#define IS_SENTINEL(E) ((E)->pKey==(void*)(E))
 
-static int ptrCompare(const void *pKey1, int n1, const void *pKey2, int n2)
-{
-	if( pKey1==pKey2 ) return 0;
-	if( pKey1<pKey2 ) return -1;
-	return 1;
-}
 
-
-
-/* Hash and comparison functions when the mode is SJHASH_STRING
- */
-static int strHash(const void *pKey, int nKey)
+static unsigned int hashKey(const mrhash_t *pH, const void *pKey, int nKey)
 {
-	return sjhashNoCase((const char*)pKey, nKey);
-}
+	unsigned int h;
+	const unsigned char *z;
 
-static int strCompare(const void *pKey1, int n1, const void *pKey2, int n2)
-{
-	if( n1!=n2 ) return 1;
-	return sjhashStrNICmp((const char*)pKey1,(const char*)pKey2,n1);
-}
+	switch( pH->keyClass )
+	{
+		case MRHASH_INT:
+			h = (unsigned int)nKey;
+			break;
 
+		case MRHASH_POINTER:
+			h = (unsigned int)Addr(pKey) ^ (unsigned int)(Addr(pKey)>>16);
+			break;
 
+		case MRHASH_STRING:
+			h = (unsigned int)sjhashNoCase((const char*)pKey, nKey);
+			break;
 
-/* Hash and comparison functions when the mode is SJHASH_BINARY
- */
-static int binHash(const void *pKey, int nKey)
-{
-	int h = 0;
-	const char *z = (const char *)pKey;
-	while( nKey-- > 0 )
-	{
-		h = (h<<3) ^ h ^ *(z++);
+		default:
+			for( h = 0, z = (const unsigned char*)pKey; nKey > 0; nKey-- ) {
+				h = (h<<3) ^ h ^ *(z++);
+			}
+			break;
 	}
-	return h & 0x7fffffff;
-}
 
-static int binCompare(const void *pKey1, int n1, const void *pKey2, int n2)
-{
-	if( n1!=n2 ) return 1;
-	return memcmp(pKey1,pKey2,n1);
+	/* spread the bits as the index uses the lower bits only and neighbouring keys should not end up in neighbouring slots */
+	h ^= h >> 16;
+	h *= 0x45d9f3b;
+	h ^= h >> 16;
+	return h;
 }
 
 
-
-/* Return a pointer to the appropriate hash function given the key class.
- *
- * About the syntax:
- * The name of the function is "hashFunction".  The function takes a
- * single parameter "keyClass".  The return value of hashFunction()
- * is a pointer to another function.  Specifically, the return value
- * of hashFunction() is a pointer to a function that takes two parameters
- * with types "const void*" and "int" and returns an "int".
- */
-static int (*hashFunction(int keyClass))(const void*,int)
+static int compareKey(const mrhash_t *pH, const mrhashelem_t *elem, const void *pKey, int nKey)
 {
-	switch( keyClass )
+	switch( pH->keyClass )
 	{
-		case MRHASH_INT:    return &intHash;
-		case MRHASH_POINTER:return &ptrHash;
-		case MRHASH_STRING: return &strHash;
-		case MRHASH_BINARY: return &binHash;;
-		default:            break;
+		case MRHASH_INT:     return elem->nKey==nKey? 0 : 1;
+		case MRHASH_POINTER: return elem->pKey==pKey? 0 : 1;
+		case MRHASH_STRING:  return elem->nKey==nKey? sjhashStrNICmp((const char*)elem->pKey, (const char*)pKey, nKey) : 1;
+		default:             return elem->nKey==nKey? memcmp(elem->pKey, pKey, nKey) : 1;
 	}
-	return 0;
 }
 
 
-
-/* Return a pointer to the appropriate hash function given the key class.
+/* Return the element with the given key, NULL if there is no such element.
  */
-static int (*compareFunction(int keyClass))(const void*,int,const void*,int)
+static mrhashelem_t *findElement(const mrhash_t *pH, const void *pKey, int nKey, unsigned int h)
 {
-	switch( keyClass )
-	{
-		case MRHASH_INT:     return &intCompare;
-		case MRHASH_POINTER: return &ptrCompare;
-		case MRHASH_STRING:  return &strCompare;
-		case MRHASH_BINARY:  return &binCompare;
-		default: break;
-	}
-	return 0;
-}
+	int mask, i, index;
+	mrhashelem_t *elem;
 
-
-
-/* Link an element into the hash table
- */
-static void insertElement(mrhash_t *pH,           /* The complete hash table */
-                          struct _ht *pEntry,   /* The entry into which pNew is inserted */
-                          mrhashelem_t *pNew)     /* The element to be inserted */
-{
-	mrhashelem_t *pHead; /* First element already in pEntry */
-	pHead = pEntry->chain;
-	if( pHead )
-	{
-		pNew->next = pHead;
-		pNew->prev = pHead->prev;
-		if( pHead->prev ) { pHead->prev->next = pNew; }
-		else             { pH->first = pNew; }
-		pHead->prev = pNew;
+	if( pH->alloc == 0 ) {
+		return NULL;
 	}
-	else
+
+	mask = pH->alloc*2 - 1;
+	for( i = h & mask; (index=pH->index[i]) != INDEX_EMPTY; i = (i+1) & mask )
 	{
-		pNew->next = pH->first;
-		if( pH->first ) { pH->first->prev = pNew; }
-		pNew->prev = 0;
-		pH->first = pNew;
+		elem = &pH->elems[index];
+		if( elem->h == h && elem->data && compareKey(pH, elem, pKey, nKey)==0 ) {
+			return elem;
+		}
 	}
-	pEntry->count++;
-	pEntry->chain = pNew;
-}
 
+	return NULL;
+}
 
 
-/* Resize the hash table so that it cantains "new_size" buckets.
- * "new_size" must be a power of 2.  The hash table might fail
- * to resize if sjhashMalloc() fails.
+/* Move all elements that are not removed to a new allocation with
+ * room for at least one more element and rebuild the index.
+ * Returns 0 if the allocation fails, the table is unchanged then.
  */
-static void rehash(mrhash_t *pH, int new_size)
+static int rebuild(mrhash_t *pH)
 {
-	struct _ht *new_ht;            /* The new hash table */
-	mrhashelem_t *elem, *next_elem;    /* For looping over existing elements */
-	int (*xHash)(const void*,int); /* The hash function */
-
-	assert( (new_size & (new_size-1))==0 );
-	new_ht = (struct _ht *)sjhashMalloc( new_size*sizeof(struct _ht) );
-	if( new_ht==0 ) return;
-	if( pH->ht ) sjhashFree(pH->ht);
-	pH->ht = new_ht;
-	pH->htsize = new_size;
-	xHash = hashFunction(pH->keyClass);
-	for(elem=pH->first, pH->first=0; elem; elem = next_elem)
-	{
-		int h = (*xHash)(elem->pKey, elem->nKey) & (new_size-1);
-		next_elem = elem->next;
-		insertElement(pH, &new_ht[h], elem);
-	}
-}
-
+	int new_alloc, mask, i, j, used = 0;
+	mrhashelem_t *new_elems;
+	int *new_index;
 
+	new_alloc = pH->alloc? pH->alloc : INITIAL_ALLOC;
+	while( pH->count >= new_alloc/2 ) {
+		new_alloc *= 2; /* less than half of the array is used by existing elements afterwards */
+	}
 
-/* This function (for internal use only) locates an element in an
- * hash table that matches the given key.  The hash for this key has
- * already been computed and is passed as the 4th parameter.
- */
-static mrhashelem_t *findElementGivenHash(const mrhash_t *pH,   /* The pH to be searched */
-                                        const void *pKey,   /* The key we are searching for */
-                                        int nKey,
-                                        int h)              /* The hash for this key. */
-{
-	mrhashelem_t *elem; /* Used to loop thru the element list */
-	int count; /* Number of elements left to test */
-	int (*xCompare)(const void*,int,const void*,int);  /* comparison function */
+	new_elems = (mrhashelem_t*)malloc((new_alloc+1)*sizeof(mrhashelem_t) + new_alloc*2*sizeof(int));
+	if( new_elems==NULL ) {
+		return 0;
+	}
+	new_index = (int*)&new_elems[new_alloc+1];
+	memset(new_index, 0xFF, new_alloc*2*sizeof(int)); /* INDEX_EMPTY */
 
-	if( pH->ht )
+	mask = new_alloc*2 - 1;
+	for( i = 0; i < pH->used; i++ )
 	{
-		struct _ht *pEntry = &pH->ht[h];
-		elem = pEntry->chain;
-		count = pEntry->count;
-		xCompare = compareFunction(pH->keyClass);
-		while( count-- && elem )
-		{
-			if( (*xCompare)(elem->pKey,elem->nKey,pKey,nKey)==0 )
-			{
-				return elem;
+		if( pH->elems[i].data ) {
+			new_elems[used] = pH->elems[i];
+			for( j = new_elems[used].h & mask; new_index[j] != INDEX_EMPTY; j = (j+1) & mask ) {
+				;
 			}
-			elem = elem->next;
+			new_index[j] = used;
+			used++;
 		}
 	}
-	return 0;
-}
+	new_elems[used].pKey = &new_elems[used];
 
+	free(pH->elems);
+	pH->elems = new_elems;
+	pH->index = new_index;
+	pH->alloc = new_alloc;
+	pH->used  = used;
+	return 1;
+}
 
 
-/* Remove a single entry from the hash table given a pointer to that
- * element and a hash on the element's key.
+/* Turn bulk memory into a hash table object by initializing the
+ * fields of the Hash structure.
+ *
+ * "pNew" is a pointer to the hash table that is to be initialized.
+ * keyClass is one of the constants MRHASH_INT, MRHASH_POINTER,
+ * MRHASH_BINARY, or MRHASH_STRING.  The value of keyClass
+ * determines what kind of key the hash table will use.  "copyKey" is
+ * true if the hash table should make its own private copy of keys and
+ * false if it should just use the supplied pointer.  CopyKey only makes
+ * sense for MRHASH_STRING and MRHASH_BINARY and is ignored
+ * for other key classes.
+ *
+ * No memory is allocated before the first element is inserted.
  */
-static void removeElementGivenHash(mrhash_t *pH,         /* The pH containing "elem" */
-                                   mrhashelem_t* elem,   /* The element to be removed from the pH */
-                                   int h)              /* Hash value for the element */
+void mrhash_init(mrhash_t *pNew, int keyClass, int copyKey)
 {
-	struct _ht *pEntry;
-
-	if( elem->prev )
-	{
-		elem->prev->next = elem->next;
-	}
-	else
-	{
-		pH->first = elem->next;
-	}
+	assert( pNew!=0 );
+	assert( keyClass>=MRHASH_INT && keyClass<=MRHASH_BINARY );
+	pNew->keyClass = keyClass;
 
-	if( elem->next )
-	{
-		elem->next->prev = elem->prev;
-	}
+	if( keyClass==MRHASH_POINTER || keyClass==MRHASH_INT ) copyKey = 0;
 
-	pEntry = &pH->ht[h];
+	pNew->copyKey = copyKey;
+	pNew->count = 0;
+	pNew->used = 0;
+	pNew->alloc = 0;
+	pNew->elems = NULL;
+	pNew->index = NULL;
+}
 
-	if( pEntry->chain==elem )
-	{
-		pEntry->chain = elem->next;
-	}
 
-	pEntry->count--;
+/* Remove all entries from a hash table.  Reclaim all memory.
+ * Call this routine to delete a hash table or to reset a hash table
+ * to the empty state.
+ */
+void mrhash_clear(mrhash_t *pH)
+{
+	int i;
 
-	if( pEntry->count<=0 )
-	{
-		pEntry->chain = 0;
+	if( pH == NULL ) {
+		return;
 	}
 
-	if( pH->copyKey && elem->pKey )
-	{
-		sjhashFree(elem->pKey);
+	if( pH->copyKey ) {
+		for( i = 0; i < pH->used; i++ ) {
+			if( pH->elems[i].data ) {
+				free(pH->elems[i].pKey);
+			}
+		}
 	}
 
-	sjhashFree( elem );
-	pH->count--;
+	free(pH->elems);
+	pH->elems = NULL;
+	pH->index = NULL;
+	pH->alloc = 0;
+	pH->used = 0;
+	pH->count = 0;
 }
 
 
-
 /* Attempt to locate an element of the hash table pH with a key
  * that matches pKey,nKey.  Return the data for this element if it is
  * found, or NULL if there is no match.
  */
 void* mrhash_find(const mrhash_t *pH, const void *pKey, int nKey)
 {
-	int h;             /* A hash on key */
-	mrhashelem_t *elem;    /* The element that matches key */
-	int (*xHash)(const void*,int);  /* The hash function */
-
-	if( pH==0 || pH->ht==0 ) return 0;
-	xHash = hashFunction(pH->keyClass);
-	assert( xHash!=0 );
-	h = (*xHash)(pKey,nKey);
-	assert( (pH->htsize & (pH->htsize-1))==0 );
-	elem = findElementGivenHash(pH,pKey,nKey, h & (pH->htsize-1));
-	return elem ? elem->data : 0;
-}
+	mrhashelem_t *elem;
+
+	if( pH==0 || pH->alloc==0 ) return 0;
 
+	elem = findElement(pH, pKey, nKey, hashKey(pH, pKey, nKey));
+	return elem? elem->data : 0;
+}
 
 
 /* Insert an element into the hash table pH.  The key is pKey,nKey
@@ -442,26 +313,26 @@ void* mrhash_find(const mrhash_t *pH, const void *pKey, int nKey)
  */
 void* mrhash_insert(mrhash_t *pH, const void *pKey, int nKey, void *data)
 {
-	int hraw;                       /* Raw hash value of the key */
-	int h;                          /* the hash of the key modulo hash table size */
-	mrhashelem_t *elem;               /* Used to loop thru the element list */
-	mrhashelem_t *new_elem;           /* New element added to the pH */
-	int (*xHash)(const void*,int);  /* The hash function */
+	unsigned int h;
+	int mask, i;
+	mrhashelem_t *elem;
+	void *key_copy = NULL;
 
 	assert( pH!=0 );
-	xHash = hashFunction(pH->keyClass);
-	assert( xHash!=0 );
-	hraw = (*xHash)(pKey, nKey);
-	assert( (pH->htsize & (pH->htsize-1))==0 );
-	h = hraw & (pH->htsize-1);
-	elem = findElementGivenHash(pH,pKey,nKey,h);
-
-	if( elem )
+	h = hashKey(pH, pKey, nKey);
+
+	if( (elem=findElement(pH, pKey, nKey, h)) != NULL )
 	{
 		void *old_data = elem->data;
 		if( data==0 )
 		{
-			removeElementGivenHash(pH,elem,h);
+			/* the element stays in the array until the next rebuild, it is skipped by lookups and iterations */
+			if( pH->copyKey ) {
+				free(elem->pKey);
+			}
+			elem->pKey = NULL;
+			elem->data = NULL;
+			pH->count--;
 		}
 		else
 		{
@@ -472,49 +343,55 @@ void* mrhash_insert(mrhash_t *pH, const void *pKey, int nKey, void *data)
 
 	if( data==0 ) return 0;
 
-	new_elem = (mrhashelem_t*)sjhashMalloc( sizeof(mrhashelem_t) );
-
-	if( new_elem==0 ) return data;
-
 	if( pH->copyKey && pKey!=0 )
 	{
-		new_elem->pKey = sjhashMallocRaw( nKey );
-		if( new_elem->pKey==0 )
-		{
-			sjhashFree(new_elem);
+		if( (key_copy=malloc(nKey))==NULL ) {
 			return data;
 		}
-		memcpy((void*)new_elem->pKey, pKey, nKey);
+		memcpy(key_copy, pKey, nKey);
 	}
-	else
-	{
-		new_elem->pKey = (void*)pKey;
-	}
-
-	new_elem->nKey = nKey;
-	pH->count++;
 
-	if( pH->htsize==0 )
+	if( pH->used >= pH->alloc && !rebuild(pH) )
 	{
-		rehash(pH,8);
-		if( pH->htsize==0 )
-		{
-			pH->count = 0;
-			sjhashFree(new_elem);
-			return data;
-		}
+		free(key_copy);
+		return data;
 	}
 
-	if( pH->count > pH->htsize )
-	{
-		rehash(pH,pH->htsize*2);
+	elem = &pH->elems[pH->used];
+	elem->data = data;
+	elem->pKey = key_copy? key_copy : (void*)pKey;
+	elem->nKey = nKey;
+	elem->h    = h;
+
+	mask = pH->alloc*2 - 1;
+	for( i = h & mask; pH->index[i] != INDEX_EMPTY; i = (i+1) & mask ) {
+		;
 	}
+	pH->index[i] = pH->used;
 
-	assert( pH->htsize>0 );
-	assert( (pH->htsize & (pH->htsize-1))==0 );
-	h = hraw & (pH->htsize-1);
-	insertElement(pH, &pH->ht[h], new_elem);
-	new_elem->data = data;
+	pH->used++;
+	pH->count++;
+	pH->elems[pH->used].pKey = &pH->elems[pH->used]; /* the new sentinel */
 	return 0;
 }
 
+
+/* Iterate over the elements in the order of insertion, see mrhash_first() and mrhash_next().
+ */
+mrhashelem_t* mrhash_first_elem_(const mrhash_t *pH)
+{
+	if( pH==0 || pH->count==0 ) return 0;
+	if( pH->elems[0].data ) return &pH->elems[0];
+	return mrhash_next_elem_(&pH->elems[0]);
+}
+
+
+mrhashelem_t* mrhash_next_elem_(const mrhashelem_t *elem)
+{
+	for( elem++; !IS_SENTINEL(elem); elem++ ) {
+		if( elem->data ) {
+			return (mrhashelem_t*)elem;
+		}
+	}
+	return 0;
+}
@@ -40,34 +40,35 @@ typedef struct mrhashelem_t   mrhashelem_t;
  * However, many of the "procedures" and "functions" for modifying and
  * accessing this structure are really macros, so we can't really make
  * this structure opaque.
+ *
+ * The elements are stored in a single array in the order of insertion,
+ * followed by an open-addressing index in the same allocation; so there is
+ * no allocation per element (unless the keys are copied).
  */
 typedef struct mrhash_t
 {
-	char              keyClass;       /* SJHASH_INT, _POINTER, _STRING, _BINARY */
+	char              keyClass;       /* MRHASH_INT, _POINTER, _STRING, _BINARY */
 	char              copyKey;        /* True if copy of key made on insert */
 	int               count;          /* Number of entries in this table */
-	mrhashelem_t*     first;          /* The first element of the array */
-	int               htsize;         /* Number of buckets in the hash table */
-	struct _ht
-	{	/* the hash table */
-		int           count;          /* Number of entries with this hash */
-		mrhashelem_t* chain;          /* Pointer to first entry with this hash */
-	} *ht;
+	int               used;           /* Number of used elements in the array, including removed ones */
+	int               alloc;          /* Number of elements the array has room for, a power of 2; the index has twice as many slots */
+	mrhashelem_t*     elems;          /* The elements in the order of insertion, followed by a sentinel */
+	int*              index;          /* Indices into elems, -1 for empty slots, points into the allocation of elems */
 } mrhash_t;
 
 
 /* Each element in the hash table is an instance of the following
- * structure.  All elements are stored on a single doubly-linked list.
+ * structure.  Removed elements have data set to NULL.
  *
  * Again, this structure is intended to be opaque, but it can't really
  * be opaque because it is used by macros.
  */
 typedef struct mrhashelem_t
 {
-	mrhashelem_t      *next, *prev;   /* Next and previous elements in the table */
 	void*             data;           /* Data associated with this element */
 	void*             pKey;           /* Key associated with this element */
 	int               nKey;           /* Key associated with this element */
+	unsigned int      h;              /* Hash of the key, compared before the key itself */
 } mrhashelem_t;
 
 
@@ -101,6 +102,8 @@ void    mrhash_init     (mrhash_t*, int keytype, int copyKey);
 void*   mrhash_insert   (mrhash_t*, const void *pKey, int nKey, void *pData);
 void*   mrhash_find     (const mrhash_t*, const void *pKey, int nKey);
 void    mrhash_clear    (mrhash_t*);
+mrhashelem_t* mrhash_first_elem_(const mrhash_t*);
+mrhashelem_t* mrhash_next_elem_ (const mrhashelem_t*);
 
 
 /*
@@ -115,8 +118,8 @@ void    mrhash_clear    (mrhash_t*);
  *     // do something with pData
  *   }
  */
-#define mrhash_first(H)      ((H)->first)
-#define mrhash_next(E)       ((E)->next)
+#define mrhash_first(H)      mrhash_first_elem_(H)
+#define mrhash_next(E)       mrhash_next_elem_(E)
 #define mrhash_data(E)       ((E)->data)
 #define mrhash_key(E)        ((E)->pKey)
 #define mrhash_keysize(E)    ((E)->nKey)
@@ -74,16 +74,17 @@ static int is_error(mrimap_t* ths, int code)
 }
 
 
-static void get_config_lastseenuid(mrimap_t* imap, const char* folder, uint32_t* uidvalidity, uint32_t* lastseenuid)
+static void get_config_lastseenuid(mrimap_t* imap, const char* folder, uint32_t* uidvalidity, uint32_t* lastseenuid, uint64_t* modseq)
 {
 	*uidvalidity = 0;
 	*lastseenuid = 0;
+	*modseq      = 0;
 
 	char* key = mr_mprintf("imap.mailbox.%s", folder);
 	char* val1 = imap->m_get_config(imap, key, NULL), *val2 = NULL, *val3 = NULL;
 	if( val1 )
 	{
-		/* the entry has the format `imap.mailbox.<folder>=<uidvalidity>:<lastseenuid>` */
+		/* the entry has the format `imap.mailbox.<folder>=<uidvalidity>:<lastseenuid>:<modseq>`, the HIGHESTMODSEQ (RFC 7162) was added later and may be missing */
 		val2 = strchr(val1, ':');
 		if( val2 )
 		{
@@ -91,7 +92,11 @@ static void get_config_lastseenuid(mrimap_t* imap, const char* folder, uint32_t*
 			val2++;
 
 			val3 = strchr(val2, ':');
-			if( val3 ) { *val3 = 0; /* ignore everything bethind an optional second colon to allow future enhancements */ }
+			if( val3 ) {
+				*val3 = 0;
+				val3++;
+				*modseq = strtoull(val3, NULL, 10); /* stops at an optional further colon, allowing future enhancements */
+			}
 
 			*uidvalidity = atol(val1);
 			*lastseenuid = atol(val2);
@@ -102,10 +107,10 @@ static void get_config_lastseenuid(mrimap_t* imap, const char* folder, uint32_t*
 }
 
 
-static void set_config_lastseenuid(mrimap_t* imap, const char* folder, uint32_t uidvalidity, uint32_t lastseenuid)
+static void set_config_lastseenuid(mrimap_t* imap, const char* folder, uint32_t uidvalidity, uint32_t lastseenuid, uint64_t modseq)
 {
 	char* key = mr_mprintf("imap.mailbox.%s", folder);
-	char* val = mr_mprintf("%lu:%lu", uidvalidity, lastseenuid);
+	char* val = mr_mprintf("%lu:%lu:%llu", uidvalidity, lastseenuid, (unsigned long long)modseq);
 	imap->m_set_config(imap, key, val);
 	free(val);
 	free(key);
@@ -398,11 +403,13 @@ static int select_folder__(mrimap_t* ths, const char* folder /*may be NULL*/)
 		ths->m_selected_folder_needs_expunge = 0;
 	}
 
-	/* select new folder */
+	/* select new folder; if possible, with CONDSTORE to get the HIGHESTMODSEQ */
+	ths->m_selected_modseq = 0;
 	if( folder ) {
-		int r = mailimap_select(ths->m_hEtpan, folder);
+		int r = ths->m_has_condstore? mailimap_select_condstore(ths->m_hEtpan, folder, &ths->m_selected_modseq) : mailimap_select(ths->m_hEtpan, folder);
 		if( is_error(ths, r) || ths->m_hEtpan->imap_selection_info == NULL ) {
 			ths->m_selected_folder[0] = 0;
+			ths->m_selected_modseq = 0;
 			return 0;
 		}
 	}
@@ -486,6 +493,29 @@ static uint32_t peek_uid(struct mailimap_msg_att* msg_att)
 }
 
 
+static uint64_t peek_modseq(struct mailimap_msg_att* msg_att)
+{
+	/* search the MODSEQ (RFC 7162) in a list of attributes returned by a FETCH command */
+	clistiter* iter1;
+	for( iter1=clist_begin(msg_att->att_list); iter1!=NULL; iter1=clist_next(iter1) )
+	{
+		struct mailimap_msg_att_item* item = (struct mailimap_msg_att_item*)clist_content(iter1);
+		if( item && item->att_type == MAILIMAP_MSG_ATT_ITEM_EXTENSION && item->att_data.att_extension_data )
+		{
+			struct mailimap_extension_data* ext_data = item->att_data.att_extension_data;
+			if( ext_data->ext_extension->ext_id == MAILIMAP_EXTENSION_CONDSTORE
+			 && ext_data->ext_type == MAILIMAP_CONDSTORE_TYPE_FETCH_DATA
+			 && ext_data->ext_data )
+			{
+				return ((struct mailimap_condstore_fetch_mod_resp*)ext_data->ext_data)->cs_modseq_value;
+			}
+		}
+	}
+
+	return 0;
+}
+
+
 static char* unquote_rfc724_mid(const char* in)
 {
 	/* remove < and > from the given message id */
@@ -618,91 +648,222 @@ static void peek_body(struct mailimap_msg_att* msg_att, char** p_msg, size_t* p_
 }
 
 
-static int fetch_single_msg(mrimap_t* ths, const char* folder, uint32_t server_uid, int block_idle)
+typedef struct mrimapbatch_t
+{
+	mrimap_t*   m_imap;
+	const char* m_folder;
+	uint32_t    m_last_uid; /* the largest UID reported by the server so far */
+} mrimapbatch_t;
+
+
+static void fetch_msg_batch_handler(struct mailimap_msg_att* msg_att, void* context)
+{
+	/* called by libetpan from within mailimap_uid_fetch() each time a message has been read completely from the stream;
+	msg_att is freed by libetpan after we return, so the memory used is bounded by the largest message, not by the batch. */
+	mrimapbatch_t* batch = (mrimapbatch_t*)context;
+	char*          msg_content = NULL;
+	size_t         msg_bytes = 0;
+	uint32_t       flags = 0;
+	int            deleted = 0;
+	uint32_t       server_uid = peek_uid(msg_att);
+
+	if( server_uid > batch->m_last_uid ) {
+		batch->m_last_uid = server_uid;
+	}
+
+	peek_body(msg_att, &msg_content, &msg_bytes, &flags, &deleted);
+	if( server_uid == 0 || msg_content == NULL  || msg_bytes <= 0 || deleted ) {
+		/* mrmailbox_log_warning(ths->m_mailbox, 0, "Message #%i in folder \"%s\" is empty or deleted.", (int)server_uid, folder); -- this is a quite usual situation, do not print a warning */
+		return;
+	}
+
+	batch->m_imap->m_receive_imf(batch->m_imap, msg_content, msg_bytes, batch->m_folder, server_uid, flags);
+}
+
+
+static void fetch_msg_batch_progress(size_t current, size_t maximum, void* context)
+{
+	/* nothing to do; however, libetpan calls the handler set by mailimap_set_msg_att_handler() only if a progress callback is set */
+}
+
+
+static int fetch_msg_batch(mrimap_t* ths, const char* folder, uint32_t first_uid, uint32_t last_uid, uint32_t* ret_last_uid)
 {
-	/* the function returns:
+	/* fetch the bodies of all messages with UIDs between first_uid and last_uid (`UID FETCH first:last BODY.PEEK[]`)
+	in a single round trip; each message is handed over to m_receive_imf() as soon as it is parsed from the response,
+	before the function returns, m_flush_imf() makes sure, all messages are in the database.
+	the function returns:
 	    0  the caller should try over again later
-	or  1  if the messages should be treated as received, the caller should not try to read the message again (even if no database entries are returned) */
-	char*       msg_content = NULL;
-	size_t      msg_bytes = 0;
-	int         r, retry_later = 0, deleted = 0, handle_locked = 0, idle_blocked = 0;
-	uint32_t    flags = 0;
-	clist*      fetch_result = NULL;
-	clistiter*  cur;
+	or  1  if the messages should be treated as received, the caller should not try to read the messages again (even if no database entries are returned)
+	or  2  if the server answered the command with an error; the messages up to *ret_last_uid were received, the others should be fetched one by one */
+	int           r, retry_later = 0, server_error = 0, handle_locked = 0;
+	clist*        fetch_result = NULL;
+	mrimapbatch_t batch;
 
 	if( ths==NULL ) {
 		goto cleanup;
 	}
 
+	batch.m_imap     = ths;
+	batch.m_folder   = folder;
+	batch.m_last_uid = 0;
+
 	LOCK_HANDLE
 
 		if( ths->m_hEtpan==NULL ) {
+			retry_later = 1; /* not connected, this says nothing about the messages */
 			goto cleanup;
 		}
 
-		if( block_idle ) {
-			BLOCK_IDLE
-			INTERRUPT_IDLE
-			setup_handle_if_needed__(ths);
-			forget_folder_selection__(ths);
-			select_folder__(ths, folder); /* if we need to block IDLE, we'll also need to select the folder as it may have changed by IDLE */
-		}
-
 		{
-			struct mailimap_set* set = mailimap_set_new_single(server_uid);
-				r = mailimap_uid_fetch(ths->m_hEtpan, set, ths->m_fetch_type_body, &fetch_result);
+			struct mailimap_set* set = mailimap_set_new_interval(first_uid, last_uid);
+				mailimap_set_progress_callback(ths->m_hEtpan, NULL, fetch_msg_batch_progress, NULL);
+				mailimap_set_msg_att_handler(ths->m_hEtpan, fetch_msg_batch_handler, &batch);
+					r = mailimap_uid_fetch(ths->m_hEtpan, set, ths->m_fetch_type_body, &fetch_result); /* messages that do not exist (any longer) are simply not reported to the handler */
+				mailimap_set_msg_att_handler(ths->m_hEtpan, NULL, NULL);
+				mailimap_set_progress_callback(ths->m_hEtpan, NULL, NULL, NULL);
 			mailimap_set_free(set);
 		}
 
-		if( block_idle ) {
-			UNBLOCK_IDLE
-		}
-
 	UNLOCK_HANDLE
 
+	/* messages passed to the handler are not added to fetch_result; if the handler was not used for any reason, handle the messages here */
+	if( !is_error(ths, r) && fetch_result ) {
+		clistiter* cur;
+		for( cur = clist_begin(fetch_result); cur != NULL ; cur = clist_next(cur) ) {
+			fetch_msg_batch_handler((struct mailimap_msg_att*)clist_content(cur), &batch);
+		}
+	}
+
 	if( is_error(ths, r) || fetch_result == NULL ) {
 		fetch_result = NULL;
-		mrmailbox_log_warning(ths->m_mailbox, 0, "Error #%i on fetching message #%i from folder \"%s\"; retry=%i.", (int)r, (int)server_uid, folder, (int)ths->m_should_reconnect);
+		mrmailbox_log_warning(ths->m_mailbox, 0, "Error #%i on fetching messages #%i-#%i from folder \"%s\"; retry=%i.", (int)r, (int)first_uid, (int)last_uid, folder, (int)ths->m_should_reconnect);
 		if( ths->m_should_reconnect ) {
-			retry_later = 1; /* maybe we should also retry on other errors, however, we should check this carefully, as this may result in a dead lock! */
+			retry_later = 1; /* the caller should try over later to fetch the messages again (if there are no such messages, we simply get an empty result) */
+		}
+		else {
+			server_error = 1; /* eg. a tagged NO/BAD for a single broken message; retrying the whole batch may result in a dead lock, so the caller goes on one by one */
+		}
+		goto cleanup;
+	}
+
+cleanup:
+	UNLOCK_HANDLE
+
+	if( ths && ths->m_flush_imf ) {
+		if( !ths->m_flush_imf(ths) ) { /* also on errors, the messages received so far should be added */
+			retry_later = 1;
 		}
-		goto cleanup; /* this is an error that should be recovered; the caller should try over later to fetch the message again (if there is no such message, we simply get an empty result) */
 	}
 
-	if( (cur=clist_begin(fetch_result)) == NULL ) {
-		mrmailbox_log_warning(ths->m_mailbox, 0, "Message #%i does not exist in folder \"%s\".", (int)server_uid, folder);
-		goto cleanup; /* server response is fine, however, there is no such message, do not try to fetch the message again */
+	if( fetch_result ) {
+		mailimap_fetch_list_free(fetch_result);
 	}
 
-	struct mailimap_msg_att* msg_att = (struct mailimap_msg_att*)clist_content(cur);
-	peek_body(msg_att, &msg_content, &msg_bytes, &flags, &deleted);
-	if( msg_content == NULL  || msg_bytes <= 0 || deleted ) {
-		/* mrmailbox_log_warning(ths->m_mailbox, 0, "Message #%i in folder \"%s\" is empty or deleted.", (int)server_uid, folder); -- this is a quite usual situation, do not print a warning */
+	if( ret_last_uid ) {
+		*ret_last_uid = batch.m_last_uid;
+	}
+	return retry_later? 0 : (server_error? 2 : 1);
+}
+
+
+static int fetch_changed_flags__(mrimap_t* ths, uint32_t lastseenuid, uint64_t* modseq, mrarray_t* seen_uids, mrarray_t* gone_uid_ranges)
+{
+	/* get the flags of the messages in the selected folder that were changed since the given HIGHESTMODSEQ
+	(`UID FETCH 1:lastseenuid (FLAGS) (CHANGEDSINCE modseq VANISHED)`, see RFC 7162).  Seen messages are added to seen_uids,
+	messages flagged as deleted and, if QRESYNC is enabled, expunged messages are added to gone_uid_ranges as pairs of the first and the last UID.
+	On success, modseq is updated to the new HIGHESTMODSEQ. */
+	int                               r, success = 0;
+	clist*                            fetch_result = NULL;
+	clistiter*                        cur;
+	struct mailimap_qresync_vanished* vanished = NULL;
+	uint64_t                          new_modseq = *modseq;
+
+	{
+		struct mailimap_set* set = mailimap_set_new_interval(1, lastseenuid);
+			if( ths->m_qresync_enabled ) {
+				r = mailimap_uid_fetch_qresync(ths->m_hEtpan, set, ths->m_fetch_type_flags, *modseq, &fetch_result, &vanished);
+			}
+			else {
+				r = mailimap_uid_fetch_changedsince(ths->m_hEtpan, set, ths->m_fetch_type_flags, *modseq, &fetch_result);
+			}
+		mailimap_set_free(set);
+	}
+
+	if( is_error(ths, r) || fetch_result == NULL ) {
+		mrmailbox_log_warning(ths->m_mailbox, 0, "Cannot fetch changed flags. (Error #%i)", (int)r);
 		goto cleanup;
 	}
 
-	ths->m_receive_imf(ths, msg_content, msg_bytes, folder, server_uid, flags);
+	for( cur = clist_begin(fetch_result); cur != NULL ; cur = clist_next(cur) )
+	{
+		struct mailimap_msg_att* msg_att = (struct mailimap_msg_att*)clist_content(cur);
+		char*    msg_content = NULL; /* not requested, peek_body() is only used for the flags */
+		size_t   msg_bytes = 0;
+		uint32_t flags = 0;
+		int      deleted = 0;
+		uint32_t server_uid = peek_uid(msg_att);
+		uint64_t msg_modseq = peek_modseq(msg_att);
+
+		if( msg_modseq > new_modseq ) {
+			new_modseq = msg_modseq;
+		}
 
-cleanup:
-	if( block_idle ) {
-		UNBLOCK_IDLE
+		peek_body(msg_att, &msg_content, &msg_bytes, &flags, &deleted);
+		if( server_uid == 0 ) {
+			continue;
+		}
+
+		if( deleted ) {
+			mrarray_add_id(gone_uid_ranges, server_uid);
+			mrarray_add_id(gone_uid_ranges, server_uid);
+		}
+		else if( flags&MR_IMAP_SEEN ) {
+			mrarray_add_id(seen_uids, server_uid);
+		}
+	}
+
+	if( vanished && vanished->qr_known_uids && vanished->qr_known_uids->set_list ) {
+		for( cur = clist_begin(vanished->qr_known_uids->set_list); cur != NULL ; cur = clist_next(cur) ) {
+			struct mailimap_set_item* item = (struct mailimap_set_item*)clist_content(cur);
+			mrarray_add_id(gone_uid_ranges, item->set_first);
+			mrarray_add_id(gone_uid_ranges, item->set_last? item->set_last : lastseenuid /* `*`, should not happen for VANISHED */);
+		}
 	}
-	UNLOCK_HANDLE
 
+	/* expunges increase the HIGHESTMODSEQ but are not reported with a MODSEQ, so also use the value from the SELECT */
+	if( ths->m_selected_modseq > new_modseq ) {
+		new_modseq = ths->m_selected_modseq;
+	}
+
+	*modseq = new_modseq;
+	success = 1;
+
+cleanup:
+	if( vanished ) {
+		mailimap_qresync_vanished_free(vanished);
+	}
 	if( fetch_result ) {
 		mailimap_fetch_list_free(fetch_result);
 	}
-	return retry_later? 0 : 1;
+	return success;
 }
 
 
 static int fetch_from_single_folder(mrimap_t* ths, const char* folder)
 {
+	#define              FETCH_BATCH_MSGS 100 /* number of message bodies requested by a single `UID FETCH`; lastseenuid is checkpointed after each batch */
 	int                  r, handle_locked = 0;
 	uint32_t             uidvalidity = 0;
-	uint32_t             lastseenuid = 0, new_lastseenuid = 0;
+	uint32_t             lastseenuid = 0;
+	uint64_t             modseq = 0;
+	int                  flags_fetched = 0;
+	mrarray_t*           seen_uids = NULL;
+	mrarray_t*           gone_uid_ranges = NULL;
 	clist*               fetch_result = NULL;
-	size_t               read_cnt = 0, read_errors = 0;
+	mrarray_t*           uids = NULL;
+	size_t               read_cnt = 0, read_errors = 0, batch_start, batch_cnt, uid_cnt, i;
+	uint32_t             batch_last_uid;
 	clistiter*           cur;
 	struct mailimap_set* set;
 
@@ -723,7 +884,7 @@ static int fetch_from_single_folder(mrimap_t* ths, const char* folder)
 		}
 
 		/* compare last seen UIDVALIDITY against the current one */
-		get_config_lastseenuid(ths, folder, &uidvalidity, &lastseenuid);
+		get_config_lastseenuid(ths, folder, &uidvalidity, &lastseenuid, &modseq);
 		if( uidvalidity != ths->m_hEtpan->imap_selection_info->sel_uidvalidity )
 		{
 			/* first time this folder is selected or UIDVALIDITY has changed, init lastseenuid and save it to config */
@@ -769,9 +930,23 @@ static int fetch_from_single_folder(mrimap_t* ths, const char* folder)
 				lastseenuid -= 1;
 			}
 
-			/* store calculated uidvalidity/lastseenuid */
+			/* store calculated uidvalidity/lastseenuid; flag changes are tracked from now on */
 			uidvalidity = ths->m_hEtpan->imap_selection_info->sel_uidvalidity;
-			set_config_lastseenuid(ths, folder, uidvalidity, lastseenuid);
+			modseq = ths->m_selected_modseq;
+			set_config_lastseenuid(ths, folder, uidvalidity, lastseenuid, modseq);
+		}
+		else if( ths->m_has_condstore && ths->m_selected_modseq > 0 /*0=NOMODSEQ, the folder does not support CONDSTORE*/ )
+		{
+			/* get the flags changed by other devices since the last fetch; messages after lastseenuid are fetched below anyway */
+			seen_uids = mrarray_new(ths->m_mailbox, 16);
+			gone_uid_ranges = mrarray_new(ths->m_mailbox, 16);
+			if( modseq == 0 ) {
+				modseq = ths->m_selected_modseq; /* first fetch with CONDSTORE, the flags of the messages received before are not synced */
+				flags_fetched = 1;
+			}
+			else if( lastseenuid > 0 ) {
+				flags_fetched = fetch_changed_flags__(ths, lastseenuid, &modseq, seen_uids, gone_uid_ranges);
+			}
 		}
 
 		/* fetch messages with larger UID than the last one seen (`UID FETCH lastseenuid+1:*)`, see RFC 4549 */
@@ -781,6 +956,14 @@ static int fetch_from_single_folder(mrimap_t* ths, const char* folder)
 
 	UNLOCK_HANDLE
 
+	if( flags_fetched ) {
+		if( mrarray_get_cnt(seen_uids) > 0 || mrarray_get_cnt(gone_uid_ranges) > 0 ) {
+			mrmailbox_log_info(ths->m_mailbox, 0, "%i messages seen and %i UID ranges gone in \"%s\".", (int)mrarray_get_cnt(seen_uids), (int)mrarray_get_cnt(gone_uid_ranges)/2, folder);
+			ths->m_sync_flags(ths, folder, seen_uids, gone_uid_ranges);
+		}
+		set_config_lastseenuid(ths, folder, uidvalidity, lastseenuid, modseq); /* only after the changes are applied, so they are fetched again if we get interrupted */
+	}
+
 	if( is_error(ths, r) || fetch_result == NULL )
 	{
 		fetch_result = NULL;
@@ -792,27 +975,74 @@ static int fetch_from_single_folder(mrimap_t* ths, const char* folder)
 		goto cleanup;
 	}
 
-	/* go through all mails in folder (this is typically _fast_ as we already have the whole list) */
+	/* collect the UIDs of all mails in folder (this is typically _fast_ as we already have the whole list) */
+	uids = mrarray_new(ths->m_mailbox, 128);
 	for( cur = clist_begin(fetch_result); cur != NULL ; cur = clist_next(cur) )
 	{
 		struct mailimap_msg_att* msg_att = (struct mailimap_msg_att*)clist_content(cur); /* mailimap_msg_att is a list of attributes: list is a list of message attributes */
 		uint32_t cur_uid = peek_uid(msg_att);
-		if( cur_uid > 0
-		 && cur_uid!=lastseenuid /* `UID FETCH <lastseenuid+1>:*` may include lastseenuid if "*" == lastseenuid */ )
-		{
-			read_cnt++;
-			if( fetch_single_msg(ths, folder, cur_uid, 0) == 0/* 0=try again later*/ ) {
-				read_errors++;
+		if( cur_uid > lastseenuid /* `UID FETCH <lastseenuid+1>:*` may include lastseenuid if "*" == lastseenuid */ ) {
+			mrarray_add_id(uids, cur_uid);
+		}
+	}
+	mailimap_fetch_list_free(fetch_result);
+	fetch_result = NULL;
+	mrarray_sort_ids(uids);
+
+	/* download the messages in batches of ascending UIDs; as UIDs are strictly ascending, the interval `first:last` does not
+	contain UIDs we have not seen in the list above.  After each batch, lastseenuid is saved, so an interrupted sync resumes at this point. */
+	uid_cnt = mrarray_get_cnt(uids);
+	for( batch_start = 0; batch_start < uid_cnt; batch_start += batch_cnt )
+	{
+		batch_cnt = uid_cnt-batch_start;
+		if( batch_cnt > FETCH_BATCH_MSGS ) {
+			batch_cnt = FETCH_BATCH_MSGS;
+		}
+
+		uint32_t first_uid = mrarray_get_id(uids, batch_start);
+		uint32_t last_uid  = mrarray_get_id(uids, batch_start+batch_cnt-1);
+		read_cnt += batch_cnt;
+
+		r = fetch_msg_batch(ths, folder, first_uid, last_uid, &batch_last_uid);
+		if( r == 0/* 0=try again later*/ ) {
+			read_errors += batch_cnt;
+			break; /* the connection is probably lost, go on with the next fetch */
+		}
+		else if( r == 2 ) {
+			/* the server refused the batch; a single message must not make us skip the whole batch,
+			so fetch the messages not received so far one by one and treat only those failing again as received */
+			if( batch_last_uid >= first_uid ) {
+				set_config_lastseenuid(ths, folder, uidvalidity, batch_last_uid, modseq);
 			}
-			else if( cur_uid > new_lastseenuid ) {
-				new_lastseenuid = cur_uid;
+
+			for( i = batch_start; i < batch_start+batch_cnt; i++ ) {
+				uint32_t cur_uid = mrarray_get_id(uids, i);
+				if( cur_uid <= batch_last_uid ) {
+					continue;
+				}
+
+				r = fetch_msg_batch(ths, folder, cur_uid, cur_uid, NULL);
+				if( r == 0 ) {
+					break;
+				}
+				else if( r == 2 ) {
+					read_errors++;
+				}
+
+				set_config_lastseenuid(ths, folder, uidvalidity, cur_uid, modseq);
 			}
 
+			if( r == 0 ) {
+				read_errors += batch_start+batch_cnt-i;
+				break;
+			}
 		}
-	}
 
-	if( !read_errors && new_lastseenuid > 0 ) {
-		set_config_lastseenuid(ths, folder, uidvalidity, new_lastseenuid);
+		set_config_lastseenuid(ths, folder, uidvalidity, last_uid, modseq);
+
+		if( ths->m_watch_do_exit ) {
+			break; /* the remaining messages are fetched on the next connect */
+		}
 	}
 
 	/* done */
@@ -834,6 +1064,9 @@ cleanup:
 		mailimap_fetch_list_free(fetch_result);
 	}
 
+	mrarray_unref(uids);
+	mrarray_unref(seen_uids);
+	mrarray_unref(gone_uid_ranges);
 	return read_cnt;
 }
 
@@ -1182,6 +1415,208 @@ cleanup:
  ******************************************************************************/
 
 
+/* mailstream_low driver that counts the bytes read from and written to the
+wrapped stream.  It is put below and above the COMPRESS=DEFLATE layer; we cannot
+use the loggers of the streams for this as the compression layer calls the driver
+it wraps directly. */
+typedef struct mrcountinglow_t
+{
+	mailstream_low*  m_inner;
+	uint64_t*        m_bytes;
+	pthread_mutex_t* m_bytes_critical;
+} mrcountinglow_t;
+
+
+static ssize_t counting_low_read(mailstream_low* s, void* buf, size_t count)
+{
+	mrcountinglow_t* data = (mrcountinglow_t*)s->data;
+	ssize_t r = mailstream_low_read(data->m_inner, buf, count);
+	if( r > 0 ) {
+		pthread_mutex_lock(data->m_bytes_critical);
+			*data->m_bytes += r;
+		pthread_mutex_unlock(data->m_bytes_critical);
+	}
+	return r;
+}
+
+
+static ssize_t counting_low_write(mailstream_low* s, const void* buf, size_t count)
+{
+	mrcountinglow_t* data = (mrcountinglow_t*)s->data;
+	ssize_t r = mailstream_low_write(data->m_inner, buf, count);
+	if( r > 0 ) {
+		pthread_mutex_lock(data->m_bytes_critical);
+			*data->m_bytes += r;
+		pthread_mutex_unlock(data->m_bytes_critical);
+	}
+	return r;
+}
+
+
+static int counting_low_close(mailstream_low* s)
+{
+	return mailstream_low_close(((mrcountinglow_t*)s->data)->m_inner);
+}
+
+
+static int counting_low_get_fd(mailstream_low* s)
+{
+	return mailstream_low_get_fd(((mrcountinglow_t*)s->data)->m_inner);
+}
+
+
+static void counting_low_free(mailstream_low* s)
+{
+	mrcountinglow_t* data = (mrcountinglow_t*)s->data;
+	mailstream_low_free(data->m_inner);
+	free(data);
+	free(s);
+}
+
+
+static void counting_low_cancel(mailstream_low* s)
+{
+	mailstream_low_cancel(((mrcountinglow_t*)s->data)->m_inner);
+}
+
+
+static struct mailstream_cancel* counting_low_get_cancel(mailstream_low* s)
+{
+	return mailstream_low_get_cancel(((mrcountinglow_t*)s->data)->m_inner);
+}
+
+
+static carray* counting_low_get_certificate_chain(mailstream_low* s)
+{
+	return mailstream_low_get_certificate_chain(((mrcountinglow_t*)s->data)->m_inner);
+}
+
+
+static int counting_low_setup_idle(mailstream_low* s)
+{
+	return mailstream_low_setup_idle(((mrcountinglow_t*)s->data)->m_inner);
+}
+
+
+static int counting_low_unsetup_idle(mailstream_low* s)
+{
+	return mailstream_low_unsetup_idle(((mrcountinglow_t*)s->data)->m_inner);
+}
+
+
+static int counting_low_interrupt_idle(mailstream_low* s)
+{
+	return mailstream_low_interrupt_idle(((mrcountinglow_t*)s->data)->m_inner);
+}
+
+
+static mailstream_low_driver s_counting_low_driver = {
+	counting_low_read,
+	counting_low_write,
+	counting_low_close,
+	counting_low_get_fd,
+	counting_low_free,
+	counting_low_cancel,
+	counting_low_get_cancel,
+	counting_low_get_certificate_chain,
+	counting_low_setup_idle,
+	counting_low_unsetup_idle,
+	counting_low_interrupt_idle
+};
+
+
+static void push_counting_low(mailstream* stream, uint64_t* bytes, pthread_mutex_t* bytes_critical)
+{
+	mailstream_low*  inner = mailstream_get_low(stream);
+	mrcountinglow_t* data = calloc(1, sizeof(mrcountinglow_t));
+	if( data == NULL ) {
+		exit(72);
+	}
+	data->m_inner = inner;
+	data->m_bytes = bytes;
+	data->m_bytes_critical = bytes_critical;
+
+	mailstream_low* s = mailstream_low_new(data, &s_counting_low_driver);
+	if( s == NULL ) {
+		exit(73);
+	}
+	mailstream_low_set_timeout(s, mailstream_low_get_timeout(inner));
+	mailstream_set_low(stream, s);
+}
+
+
+static void pop_counting_low(mailstream* stream)
+{
+	/* remove the counting layer on top of the stream without closing the stream it wraps */
+	mailstream_low* s = mailstream_get_low(stream);
+	if( s && s->driver == &s_counting_low_driver ) {
+		mrcountinglow_t* data = (mrcountinglow_t*)s->data;
+		mailstream_set_low(stream, data->m_inner);
+		free(data);
+		free(s);
+	}
+}
+
+
+static int compress_if_possible__(mrimap_t* ths)
+{
+	/* COMPRESS=DEFLATE (RFC 4978) must be requested after login on each connection; we count the bytes below and above the compression
+	layer so that the savings can be shown in mrmailbox_get_info().
+	returns 0 if the connection cannot be used any longer and must be set up again */
+	ths->m_compress_enabled = 0;
+
+	char* compress_str = ths->m_get_config(ths, "imap_compress", NULL);
+	int   compress = compress_str? atoi(compress_str) : MR_IMAP_COMPRESS_DEFAULT;
+	free(compress_str);
+	if( !compress || ths->m_compress_failed || !mailimap_has_compress_deflate(ths->m_hEtpan) ) {
+		return 1;
+	}
+
+	push_counting_low(ths->m_hEtpan->imap_stream, &ths->m_bytes_compressed, &ths->m_bytes_critical);
+		int r = mailimap_compress(ths->m_hEtpan);
+		if( is_error(ths, r) ) {
+			pop_counting_low(ths->m_hEtpan->imap_stream); /* the stream is not wrapped by the compression layer on errors */
+			if( r == MAILIMAP_ERROR_EXTENSION ) {
+				mrmailbox_log_warning(ths->m_mailbox, 0, "Cannot enable IMAP-compression. (Error #%i)", (int)r);
+				return 1; /* the server refused, the connection is fine without compression */
+			}
+			/* the server may have agreed and expects compressed data now, eg. if libetpan cannot create the compression layer
+			as it is built without zlib; the state of the connection is unknown, reconnect without compression */
+			mrmailbox_log_warning(ths->m_mailbox, 0, "Cannot enable IMAP-compression, reconnecting without. (Error #%i)", (int)r);
+			ths->m_compress_failed = 1;
+			return 0;
+		}
+	push_counting_low(ths->m_hEtpan->imap_stream, &ths->m_bytes_uncompressed, &ths->m_bytes_critical);
+
+	ths->m_compress_enabled = 1;
+	mrmailbox_log_info(ths->m_mailbox, 0, "IMAP-compression enabled.");
+	return 1;
+}
+
+
+void mrimap_get_bytes(mrimap_t* ths, uint64_t* ret_bytes_uncompressed, uint64_t* ret_bytes_compressed)
+{
+	*ret_bytes_uncompressed = 0;
+	*ret_bytes_compressed   = 0;
+
+	if( ths == NULL ) {
+		return;
+	}
+
+	pthread_mutex_lock(&ths->m_bytes_critical);
+		*ret_bytes_uncompressed = ths->m_bytes_uncompressed;
+		*ret_bytes_compressed   = ths->m_bytes_compressed;
+	pthread_mutex_unlock(&ths->m_bytes_critical);
+
+	if( ths->m_job_session ) {
+		uint64_t job_uncompressed, job_compressed;
+		mrimap_get_bytes(ths->m_job_session, &job_uncompressed, &job_compressed);
+		*ret_bytes_uncompressed += job_uncompressed;
+		*ret_bytes_compressed   += job_compressed;
+	}
+}
+
+
 static int setup_handle_if_needed__(mrimap_t* ths)
 {
 	int r, success = 0;
@@ -1204,6 +1639,7 @@ static int setup_handle_if_needed__(mrimap_t* ths)
 		goto cleanup;
 	}
 
+reconnect:
 	ths->m_hEtpan = mailimap_new(0, NULL);
 
 	mailimap_set_timeout(ths->m_hEtpan, 30); /* 30 seconds until actions are aborted, this is also used in mailcore2 */
@@ -1265,6 +1701,29 @@ static int setup_handle_if_needed__(mrimap_t* ths)
 
 	mrmailbox_log_info(ths->m_mailbox, 0, "IMAP-Login ok.");
 
+	/* QRESYNC must be enabled for each connection (RFC 7162, RFC 5161) */
+	ths->m_qresync_enabled = 0;
+	if( mailimap_has_qresync(ths->m_hEtpan) && mailimap_has_enable(ths->m_hEtpan) )
+	{
+		struct mailimap_capability_data* result = NULL;
+		clist* cap_list = clist_new();
+		clist_append(cap_list, mailimap_capability_new(MAILIMAP_CAPABILITY_NAME, NULL, strdup("QRESYNC")));
+		struct mailimap_capability_data* caps = mailimap_capability_data_new(cap_list);
+			r = mailimap_enable(ths->m_hEtpan, caps, &result);
+			if( !is_error(ths, r) ) {
+				ths->m_qresync_enabled = 1;
+			}
+		mailimap_capability_data_free(caps);
+		if( result ) {
+			mailimap_capability_data_free(result);
+		}
+	}
+
+	if( !compress_if_possible__(ths) ) {
+		unsetup_handle__(ths);
+		goto reconnect; /* compression is not tried again as m_compress_failed is set now */
+	}
+
 	success = 1;
 
 cleanup:
@@ -1304,6 +1763,9 @@ static void unsetup_handle__(mrimap_t* ths)
 	}
 
 	ths->m_selected_folder[0] = 0;
+	ths->m_selected_modseq = 0;
+	ths->m_qresync_enabled = 0;
+	ths->m_compress_enabled = 0;
 
 	/* we leave m_sent_folder set; normally this does not change in a normal reconnect; we'll update this folder if we get errors */
 }
@@ -1314,6 +1776,77 @@ static void unsetup_handle__(mrimap_t* ths)
  ******************************************************************************/
 
 
+static int connect_job_session(mrimap_t* ths)
+{
+	/* make sure, the job session is logged in; returns 0 if the job session is not enabled or if it cannot be used for the moment,
+	the job actions use the connection of the watch thread then.  The job session reconnects independently from the watch thread. */
+	int handle_locked = 0, success = 0;
+
+	LOCK_HANDLE
+
+		if( !ths->m_connected ) {
+			goto cleanup;
+		}
+
+		if( ths->m_hEtpan && !ths->m_should_reconnect ) {
+			success = 1;
+			goto cleanup;
+		}
+
+		if( time(NULL) < ths->m_reconnect_not_before ) {
+			goto cleanup;
+		}
+
+		if( !setup_handle_if_needed__(ths) ) {
+			ths->m_reconnect_backoff = ths->m_reconnect_backoff? MR_MIN(ths->m_reconnect_backoff*2, 5*60) : 10;
+			ths->m_reconnect_not_before = time(NULL) + ths->m_reconnect_backoff;
+			mrmailbox_log_info(ths->m_mailbox, 0, "Cannot login the IMAP-job-session, using the IMAP-watch-session for %i seconds.", ths->m_reconnect_backoff);
+			goto cleanup;
+		}
+
+		ths->m_reconnect_backoff = 0;
+		ths->m_reconnect_not_before = 0;
+		success = 1;
+
+cleanup:
+	UNLOCK_HANDLE
+	return success;
+}
+
+
+static void disconnect_job_session(mrimap_t* ths)
+{
+	int handle_locked = 0;
+
+	if( ths==NULL ) {
+		return;
+	}
+
+	LOCK_HANDLE
+		unsetup_handle__(ths);
+		ths->m_connected = 0;
+	UNLOCK_HANDLE
+}
+
+
+static mrimap_t* session_for_jobs(mrimap_t* ths)
+{
+	if( ths->m_job_session && connect_job_session(ths->m_job_session) ) {
+		return ths->m_job_session;
+	}
+	return ths;
+}
+
+
+static void expunge_if_job_session__(mrimap_t* ths)
+{
+	/* the watch thread expunges when it selects INBOX again; the job session does not switch folders that often, so we expunge at once */
+	if( ths->m_is_job_session && ths->m_selected_folder_needs_expunge ) {
+		forget_folder_selection__(ths);
+	}
+}
+
+
 int mrimap_connect(mrimap_t* ths, const mrloginparam_t* lp)
 {
 	int success = 0, handle_locked = 0;
@@ -1344,6 +1877,8 @@ int mrimap_connect(mrimap_t* ths, const mrloginparam_t* lp)
 		/* we set the following flags here and not in setup_handle_if_needed__() as they must not change during connection */
 		ths->m_can_idle = mailimap_has_idle(ths->m_hEtpan);
 		ths->m_has_xlist = mailimap_has_xlist(ths->m_hEtpan);
+		ths->m_can_move = mailimap_has_extension(ths->m_hEtpan, "MOVE");
+		ths->m_has_condstore = mailimap_has_condstore(ths->m_hEtpan) || mailimap_has_qresync(ths->m_hEtpan); /* QRESYNC implies CONDSTORE */
 
 		#ifdef __APPLE__
 		ths->m_can_idle = 0; // HACK to force iOS not to work IMAP-IDLE which does not work for now, see also (*)
@@ -1369,6 +1904,28 @@ int mrimap_connect(mrimap_t* ths, const mrloginparam_t* lp)
 			free(capinfostr.m_buf);
 		}
 
+		/* prepare the job session, it logs in on the first job action */
+		char* job_session_str = ths->m_get_config(ths, "imap_job_session", NULL);
+		int   job_session = job_session_str? atoi(job_session_str) : MR_IMAP_JOB_SESSION_DEFAULT;
+		free(job_session_str);
+		if( job_session && ths->m_job_session ) {
+			mrimap_t* js = ths->m_job_session;
+			pthread_mutex_lock(&js->m_hEtpanmutex);
+				free(js->m_imap_server); js->m_imap_server  = safe_strdup(ths->m_imap_server);
+				                         js->m_imap_port    = ths->m_imap_port;
+				free(js->m_imap_user);   js->m_imap_user    = safe_strdup(ths->m_imap_user);
+				free(js->m_imap_pw);     js->m_imap_pw      = safe_strdup(ths->m_imap_pw);
+				                         js->m_server_flags = ths->m_server_flags;
+				js->m_has_xlist     = ths->m_has_xlist;
+				js->m_can_move      = ths->m_can_move;
+				js->m_has_condstore = ths->m_has_condstore;
+				js->m_can_idle      = 0; /* the job session never IDLEs, so there is nothing to interrupt */
+				js->m_reconnect_backoff    = 0;
+				js->m_reconnect_not_before = 0;
+				js->m_connected     = 1;
+			pthread_mutex_unlock(&js->m_hEtpanmutex);
+		}
+
 		mrmailbox_log_info(ths->m_mailbox, 0, "Starting IMAP-watch-thread...");
 		ths->m_watch_do_exit = 0;
 
@@ -1396,6 +1953,8 @@ void mrimap_disconnect(mrimap_t* ths)
 		return;
 	}
 
+	disconnect_job_session(ths->m_job_session);
+
 	LOCK_HANDLE
 		connected = (ths->m_hEtpan && ths->m_connected);
 	UNLOCK_HANDLE
@@ -1437,6 +1996,7 @@ void mrimap_disconnect(mrimap_t* ths)
 			unsetup_handle__(ths);
 			ths->m_can_idle  = 0;
 			ths->m_has_xlist = 0;
+			ths->m_has_condstore = 0;
 			ths->m_connected = 0;
 		UNLOCK_HANDLE
 	}
@@ -1454,7 +2014,7 @@ int mrimap_is_connected(mrimap_t* ths)
  ******************************************************************************/
 
 
-mrimap_t* mrimap_new(mr_get_config_t get_config, mr_set_config_t set_config, mr_receive_imf_t receive_imf, void* userData, mrmailbox_t* mailbox)
+static mrimap_t* session_new(mr_get_config_t get_config, mr_set_config_t set_config, mr_receive_imf_t receive_imf, mr_flush_imf_t flush_imf, mr_sync_flags_t sync_flags, void* userData, mrmailbox_t* mailbox)
 {
 	mrimap_t* ths = NULL;
 
@@ -1468,9 +2028,12 @@ mrimap_t* mrimap_new(mr_get_config_t get_config, mr_set_config_t set_config, mr_
 	ths->m_get_config     = get_config;
 	ths->m_set_config     = set_config;
 	ths->m_receive_imf    = receive_imf;
+	ths->m_flush_imf      = flush_imf;
+	ths->m_sync_flags     = sync_flags;
 	ths->m_userData       = userData;
 
 	pthread_mutex_init(&ths->m_hEtpanmutex, NULL);
+	pthread_mutex_init(&ths->m_bytes_critical, NULL);
 	pthread_mutex_init(&ths->m_idlemutex, NULL);
 	pthread_mutex_init(&ths->m_inwait_mutex, NULL);
 	pthread_mutex_init(&ths->m_watch_condmutex, NULL);
@@ -1511,6 +2074,19 @@ mrimap_t* mrimap_new(mr_get_config_t get_config, mr_set_config_t set_config, mr_
 }
 
 
+mrimap_t* mrimap_new(mr_get_config_t get_config, mr_set_config_t set_config, mr_receive_imf_t receive_imf, mr_flush_imf_t flush_imf, mr_sync_flags_t sync_flags, void* userData, mrmailbox_t* mailbox)
+{
+	mrimap_t* ths = session_new(get_config, set_config, receive_imf, flush_imf, sync_flags, userData, mailbox);
+
+	/* the job session is created together with the object and lives as long, so that job actions never see a freed job session */
+	ths->m_job_session = session_new(get_config, set_config, receive_imf, flush_imf, sync_flags, userData, mailbox);
+	ths->m_job_session->m_is_job_session = 1;
+	ths->m_job_session->m_log_connect_errors = 0; /* the watch thread's connection is used if the job session fails, so this is no error for the user */
+
+	return ths;
+}
+
+
 void mrimap_unref(mrimap_t* ths)
 {
 	if( ths==NULL ) {
@@ -1519,6 +2095,8 @@ void mrimap_unref(mrimap_t* ths)
 
 	mrimap_disconnect(ths);
 
+	mrimap_unref(ths->m_job_session);
+
 	pthread_cond_destroy(&ths->m_heartbeat_cond);
 	pthread_mutex_destroy(&ths->m_heartbeat_condmutex);
 
@@ -1526,6 +2104,7 @@ void mrimap_unref(mrimap_t* ths)
 	pthread_mutex_destroy(&ths->m_watch_condmutex);
 	pthread_mutex_destroy(&ths->m_inwait_mutex);
 	pthread_mutex_destroy(&ths->m_idlemutex);
+	pthread_mutex_destroy(&ths->m_bytes_critical);
 	pthread_mutex_destroy(&ths->m_hEtpanmutex);
 
 	free(ths->m_imap_server);
@@ -1571,6 +2150,8 @@ int mrimap_append_msg(mrimap_t* ths, time_t timestamp, const char* data_not_term
 		goto cleanup;
 	}
 
+	ths = session_for_jobs(ths);
+
 	LOCK_HANDLE
 
 	if( ths->m_hEtpan==NULL ) {
@@ -1631,14 +2212,13 @@ cleanup:
 }
 
 
-static int add_flag__(mrimap_t* ths, uint32_t server_uid, struct mailimap_flag* flag)
+static int add_flag_to_set__(mrimap_t* ths, struct mailimap_set* set, struct mailimap_flag* flag)
 {
 	int                              r;
 	struct mailimap_flag_list*       flag_list = NULL;
 	struct mailimap_store_att_flags* store_att_flags = NULL;
-	struct mailimap_set*             set = mailimap_set_new_single(server_uid);
 
-	if( ths==NULL || ths->m_hEtpan==NULL ) {
+	if( ths==NULL || ths->m_hEtpan==NULL || set==NULL ) {
 		goto cleanup;
 	}
 
@@ -1656,10 +2236,38 @@ cleanup:
 	if( store_att_flags ) {
 		mailimap_store_att_flags_free(store_att_flags);
 	}
+	return ths->m_should_reconnect? 0 : 1; /* all non-connection states are treated as success - the mail may already be deleted or moved away on the server */
+}
+
+
+static int add_flag__(mrimap_t* ths, uint32_t server_uid, struct mailimap_flag* flag)
+{
+	int                  ret;
+	struct mailimap_set* set = mailimap_set_new_single(server_uid);
+		ret = add_flag_to_set__(ths, set, flag);
 	if( set ) {
 		mailimap_set_free(set);
 	}
-	return ths->m_should_reconnect? 0 : 1; /* all non-connection states are treated as success - the mail may already be deleted or moved away on the server */
+	return ret;
+}
+
+
+static int set_get_uid(const struct mailimap_set* set, int index, uint32_t* ret_uid)
+{
+	/* get the index'th UID of the set, used to map the COPYUID response of UID MOVE/COPY to the source UIDs */
+	clistiter* cur;
+	for( cur = clist_begin(set->set_list); cur != NULL; cur = clist_next(cur) ) {
+		struct mailimap_set_item* item = (struct mailimap_set_item*)clist_content(cur);
+		if( item->set_last < item->set_first ) {
+			continue;
+		}
+		if( index <= (int)(item->set_last - item->set_first) ) {
+			*ret_uid = item->set_first + index;
+			return 1;
+		}
+		index -= (int)(item->set_last - item->set_first) + 1;
+	}
+	return 0;
 }
 
 
@@ -1680,6 +2288,8 @@ int mrimap_markseen_msg(mrimap_t* ths, const char* folder, uint32_t server_uid,
 		goto cleanup;
 	}
 
+	ths = session_for_jobs(ths);
+
 	LOCK_HANDLE
 
 	if( ths->m_hEtpan==NULL ) {
@@ -1808,6 +2418,134 @@ cleanup:
 }
 
 
+int mrimap_markseen_msgs(mrimap_t* ths, const char* folder, const uint32_t* server_uids, int cnt, int ms_flags,
+                         char** ret_server_folder, uint32_t* ret_server_uids)
+{
+	/* same as mrimap_markseen_msg() for several messages of a folder, however, with a single "UID STORE 123:125,200 +FLAGS (\Seen)"
+	and a single "UID MOVE"; ret_server_uids must have place for cnt UIDs and are set to the new UID for all moved messages, 0 otherwise */
+	int                  handle_locked = 0, idle_blocked = 0, r, i, j;
+	uint32_t             run_first = 0, run_last = 0, src_uid, dest_uid;
+	struct mailimap_set* set = NULL;
+	struct mailimap_set* res_setsrc = NULL;
+	struct mailimap_set* res_setdest = NULL;
+	uint32_t             res_uidvalidity = 0;
+
+	if( ths==NULL || folder==NULL || server_uids==NULL || cnt<=0 || ret_server_folder==NULL || ret_server_uids==NULL || *ret_server_folder!=NULL ) {
+		return 1; /* job done */
+	}
+
+	memset(ret_server_uids, 0, cnt*sizeof(uint32_t));
+
+	/* build the UID set, consecutive UIDs are combined to ranges */
+	if( (set=mailimap_set_new_empty())==NULL ) {
+		goto cleanup;
+	}
+	for( i = 0; i <= cnt; i++ ) {
+		if( i < cnt && server_uids[i] == 0 ) {
+			continue;
+		}
+		if( i < cnt && run_first && server_uids[i] == run_last+1 ) {
+			run_last = server_uids[i];
+			continue;
+		}
+		if( run_first ) {
+			mailimap_set_add_interval(set, run_first, run_last);
+		}
+		if( i < cnt ) {
+			run_first = run_last = server_uids[i];
+		}
+	}
+	if( run_first == 0 ) {
+		goto cleanup; /* no valid UIDs */
+	}
+
+	ths = session_for_jobs(ths);
+
+	LOCK_HANDLE
+
+	if( ths->m_hEtpan==NULL ) {
+		goto cleanup;
+	}
+
+	BLOCK_IDLE
+
+		INTERRUPT_IDLE
+
+		mrmailbox_log_info(ths->m_mailbox, 0, "Marking %i messages in %s as seen...", cnt, folder);
+
+		if( select_folder__(ths, folder)==0 ) {
+			mrmailbox_log_warning(ths->m_mailbox, 0, "Cannot select folder.");
+			goto cleanup;
+		}
+
+		if( add_flag_to_set__(ths, set, mailimap_flag_new_seen())==0 ) {
+			mrmailbox_log_warning(ths->m_mailbox, 0, "Cannot mark messages as seen.");
+			goto cleanup;
+		}
+
+		mrmailbox_log_info(ths->m_mailbox, 0, "Messages marked as seen.");
+
+		if( (ms_flags&MR_MS_ALSO_MOVE) && (ths->m_server_flags&MR_NO_MOVE_TO_CHATS)==0 )
+		{
+			init_chat_folders__(ths);
+			if( ths->m_moveto_folder && strcmp(folder, ths->m_moveto_folder)!=0 )
+			{
+				mrmailbox_log_info(ths->m_mailbox, 0, "Moving %i messages from %s to %s...", cnt, folder, ths->m_moveto_folder);
+
+				if( ths->m_can_move ) {
+					r = mailimap_uidplus_uid_move(ths->m_hEtpan, set, ths->m_moveto_folder, &res_uidvalidity, &res_setsrc, &res_setdest);
+				}
+				else {
+					/* without MOVE, copy the messages and mark the originals for deletion; they're expunged when the folder is left */
+					r = mailimap_uidplus_uid_copy(ths->m_hEtpan, set, ths->m_moveto_folder, &res_uidvalidity, &res_setsrc, &res_setdest);
+					if( !is_error(ths, r) ) {
+						add_flag_to_set__(ths, set, mailimap_flag_new_deleted());
+						ths->m_selected_folder_needs_expunge = 1;
+					}
+				}
+
+				if( is_error(ths, r) ) {
+					mrmailbox_log_info(ths->m_mailbox, 0, "Cannot move messages.");
+					goto cleanup;
+				}
+
+				/* the COPYUID response lists the source and the destination UIDs in the same order */
+				if( res_setsrc && res_setdest ) {
+					for( j = 0; set_get_uid(res_setsrc, j, &src_uid) && set_get_uid(res_setdest, j, &dest_uid); j++ ) {
+						for( i = 0; i < cnt; i++ ) {
+							if( server_uids[i] == src_uid ) {
+								ret_server_uids[i] = dest_uid;
+								if( *ret_server_folder == NULL ) {
+									*ret_server_folder = safe_strdup(ths->m_moveto_folder);
+								}
+							}
+						}
+					}
+				}
+
+				mrmailbox_log_info(ths->m_mailbox, 0, "Messages moved.");
+			}
+		}
+
+cleanup:
+	if( handle_locked ) {
+		expunge_if_job_session__(ths);
+	}
+	UNBLOCK_IDLE
+	UNLOCK_HANDLE
+	if( res_setsrc ) {
+		mailimap_set_free(res_setsrc);
+	}
+	if( res_setdest ) {
+		mailimap_set_free(res_setdest);
+	}
+	if( set ) {
+		mailimap_set_free(set);
+	}
+	return ths->m_should_reconnect? 0 : 1;
+}
+
+
 int mrimap_delete_msg(mrimap_t* ths, const char* rfc724_mid, const char* folder, uint32_t server_uid)
 {
 	int    success = 0, handle_locked = 0, idle_blocked = 0, r = 0;
@@ -1820,6 +2558,8 @@ int mrimap_delete_msg(mrimap_t* ths, const char* rfc724_mid, const char* folder,
 		goto cleanup;
 	}
 
+	ths = session_for_jobs(ths);
+
 	LOCK_HANDLE
 	BLOCK_IDLE
 
@@ -1878,6 +2618,9 @@ int mrimap_delete_msg(mrimap_t* ths, const char* rfc724_mid, const char* folder,
 		success = 1;
 
 cleanup:
+	if( handle_locked ) {
+		expunge_if_job_session__(ths);
+	}
 	UNBLOCK_IDLE
 	UNLOCK_HANDLE
 
@@ -37,9 +37,15 @@ typedef struct mrimap_t mrimap_t;
 
 #define MR_IMAP_SEEN 0x0001L
 
+#define MR_IMAP_COMPRESS_DEFAULT    1
+#define MR_IMAP_JOB_SESSION_DEFAULT 1
+
 typedef char*    (*mr_get_config_t)    (mrimap_t*, const char*, const char*);
 typedef void     (*mr_set_config_t)    (mrimap_t*, const char*, const char*);
 typedef void     (*mr_receive_imf_t)   (mrimap_t*, const char* imf_raw_not_terminated, size_t imf_raw_bytes, const char* server_folder, uint32_t server_uid, uint32_t flags);
+typedef struct _mrarray mrarray_t;
+typedef void     (*mr_sync_flags_t)    (mrimap_t*, const char* server_folder, const mrarray_t* seen_uids, const mrarray_t* gone_uid_ranges); /* gone_uid_ranges contains pairs of the first and the last UID */
+typedef int      (*mr_flush_imf_t)     (mrimap_t*); /* must not return before all messages given to mr_receive_imf_t are in the database; returns 0 if the messages should be fetched again */
 
 
 /**
@@ -65,6 +71,15 @@ typedef struct mrimap_t
 
 	int                   m_can_idle;
 	int                   m_has_xlist;
+	int                   m_can_move;     /* the server supports UID MOVE (RFC 6851); otherwise, moving is done by COPY and \Deleted */
+	int                   m_has_condstore;/* the server supports CONDSTORE (RFC 7162), flags changed by other devices are fetched using CHANGEDSINCE */
+	int                   m_qresync_enabled; /* QRESYNC (RFC 7162) is enabled for the current connection, expunged messages are reported by VANISHED */
+	uint64_t              m_selected_modseq; /* the HIGHESTMODSEQ returned when m_selected_folder was selected, 0 if unknown */
+	int                   m_compress_enabled; /* COMPRESS=DEFLATE (RFC 4978) is active on the current connection */
+	int                   m_compress_failed;  /* COMPRESS=DEFLATE failed after the server agreed, eg. as libetpan is built without zlib; compression is not tried again */
+	uint64_t              m_bytes_uncompressed; /* bytes transferred on compressed connections before compression and after decompression ... */
+	uint64_t              m_bytes_compressed;   /* ... and on the wire; both are protected by m_bytes_critical, see mrimap_get_bytes() */
+	pthread_mutex_t       m_bytes_critical;
 	char*                 m_moveto_folder;/* Folder, where reveived chat messages should go to.  Normally "Chats" but may be NULL to leave them in the INBOX */
 	char*                 m_sent_folder;  /* Folder, where send messages should go to.  Normally "Chats". */
 	pthread_mutex_t       m_idlemutex;    /* set, if idle is not possible; morover, the interrupted IDLE thread waits a second before IDLEing again; this allows several jobs to be executed */
@@ -89,15 +104,22 @@ typedef struct mrimap_t
 
 	mr_get_config_t       m_get_config;
 	mr_set_config_t       m_set_config;
-	mr_receive_imf_t      m_receive_imf;
+	mr_receive_imf_t      m_receive_imf;  /* may just queue the message, see m_flush_imf */
+	mr_flush_imf_t        m_flush_imf;    /* called after each fetched batch of messages, before lastseenuid is saved */
+	mr_sync_flags_t       m_sync_flags;   /* called with the flags changed on the server by other devices */
 	void*                 m_userData;
 	mrmailbox_t*          m_mailbox;
 
 	int                   m_log_connect_errors;
+
+	struct mrimap_t*      m_job_session;  /* second connection used exclusively by mrimap_append_msg(), mrimap_markseen_msg(s) and mrimap_delete_msg() so that IDLE is not interrupted; connected on demand */
+	int                   m_is_job_session;
+	int                   m_reconnect_backoff;    /* job session only: seconds to wait after a failed login, doubled on each failure */
+	time_t                m_reconnect_not_before; /* job session only: until then, job actions use the connection of the watch thread */
 } mrimap_t;
 
 
-mrimap_t* mrimap_new               (mr_get_config_t, mr_set_config_t, mr_receive_imf_t, void* userData, mrmailbox_t*);
+mrimap_t* mrimap_new               (mr_get_config_t, mr_set_config_t, mr_receive_imf_t, mr_flush_imf_t, mr_sync_flags_t, void* userData, mrmailbox_t*);
 void      mrimap_unref             (mrimap_t*);
 
 int       mrimap_connect           (mrimap_t*, const mrloginparam_t*);
@@ -112,10 +134,14 @@ int       mrimap_append_msg        (mrimap_t*, time_t timestamp, const char* dat
 #define   MR_MS_MDNSent_JUST_SET   0x10
 int       mrimap_markseen_msg      (mrimap_t*, const char* folder, uint32_t server_uid, int ms_flags, char** ret_server_folder, uint32_t* ret_server_uid, int* ret_ms_flags); /* only returns 0 on connection problems; we should try later again in this case */
 
+int       mrimap_markseen_msgs     (mrimap_t*, const char* folder, const uint32_t* server_uids, int cnt, int ms_flags, char** ret_server_folder, uint32_t* ret_server_uids); /* MR_MS_SET_MDNSent_FLAG is not supported here; only returns 0 on connection problems */
+
 int       mrimap_delete_msg        (mrimap_t*, const char* rfc724_mid, const char* folder, uint32_t server_uid); /* only returns 0 on connection problems; we should try later again in this case */
 
 void      mrimap_heartbeat         (mrimap_t*);
 
+void      mrimap_get_bytes         (mrimap_t*, uint64_t* ret_bytes_uncompressed, uint64_t* ret_bytes_compressed); /* adds the bytes of the object and its job session */
+
 #ifdef __cplusplus
 } /* /extern "C" */
 #endif
@@ -0,0 +1,343 @@
+/*******************************************************************************
+ *
+ *                              Delta Chat Core
+ *                      Copyright (C) 2017 Björn Petersen
+ *                   Contact: r10s@b44t.com, http://b44t.com
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see http://www.gnu.org/licenses/ .
+ *
+ ******************************************************************************/
+
+
+#include <unistd.h>
+#include <time.h>
+#include "mrmailbox_internal.h"
+#include "mrmimeparser.h"
+#include "mrimfpipe.h"
+
+
+static void* parse_thread_entry_point(void* entry_arg)
+{
+	mrimfpipe_t*     ths = (mrimfpipe_t*)entry_arg;
+	mrimfpipeslot_t* slot;
+
+	pthread_mutex_lock(&ths->m_mutex);
+		while( 1 )
+		{
+			if( ths->m_next_parse == ths->m_next_add ) {
+				if( ths->m_do_exit ) {
+					break;
+				}
+				pthread_cond_wait(&ths->m_cond, &ths->m_mutex);
+				continue;
+			}
+
+			slot = &ths->m_slots[ths->m_next_parse % MR_IMFPIPE_SLOTS];
+			ths->m_next_parse++;
+
+			pthread_mutex_unlock(&ths->m_mutex);
+				mrmimeparser_t* mime_parser = mrmailbox_parse_imf(ths->m_mailbox, slot->m_imf_raw, slot->m_imf_raw_bytes);
+			pthread_mutex_lock(&ths->m_mutex);
+
+			slot->m_mime_parser = mime_parser;
+			pthread_cond_broadcast(&ths->m_cond);
+		}
+	pthread_mutex_unlock(&ths->m_mutex);
+
+	return NULL;
+}
+
+
+static void send_events(mrimfpipe_t* ths, carray* events)
+{
+	/* the events are triples of event, data1 and data2.  MR_EVENT_MSGS_CHANGED and MR_EVENT_INCOMING_MSG are coalesced
+	to one event per chat: the last MR_EVENT_INCOMING_MSG, if any, otherwise the last MR_EVENT_MSGS_CHANGED.
+	Other events are sent as they are. */
+	mrhash_t chats;
+	int      i, cnt = carray_count(events);
+
+	mrhash_init(&chats, MRHASH_INT, 0);
+
+		for( i = cnt-3; i >= 0; i -= 3 ) {
+			int      event = (int)(uintptr_t)carray_get(events, i);
+			uint32_t chat_id = (uint32_t)(uintptr_t)carray_get(events, i+1);
+			if( event == MR_EVENT_MSGS_CHANGED || event == MR_EVENT_INCOMING_MSG ) {
+				int kept = (int)(uintptr_t)mrhash_find(&chats, NULL, chat_id); /* index+1 of the event to send for the chat, 0=none yet */
+				if( kept == 0
+				 || (event == MR_EVENT_INCOMING_MSG && (int)(uintptr_t)carray_get(events, kept-1) == MR_EVENT_MSGS_CHANGED) ) {
+					mrhash_insert(&chats, NULL, chat_id, (void*)(uintptr_t)(i+1));
+				}
+			}
+		}
+
+		for( i = 0; i < cnt; i += 3 ) {
+			int       event = (int)(uintptr_t)carray_get(events, i);
+			uintptr_t data1 = (uintptr_t)carray_get(events, i+1);
+			uintptr_t data2 = (uintptr_t)carray_get(events, i+2);
+			if( (event != MR_EVENT_MSGS_CHANGED && event != MR_EVENT_INCOMING_MSG)
+			 || (int)(uintptr_t)mrhash_find(&chats, NULL, (uint32_t)data1) == i+1 ) {
+				ths->m_mailbox->m_cb(ths->m_mailbox, event, data1, data2);
+			}
+		}
+
+	mrhash_clear(&chats);
+}
+
+
+static int commit_group(mrimfpipe_t* ths, carray* events, int group_msgs)
+{
+	/* the database is locked since the transaction was started, see commit_thread_entry_point() */
+	int success;
+
+	success = mrsqlite3_commit__(ths->m_mailbox->m_sql);
+	mrsqlite3_unlock(ths->m_mailbox->m_sql);
+
+	if( success ) {
+		send_events(ths, events);
+	}
+	else {
+		mrmailbox_log_warning(ths->m_mailbox, 0, "Cannot commit %i received messages, they are fetched again.", group_msgs);
+	}
+
+	carray_set_size(events, 0);
+	return success;
+}
+
+
+static void* commit_thread_entry_point(void* entry_arg)
+{
+	mrimfpipe_t*     ths = (mrimfpipe_t*)entry_arg;
+	mrimfpipeslot_t* slot;
+	carray*          events = carray_new(64);
+	int              group_msgs = 0, group_committed, is_handshake_message;
+	struct timespec  group_deadline, now;
+
+	pthread_mutex_lock(&ths->m_mutex);
+		while( 1 )
+		{
+			slot = &ths->m_slots[ths->m_next_commit % MR_IMFPIPE_SLOTS];
+			if( ths->m_next_commit == ths->m_next_parse || slot->m_mime_parser == NULL ) {
+				if( group_msgs > 0 ) {
+					/* the next message is not yet parsed: commit, we must not wait with the database locked
+					(the parser threads may need the lock and other threads would write into our transaction otherwise) */
+					pthread_mutex_unlock(&ths->m_mutex);
+						group_committed = commit_group(ths, events, group_msgs);
+					pthread_mutex_lock(&ths->m_mutex);
+					group_msgs = 0;
+					ths->m_group_open = 0;
+					ths->m_group_failed |= !group_committed;
+					pthread_cond_broadcast(&ths->m_cond);
+					continue;
+				}
+				if( ths->m_do_exit && ths->m_next_commit == ths->m_next_add ) {
+					break;
+				}
+				pthread_cond_wait(&ths->m_cond, &ths->m_mutex); /* wait for the parser of the _next_ message, even if later ones are already done */
+				continue;
+			}
+
+			pthread_mutex_unlock(&ths->m_mutex);
+
+				/* the database stays locked from the beginning of the transaction until it is committed, so no other thread
+				writes to the database inside our transaction */
+				group_committed = 1;
+				is_handshake_message = mrmailbox_oob_is_handshake_message__(ths->m_mailbox, slot->m_mime_parser); /* checks the header only */
+				if( group_msgs > 0 ) {
+					clock_gettime(CLOCK_REALTIME, &now);
+					if( is_handshake_message || group_msgs >= MR_IMFPIPE_GROUP_MSGS
+					 || now.tv_sec > group_deadline.tv_sec || (now.tv_sec == group_deadline.tv_sec && now.tv_nsec >= group_deadline.tv_nsec) ) {
+						group_committed = commit_group(ths, events, group_msgs);
+						group_msgs = 0;
+					}
+				}
+
+				if( is_handshake_message ) {
+					mrmailbox_receive_parsed_imf(ths->m_mailbox, slot->m_mime_parser, slot->m_imf_raw, slot->m_imf_raw_bytes,
+						slot->m_server_folder, slot->m_server_uid, slot->m_flags); /* needs the database unlocked, has its own transaction */
+				}
+				else {
+					if( group_msgs == 0 ) {
+						mrsqlite3_lock(ths->m_mailbox->m_sql);
+						mrsqlite3_begin_transaction__(ths->m_mailbox->m_sql);
+
+						clock_gettime(CLOCK_REALTIME, &group_deadline);
+						group_deadline.tv_nsec += MR_IMFPIPE_GROUP_MS * 1000000L;
+						group_deadline.tv_sec  += group_deadline.tv_nsec / 1000000000L;
+						group_deadline.tv_nsec %= 1000000000L;
+					}
+
+					mrmailbox_receive_parsed_imf__(ths->m_mailbox, slot->m_mime_parser, slot->m_imf_raw, slot->m_imf_raw_bytes,
+						slot->m_server_folder, slot->m_server_uid, slot->m_flags, events);
+					group_msgs++;
+				}
+				free(slot->m_imf_raw);
+				free(slot->m_server_folder);
+
+			pthread_mutex_lock(&ths->m_mutex);
+
+			memset(slot, 0, sizeof(mrimfpipeslot_t));
+			ths->m_next_commit++;
+			ths->m_group_open = group_msgs > 0;
+			ths->m_group_failed |= !group_committed;
+			pthread_cond_broadcast(&ths->m_cond);
+		}
+	pthread_mutex_unlock(&ths->m_mutex);
+
+	carray_free(events);
+	return NULL;
+}
+
+
+static void start_threads__(mrimfpipe_t* ths, int thread_cnt)
+{
+	if( thread_cnt <= 0 ) {
+		long cpu_cnt = sysconf(_SC_NPROCESSORS_ONLN);
+		thread_cnt = cpu_cnt > 0? (int)cpu_cnt : 1;
+	}
+
+	if( thread_cnt > MR_IMFPIPE_MAX_THREADS ) {
+		thread_cnt = MR_IMFPIPE_MAX_THREADS;
+	}
+
+	for( ths->m_thread_cnt = 0; ths->m_thread_cnt < thread_cnt; ths->m_thread_cnt++ ) {
+		pthread_create(&ths->m_parse_threads[ths->m_thread_cnt], NULL, parse_thread_entry_point, ths);
+	}
+	pthread_create(&ths->m_commit_thread, NULL, commit_thread_entry_point, ths);
+
+	mrmailbox_log_info(ths->m_mailbox, 0, "Receiving messages using %i parser threads.", ths->m_thread_cnt);
+}
+
+
+/**
+ * Create a pipeline for receiving messages.  No threads are started before the first message is added.
+ *
+ * @private @memberof mrimfpipe_t
+ */
+mrimfpipe_t* mrimfpipe_new(mrmailbox_t* mailbox)
+{
+	mrimfpipe_t* ths = NULL;
+
+	if( (ths=calloc(1, sizeof(mrimfpipe_t)))==NULL ) {
+		exit(70);
+	}
+
+	ths->m_mailbox = mailbox;
+
+	pthread_mutex_init(&ths->m_mutex, NULL);
+	pthread_cond_init(&ths->m_cond, NULL);
+
+	return ths;
+}
+
+
+/**
+ * Free a pipeline.  Messages not yet in the database are added before the threads are stopped.
+ *
+ * @private @memberof mrimfpipe_t
+ */
+void mrimfpipe_unref(mrimfpipe_t* ths)
+{
+	int i, thread_cnt;
+
+	if( ths == NULL ) {
+		return;
+	}
+
+	pthread_mutex_lock(&ths->m_mutex);
+		thread_cnt = ths->m_thread_cnt;
+		ths->m_do_exit = 1;
+		pthread_cond_broadcast(&ths->m_cond);
+	pthread_mutex_unlock(&ths->m_mutex);
+
+	if( thread_cnt > 0 ) {
+		for( i = 0; i < thread_cnt; i++ ) {
+			pthread_join(ths->m_parse_threads[i], NULL);
+		}
+		pthread_join(ths->m_commit_thread, NULL);
+	}
+
+	pthread_cond_destroy(&ths->m_cond);
+	pthread_mutex_destroy(&ths->m_mutex);
+	free(ths);
+}
+
+
+/**
+ * Add a message to the pipeline.  The raw data are copied, so the caller may free them after the function returns.
+ * If all slots are in use, the function waits until the oldest message is added to the database.
+ *
+ * @private @memberof mrimfpipe_t
+ */
+void mrimfpipe_add(mrimfpipe_t* ths, int thread_cnt, const char* imf_raw_not_terminated, size_t imf_raw_bytes,
+                   const char* server_folder, uint32_t server_uid, uint32_t flags)
+{
+	mrimfpipeslot_t* slot;
+
+	if( ths == NULL || imf_raw_not_terminated == NULL ) {
+		return;
+	}
+
+	pthread_mutex_lock(&ths->m_mutex);
+
+		if( ths->m_thread_cnt == 0 ) {
+			start_threads__(ths, thread_cnt);
+		}
+
+		while( ths->m_next_add - ths->m_next_commit >= MR_IMFPIPE_SLOTS ) {
+			pthread_cond_wait(&ths->m_cond, &ths->m_mutex);
+		}
+
+		slot = &ths->m_slots[ths->m_next_add % MR_IMFPIPE_SLOTS];
+		if( (slot->m_imf_raw=malloc(imf_raw_bytes))==NULL ) {
+			exit(71);
+		}
+		memcpy(slot->m_imf_raw, imf_raw_not_terminated, imf_raw_bytes);
+		slot->m_imf_raw_bytes = imf_raw_bytes;
+		slot->m_server_folder = strdup_keep_null(server_folder);
+		slot->m_server_uid    = server_uid;
+		slot->m_flags         = flags;
+
+		ths->m_next_add++;
+		pthread_cond_broadcast(&ths->m_cond);
+
+	pthread_mutex_unlock(&ths->m_mutex);
+}
+
+
+/**
+ * Wait until all messages added to the pipeline are committed to the database.
+ * Returns 0 if some messages could not be committed since the last call, in this case, the caller
+ * should fetch the messages again; messages already in the database are detected by their Message-ID.
+ *
+ * @private @memberof mrimfpipe_t
+ */
+int mrimfpipe_flush(mrimfpipe_t* ths)
+{
+	int success;
+
+	if( ths == NULL ) {
+		return 0;
+	}
+
+	pthread_mutex_lock(&ths->m_mutex);
+		while( ths->m_next_commit != ths->m_next_add || ths->m_group_open ) {
+			pthread_cond_wait(&ths->m_cond, &ths->m_mutex);
+		}
+		success = !ths->m_group_failed;
+		ths->m_group_failed = 0;
+	pthread_mutex_unlock(&ths->m_mutex);
+
+	return success;
+}
+
@@ -0,0 +1,116 @@
+/*******************************************************************************
+ *
+ *                              Delta Chat Core
+ *                      Copyright (C) 2017 Björn Petersen
+ *                   Contact: r10s@b44t.com, http://b44t.com
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see http://www.gnu.org/licenses/ .
+ *
+ ******************************************************************************/
+
+
+#ifndef __MRIMFPIPE_H__
+#define __MRIMFPIPE_H__
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/*** library-private **********************************************************/
+
+#include <pthread.h>
+typedef struct _mrmailbox mrmailbox_t;
+typedef struct mrmimeparser_t mrmimeparser_t;
+
+
+/**
+ * Library-internal.
+ *
+ * A message in one of the slots of mrimfpipe_t.
+ */
+typedef struct mrimfpipeslot_t
+{
+	/** @privatesection */
+	char*           m_imf_raw;       /**< a copy of the raw message, free()'d after the message is added to the database */
+	size_t          m_imf_raw_bytes;
+	char*           m_server_folder;
+	uint32_t        m_server_uid;
+	uint32_t        m_flags;
+	mrmimeparser_t* m_mime_parser;   /**< set by the parser threads, NULL until the message is parsed */
+} mrimfpipeslot_t;
+
+
+/**
+ * Library-internal.
+ *
+ * Pipeline for receiving many messages at once, eg. on the initial sync.
+ *
+ * mrimfpipe_add() copies the raw message to a free slot.  A pool of parser threads
+ * calls mrmailbox_parse_imf() for the slots, this is where the CPU time is spent,
+ * esp. for decryption.  A single committer thread adds the parsed messages to the
+ * database using mrmailbox_receive_parsed_imf() in the order they were added.
+ *
+ * The committer thread adds up to MR_IMFPIPE_GROUP_MSGS messages or the messages of
+ * MR_IMFPIPE_GROUP_MS milliseconds in a single transaction, each message is a nested
+ * transaction and is rolled back on its own on errors.  The database is locked for the
+ * whole transaction, so it is committed as soon as the next message is not yet parsed.  The events about the new
+ * messages are sent after the transaction is committed, one per chat.  If the
+ * transaction cannot be committed, mrimfpipe_flush() returns 0 and the caller should
+ * fetch the messages again.
+ *
+ * Messages are identified by a running sequence number, the slot used is the number
+ * modulo MR_IMFPIPE_SLOTS.  All members below are protected by m_mutex.
+ */
+typedef struct mrimfpipe_t
+{
+	/** @privatesection */
+	mrmailbox_t*    m_mailbox;
+
+	pthread_mutex_t m_mutex;
+	pthread_cond_t  m_cond;          /**< broadcasted on every state change, the mutex is m_mutex */
+	int             m_do_exit;
+
+	#define         MR_IMFPIPE_MAX_THREADS 8
+	int             m_thread_cnt;    /**< number of parser threads, 0 if the threads are not yet started */
+	pthread_t       m_parse_threads[MR_IMFPIPE_MAX_THREADS];
+	pthread_t       m_commit_thread;
+
+	#define         MR_IMFPIPE_SLOTS 32 /* max. number of messages in the pipeline; if all slots are in use, mrimfpipe_add() waits */
+	mrimfpipeslot_t m_slots[MR_IMFPIPE_SLOTS];
+	uint32_t        m_next_add;      /**< sequence number of the next message added */
+	uint32_t        m_next_parse;    /**< sequence number of the next message to parse, <= m_next_add */
+	uint32_t        m_next_commit;   /**< sequence number of the next message to add to the database, <= m_next_parse */
+
+	#define         MR_IMFPIPE_GROUP_MSGS 250
+	#define         MR_IMFPIPE_GROUP_MS   500
+	int             m_group_open;    /**< set if messages are added to a transaction not yet committed */
+	int             m_group_failed;  /**< set if a transaction could not be committed since the last mrimfpipe_flush() */
+} mrimfpipe_t;
+
+
+mrimfpipe_t* mrimfpipe_new   (mrmailbox_t*);
+void         mrimfpipe_unref (mrimfpipe_t*);
+
+/* the threads are started on the first call to mrimfpipe_add(), thread_cnt is the number of parser threads to use then */
+void         mrimfpipe_add   (mrimfpipe_t*, int thread_cnt, const char* imf_raw_not_terminated, size_t imf_raw_bytes, const char* server_folder, uint32_t server_uid, uint32_t flags);
+
+/* wait until all messages added are committed to the database, returns 0 if some messages are lost and should be fetched again */
+int          mrimfpipe_flush (mrimfpipe_t*);
+
+
+#ifdef __cplusplus
+} /* /extern "C" */
+#endif
+#endif /* __MRIMFPIPE_H__ */
+
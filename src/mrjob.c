@@ -30,142 +30,286 @@
  ******************************************************************************/
 
 
-static int get_wait_seconds(mrmailbox_t* mailbox) // >0: wait seconds, =0: do not wait, <0: wait until signal
+static int cmp_by_timestamp(const mrjobentry_t* a, const mrjobentry_t* b)
 {
-	int           ret = -1;
-	sqlite3_stmt* stmt;
+	if( a->m_desired_timestamp != b->m_desired_timestamp ) {
+		return a->m_desired_timestamp < b->m_desired_timestamp? -1 : 1;
+	}
+	return a->m_job_id < b->m_job_id? -1 : 1;
+}
 
-	mrsqlite3_lock(mailbox->m_sql);
-		stmt = mrsqlite3_predefine__(mailbox->m_sql, SELECT_MIN_d_FROM_jobs, "SELECT MIN(desired_timestamp) FROM jobs;");
-		if( stmt && sqlite3_step(stmt) == SQLITE_ROW )
-		{
-			if( sqlite3_column_type(stmt, 0)!=SQLITE_NULL )
-			{
-				time_t min_desired_timestamp = (time_t)sqlite3_column_int64(stmt, 0);
-				time_t now = time(NULL);
-				if( min_desired_timestamp <= now ) {
-					ret = 0;
-				}
-				else {
-					ret = (int)(min_desired_timestamp-now) + 1 /*wait a second longer, pthread_cond_timedwait() is not _that_ exact and we want to be sure to catch the jobs in the first try*/;
-				}
-			}
+
+static int cmp_by_priority(const mrjobentry_t* a, const mrjobentry_t* b)
+{
+	/* same order as the former "ORDER BY action DESC, id" */
+	if( a->m_action != b->m_action ) {
+		return a->m_action > b->m_action? -1 : 1;
+	}
+	return a->m_job_id < b->m_job_id? -1 : 1;
+}
+
+
+static void heap_sift_down(mrjobheap_t* heap, int i)
+{
+	while( 1 ) {
+		int best = i, l = i*2+1, r = i*2+2;
+		if( l < heap->m_cnt && heap->m_cmp(&heap->m_entries[l], &heap->m_entries[best]) < 0 ) { best = l; }
+		if( r < heap->m_cnt && heap->m_cmp(&heap->m_entries[r], &heap->m_entries[best]) < 0 ) { best = r; }
+		if( best == i ) {
+			break;
 		}
-	mrsqlite3_unlock(mailbox->m_sql);
+		mrjobentry_t tmp = heap->m_entries[i]; heap->m_entries[i] = heap->m_entries[best]; heap->m_entries[best] = tmp;
+		i = best;
+	}
+}
+
 
-	return ret;
+static void heap_push(mrjobheap_t* heap, const mrjobentry_t* entry)
+{
+	int i;
+
+	if( heap->m_cnt >= heap->m_allocated ) {
+		heap->m_allocated = heap->m_allocated? heap->m_allocated*2 : 32;
+		if( (heap->m_entries=realloc(heap->m_entries, heap->m_allocated*sizeof(mrjobentry_t)))==NULL ) {
+			exit(50);
+		}
+	}
+
+	i = heap->m_cnt++;
+	heap->m_entries[i] = *entry;
+	while( i > 0 && heap->m_cmp(&heap->m_entries[i], &heap->m_entries[(i-1)/2]) < 0 ) {
+		mrjobentry_t tmp = heap->m_entries[i]; heap->m_entries[i] = heap->m_entries[(i-1)/2]; heap->m_entries[(i-1)/2] = tmp;
+		i = (i-1)/2;
+	}
+}
+
+
+static void heap_pop(mrjobheap_t* heap, mrjobentry_t* ret_entry)
+{
+	*ret_entry = heap->m_entries[0];
+	heap->m_entries[0] = heap->m_entries[--heap->m_cnt];
+	heap_sift_down(heap, 0);
+}
+
+
+static void heap_remove_action(mrjobheap_t* heap, int action)
+{
+	int i, cnt = 0;
+
+	for( i = 0; i < heap->m_cnt; i++ ) {
+		if( heap->m_entries[i].m_action != action ) {
+			heap->m_entries[cnt++] = heap->m_entries[i];
+		}
+	}
+
+	if( cnt != heap->m_cnt ) {
+		heap->m_cnt = cnt;
+		for( i = cnt/2-1; i >= 0; i-- ) {
+			heap_sift_down(heap, i);
+		}
+	}
+}
+
+
+static void heap_empty(mrjobheap_t* heap)
+{
+	free(heap->m_entries);
+	heap->m_entries   = NULL;
+	heap->m_cnt       = 0;
+	heap->m_allocated = 0;
+}
+
+
+static void add_to_lane(mrmailbox_t* mailbox, int lane, uint32_t job_id, int action, time_t desired_timestamp)
+{
+	/* the caller must hold m_job_condmutex */
+	mrjobentry_t entry;
+	entry.m_job_id            = job_id;
+	entry.m_action            = action;
+	entry.m_desired_timestamp = desired_timestamp;
+	heap_push(&mailbox->m_job_lanes[lane].m_timers, &entry);
+
+	mailbox->m_job_lanes[lane].m_condflag = 1;
+	pthread_cond_signal(&mailbox->m_job_lanes[lane].m_cond);
 }
 
 
 static void* job_thread_entry_point(void* entry_arg)
 {
-	mrmailbox_t*  mailbox = (mrmailbox_t*)entry_arg;
+	mrjoblane_t*  lane = (mrjoblane_t*)entry_arg;
+	mrmailbox_t*  mailbox = lane->m_mailbox;
 	mrosnative_setup_thread(mailbox); /* must be very first */
 
 	sqlite3_stmt* stmt;
-	mrjob_t       job;
-	int           seconds_to_wait;
-
-	memset(&job, 0, sizeof(mrjob_t));
-	job.m_param = mrparam_new();
+	mrjob_t*      jobs = NULL;
+	int           job_cnt, i;
+	mrjobentry_t  entries[MRJ_COALESCE_MAX];
+	int           entry_cnt;
+	time_t        now;
+
+	if( (jobs=calloc(MRJ_COALESCE_MAX, sizeof(mrjob_t)))==NULL ) {
+		exit(51);
+	}
+	for( i = 0; i < MRJ_COALESCE_MAX; i++ ) {
+		jobs[i].m_param = mrparam_new();
+	}
 
 	/* init thread */
-	mrmailbox_log_info(mailbox, 0, "Job thread entered.");
+	mrmailbox_log_info(mailbox, 0, "Job thread for lane %i entered.", lane->m_lane);
 
 	while( 1 )
 	{
-		/* wait for condition */
+		/* wait until a job is due or the lane is signalled; as the index is in memory, this does not touch the database */
 		pthread_mutex_lock(&mailbox->m_job_condmutex);
-			seconds_to_wait = get_wait_seconds(mailbox);
-			if( seconds_to_wait > 0 ) {
-				mrmailbox_log_info(mailbox, 0, "Job thread waiting for %i seconds or signal...", seconds_to_wait);
-				if( mailbox->m_job_condflag == 0 ) {
-					struct timespec timeToWait;
-					timeToWait.tv_sec  = time(NULL)+seconds_to_wait;
-					timeToWait.tv_nsec = 0;
-					pthread_cond_timedwait(&mailbox->m_job_cond, &mailbox->m_job_condmutex, &timeToWait);
-				}
-			}
-			else if( seconds_to_wait < 0 ) {
-				mrmailbox_log_info(mailbox, 0, "Job thread waiting for signal...");
-				while( mailbox->m_job_condflag == 0 ) {
-					pthread_cond_wait(&mailbox->m_job_cond, &mailbox->m_job_condmutex); /* wait unlocks the mutex and waits for signal; if it returns, the mutex is locked again */
-				}
-			}
-			mailbox->m_job_condflag = 0;
-		pthread_mutex_unlock(&mailbox->m_job_condmutex);
-
-		/* do all waiting jobs */
-		mrmailbox_log_info(mailbox, 0, "Job thread checks for pending jobs...");
-		while( 1 )
-		{
-			pthread_mutex_lock(&mailbox->m_job_condmutex);
+			while( 1 )
+			{
 				if( mailbox->m_job_do_exit ) {
 					pthread_mutex_unlock(&mailbox->m_job_condmutex);
 					goto exit_;
 				}
-			pthread_mutex_unlock(&mailbox->m_job_condmutex);
-
-			/* get next waiting job */
-			job.m_job_id = 0;
-			mrsqlite3_lock(mailbox->m_sql);
-				stmt = mrsqlite3_predefine__(mailbox->m_sql, SELECT_iafp_FROM_jobs,
-					"SELECT id, action, foreign_id, param FROM jobs WHERE desired_timestamp<=? ORDER BY action DESC, id LIMIT 1;");
-				sqlite3_bind_int64(stmt, 1, time(NULL));
-				if( sqlite3_step(stmt) == SQLITE_ROW ) {
-					job.m_job_id                         = sqlite3_column_int (stmt, 0);
-					job.m_action                         = sqlite3_column_int (stmt, 1);
-					job.m_foreign_id                     = sqlite3_column_int (stmt, 2);
-					mrparam_set_packed(job.m_param, (char*)sqlite3_column_text(stmt, 3));
+
+				now = time(NULL);
+				while( lane->m_timers.m_cnt > 0 && lane->m_timers.m_entries[0].m_desired_timestamp <= now ) {
+					heap_pop(&lane->m_timers, &entries[0]);
+					heap_push(&lane->m_ready, &entries[0]);
+				}
+
+				if( lane->m_ready.m_cnt > 0 ) {
+					heap_pop(&lane->m_ready, &entries[0]);
+					entry_cnt = 1;
+
+					/* coalesce: MRJ_MARKSEEN_MSG_ON_IMAP jobs are executed together, resulting in one IMAP command per folder,
+					MRJ_SEND_MSG_TO_SMTP jobs are sent over the same connection; as the ready heap is ordered by action, all due jobs of the same action are on top */
+					if( entries[0].m_action == MRJ_MARKSEEN_MSG_ON_IMAP || entries[0].m_action == MRJ_SEND_MSG_TO_SMTP ) {
+						while( entry_cnt < MRJ_COALESCE_MAX && lane->m_ready.m_cnt > 0 && lane->m_ready.m_entries[0].m_action == entries[0].m_action ) {
+							heap_pop(&lane->m_ready, &entries[entry_cnt++]);
+						}
+					}
+					break;
 				}
-			mrsqlite3_unlock(mailbox->m_sql);
 
-			if( job.m_job_id == 0 ) {
-				break;
+				if( lane->m_condflag == 0 ) {
+					if( lane->m_timers.m_cnt > 0 ) {
+						struct timespec timeToWait;
+						timeToWait.tv_sec  = lane->m_timers.m_entries[0].m_desired_timestamp;
+						timeToWait.tv_nsec = 0;
+						mrmailbox_log_info(mailbox, 0, "Job thread for lane %i waiting for %i seconds or signal...", lane->m_lane, (int)(timeToWait.tv_sec-now));
+						pthread_cond_timedwait(&lane->m_cond, &mailbox->m_job_condmutex, &timeToWait);
+					}
+					else {
+						mrmailbox_log_info(mailbox, 0, "Job thread for lane %i waiting for signal...", lane->m_lane);
+						while( lane->m_condflag == 0 ) {
+							pthread_cond_wait(&lane->m_cond, &mailbox->m_job_condmutex); /* wait unlocks the mutex and waits for signal; if it returns, the mutex is locked again */
+						}
+					}
+				}
+				lane->m_condflag = 0;
 			}
+		pthread_mutex_unlock(&mailbox->m_job_condmutex);
 
-			/* execute job */
-			mrmailbox_log_info(mailbox, 0, "Executing job #%i, action %i...", (int)job.m_job_id, (int)job.m_action);
-			job.m_start_again_at = 0;
-			switch( job.m_action ) {
-				case MRJ_CONNECT_TO_IMAP:      mrmailbox_connect_to_imap      (mailbox, &job); break;
-                case MRJ_SEND_MSG_TO_SMTP:     mrmailbox_send_msg_to_smtp     (mailbox, &job); break;
-                case MRJ_SEND_MSG_TO_IMAP:     mrmailbox_send_msg_to_imap     (mailbox, &job); break;
-                case MRJ_DELETE_MSG_ON_IMAP:   mrmailbox_delete_msg_on_imap   (mailbox, &job); break;
-                case MRJ_MARKSEEN_MSG_ON_IMAP: mrmailbox_markseen_msg_on_imap (mailbox, &job); break;
-                case MRJ_MARKSEEN_MDN_ON_IMAP: mrmailbox_markseen_mdn_on_imap (mailbox, &job); break;
-                case MRJ_SEND_MDN:             mrmailbox_send_mdn             (mailbox, &job); break;
+		/* load and claim the jobs; they may have been deleted in between, eg. by mrjob_kill_action__() */
+		job_cnt = 0;
+		mrsqlite3_lock(mailbox->m_sql);
+			for( i = 0; i < entry_cnt; i++ ) {
+				stmt = mrsqlite3_predefine__(mailbox->m_sql,
+					"SELECT foreign_id, param, desired_timestamp, leased_until FROM jobs WHERE id=?;");
+				sqlite3_bind_int(stmt, 1, entries[i].m_job_id);
+				if( stmt && sqlite3_step(stmt) == SQLITE_ROW ) {
+					time_t leased_until = (time_t)sqlite3_column_int64(stmt, 3);
+					now = time(NULL);
+					if( leased_until > now ) {
+						/* claimed by another worker, eg. by a previous run that was killed while executing the job; as the job
+						may be done partly, we wait until the lease expires */
+						pthread_mutex_lock(&mailbox->m_job_condmutex);
+							add_to_lane(mailbox, lane->m_lane, entries[i].m_job_id, entries[i].m_action, leased_until);
+						pthread_mutex_unlock(&mailbox->m_job_condmutex);
+						continue;
+					}
+					if( (time_t)sqlite3_column_int64(stmt, 2) > now ) {
+						continue; /* the job was delayed in between and is already in the index again */
+					}
+
+					mrjob_t* job = &jobs[job_cnt++];
+					job->m_job_id                        = entries[i].m_job_id;
+					job->m_action                        = entries[i].m_action;
+					job->m_foreign_id                    = sqlite3_column_int (stmt, 0);
+					mrparam_set_packed(job->m_param, (char*)sqlite3_column_text(stmt, 1));
+					job->m_start_again_at                = 0;
+
+					stmt = mrsqlite3_predefine__(mailbox->m_sql,
+						"UPDATE jobs SET leased_until=? WHERE id=?;");
+					sqlite3_bind_int64(stmt, 1, time(NULL)+MRJ_LEASE_SECONDS);
+					sqlite3_bind_int  (stmt, 2, job->m_job_id);
+					sqlite3_step(stmt);
+				}
 			}
+		mrsqlite3_unlock(mailbox->m_sql);
 
-			/* delete job or execute job later again */
-			if( job.m_start_again_at ) {
-				mrsqlite3_lock(mailbox->m_sql);
-					stmt = mrsqlite3_predefine__(mailbox->m_sql, UPDATE_jobs_SET_dp_WHERE_id,
-						"UPDATE jobs SET desired_timestamp=?, param=? WHERE id=?;");
-					sqlite3_bind_int64(stmt, 1, job.m_start_again_at);
-					sqlite3_bind_text (stmt, 2, job.m_param->m_packed, -1, SQLITE_STATIC);
-					sqlite3_bind_int  (stmt, 3, job.m_job_id);
-					sqlite3_step(stmt);
-				mrsqlite3_unlock(mailbox->m_sql);
-				mrmailbox_log_info(mailbox, 0, "Job #%i delayed for %i seconds", (int)job.m_job_id, (int)(job.m_start_again_at-time(NULL)));
+		if( job_cnt == 0 ) {
+			continue;
+		}
+
+		/* execute job(s) */
+		if( jobs[0].m_action == MRJ_MARKSEEN_MSG_ON_IMAP || jobs[0].m_action == MRJ_SEND_MSG_TO_SMTP ) {
+			mrmailbox_log_info(mailbox, 0, "Executing %i job(s) starting with #%i, action %i...", job_cnt, (int)jobs[0].m_job_id, (int)jobs[0].m_action);
+			if( jobs[0].m_action == MRJ_MARKSEEN_MSG_ON_IMAP ) {
+				mrmailbox_markseen_msgs_on_imap(mailbox, jobs, job_cnt);
 			}
 			else {
-				mrsqlite3_lock(mailbox->m_sql);
-					stmt = mrsqlite3_predefine__(mailbox->m_sql, DELETE_FROM_jobs_WHERE_id,
-						"DELETE FROM jobs WHERE id=?;");
-					sqlite3_bind_int(stmt, 1, job.m_job_id);
-					sqlite3_step(stmt);
-				mrsqlite3_unlock(mailbox->m_sql);
-				mrmailbox_log_info(mailbox, 0, "Job #%i done and deleted from database", (int)job.m_job_id);
+				mrmailbox_send_msgs_to_smtp(mailbox, jobs, job_cnt);
+			}
+		}
+		else {
+			mrjob_t* job = &jobs[0];
+			mrmailbox_log_info(mailbox, 0, "Executing job #%i, action %i...", (int)job->m_job_id, (int)job->m_action);
+			switch( job->m_action ) {
+				case MRJ_CONNECT_TO_IMAP:      mrmailbox_connect_to_imap      (mailbox, job); break;
+				case MRJ_SEND_MSG_TO_IMAP:     mrmailbox_send_msg_to_imap     (mailbox, job); break;
+				case MRJ_DELETE_MSG_ON_IMAP:   mrmailbox_delete_msg_on_imap   (mailbox, job); break;
+				case MRJ_MARKSEEN_MDN_ON_IMAP: mrmailbox_markseen_mdn_on_imap (mailbox, job); break;
+				case MRJ_SEND_MDN:             mrmailbox_send_mdn             (mailbox, job); break;
+				case MRJ_FTS_BACKFILL:         mrmailbox_fts_backfill         (mailbox, job); break;
+				case MRJ_GENERATE_KEYPAIR:     mrmailbox_generate_keypair     (mailbox, job); break;
 			}
 		}
 
+		/* delete jobs or execute jobs later again (this also releases the lease) */
+		mrsqlite3_lock(mailbox->m_sql);
+		if( job_cnt > 1 ) { mrsqlite3_begin_transaction__(mailbox->m_sql); }
+			for( i = 0; i < job_cnt; i++ ) {
+				mrjob_t* job = &jobs[i];
+				if( job->m_start_again_at ) {
+					stmt = mrsqlite3_predefine__(mailbox->m_sql,
+						"UPDATE jobs SET desired_timestamp=?, param=?, leased_until=0 WHERE id=?;");
+					sqlite3_bind_int64(stmt, 1, job->m_start_again_at);
+					sqlite3_bind_text (stmt, 2, mrparam_get_packed(job->m_param), -1, SQLITE_STATIC);
+					sqlite3_bind_int  (stmt, 3, job->m_job_id);
+					if( sqlite3_step(stmt) == SQLITE_DONE && sqlite3_changes(mailbox->m_sql->m_cobj) > 0 ) { /* not re-added if the job was killed while executed */
+						pthread_mutex_lock(&mailbox->m_job_condmutex);
+							add_to_lane(mailbox, lane->m_lane, job->m_job_id, job->m_action, job->m_start_again_at);
+						pthread_mutex_unlock(&mailbox->m_job_condmutex);
+					}
+					mrmailbox_log_info(mailbox, 0, "Job #%i delayed for %i seconds", (int)job->m_job_id, (int)(job->m_start_again_at-time(NULL)));
+				}
+				else {
+					stmt = mrsqlite3_predefine__(mailbox->m_sql,
+						"DELETE FROM jobs WHERE id=?;");
+					sqlite3_bind_int(stmt, 1, job->m_job_id);
+					sqlite3_step(stmt);
+					mrmailbox_log_info(mailbox, 0, "Job #%i done and deleted from database", (int)job->m_job_id);
+				}
+			}
+		if( job_cnt > 1 ) { mrsqlite3_commit__(mailbox->m_sql); }
+		mrsqlite3_unlock(mailbox->m_sql);
 	}
 
 	/* exit thread */
 exit_:
-	mrparam_unref(job.m_param);
-	mrmailbox_log_info(mailbox, 0, "Exit job thread.");
+	for( i = 0; i < MRJ_COALESCE_MAX; i++ ) {
+		mrparam_unref(jobs[i].m_param);
+	}
+	free(jobs);
+	mrmailbox_log_info(mailbox, 0, "Exit job thread for lane %i.", lane->m_lane);
 	mrosnative_unsetup_thread(mailbox); /* must be very last */
 	return NULL;
 }
@@ -178,23 +322,99 @@ exit_:
 
 void mrjob_init_thread(mrmailbox_t* mailbox)
 {
+	int i;
+
+	if( (mailbox->m_job_lanes=calloc(MRJ_LANE_CNT, sizeof(mrjoblane_t)))==NULL ) {
+		exit(26); /* cannot allocate little memory, unrecoverable error */
+	}
+
 	pthread_mutex_init(&mailbox->m_job_condmutex, NULL);
-    pthread_cond_init(&mailbox->m_job_cond, NULL);
-    pthread_create(&mailbox->m_job_thread, NULL, job_thread_entry_point, mailbox);
+
+	for( i = 0; i < MRJ_LANE_CNT; i++ ) {
+		mrjoblane_t* lane = &mailbox->m_job_lanes[i];
+		lane->m_mailbox = mailbox;
+		lane->m_lane    = i;
+		lane->m_timers.m_cmp = cmp_by_timestamp;
+		lane->m_ready.m_cmp  = cmp_by_priority;
+		pthread_cond_init(&lane->m_cond, NULL);
+		pthread_create(&lane->m_thread, NULL, job_thread_entry_point, lane);
+	}
 }
 
 
 void mrjob_exit_thread(mrmailbox_t* mailbox)
 {
+	int i;
+
 	pthread_mutex_lock(&mailbox->m_job_condmutex);
-		mailbox->m_job_condflag = 1;
 		mailbox->m_job_do_exit = 1;
-		pthread_cond_signal(&mailbox->m_job_cond);
+		for( i = 0; i < MRJ_LANE_CNT; i++ ) {
+			mailbox->m_job_lanes[i].m_condflag = 1;
+			pthread_cond_signal(&mailbox->m_job_lanes[i].m_cond);
+		}
 	pthread_mutex_unlock(&mailbox->m_job_condmutex);
 
-	pthread_join(mailbox->m_job_thread, NULL);
-	pthread_cond_destroy(&mailbox->m_job_cond);
+	for( i = 0; i < MRJ_LANE_CNT; i++ ) {
+		pthread_join(mailbox->m_job_lanes[i].m_thread, NULL);
+		pthread_cond_destroy(&mailbox->m_job_lanes[i].m_cond);
+		heap_empty(&mailbox->m_job_lanes[i].m_timers);
+		heap_empty(&mailbox->m_job_lanes[i].m_ready);
+	}
 	pthread_mutex_destroy(&mailbox->m_job_condmutex);
+
+	free(mailbox->m_job_lanes);
+	mailbox->m_job_lanes = NULL;
+}
+
+
+int mrjob_get_lane(int action)
+{
+	/* CAVE: if you change the mapping, also update the lane of the existing jobs, see mrsqlite3_open__() */
+	switch( action ) {
+		case MRJ_SEND_MSG_TO_SMTP:
+		case MRJ_SEND_MDN:
+			return MRJ_LANE_SMTP;
+
+		case MRJ_CONNECT_TO_IMAP:
+		case MRJ_SEND_MSG_TO_IMAP:
+		case MRJ_DELETE_MSG_ON_IMAP:
+		case MRJ_MARKSEEN_MSG_ON_IMAP:
+		case MRJ_MARKSEEN_MDN_ON_IMAP:
+			return MRJ_LANE_IMAP;
+	}
+	return MRJ_LANE_LOCAL;
+}
+
+
+void mrjob_reload__(mrmailbox_t* mailbox)
+{
+	sqlite3_stmt* stmt = NULL;
+	int           i, lane;
+
+	if( mailbox == NULL || mailbox->m_job_lanes == NULL /*job threads already exited*/ ) {
+		return;
+	}
+
+	pthread_mutex_lock(&mailbox->m_job_condmutex);
+
+		for( i = 0; i < MRJ_LANE_CNT; i++ ) {
+			mailbox->m_job_lanes[i].m_timers.m_cnt = 0;
+			mailbox->m_job_lanes[i].m_ready.m_cnt  = 0;
+		}
+
+		if( mrsqlite3_is_open(mailbox->m_sql) )
+		{
+			/* this is the only time the index is read from the database, afterwards it is kept in sync by mrjob_add__(), mrjob_kill_action__() and the job threads */
+			stmt = mrsqlite3_prepare_v2_(mailbox->m_sql, "SELECT id, action, MAX(desired_timestamp, leased_until) FROM jobs;"); /* leased jobs are not started before the lease expires */
+			while( stmt && sqlite3_step(stmt) == SQLITE_ROW ) {
+				lane = mrjob_get_lane(sqlite3_column_int(stmt, 1));
+				add_to_lane(mailbox, lane, sqlite3_column_int(stmt, 0), sqlite3_column_int(stmt, 1), (time_t)sqlite3_column_int64(stmt, 2));
+			}
+		}
+
+	pthread_mutex_unlock(&mailbox->m_job_condmutex);
+
+	if( stmt ) { sqlite3_finalize(stmt); }
 }
 
 
@@ -203,8 +423,9 @@ uint32_t mrjob_add__(mrmailbox_t* mailbox, int action, int foreign_id, const cha
 	time_t        timestamp = time(NULL);
 	sqlite3_stmt* stmt;
 	uint32_t      job_id = 0;
+	int           lane = mrjob_get_lane(action);
 
-	stmt = mrsqlite3_predefine__(mailbox->m_sql, INSERT_INTO_jobs_aafp,
+	stmt = mrsqlite3_predefine__(mailbox->m_sql,
 		"INSERT INTO jobs (added_timestamp, action, foreign_id, param) VALUES (?,?,?,?);");
 	sqlite3_bind_int64(stmt, 1, timestamp);
 	sqlite3_bind_int  (stmt, 2, action);
@@ -218,9 +439,8 @@ uint32_t mrjob_add__(mrmailbox_t* mailbox, int action, int foreign_id, const cha
 
 	pthread_mutex_lock(&mailbox->m_job_condmutex);
 		if( !mailbox->m_job_do_exit ) {
-			mrmailbox_log_info(mailbox, 0, "Signal job thread to wake up...");
-			mailbox->m_job_condflag = 1;
-			pthread_cond_signal(&mailbox->m_job_cond);
+			mrmailbox_log_info(mailbox, 0, "Signal job thread for lane %i to wake up...", lane);
+			add_to_lane(mailbox, lane, job_id, action, 0);
 		}
 	pthread_mutex_unlock(&mailbox->m_job_condmutex);
 
@@ -270,9 +490,18 @@ void mrjob_kill_action__(mrmailbox_t* mailbox, int action)
 		return;
 	}
 
-	sqlite3_stmt* stmt = mrsqlite3_predefine__(mailbox->m_sql, DELETE_FROM_jobs_WHERE_action,
+	sqlite3_stmt* stmt = mrsqlite3_predefine__(mailbox->m_sql,
 		"DELETE FROM jobs WHERE action=?;");
 	sqlite3_bind_int(stmt, 1, action);
 	sqlite3_step(stmt);
+
+	if( mailbox->m_job_lanes == NULL ) {
+		return;
+	}
+
+	pthread_mutex_lock(&mailbox->m_job_condmutex);
+		heap_remove_action(&mailbox->m_job_lanes[mrjob_get_lane(action)].m_timers, action);
+		heap_remove_action(&mailbox->m_job_lanes[mrjob_get_lane(action)].m_ready, action);
+	pthread_mutex_unlock(&mailbox->m_job_condmutex);
 }
 
@@ -26,6 +26,8 @@ extern "C" {
 #endif
 
 
+#define MRJ_FTS_BACKFILL           10     /* lowest priority, runs in the local lane */
+#define MRJ_GENERATE_KEYPAIR       20     /* local lane, started after the configuration */
 #define MRJ_DELETE_MSG_ON_IMAP     100    /* low priority ... */
 #define MRJ_MARKSEEN_MDN_ON_IMAP   102
 #define MRJ_SEND_MDN               105
@@ -34,6 +36,18 @@ extern "C" {
 #define MRJ_SEND_MSG_TO_SMTP       800
 #define MRJ_CONNECT_TO_IMAP        900    /* ... high priority*/
 
+
+/* Jobs are executed by one worker thread per lane; lanes run concurrently, inside a lane, jobs are executed
+ordered by priority and id.  This way, eg. a slow SMTP-send does not delay marking messages as seen on IMAP. */
+#define MRJ_LANE_LOCAL             0      /* jobs that need neither IMAP nor SMTP */
+#define MRJ_LANE_IMAP              1
+#define MRJ_LANE_SMTP              2
+#define MRJ_LANE_CNT               3
+
+#define MRJ_LEASE_SECONDS          (5*60) /* a job claimed by a worker is not picked up again before the lease expires, also not after a restart */
+
+#define MRJ_COALESCE_MAX           200    /* max. number of due MRJ_MARKSEEN_MSG_ON_IMAP resp. MRJ_SEND_MSG_TO_SMTP jobs executed together, see mrmailbox_markseen_msgs_on_imap() and mrmailbox_send_msgs_to_smtp() */
+
 /**
  * Library-internal.
  */
@@ -49,8 +63,56 @@ typedef struct mrjob_t
 	time_t     m_start_again_at; /* 1=on next loop, >1=on timestamp, 0=delete job (default) */
 } mrjob_t;
 
+/**
+ * Library-internal.
+ */
+typedef struct mrjobentry_t
+{
+	/** @privatesection */
+
+	uint32_t   m_job_id;
+	int        m_action;
+	time_t     m_desired_timestamp;
+} mrjobentry_t;
+
+/**
+ * Library-internal. Binary heap of job entries, the order is defined by m_cmp.
+ */
+typedef struct mrjobheap_t
+{
+	/** @privatesection */
+
+	mrjobentry_t* m_entries;
+	int           m_cnt;
+	int           m_allocated;
+	int           (*m_cmp)(const mrjobentry_t*, const mrjobentry_t*); /* <0 if the first entry should be popped before the second */
+} mrjobheap_t;
+
+/**
+ * Library-internal.
+ */
+typedef struct mrjoblane_t
+{
+	/** @privatesection */
+
+	mrmailbox_t*    m_mailbox;
+	int             m_lane;
+	pthread_t       m_thread;
+	pthread_cond_t  m_cond;     /* signalled if a job is added to this lane; the mutex is mrmailbox_t::m_job_condmutex */
+	int             m_condflag;
+
+	/* In-memory index of the pending jobs of this lane, so the worker knows when to wake up and what to do next
+	without querying the database.  Jobs not yet due wait in m_timers ordered by time, due jobs are moved to
+	m_ready which is ordered by priority.  The currently executed job is in neither heap.  Both heaps are
+	protected by mrmailbox_t::m_job_condmutex. */
+	mrjobheap_t     m_timers;
+	mrjobheap_t     m_ready;
+} mrjoblane_t;
+
 void     mrjob_init_thread     (mrmailbox_t*);
 void     mrjob_exit_thread     (mrmailbox_t*);
+int      mrjob_get_lane        (int action);
+void     mrjob_reload__        (mrmailbox_t*); /* rebuild the in-memory job index from the database; if the database is closed, the index is just emptied */
 uint32_t mrjob_add__           (mrmailbox_t*, int action, int foreign_id, const char* param); /* returns the job_id or 0 on errors. the job may or may not be done if the function returns. */
 void     mrjob_kill_action__   (mrmailbox_t*, int action); /* delete all pending jobs with the given action */
 
@@ -239,7 +239,7 @@ int mrkey_save_self_keypair__(const mrkey_t* public_key, const mrkey_t* private_
 		return 0;
 	}
 
-	stmt = mrsqlite3_predefine__(sql, INSERT_INTO_keypairs_aippc,
+	stmt = mrsqlite3_predefine__(sql,
 		"INSERT INTO keypairs (addr, is_default, public_key, private_key, created) VALUES (?,?,?,?,?);");
 	sqlite3_bind_text (stmt, 1, addr, -1, SQLITE_STATIC);
 	sqlite3_bind_int  (stmt, 2, is_default);
@@ -250,6 +250,7 @@ int mrkey_save_self_keypair__(const mrkey_t* public_key, const mrkey_t* private_
 		return 0;
 	}
 
+	mrpgp_forget_cached_keys(); /* eg. an imported key replaces the old default key */
 	return 1;
 }
 
@@ -263,7 +264,7 @@ int mrkey_load_self_public__(mrkey_t* ths, const char* self_addr, mrsqlite3_t* s
 	}
 
 	mrkey_empty(ths);
-	stmt = mrsqlite3_predefine__(sql, SELECT_public_key_FROM_keypairs_WHERE_default,
+	stmt = mrsqlite3_predefine__(sql,
 		"SELECT public_key FROM keypairs WHERE addr=? AND is_default=1;");
 	sqlite3_bind_text (stmt, 1, self_addr, -1, SQLITE_STATIC);
 	if( sqlite3_step(stmt) != SQLITE_ROW ) {
@@ -283,7 +284,7 @@ int mrkey_load_self_private__(mrkey_t* ths, const char* self_addr, mrsqlite3_t*
 	}
 
 	mrkey_empty(ths);
-	stmt = mrsqlite3_predefine__(sql, SELECT_private_key_FROM_keypairs_WHERE_default,
+	stmt = mrsqlite3_predefine__(sql,
 		"SELECT private_key FROM keypairs WHERE addr=? AND is_default=1;");
 	sqlite3_bind_text (stmt, 1, self_addr, -1, SQLITE_STATIC);
 	if( sqlite3_step(stmt) != SQLITE_ROW ) {
@@ -87,7 +87,7 @@ int mrkeyring_load_self_private_for_decrypting__(mrkeyring_t* ths, const char* s
 		return 0;
 	}
 
-	stmt = mrsqlite3_predefine__(sql, SELECT_private_key_FROM_keypairs_ORDER_BY_default,
+	stmt = mrsqlite3_predefine__(sql,
 		"SELECT private_key FROM keypairs ORDER BY addr=? DESC, is_default DESC;");
 	sqlite3_bind_text (stmt, 1, self_addr, -1, SQLITE_STATIC);
 	while( sqlite3_step(stmt) == SQLITE_ROW ) {
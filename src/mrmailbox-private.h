@@ -31,7 +31,10 @@ typedef struct mrimap_t       mrimap_t;
 typedef struct mrsmtp_t       mrsmtp_t;
 typedef struct mrsqlite3_t    mrsqlite3_t;
 typedef struct mrjob_t        mrjob_t;
+typedef struct mrjoblane_t    mrjoblane_t;
 typedef struct mrmimeparser_t mrmimeparser_t;
+typedef struct mrarena_t      mrarena_t;
+typedef struct mrimfpipe_t    mrimfpipe_t;
 
 
 /** Structure behind mrmailbox_t */
@@ -49,11 +52,10 @@ struct _mrmailbox
 	mrsqlite3_t*     m_sql;                   /**< Internal SQL object, never NULL */
 	mrimap_t*        m_imap;                  /**< Internal IMAP object, never NULL */
 	mrsmtp_t*        m_smtp;                  /**< Internal SMTP object, never NULL */
+	mrimfpipe_t*     m_imf_pipe;              /**< Internal, parses messages fetched by m_imap in several threads, never NULL */
 
-	pthread_t        m_job_thread;            /**< Internal */
-	pthread_cond_t   m_job_cond;              /**< Internal */
+	mrjoblane_t*     m_job_lanes;             /**< Internal, MRJ_LANE_CNT job lanes, each with its own worker thread */
 	pthread_mutex_t  m_job_condmutex;         /**< Internal */
-	int              m_job_condflag;          /**< Internal */
 	int              m_job_do_exit;           /**< Internal */
 
 	mrmailboxcb_t    m_cb;                    /**< Internal */
@@ -66,6 +68,14 @@ struct _mrmailbox
 	pthread_mutex_t  m_wake_lock_critical;    /**< Internal */
 
 	int              m_e2ee_enabled;          /**< Internal */
+	size_t           m_decode_window;         /**< Internal, max. bytes decoded at once when writing attachments to the blob directory, config key `decode_window` */
+
+	int              m_receive_threads;       /**< Internal, config key `receive_threads`, 0=one thread per CPU core */
+
+	#define          MR_SPARE_ARENA_CNT       9 /* one per parse thread of mrimfpipe_t plus one */
+	mrarena_t*       m_spare_arenas[MR_SPARE_ARENA_CNT]; /**< Internal, the arenas of freed mrmimeparser_t objects, taken over by the next ones */
+	int              m_spare_arena_cnt;       /**< Internal */
+	pthread_mutex_t  m_spare_arena_critical;  /**< Internal */
 
 	#define          MR_LOG_RINGBUF_SIZE 200
 	pthread_mutex_t  m_log_ringbuf_critical;  /**< Internal */
@@ -77,12 +87,16 @@ struct _mrmailbox
 
 };
 
+void            mrmailbox_sync_server_flags                       (mrmailbox_t*, const char* server_folder, const mrarray_t* seen_uids, const mrarray_t* gone_uid_ranges);
 void            mrmailbox_receive_imf                             (mrmailbox_t*, const char* imf_raw_not_terminated, size_t imf_raw_bytes, const char* server_folder, uint32_t server_uid, uint32_t flags);
+mrmimeparser_t* mrmailbox_parse_imf                               (mrmailbox_t*, const char* imf_raw_not_terminated, size_t imf_raw_bytes); /* may be called from several threads */
+void            mrmailbox_receive_parsed_imf                      (mrmailbox_t*, mrmimeparser_t*, const char* imf_raw_not_terminated, size_t imf_raw_bytes, const char* server_folder, uint32_t server_uid, uint32_t flags); /* takes the ownership of the mrmimeparser_t object */
+void            mrmailbox_receive_parsed_imf__                    (mrmailbox_t*, mrmimeparser_t*, const char* imf_raw_not_terminated, size_t imf_raw_bytes, const char* server_folder, uint32_t server_uid, uint32_t flags, carray* events); /* same, the database is locked by the caller */
 uint32_t        mrmailbox_send_msg_object                         (mrmailbox_t*, uint32_t chat_id, mrmsg_t*);
 void            mrmailbox_connect_to_imap                         (mrmailbox_t*, mrjob_t*);
 void            mrmailbox_wake_lock                               (mrmailbox_t*);
 void            mrmailbox_wake_unlock                             (mrmailbox_t*);
-int             mrmailbox_get_archived_count__                    (mrmailbox_t*);
+int             mrmailbox_get_archived_count__                    (mrsqlite3_t*);
 size_t          mrmailbox_get_real_contact_cnt__                  (mrmailbox_t*);
 uint32_t        mrmailbox_add_or_lookup_contact__                 (mrmailbox_t*, const char* display_name /*can be NULL*/, const char* addr_spec, int origin, int* sth_modified);
 int             mrmailbox_get_contact_origin__                    (mrmailbox_t*, uint32_t id, int* ret_blocked);
@@ -98,9 +112,11 @@ void            mrmailbox_create_or_lookup_nchat_by_contact_id__  (mrmailbox_t*,
 void            mrmailbox_lookup_real_nchat_by_contact_id__       (mrmailbox_t*, uint32_t contact_id, uint32_t* ret_chat_id, int* ret_chat_blocked);
 int             mrmailbox_get_total_msg_count__                   (mrmailbox_t*, uint32_t chat_id);
 int             mrmailbox_get_fresh_msg_count__                   (mrmailbox_t*, uint32_t chat_id);
-uint32_t        mrmailbox_get_last_deaddrop_fresh_msg__           (mrmailbox_t*);
-void            mrmailbox_send_msg_to_smtp                        (mrmailbox_t*, mrjob_t*);
+uint32_t        mrmailbox_get_last_deaddrop_fresh_msg__           (mrsqlite3_t*);
+void            mrmailbox_send_msgs_to_smtp                       (mrmailbox_t*, mrjob_t* jobs, int job_cnt);
 void            mrmailbox_send_msg_to_imap                        (mrmailbox_t*, mrjob_t*);
+#define         MR_SPOOL_DIR "spool" /* subdirectory of the blob directory with the messages to upload to IMAP, not part of backups */
+void            mrmailbox_sweep_spool__                           (mrmailbox_t*);
 int             mrmailbox_add_contact_to_chat__                   (mrmailbox_t*, uint32_t chat_id, uint32_t contact_id);
 int             mrmailbox_is_contact_in_chat__                    (mrmailbox_t*, uint32_t chat_id, uint32_t contact_id);
 int             mrmailbox_get_chat_contact_count__                (mrmailbox_t*, uint32_t chat_id);
@@ -112,18 +128,23 @@ int             mrmailbox_rfc724_mid_cnt__                        (mrmailbox_t*,
 int             mrmailbox_rfc724_mid_exists__                     (mrmailbox_t*, const char* rfc724_mid, char** ret_server_folder, uint32_t* ret_server_uid);
 void            mrmailbox_update_server_uid__                     (mrmailbox_t*, const char* rfc724_mid, const char* server_folder, uint32_t server_uid);
 void            mrmailbox_update_msg_chat_id__                    (mrmailbox_t*, uint32_t msg_id, uint32_t chat_id);
+void            mrmailbox_update_chat_last_msg__                  (mrmailbox_t*, uint32_t chat_id); /* must be called if messages of the chat are added, moved, deleted or if the draft changes */
 void            mrmailbox_update_msg_state__                      (mrmailbox_t*, uint32_t msg_id, int state);
 void            mrmailbox_delete_msg_on_imap                      (mrmailbox_t* mailbox, mrjob_t* job);
 int             mrmailbox_mdn_from_ext__                          (mrmailbox_t*, uint32_t from_id, const char* rfc724_mid, uint32_t* ret_chat_id, uint32_t* ret_msg_id); /* returns 1 if an event should be send */
 void            mrmailbox_send_mdn                                (mrmailbox_t*, mrjob_t* job);
 void            mrmailbox_markseen_msg_on_imap                    (mrmailbox_t* mailbox, mrjob_t* job);
+void            mrmailbox_markseen_msgs_on_imap                   (mrmailbox_t* mailbox, mrjob_t* jobs, int job_cnt);
 void            mrmailbox_markseen_mdn_on_imap                    (mrmailbox_t* mailbox, mrjob_t* job);
+void            mrmailbox_fts_backfill                            (mrmailbox_t* mailbox, mrjob_t* job);
+void            mrmailbox_fts_start_backfill__                    (mrmailbox_t*);
 int             mrmailbox_get_thread_index                        (void);
 
 
 /* library private: end-to-end-encryption */
 #define MR_E2EE_DEFAULT_ENABLED  1
 #define MR_MDNS_DEFAULT_ENABLED  1
+#define MR_DECODE_WINDOW_DEFAULT (256*1024)
 
 typedef struct mrmailbox_e2ee_helper_t {
 	int   m_encryption_successfull;
@@ -134,6 +155,7 @@ void            mrmailbox_e2ee_encrypt      (mrmailbox_t*, const clist* recipien
 int             mrmailbox_e2ee_decrypt      (mrmailbox_t*, struct mailmime* in_out_message, int* ret_validation_errors); /* returns 1 if sth. was decrypted, 0 in other cases */
 void            mrmailbox_e2ee_thanks       (mrmailbox_e2ee_helper_t*); /* frees data referenced by "mailmime" but not freed by mailmime_free(). After calling mre2ee_unhelp(), in_out_message cannot be used any longer! */
 int             mrmailbox_ensure_secret_key_exists (mrmailbox_t*); /* makes sure, the private key exists, needed only for exporting keys and the case no message was sent before */
+void            mrmailbox_generate_keypair  (mrmailbox_t*, mrjob_t*);
 char*           mrmailbox_create_setup_code (mrmailbox_t*);
 char*           mrmailbox_normalize_setup_code(mrmailbox_t*, const char* passphrase);
 char*           mrmailbox_render_setup_file (mrmailbox_t*, const char* passphrase);
@@ -22,6 +22,7 @@
 
 #include <sys/stat.h>
 #include <sys/types.h> /* for getpid() */
+#include <dirent.h>
 #include <unistd.h>    /* for getpid() */
 #include <openssl/opensslv.h>
 #include <assert.h>
@@ -35,6 +36,7 @@
 #include "mrkey.h"
 #include "mrpgp.h"
 #include "mrapeerstate.h"
+#include "mrimfpipe.h"
 
 
 /*******************************************************************************
@@ -64,7 +66,22 @@ static void cb_set_config(mrimap_t* imap, const char* key, const char* value)
 static void cb_receive_imf(mrimap_t* imap, const char* imf_raw_not_terminated, size_t imf_raw_bytes, const char* server_folder, uint32_t server_uid, uint32_t flags)
 {
 	mrmailbox_t* mailbox = (mrmailbox_t*)imap->m_userData;
-	mrmailbox_receive_imf(mailbox, imf_raw_not_terminated, imf_raw_bytes, server_folder, server_uid, flags);
+	if( mailbox->m_receive_threads == 1 ) {
+		mrmailbox_receive_imf(mailbox, imf_raw_not_terminated, imf_raw_bytes, server_folder, server_uid, flags);
+	}
+	else {
+		mrimfpipe_add(mailbox->m_imf_pipe, mailbox->m_receive_threads, imf_raw_not_terminated, imf_raw_bytes, server_folder, server_uid, flags);
+	}
+}
+static void cb_sync_flags(mrimap_t* imap, const char* server_folder, const mrarray_t* seen_uids, const mrarray_t* gone_uid_ranges)
+{
+	mrmailbox_t* mailbox = (mrmailbox_t*)imap->m_userData;
+	mrmailbox_sync_server_flags(mailbox, server_folder, seen_uids, gone_uid_ranges);
+}
+static int cb_flush_imf(mrimap_t* imap)
+{
+	mrmailbox_t* mailbox = (mrmailbox_t*)imap->m_userData;
+	return mrimfpipe_flush(mailbox->m_imf_pipe);
 }
 
 
@@ -111,11 +128,14 @@ mrmailbox_t* mrmailbox_new(mrmailboxcb_t cb, void* userdata, const char* os_name
 
 	pthread_mutex_init(&ths->m_wake_lock_critical, NULL);
 
+	pthread_mutex_init(&ths->m_spare_arena_critical, NULL);
+
 	ths->m_magic    = MR_MAILBOX_MAGIC;
 	ths->m_sql      = mrsqlite3_new(ths);
 	ths->m_cb       = cb? cb : cb_dummy;
 	ths->m_userdata = userdata;
-	ths->m_imap     = mrimap_new(cb_get_config, cb_set_config, cb_receive_imf, (void*)ths, ths);
+	ths->m_imap     = mrimap_new(cb_get_config, cb_set_config, cb_receive_imf, cb_flush_imf, cb_sync_flags, (void*)ths, ths);
+	ths->m_imf_pipe = mrimfpipe_new(ths);
 	ths->m_smtp     = mrsmtp_new(ths);
 	ths->m_os_name  = strdup_keep_null(os_name);
 
@@ -170,10 +190,16 @@ void mrmailbox_unref(mrmailbox_t* mailbox)
 	}
 
 	mrimap_unref(mailbox->m_imap);
+	mrimfpipe_unref(mailbox->m_imf_pipe); /* after the IMAP threads are stopped, before the database object is freed */
 	mrsmtp_unref(mailbox->m_smtp);
 	mrsqlite3_unref(mailbox->m_sql);
 	pthread_mutex_destroy(&mailbox->m_wake_lock_critical);
 
+	pthread_mutex_destroy(&mailbox->m_spare_arena_critical);
+	while( mailbox->m_spare_arena_cnt > 0 ) {
+		mrarena_unref(mailbox->m_spare_arenas[--mailbox->m_spare_arena_cnt]);
+	}
+
 	pthread_mutex_destroy(&mailbox->m_log_ringbuf_critical);
 	for( int i = 0; i < MR_LOG_RINGBUF_SIZE; i++ ) {
 		free(mailbox->m_log_ringbuf[i]);
@@ -212,6 +238,15 @@ static void update_config_cache__(mrmailbox_t* ths, const char* key)
 	if( key==NULL || strcmp(key, "e2ee_enabled")==0 ) {
 		ths->m_e2ee_enabled = mrsqlite3_get_config_int__(ths->m_sql, "e2ee_enabled", MR_E2EE_DEFAULT_ENABLED);
 	}
+
+	if( key==NULL || strcmp(key, "decode_window")==0 ) {
+		int32_t decode_window = mrsqlite3_get_config_int__(ths->m_sql, "decode_window", MR_DECODE_WINDOW_DEFAULT);
+		ths->m_decode_window = decode_window >= 4096? decode_window : 4096;
+	}
+
+	if( key==NULL || strcmp(key, "receive_threads")==0 ) {
+		ths->m_receive_threads = mrsqlite3_get_config_int__(ths->m_sql, "receive_threads", 0);
+	}
 }
 
 
@@ -255,6 +290,8 @@ int mrmailbox_open(mrmailbox_t* mailbox, const char* dbfile, const char* blobdir
 			goto cleanup;
 		}
 		mrjob_kill_action__(mailbox, MRJ_CONNECT_TO_IMAP);
+		mrjob_reload__(mailbox);
+		mrmailbox_fts_start_backfill__(mailbox);
 
 		/* backup dbfile name */
 		mailbox->m_dbfile = safe_strdup(dbfile);
@@ -271,6 +308,8 @@ int mrmailbox_open(mrmailbox_t* mailbox, const char* dbfile, const char* blobdir
 
 		update_config_cache__(mailbox, NULL);
 
+		mrmailbox_sweep_spool__(mailbox);
+
 		success = 1;
 
 cleanup:
@@ -309,6 +348,7 @@ void mrmailbox_close(mrmailbox_t* mailbox)
 		if( mrsqlite3_is_open(mailbox->m_sql) ) {
 			mrsqlite3_close__(mailbox->m_sql);
 		}
+		mrjob_reload__(mailbox);
 
 		free(mailbox->m_dbfile);
 		mailbox->m_dbfile = NULL;
@@ -379,6 +419,11 @@ char* mrmailbox_get_blobdir(mrmailbox_t* mailbox)
  * - displayname  = Own name to use when sending messages.  MUAs are allowed to spread this way eg. using CC, defaults to empty
  * - selfstatus   = Own status to display eg. in email footers, defaults to a standard text
  * - e2ee_enabled = 0=no e2ee, 1=prefer encryption (default)
+ * - wal_mode     = 1=use SQLite's write-ahead-log and separate reader connections, so the UI is not blocked by receiving messages; 0=rollback journal (default); applied on the next mrmailbox_open()
+ * - decode_window = max. number of bytes of an attachment decoded at once when receiving messages, defaults to 256 KB
+ * - receive_threads = number of threads parsing and decrypting fetched messages, 0=one per CPU core, up to 8 (default); 1=parse on the IMAP thread; changes to the number of threads are applied on the next start
+ * - imap_compress = 1=use COMPRESS=DEFLATE if the IMAP-server supports it (default), 0=do not compress; applied on the next connect
+ * - imap_job_session = 1=use a second IMAP-connection for sending, deleting and marking messages so that IDLE is not interrupted (default), 0=use a single connection; applied on the next connect
  *
  * @memberof mrmailbox_t
  *
@@ -505,6 +550,10 @@ char* mrmailbox_get_info(mrmailbox_t* mailbox)
 	char *displayname = NULL, *temp = NULL, *l_readable_str = NULL, *l2_readable_str = NULL, *fingerprint_str = NULL;
 	mrloginparam_t *l = NULL, *l2 = NULL;
 	int contacts, chats, real_msgs, deaddrop_msgs, is_configured, dbversion, mdns_enabled, e2ee_enabled, prv_key_count, pub_key_count;
+	int stmt_cnt, stmt_hits, stmt_misses;
+	int cache_cnt, cache_hits, cache_misses;
+	int imap_compress, imap_compress_enabled;
+	uint64_t imap_bytes_uncompressed, imap_bytes_compressed;
 	mrkey_t* self_public = mrkey_new();
 
 	mrstrbuilder_t  ret;
@@ -538,15 +587,23 @@ char* mrmailbox_get_info(mrmailbox_t* mailbox)
 
 		mdns_enabled    = mrsqlite3_get_config_int__(mailbox->m_sql, "mdns_enabled", MR_MDNS_DEFAULT_ENABLED);
 
-		sqlite3_stmt* stmt = mrsqlite3_prepare_v2_(mailbox->m_sql, "SELECT COUNT(*) FROM keypairs;");
+		sqlite3_stmt* stmt = mrsqlite3_predefine__(mailbox->m_sql, "SELECT COUNT(*) FROM keypairs;");
 		sqlite3_step(stmt);
 		prv_key_count = sqlite3_column_int(stmt, 0);
-		sqlite3_finalize(stmt);
 
-		stmt = mrsqlite3_prepare_v2_(mailbox->m_sql, "SELECT COUNT(*) FROM acpeerstates;");
+		stmt = mrsqlite3_predefine__(mailbox->m_sql, "SELECT COUNT(*) FROM acpeerstates;");
 		sqlite3_step(stmt);
 		pub_key_count = sqlite3_column_int(stmt, 0);
-		sqlite3_finalize(stmt);
+
+		stmt_cnt        = mrhash_count(&mailbox->m_sql->m_stmt_cache);
+		stmt_hits       = mailbox->m_sql->m_stmt_hits;
+		stmt_misses     = mailbox->m_sql->m_stmt_misses;
+
+		cache_cnt       = mrcache_get_count(mailbox->m_sql->m_cache);
+		cache_hits      = mailbox->m_sql->m_cache? mailbox->m_sql->m_cache->m_hits : 0;
+		cache_misses    = mailbox->m_sql->m_cache? mailbox->m_sql->m_cache->m_misses : 0;
+
+		imap_compress   = mrsqlite3_get_config_int__(mailbox->m_sql, "imap_compress", MR_IMAP_COMPRESS_DEFAULT);
 
 		if( mrkey_load_self_public__(self_public, l2->m_addr, mailbox->m_sql) ) {
 			fingerprint_str = mrkey_get_formatted_fingerprint(self_public);
@@ -557,6 +614,9 @@ char* mrmailbox_get_info(mrmailbox_t* mailbox)
 
 	mrsqlite3_unlock(mailbox->m_sql);
 
+	imap_compress_enabled   = mailbox->m_imap? mailbox->m_imap->m_compress_enabled : 0;
+	mrimap_get_bytes(mailbox->m_imap, &imap_bytes_uncompressed, &imap_bytes_compressed);
+
 	l_readable_str = mrloginparam_get_readable(l);
 	l2_readable_str = mrloginparam_get_readable(l2);
 
@@ -571,6 +631,9 @@ char* mrmailbox_get_info(mrmailbox_t* mailbox)
 		"Messages in mailbox: %i\n"
 		"Contacts: %i\n"
 		"Database=%s, dbversion=%i, Blobdir=%s\n"
+		"Statement cache: %i statements, %i hits, %i misses\n"
+		"Object cache: %i objects, %i hits, %i misses\n"
+		"IMAP compression: %s, %llu bytes transferred as %llu bytes\n"
 		"\n"
 		"displayname=%s\n"
 		"configured=%i\n"
@@ -587,6 +650,9 @@ char* mrmailbox_get_info(mrmailbox_t* mailbox)
 
 		, chats, real_msgs, deaddrop_msgs, contacts
 		, mailbox->m_dbfile? mailbox->m_dbfile : unset,   dbversion,   mailbox->m_blobdir? mailbox->m_blobdir : unset
+		, stmt_cnt, stmt_hits, stmt_misses
+		, cache_cnt, cache_hits, cache_misses
+		, imap_compress_enabled? "active" : (imap_compress? "inactive" : "disabled"),   (unsigned long long)imap_bytes_uncompressed,   (unsigned long long)imap_bytes_compressed
 
         , displayname? displayname : unset
 		, is_configured
@@ -639,9 +705,9 @@ char* mrmailbox_get_info(mrmailbox_t* mailbox)
  ******************************************************************************/
 
 
-int mrmailbox_get_archived_count__(mrmailbox_t* mailbox)
+int mrmailbox_get_archived_count__(mrsqlite3_t* sql)
 {
-	sqlite3_stmt* stmt = mrsqlite3_predefine__(mailbox->m_sql, SELECT_COUNT_FROM_chats_WHERE_archived, "SELECT COUNT(*) FROM chats WHERE blocked=0 AND archived=1;");
+	sqlite3_stmt* stmt = mrsqlite3_predefine__(sql, "SELECT COUNT(*) FROM chats WHERE blocked=0 AND archived=1;");
 	if( sqlite3_step(stmt) == SQLITE_ROW ) {
 		return sqlite3_column_int(stmt, 0);
 	}
@@ -843,24 +909,23 @@ mrchatlist_t* mrmailbox_get_chatlist(mrmailbox_t* mailbox, int listflags, const
 	clock_t       start = clock();
 
 	int success = 0;
-	int db_locked = 0;
+	mrsqlite3_t* reader = NULL;
 	mrchatlist_t* obj = mrchatlist_new(mailbox);
 
 	if( mailbox == NULL || mailbox->m_magic != MR_MAILBOX_MAGIC ) {
 		goto cleanup;
 	}
 
-	mrsqlite3_lock(mailbox->m_sql);
-	db_locked = 1;
+	reader = mrsqlite3_lock_reader(mailbox->m_sql);
 
-		if( !mrchatlist_load_from_db__(obj, listflags, query) ) {
+		if( !mrchatlist_load_from_db__(obj, reader, listflags, query) ) {
 			goto cleanup;
 		}
 
 		success = 1;
 
 cleanup:
-	if( db_locked ) { mrsqlite3_unlock(mailbox->m_sql); }
+	if( reader ) { mrsqlite3_unlock_reader(mailbox->m_sql, reader); }
 
 	mrmailbox_log_info(mailbox, 0, "Chatlist created in %.3f ms.", (double)(clock()-start)*1000.0/CLOCKS_PER_SEC);
 
@@ -943,7 +1008,7 @@ void mrmailbox_marknoticed_chat(mrmailbox_t* mailbox, uint32_t chat_id)
 
 	mrsqlite3_lock(mailbox->m_sql);
 
-		stmt = mrsqlite3_predefine__(mailbox->m_sql, UPDATE_msgs_SET_state_WHERE_chat_id_AND_state,
+		stmt = mrsqlite3_predefine__(mailbox->m_sql,
 			"UPDATE msgs SET state=" MR_STRINGIFY(MR_STATE_IN_NOTICED) " WHERE chat_id=? AND state=" MR_STRINGIFY(MR_STATE_IN_FRESH) ";");
 		sqlite3_bind_int(stmt, 1, chat_id);
 		sqlite3_step(stmt);
@@ -1121,7 +1186,7 @@ static mrarray_t* mrmailbox_get_chat_media__(mrmailbox_t* mailbox, uint32_t chat
 {
 	mrarray_t* ret = mrarray_new(mailbox, 100);
 
-	sqlite3_stmt* stmt = mrsqlite3_predefine__(mailbox->m_sql, SELECT_i_FROM_msgs_WHERE_ctt,
+	sqlite3_stmt* stmt = mrsqlite3_predefine__(mailbox->m_sql,
 		"SELECT id FROM msgs WHERE chat_id=? AND (type=? OR type=?) ORDER BY timestamp, id;");
 	sqlite3_bind_int(stmt, 1, chat_id);
 	sqlite3_bind_int(stmt, 2, msg_type);
@@ -1282,7 +1347,7 @@ mrarray_t* mrmailbox_get_chat_contacts(mrmailbox_t* mailbox, uint32_t chat_id)
 	mrsqlite3_lock(mailbox->m_sql);
 	locked = 1;
 
-		stmt = mrsqlite3_predefine__(mailbox->m_sql, SELECT_c_FROM_chats_contacts_WHERE_c_ORDER_BY,
+		stmt = mrsqlite3_predefine__(mailbox->m_sql,
 			"SELECT cc.contact_id FROM chats_contacts cc"
 				" LEFT JOIN contacts c ON c.id=cc.contact_id"
 				" WHERE cc.chat_id=?"
@@ -1322,7 +1387,7 @@ mrarray_t* mrmailbox_get_fresh_msgs(mrmailbox_t* mailbox)
 
 		show_deaddrop = 0;//mrsqlite3_get_config_int__(mailbox->m_sql, "show_deaddrop", 0);
 
-		stmt = mrsqlite3_predefine__(mailbox->m_sql, SELECT_i_FROM_msgs_LEFT_JOIN_contacts_WHERE_fresh,
+		stmt = mrsqlite3_predefine__(mailbox->m_sql,
 			"SELECT m.id"
 				" FROM msgs m"
 				" LEFT JOIN contacts ct ON m.from_id=ct.id"
@@ -1373,12 +1438,15 @@ cleanup:
  *   before the given ID in the returned array.  Set this to 0 if you do not want this behaviour.
  *
  * @return Array of message IDs, must be mrarray_unref()'d when no longer used.
+ *
+ * @see mrmailbox_get_chat_msgs_page() to load only a part of the message IDs of huge chats.
  */
 mrarray_t* mrmailbox_get_chat_msgs(mrmailbox_t* mailbox, uint32_t chat_id, uint32_t flags, uint32_t marker1before)
 {
 	clock_t       start = clock();
 
-	int           success = 0, locked = 0;
+	int           success = 0;
+	mrsqlite3_t*  reader = NULL;
 	mrarray_t*    ret = mrarray_new(mailbox, 512);
 	sqlite3_stmt* stmt = NULL;
 
@@ -1392,12 +1460,11 @@ mrarray_t* mrmailbox_get_chat_msgs(mrmailbox_t* mailbox, uint32_t chat_id, uint3
 		goto cleanup;
 	}
 
-	mrsqlite3_lock(mailbox->m_sql);
-	locked = 1;
+	reader = mrsqlite3_lock_reader(mailbox->m_sql);
 
 		if( chat_id == MR_CHAT_ID_DEADDROP )
 		{
-			stmt = mrsqlite3_predefine__(mailbox->m_sql, SELECT_i_FROM_msgs_LEFT_JOIN_chats_contacts_WHERE_blocked,
+			stmt = mrsqlite3_predefine__(reader,
 				"SELECT m.id, m.timestamp"
 					" FROM msgs m"
 					" LEFT JOIN chats ON m.chat_id=chats.id"
@@ -1409,7 +1476,7 @@ mrarray_t* mrmailbox_get_chat_msgs(mrmailbox_t* mailbox, uint32_t chat_id, uint3
 		}
 		else if( chat_id == MR_CHAT_ID_STARRED )
 		{
-			stmt = mrsqlite3_predefine__(mailbox->m_sql, SELECT_i_FROM_msgs_LEFT_JOIN_contacts_WHERE_starred,
+			stmt = mrsqlite3_predefine__(reader,
 				"SELECT m.id, m.timestamp"
 					" FROM msgs m"
 					" LEFT JOIN contacts ct ON m.from_id=ct.id"
@@ -1418,7 +1485,7 @@ mrarray_t* mrmailbox_get_chat_msgs(mrmailbox_t* mailbox, uint32_t chat_id, uint3
 		}
 		else
 		{
-			stmt = mrsqlite3_predefine__(mailbox->m_sql, SELECT_i_FROM_msgs_LEFT_JOIN_contacts_WHERE_c,
+			stmt = mrsqlite3_predefine__(reader,
 				"SELECT m.id, m.timestamp"
 					" FROM msgs m"
 					" LEFT JOIN contacts ct ON m.from_id=ct.id"
@@ -1449,13 +1516,13 @@ mrarray_t* mrmailbox_get_chat_msgs(mrmailbox_t* mailbox, uint32_t chat_id, uint3
 			mrarray_add_id(ret, curr_id);
 		}
 
-	mrsqlite3_unlock(mailbox->m_sql);
-	locked = 0;
+	mrsqlite3_unlock_reader(mailbox->m_sql, reader);
+	reader = NULL;
 
 	success = 1;
 
 cleanup:
-	if( locked ) { mrsqlite3_unlock(mailbox->m_sql); }
+	if( reader ) { mrsqlite3_unlock_reader(mailbox->m_sql, reader); }
 
 	mrmailbox_log_info(mailbox, 0, "Message list for chat #%i created in %.3f ms.", chat_id, (double)(clock()-start)*1000.0/CLOCKS_PER_SEC);
 
@@ -1471,6 +1538,186 @@ cleanup:
 }
 
 
+/* the statements for mrmailbox_get_chat_msgs_page(); ?1=chat_id, (?2,?3)=the anchor (timestamp,id), ?4=number of rows */
+#define MSGS_PAGE_SELECT "SELECT m.id, m.timestamp FROM msgs m LEFT JOIN contacts ct ON m.from_id=ct.id"
+#define MSGS_PAGE_WHERE_DEADDROP " LEFT JOIN chats c ON m.chat_id=c.id WHERE m.from_id!=" MR_STRINGIFY(MR_CONTACT_ID_SELF) " AND c.blocked=2 AND ct.blocked=0"
+#define MSGS_PAGE_WHERE_STARRED  " WHERE m.starred=1 AND ct.blocked=0"
+#define MSGS_PAGE_WHERE_CHAT     " WHERE m.chat_id=?1 AND ct.blocked=0"
+#define MSGS_PAGE_BEFORE         " AND (m.timestamp<?2 OR (m.timestamp=?2 AND m.id<?3)) ORDER BY m.timestamp DESC, m.id DESC LIMIT ?4;"
+#define MSGS_PAGE_AFTER          " AND (m.timestamp>?2 OR (m.timestamp=?2 AND m.id>?3)) ORDER BY m.timestamp, m.id LIMIT ?4;"
+
+
+/**
+ * Get a page of message IDs belonging to a chat.
+ * In contrast to mrmailbox_get_chat_msgs(), only the IDs directly before or
+ * after a given message are loaded, so the time needed does not depend on the
+ * number of messages in the chat.  To fill a virtual list, the UI typically
+ * loads the last page using `anchor_msg_id=0` and MR_GCM_BEFORE and
+ * loads more pages using the first or last ID of the already loaded pages
+ * as anchor when scrolling.
+ *
+ * The messages are sorted the same way as in mrmailbox_get_chat_msgs() and
+ * the day markers are placed the same way, so pages can just be concatenated.
+ *
+ * @memberof mrmailbox_t
+ *
+ * @param mailbox The mailbox object as returned from mrmailbox_new().
+ *
+ * @param chat_id The chat ID of which the messages IDs should be queried.
+ *
+ * @param flags If MR_GCM_ADDDAYMARKER is set, the marker MR_MSG_ID_DAYMARKER will
+ *     be added before each day (regarding the local timezone).
+ *     If MR_GCM_BEFORE is set, the messages before the anchor are returned, otherwise the messages after the anchor.
+ *
+ * @param anchor_msg_id The message the page starts or ends at, the anchor itself is not returned.
+ *     If set to 0, the page starts at the first message of the chat or ends at the last message of the chat if MR_GCM_BEFORE is set.
+ *
+ * @param max_cnt The maximal number of message IDs returned, day markers are not counted.
+ *
+ * @return Array of message IDs, must be mrarray_unref()'d when no longer used.
+ *     The array is sorted from old to new, also if MR_GCM_BEFORE is used.
+ *     NULL on errors, eg. if the anchor message does not exist.
+ */
+mrarray_t* mrmailbox_get_chat_msgs_page(mrmailbox_t* mailbox, uint32_t chat_id, uint32_t flags, uint32_t anchor_msg_id, int max_cnt)
+{
+	int           success = 0;
+	mrsqlite3_t*  reader = NULL;
+	mrarray_t*    ret = NULL;
+	sqlite3_stmt* stmt = NULL;
+	int           before = (flags&MR_GCM_BEFORE)? 1 : 0;
+	int64_t       anchor_timestamp = before? INT64_MAX : 0;
+	uint32_t*     ids = NULL;
+	time_t*       timestamps = NULL;
+	int           cnt = 0, i, has_prev = 0;
+	time_t        prev_timestamp = 0;
+	int           curr_day, last_day = 0;
+	long          cnv_to_local = mr_gm2local_offset();
+
+	if( mailbox==NULL || mailbox->m_magic != MR_MAILBOX_MAGIC || max_cnt <= 0 ) {
+		goto cleanup;
+	}
+
+	if( (ids=malloc(sizeof(uint32_t)*(max_cnt+1)))==NULL || (timestamps=malloc(sizeof(time_t)*(max_cnt+1)))==NULL ) {
+		goto cleanup;
+	}
+
+	reader = mrsqlite3_lock_reader(mailbox->m_sql);
+
+		if( anchor_msg_id )
+		{
+			stmt = mrsqlite3_predefine__(reader, "SELECT timestamp FROM msgs WHERE id=?;");
+			sqlite3_bind_int(stmt, 1, anchor_msg_id);
+			if( sqlite3_step(stmt) != SQLITE_ROW ) {
+				goto cleanup;
+			}
+			anchor_timestamp = sqlite3_column_int64(stmt, 0);
+
+			if( !before ) {
+				has_prev = 1; /* the anchor is the message before the page */
+				prev_timestamp = (time_t)anchor_timestamp;
+			}
+		}
+		else
+		{
+			anchor_msg_id = before? UINT32_MAX : 0;
+		}
+
+		if( chat_id == MR_CHAT_ID_DEADDROP ) {
+			stmt = mrsqlite3_predefine__(reader, before? MSGS_PAGE_SELECT MSGS_PAGE_WHERE_DEADDROP MSGS_PAGE_BEFORE : MSGS_PAGE_SELECT MSGS_PAGE_WHERE_DEADDROP MSGS_PAGE_AFTER);
+		}
+		else if( chat_id == MR_CHAT_ID_STARRED ) {
+			stmt = mrsqlite3_predefine__(reader, before? MSGS_PAGE_SELECT MSGS_PAGE_WHERE_STARRED MSGS_PAGE_BEFORE : MSGS_PAGE_SELECT MSGS_PAGE_WHERE_STARRED MSGS_PAGE_AFTER);
+		}
+		else {
+			stmt = mrsqlite3_predefine__(reader, before? MSGS_PAGE_SELECT MSGS_PAGE_WHERE_CHAT MSGS_PAGE_BEFORE : MSGS_PAGE_SELECT MSGS_PAGE_WHERE_CHAT MSGS_PAGE_AFTER);
+		}
+		sqlite3_bind_int  (stmt, 1, chat_id);
+		sqlite3_bind_int64(stmt, 2, anchor_timestamp);
+		sqlite3_bind_int64(stmt, 3, anchor_msg_id);
+		sqlite3_bind_int  (stmt, 4, before? max_cnt+1 : max_cnt); /* if we go back, the additional row is the message before the page, needed for the first day marker */
+
+		while( sqlite3_step(stmt) == SQLITE_ROW )
+		{
+			ids[cnt]        = sqlite3_column_int(stmt, 0);
+			timestamps[cnt] = (time_t)sqlite3_column_int64(stmt, 1);
+			cnt++;
+		}
+
+	mrsqlite3_unlock_reader(mailbox->m_sql, reader);
+	reader = NULL;
+
+	if( before )
+	{
+		/* the rows are sorted from new to old, reverse them */
+		for( i = 0; i < cnt/2; i++ ) {
+			uint32_t id = ids[i];       ids[i] = ids[cnt-1-i];               ids[cnt-1-i] = id;
+			time_t   ts = timestamps[i]; timestamps[i] = timestamps[cnt-1-i]; timestamps[cnt-1-i] = ts;
+		}
+
+		if( cnt > max_cnt ) {
+			has_prev = 1;
+			prev_timestamp = timestamps[0];
+			memmove(ids, ids+1, sizeof(uint32_t)*max_cnt);
+			memmove(timestamps, timestamps+1, sizeof(time_t)*max_cnt);
+			cnt = max_cnt;
+		}
+	}
+
+	if( has_prev ) {
+		last_day = (prev_timestamp + cnv_to_local)/SECONDS_PER_DAY;
+	}
+
+	ret = mrarray_new(mailbox, cnt*2 + 1);
+	for( i = 0; i < cnt; i++ )
+	{
+		if( flags&MR_GCM_ADDDAYMARKER ) {
+			curr_day = (timestamps[i] + cnv_to_local)/SECONDS_PER_DAY;
+			if( curr_day != last_day ) {
+				mrarray_add_id(ret, MR_MSG_ID_DAYMARKER);
+				last_day = curr_day;
+			}
+		}
+
+		mrarray_add_id(ret, ids[i]);
+	}
+
+	success = 1;
+
+cleanup:
+	if( reader ) { mrsqlite3_unlock_reader(mailbox->m_sql, reader); }
+	free(ids);
+	free(timestamps);
+	if( !success && ret ) {
+		mrarray_unref(ret);
+		ret = NULL;
+	}
+	return ret;
+}
+
+
+void mrmailbox_fts_start_backfill__(mrmailbox_t* mailbox)
+{
+	if( mailbox->m_sql->m_fts_version && mailbox->m_sql->m_fts_backfill_below > MR_MSG_ID_LAST_SPECIAL+1 ) {
+		mrjob_kill_action__(mailbox, MRJ_FTS_BACKFILL);
+		mrjob_add__(mailbox, MRJ_FTS_BACKFILL, 0, NULL); /* results in calls to mrmailbox_fts_backfill() */
+	}
+}
+
+
+void mrmailbox_fts_backfill(mrmailbox_t* mailbox, mrjob_t* job)
+{
+	int more;
+
+	mrsqlite3_lock(mailbox->m_sql);
+		more = mrsqlite3_fts_backfill__(mailbox->m_sql, MR_FTS_BACKFILL_ROWS);
+	mrsqlite3_unlock(mailbox->m_sql);
+
+	if( more ) {
+		job->m_start_again_at = time(NULL); /* continue on the next loop; the database is unlocked in between, so other threads are not blocked for long */
+	}
+}
+
+
 /**
  * Search messages containing the given query string.
  * Searching can be done globally (chat_id=0) or in a specified chat only (chat_id
@@ -1487,7 +1734,10 @@ cleanup:
  * @param chat_id ID of the chat to search messages in.
  *     Set this to 0 for a global search.
  *
- * @param query The query to search for.
+ * @param query The query to search for.  If the full-text index is available,
+ *     all words of the query must be found at the beginning of words in the
+ *     message text or the sender name; otherwise, the query is searched as a
+ *     substring of the message text.
  *
  * @return An array of message IDs. Must be freed using mrarray_unref() when no longer needed.
  *     If nothing can be found, the function returns NULL.
@@ -1496,9 +1746,10 @@ mrarray_t* mrmailbox_search_msgs(mrmailbox_t* mailbox, uint32_t chat_id, const c
 {
 	clock_t       start = clock();
 
-	int           success = 0, locked = 0;
+	int           success = 0;
+	mrsqlite3_t*  reader = NULL;
 	mrarray_t*    ret = mrarray_new(mailbox, 100);
-	char*         strLikeInText = NULL, *strLikeBeg=NULL, *real_query = NULL;
+	char*         strLikeInText = NULL, *strLikeBeg=NULL, *real_query = NULL, *strMatch = NULL;
 	sqlite3_stmt* stmt = NULL;
 
 	if( mailbox==NULL || mailbox->m_magic != MR_MAILBOX_MAGIC || ret == NULL || query == NULL ) {
@@ -1512,20 +1763,39 @@ mrarray_t* mrmailbox_search_msgs(mrmailbox_t* mailbox, uint32_t chat_id, const c
 		goto cleanup;
 	}
 
+	strMatch = mrsqlite3_fts_query(mailbox->m_sql, real_query);
 	strLikeInText = mr_mprintf("%%%s%%", real_query);
 	strLikeBeg = mr_mprintf("%s%%", real_query); /*for the name search, we use "Name%" which is fast as it can use the index ("%Name%" could not). */
 
-	mrsqlite3_lock(mailbox->m_sql);
-	locked = 1;
+	reader = mrsqlite3_lock_reader(mailbox->m_sql);
 
-		/* Incremental search with "LIKE %query%" cannot take advantages from any index
-		("query%" could for COLLATE NOCASE indexes, see http://www.sqlite.org/optoverview.html#like_opt )
-		An alternative may be the FULLTEXT sqlite stuff, however, this does not really help with incremental search.
-		An extra table with all words and a COLLATE NOCASE indexes may help, however,
-		this must be updated all the time and probably consumes more time than we can save in tenthousands of searches.
-		For now, we just expect the following query to be fast enough :-) */
-		if( chat_id ) {
-			stmt = mrsqlite3_predefine__(mailbox->m_sql, SELECT_i_FROM_msgs_WHERE_chat_id_AND_query,
+		/* If possible, we use the full-text index, where every word of the query is searched as a word prefix,
+		this is fast enough for incremental search even on large databases.
+		Otherwise (no FTS module, index not yet complete), we search using "LIKE %query%" which cannot take advantages from any index
+		("query%" could for COLLATE NOCASE indexes, see http://www.sqlite.org/optoverview.html#like_opt ) */
+		if( strMatch && chat_id ) {
+			stmt = mrsqlite3_predefine__(reader,
+				"SELECT m.id, m.timestamp FROM msgs m"
+				" LEFT JOIN contacts ct ON m.from_id=ct.id"
+				" WHERE m.id IN (SELECT rowid FROM msgs_fts WHERE msgs_fts MATCH ?)"
+					" AND m.chat_id=? AND ct.blocked=0"
+				" ORDER BY m.timestamp,m.id;");
+			sqlite3_bind_text(stmt, 1, strMatch, -1, SQLITE_STATIC);
+			sqlite3_bind_int (stmt, 2, chat_id);
+		}
+		else if( strMatch ) {
+			stmt = mrsqlite3_predefine__(reader,
+				"SELECT m.id, m.timestamp FROM msgs m"
+				" LEFT JOIN contacts ct ON m.from_id=ct.id"
+				" LEFT JOIN chats c ON m.chat_id=c.id"
+				" WHERE m.id IN (SELECT rowid FROM msgs_fts WHERE msgs_fts MATCH ?)"
+					" AND m.chat_id>" MR_STRINGIFY(MR_CHAT_ID_LAST_SPECIAL)
+					" AND c.blocked=0 AND ct.blocked=0"
+				" ORDER BY m.timestamp DESC,m.id DESC;");
+			sqlite3_bind_text(stmt, 1, strMatch, -1, SQLITE_STATIC);
+		}
+		else if( chat_id ) {
+			stmt = mrsqlite3_predefine__(reader,
 				"SELECT m.id, m.timestamp FROM msgs m"
 				" LEFT JOIN contacts ct ON m.from_id=ct.id"
 				" WHERE m.chat_id=? "
@@ -1537,7 +1807,7 @@ mrarray_t* mrmailbox_search_msgs(mrmailbox_t* mailbox, uint32_t chat_id, const c
 		}
 		else {
 			int show_deaddrop = 0;//mrsqlite3_get_config_int__(mailbox->m_sql, "show_deaddrop", 0);
-			stmt = mrsqlite3_predefine__(mailbox->m_sql, SELECT_i_FROM_msgs_WHERE_query,
+			stmt = mrsqlite3_predefine__(reader,
 				"SELECT m.id, m.timestamp FROM msgs m"
 				" LEFT JOIN contacts ct ON m.from_id=ct.id"
 				" LEFT JOIN chats c ON m.chat_id=c.id"
@@ -1554,15 +1824,16 @@ mrarray_t* mrmailbox_search_msgs(mrmailbox_t* mailbox, uint32_t chat_id, const c
 			mrarray_add_id(ret, sqlite3_column_int(stmt, 0));
 		}
 
-	mrsqlite3_unlock(mailbox->m_sql);
-	locked = 0;
+	mrsqlite3_unlock_reader(mailbox->m_sql, reader);
+	reader = NULL;
 
 	success = 1;
 
 cleanup:
-	if( locked ) { mrsqlite3_unlock(mailbox->m_sql); }
+	if( reader ) { mrsqlite3_unlock_reader(mailbox->m_sql, reader); }
 	free(strLikeInText);
 	free(strLikeBeg);
+	free(strMatch);
 	free(real_query);
 
 	mrmailbox_log_info(mailbox, 0, "Message list for search \"%s\" in chat #%i created in %.3f ms.", query, chat_id, (double)(clock()-start)*1000.0/CLOCKS_PER_SEC);
@@ -1617,7 +1888,7 @@ static void set_draft_int(mrmailbox_t* mailbox, mrchat_t* chat, uint32_t chat_id
 	/* save draft in database */
 	mrsqlite3_lock(mailbox->m_sql);
 
-		stmt = mrsqlite3_predefine__(mailbox->m_sql, UPDATE_chats_SET_draft_WHERE_id,
+		stmt = mrsqlite3_predefine__(mailbox->m_sql,
 			"UPDATE chats SET draft_timestamp=?, draft_txt=? WHERE id=?;");
 		sqlite3_bind_int64(stmt, 1, chat->m_draft_timestamp);
 		sqlite3_bind_text (stmt, 2, chat->m_draft_text? chat->m_draft_text : "", -1, SQLITE_STATIC); /* SQLITE_STATIC: we promise the buffer to be valid until the query is done */
@@ -1625,6 +1896,8 @@ static void set_draft_int(mrmailbox_t* mailbox, mrchat_t* chat, uint32_t chat_id
 
 		sqlite3_step(stmt);
 
+		mrmailbox_update_chat_last_msg__(mailbox, chat->m_id);
+
 	mrsqlite3_unlock(mailbox->m_sql);
 
 	mailbox->m_cb(mailbox, MR_EVENT_MSGS_CHANGED, 0, 0);
@@ -1666,7 +1939,7 @@ int mrmailbox_get_fresh_msg_count__(mrmailbox_t* mailbox, uint32_t chat_id)
 {
 	sqlite3_stmt* stmt = NULL;
 
-	stmt = mrsqlite3_predefine__(mailbox->m_sql, SELECT_COUNT_FROM_msgs_WHERE_state_AND_chat_id,
+	stmt = mrsqlite3_predefine__(mailbox->m_sql,
 		"SELECT COUNT(*) FROM msgs WHERE state=" MR_STRINGIFY(MR_STATE_IN_FRESH) " AND chat_id=?;"); /* we have an index over the state-column, this should be sufficient as there are typically only few fresh messages */
 	sqlite3_bind_int(stmt, 1, chat_id);
 
@@ -1678,11 +1951,11 @@ int mrmailbox_get_fresh_msg_count__(mrmailbox_t* mailbox, uint32_t chat_id)
 }
 
 
-uint32_t mrmailbox_get_last_deaddrop_fresh_msg__(mrmailbox_t* mailbox)
+uint32_t mrmailbox_get_last_deaddrop_fresh_msg__(mrsqlite3_t* sql)
 {
 	sqlite3_stmt* stmt = NULL;
 
-	stmt = mrsqlite3_predefine__(mailbox->m_sql, SELECT_id_FROM_msgs_WHERE_fresh_AND_deaddrop,
+	stmt = mrsqlite3_predefine__(sql,
 		"SELECT m.id "
 		" FROM msgs m "
 		" LEFT JOIN chats c ON c.id=m.chat_id "
@@ -1702,7 +1975,7 @@ int mrmailbox_get_total_msg_count__(mrmailbox_t* mailbox, uint32_t chat_id)
 {
 	sqlite3_stmt* stmt = NULL;
 
-	stmt = mrsqlite3_predefine__(mailbox->m_sql, SELECT_COUNT_FROM_msgs_WHERE_chat_id,
+	stmt = mrsqlite3_predefine__(mailbox->m_sql,
 		"SELECT COUNT(*) FROM msgs WHERE chat_id=?;");
 	sqlite3_bind_int(stmt, 1, chat_id);
 
@@ -1722,7 +1995,7 @@ size_t mrmailbox_get_chat_cnt__(mrmailbox_t* mailbox)
 		return 0; /* no database, no chats - this is no error (needed eg. for information) */
 	}
 
-	stmt = mrsqlite3_predefine__(mailbox->m_sql, SELECT_COUNT_FROM_chats,
+	stmt = mrsqlite3_predefine__(mailbox->m_sql,
 		"SELECT COUNT(*) FROM chats WHERE id>" MR_STRINGIFY(MR_CHAT_ID_LAST_SPECIAL) " AND blocked=0;");
 	if( sqlite3_step(stmt) != SQLITE_ROW ) {
 		return 0;
@@ -1744,7 +2017,7 @@ void mrmailbox_lookup_real_nchat_by_contact_id__(mrmailbox_t* mailbox, uint32_t
 		return; /* no database, no chats - this is no error (needed eg. for information) */
 	}
 
-	stmt = mrsqlite3_predefine__(mailbox->m_sql, SELECT_id_FROM_chats_WHERE_contact_id,
+	stmt = mrsqlite3_predefine__(mailbox->m_sql,
 			"SELECT c.id, c.blocked"
 			" FROM chats c"
 			" INNER JOIN chats_contacts j ON c.id=j.chat_id"
@@ -1838,7 +2111,7 @@ cleanup:
 
 void mrmailbox_unarchive_chat__(mrmailbox_t* mailbox, uint32_t chat_id)
 {
-	sqlite3_stmt* stmt = mrsqlite3_predefine__(mailbox->m_sql, UPDATE_chats_SET_unarchived, "UPDATE chats SET archived=0 WHERE id=?");
+	sqlite3_stmt* stmt = mrsqlite3_predefine__(mailbox->m_sql, "UPDATE chats SET archived=0 WHERE id=?");
 	sqlite3_bind_int (stmt, 1, chat_id);
 	sqlite3_step(stmt);
 }
@@ -1931,11 +2204,10 @@ void mrmailbox_archive_chat(mrmailbox_t* mailbox, uint32_t chat_id, int archive)
 	}
 
 	mrsqlite3_lock(mailbox->m_sql);
-		sqlite3_stmt* stmt = mrsqlite3_prepare_v2_(mailbox->m_sql, "UPDATE chats SET archived=? WHERE id=?;");
+		sqlite3_stmt* stmt = mrsqlite3_predefine__(mailbox->m_sql, "UPDATE chats SET archived=? WHERE id=?;");
 		sqlite3_bind_int  (stmt, 1, archive);
 		sqlite3_bind_int  (stmt, 2, chat_id);
 		sqlite3_step(stmt);
-		sqlite3_finalize(stmt);
 	mrsqlite3_unlock(mailbox->m_sql);
 
 	mailbox->m_cb(mailbox, MR_EVENT_MSGS_CHANGED, 0, 0);
@@ -2041,11 +2313,94 @@ cleanup:
  ******************************************************************************/
 
 
+/* The message rendered for SMTP is encrypted to all recipients and to ourself,
+so it is spooled to a subdirectory of the blob directory and uploaded to IMAP as is; this saves the
+second rendering and encryption.  The spool file is deleted by the IMAP job, files left over
+are deleted by mrmailbox_sweep_spool__().  The subdirectory is not part of backups.
+(a subdirectory is used as the names of the other blobs are taken from the attachments) */
+static char* get_spool_filename(mrmailbox_t* mailbox, uint32_t msg_id)
+{
+	return mr_mprintf("%s/" MR_SPOOL_DIR "/%lu.eml", mailbox->m_blobdir, (unsigned long)msg_id);
+}
+
+
+static void write_spool(mrmailbox_t* mailbox, uint32_t msg_id, const MMAPString* rendered)
+{
+	char* spool_dir = mr_mprintf("%s/" MR_SPOOL_DIR, mailbox->m_blobdir);
+	char* filename = get_spool_filename(mailbox, msg_id);
+	char* tmp_filename = mr_mprintf("%s.tmp", filename);
+
+	/* write to a temporary file first so that the IMAP job never sees partly written messages */
+	if( !mr_create_folder(spool_dir, mailbox)
+	 || !mr_write_file(tmp_filename, rendered->str, rendered->len, mailbox)
+	 || rename(tmp_filename, filename)!=0 ) {
+		mrmailbox_log_warning(mailbox, 0, "Cannot spool message #%i, it will be rendered again for IMAP.", (int)msg_id);
+		mr_delete_file(tmp_filename, NULL);
+	}
+
+	free(tmp_filename);
+	free(filename);
+	free(spool_dir);
+}
+
+
+/* delete spool files without a job to upload them, eg. if the app was killed between
+spooling and adding the job, and partly written files; called on open before jobs are executed */
+void mrmailbox_sweep_spool__(mrmailbox_t* mailbox)
+{
+	char*          spool_dir = mr_mprintf("%s/" MR_SPOOL_DIR, mailbox->m_blobdir);
+	DIR*           dir_handle = NULL;
+	struct dirent* dir_entry;
+	sqlite3_stmt*  stmt;
+	char*          pathNfilename;
+	char*          suffix;
+	unsigned long  msg_id;
+	int            keep;
+
+	if( (dir_handle=opendir(spool_dir))==NULL ) {
+		goto cleanup; /* nothing spooled yet */
+	}
+
+	while( (dir_entry=readdir(dir_handle))!=NULL )
+	{
+		const char* name = dir_entry->d_name;
+		if( name[0] == '.' ) {
+			continue; /* `.` and `..` */
+		}
+
+		keep = 0;
+		suffix = NULL;
+		msg_id = strtoul(name, &suffix, 10);
+		if( suffix && strcmp(suffix, ".eml")==0 ) {
+			stmt = mrsqlite3_predefine__(mailbox->m_sql, "SELECT id FROM jobs WHERE action=? AND foreign_id=?;");
+			sqlite3_bind_int(stmt, 1, MRJ_SEND_MSG_TO_IMAP);
+			sqlite3_bind_int(stmt, 2, (int)msg_id);
+			keep = (sqlite3_step(stmt) == SQLITE_ROW);
+		}
+
+		if( !keep ) {
+			pathNfilename = mr_mprintf("%s/%s", spool_dir, name);
+				mrmailbox_log_info(mailbox, 0, "Deleting spool file \"%s\".", pathNfilename);
+				mr_delete_file(pathNfilename, mailbox);
+			free(pathNfilename);
+		}
+	}
+
+cleanup:
+	if( dir_handle ) { closedir(dir_handle); }
+	free(spool_dir);
+}
+
+
 void mrmailbox_send_msg_to_imap(mrmailbox_t* mailbox, mrjob_t* job)
 {
 	mrmimefactory_t  mimefactory;
 	char*            server_folder = NULL;
 	uint32_t         server_uid = 0;
+	char*            spool_filename = get_spool_filename(mailbox, job->m_foreign_id);
+	void*            spooled = NULL;
+	size_t           spooled_bytes = 0;
+	int              try_again_later = 0;
 
 	mrmimefactory_init(&mimefactory, mailbox);
 
@@ -2054,6 +2409,7 @@ void mrmailbox_send_msg_to_imap(mrmailbox_t* mailbox, mrjob_t* job)
 		mrmailbox_connect_to_imap(mailbox, NULL);
 		if( !mrimap_is_connected(mailbox->m_imap) ) {
 			mrjob_try_again_later(job, MR_STANDARD_DELAY);
+			try_again_later = 1;
 			goto cleanup;
 		}
 	}
@@ -2064,12 +2420,20 @@ void mrmailbox_send_msg_to_imap(mrmailbox_t* mailbox, mrjob_t* job)
 		goto cleanup; /* should not happen as we've sent the message to the SMTP server before */
 	}
 
-	if( !mrmimefactory_render(&mimefactory, 1/*encrypt to self*/) ) {
+	if( mr_file_exist(spool_filename) && mr_read_file(spool_filename, &spooled, &spooled_bytes, mailbox) ) {
+		; /* use the message as sent to SMTP */
+	}
+	else if( mrmimefactory_render(&mimefactory, 1/*encrypt to self*/) ) {
+		; /* no spooled message, eg. for messages to ourself only or for jobs created by older versions */
+	}
+	else {
 		goto cleanup; /* should not happen as we've sent the message to the SMTP server before */
 	}
 
-	if( !mrimap_append_msg(mailbox->m_imap, mimefactory.m_msg->m_timestamp, mimefactory.m_out->str, mimefactory.m_out->len, &server_folder, &server_uid) ) {
+	if( !mrimap_append_msg(mailbox->m_imap, mimefactory.m_msg->m_timestamp,
+	        spooled? spooled : mimefactory.m_out->str, spooled? spooled_bytes : mimefactory.m_out->len, &server_folder, &server_uid) ) {
 		mrjob_try_again_later(job, MR_STANDARD_DELAY);
+		try_again_later = 1;
 		goto cleanup;
 	}
 	else {
@@ -2079,8 +2443,13 @@ void mrmailbox_send_msg_to_imap(mrmailbox_t* mailbox, mrjob_t* job)
 	}
 
 cleanup:
+	if( !try_again_later && mr_file_exist(spool_filename) ) {
+		mr_delete_file(spool_filename, mailbox);
+	}
 	mrmimefactory_empty(&mimefactory);
 	free(server_folder);
+	free(spooled);
+	free(spool_filename);
 }
 
 
@@ -2097,11 +2466,42 @@ static void mark_as_error(mrmailbox_t* mailbox, mrmsg_t* msg)
 }
 
 
-void mrmailbox_send_msg_to_smtp(mrmailbox_t* mailbox, mrjob_t* job)
+static clist* get_send_to(mrjob_t* job, const clist* recipients_addr)
+{
+	/* if a message was rejected temporarily for some recipients only, it is sent again to these recipients only, see send_msg_to_smtp();
+	the returned list points to the strings of recipients_addr and must be freed using clist_free() */
+	clist*     ret = clist_new();
+	char*      pending = mrparam_get(job->m_param, MRP_PENDING_RECIPIENTS, NULL);
+	char*      pending_spaced = pending? mr_mprintf(" %s ", pending) : NULL;
+	clistiter* iter;
+
+	for( iter=clist_begin(recipients_addr); iter!=NULL; iter=clist_next(iter) ) {
+		char* addr = clist_content(iter);
+		char* addr_spaced = mr_mprintf(" %s ", addr);
+			if( pending_spaced == NULL || strstr(pending_spaced, addr_spaced) ) {
+				clist_append(ret, addr);
+			}
+		free(addr_spaced);
+	}
+
+	free(pending_spaced);
+	free(pending);
+	return ret;
+}
+
+
+static int send_msg_to_smtp(mrmailbox_t* mailbox, mrjob_t* job)
 {
+	/* returns 0 if we cannot connect to the SMTP server, the remaining jobs of a batch are delayed then */
 	mrmimefactory_t mimefactory;
+	int             upload_to_imap = 0, connected = 1, i, accepted = 0;
+	clist*          send_to = NULL;
+	int*            rcpt_codes = NULL;
+	clistiter*      iter;
+	mrstrbuilder_t  pending;
 
 	mrmimefactory_init(&mimefactory, mailbox);
+	mrstrbuilder_init(&pending, 0);
 
 	/* connect to SMTP server, if not yet done */
 	if( !mrsmtp_is_connected(mailbox->m_smtp) ) {
@@ -2109,7 +2509,7 @@ void mrmailbox_send_msg_to_smtp(mrmailbox_t* mailbox, mrjob_t* job)
 			mrsqlite3_lock(mailbox->m_sql);
 				mrloginparam_read__(loginparam, mailbox->m_sql, "configured_");
 			mrsqlite3_unlock(mailbox->m_sql);
-			int connected = mrsmtp_connect(mailbox->m_smtp, loginparam);
+			connected = mrsmtp_connect(mailbox->m_smtp, loginparam);
 		mrloginparam_unref(loginparam);
 		if( !connected ) {
 			mrjob_try_again_later(job, MR_STANDARD_DELAY);
@@ -2146,13 +2546,64 @@ void mrmailbox_send_msg_to_smtp(mrmailbox_t* mailbox, mrjob_t* job)
 			goto cleanup; /* unrecoverable */
 		}
 
-		if( !mrsmtp_send_msg(mailbox->m_smtp, mimefactory.m_recipients_addr, mimefactory.m_out->str, mimefactory.m_out->len) ) {
-			mrsmtp_disconnect(mailbox->m_smtp);
-			mrjob_try_again_later(job, MR_AT_ONCE); /* MR_AT_ONCE is only the _initial_ delay, if the second try failes, the delay gets larger */
-			goto cleanup;
+		send_to = get_send_to(job, mimefactory.m_recipients_addr);
+		if( clist_count(send_to) > 0 )
+		{
+			if( (rcpt_codes=calloc(clist_count(send_to), sizeof(int)))==NULL ) {
+				exit(75);
+			}
+
+			if( !mrsmtp_send_msg(mailbox->m_smtp, send_to, mimefactory.m_out->str, mimefactory.m_out->len, rcpt_codes) ) {
+				mrsmtp_disconnect(mailbox->m_smtp);
+				mrjob_try_again_later(job, MR_AT_ONCE); /* MR_AT_ONCE is only the _initial_ delay, if the second try failes, the delay gets larger */
+				goto cleanup;
+			}
+
+			/* recipients rejected temporarily (4xx) are tried again later, the message is not sent again to the others;
+			recipients rejected permanently (5xx) are dropped, they're logged by mrsmtp_send_msg() */
+			for( i = 0, iter=clist_begin(send_to); iter!=NULL; i++, iter=clist_next(iter) ) {
+				if( rcpt_codes[i]/100 == 2 ) {
+					accepted++;
+				}
+				else if( rcpt_codes[i]/100 == 4 ) {
+					mrstrbuilder_cat(&pending, pending.m_buf[0]? " " : "");
+					mrstrbuilder_cat(&pending, (const char*)clist_content(iter));
+				}
+			}
+
+			if( pending.m_buf[0] ) {
+				mrparam_set(job->m_param, MRP_PENDING_RECIPIENTS, pending.m_buf);
+				mrjob_try_again_later(job, MR_STANDARD_DELAY);
+			}
+
+			if( accepted == 0 ) {
+				if( pending.m_buf[0] == 0 ) {
+					if( mimefactory.m_msg->m_state == MR_STATE_OUT_PENDING ) {
+						mark_as_error(mailbox, mimefactory.m_msg);
+						mrmailbox_log_error(mailbox, 0, "All recipients rejected by the SMTP-server.");
+					}
+					else {
+						/* a retry to recipients rejected temporarily before; the message is delivered to the others already */
+						mrmailbox_log_warning(mailbox, 0, "Remaining recipients rejected by the SMTP-server.");
+					}
+				}
+				goto cleanup;
+			}
+		}
+
+		if( mimefactory.m_msg->m_state != MR_STATE_OUT_PENDING ) {
+			goto cleanup; /* sent to recipients rejected temporarily before, the message is already marked as delivered and uploaded */
 		}
 	}
 
+	/* spool the message for the IMAP upload */
+	upload_to_imap = (mailbox->m_imap->m_server_flags&MR_NO_EXTRA_IMAP_UPLOAD)==0
+	 && mrparam_get(mimefactory.m_chat->m_param, MRP_SELFTALK, 0)==0
+	 && mrparam_get_int(mimefactory.m_msg->m_param, MRP_SYSTEM_CMD, 0)!=MR_SYSTEM_OOB_VERIFY_MESSAGE;
+	if( upload_to_imap && mimefactory.m_out ) {
+		write_spool(mailbox, mimefactory.m_msg->m_id, mimefactory.m_out);
+	}
+
 	/* done */
 	mrsqlite3_lock(mailbox->m_sql);
 	mrsqlite3_begin_transaction__(mailbox->m_sql);
@@ -2176,9 +2627,7 @@ void mrmailbox_send_msg_to_smtp(mrmailbox_t* mailbox, mrjob_t* job)
 			mrmsg_save_param_to_disk__(mimefactory.m_msg);
 		}
 
-		if( (mailbox->m_imap->m_server_flags&MR_NO_EXTRA_IMAP_UPLOAD)==0
-		 && mrparam_get(mimefactory.m_chat->m_param, MRP_SELFTALK, 0)==0
-		 && mrparam_get_int(mimefactory.m_msg->m_param, MRP_SYSTEM_CMD, 0)!=MR_SYSTEM_OOB_VERIFY_MESSAGE ) {
+		if( upload_to_imap ) {
 			mrjob_add__(mailbox, MRJ_SEND_MSG_TO_IMAP, mimefactory.m_msg->m_id, NULL); /* send message to IMAP in another job */
 		}
 
@@ -2189,13 +2638,37 @@ void mrmailbox_send_msg_to_smtp(mrmailbox_t* mailbox, mrjob_t* job)
 
 cleanup:
 	mrmimefactory_empty(&mimefactory);
+	if( send_to ) {
+		clist_free(send_to);
+	}
+	free(rcpt_codes);
+	free(pending.m_buf);
+	return connected;
+}
+
+
+void mrmailbox_send_msgs_to_smtp(mrmailbox_t* mailbox, mrjob_t* jobs, int job_cnt)
+{
+	/* all due MRJ_SEND_MSG_TO_SMTP jobs are executed together over the same connection, see job_thread_entry_point() */
+	int i, connected = 1;
+
+	mrsmtp_disconnect_if_stale(mailbox->m_smtp);
+
+	for( i = 0; i < job_cnt; i++ ) {
+		if( connected ) {
+			connected = send_msg_to_smtp(mailbox, &jobs[i]);
+		}
+		else {
+			mrjob_try_again_later(&jobs[i], MR_STANDARD_DELAY); /* do not wait for the connection timeout for each message */
+		}
+	}
 }
 
 
 static int last_msg_in_chat_encrypted(mrsqlite3_t* sql, uint32_t chat_id)
 {
 	int last_is_encrypted = 0;
-	sqlite3_stmt* stmt = mrsqlite3_predefine__(sql, SELECT_param_FROM_msgs,
+	sqlite3_stmt* stmt = mrsqlite3_predefine__(sql,
 		"SELECT param "
 		" FROM msgs "
 		" WHERE timestamp=(SELECT MAX(timestamp) FROM msgs WHERE chat_id=?) "
@@ -2236,7 +2709,7 @@ static uint32_t mrmailbox_send_msg_i__(mrmailbox_t* mailbox, mrchat_t* chat, con
 
 	if( chat->m_type == MR_CHAT_TYPE_NORMAL )
 	{
-		stmt = mrsqlite3_predefine__(mailbox->m_sql, SELECT_c_FROM_chats_contacts_WHERE_c,
+		stmt = mrsqlite3_predefine__(mailbox->m_sql,
 			"SELECT contact_id FROM chats_contacts WHERE chat_id=?;");
 		sqlite3_bind_int(stmt, 1, chat->m_id);
 		if( sqlite3_step(stmt) != SQLITE_ROW ) {
@@ -2260,7 +2733,7 @@ static uint32_t mrmailbox_send_msg_i__(mrmailbox_t* mailbox, mrchat_t* chat, con
 	if( mailbox->m_e2ee_enabled && system_command!=MR_SYSTEM_AUTOCRYPT_SETUP_MESSAGE )
 	{
 		int can_encrypt = 1, all_mutual = 1; /* be optimistic */
-		sqlite3_stmt* stmt = mrsqlite3_predefine__(mailbox->m_sql, SELECT_p_FROM_chats_contacs_JOIN_contacts_peerstates_WHERE_cc,
+		sqlite3_stmt* stmt = mrsqlite3_predefine__(mailbox->m_sql,
 			"SELECT ps.prefer_encrypted "
 			 " FROM chats_contacts cc "
 			 " LEFT JOIN contacts c ON cc.contact_id=c.id "
@@ -2306,7 +2779,7 @@ static uint32_t mrmailbox_send_msg_i__(mrmailbox_t* mailbox, mrchat_t* chat, con
 	mrparam_set(msg->m_param, MRP_ERRONEOUS_E2EE, NULL); /* reset eg. on forwarding */
 
 	/* add message to the database */
-	stmt = mrsqlite3_predefine__(mailbox->m_sql, INSERT_INTO_msgs_mcftttstpb,
+	stmt = mrsqlite3_predefine__(mailbox->m_sql,
 		"INSERT INTO msgs (rfc724_mid,chat_id,from_id,to_id, timestamp,type,state, txt,param) VALUES (?,?,?,?, ?,?,?, ?,?);");
 	sqlite3_bind_text (stmt,  1, rfc724_mid, -1, SQLITE_STATIC);
 	sqlite3_bind_int  (stmt,  2, MR_CHAT_ID_MSGS_IN_CREATION);
@@ -2316,13 +2789,14 @@ static uint32_t mrmailbox_send_msg_i__(mrmailbox_t* mailbox, mrchat_t* chat, con
 	sqlite3_bind_int  (stmt,  6, msg->m_type);
 	sqlite3_bind_int  (stmt,  7, MR_STATE_OUT_PENDING);
 	sqlite3_bind_text (stmt,  8, msg->m_text? msg->m_text : "",  -1, SQLITE_STATIC);
-	sqlite3_bind_text (stmt,  9, msg->m_param->m_packed, -1, SQLITE_STATIC);
+	sqlite3_bind_text (stmt,  9, mrparam_get_packed(msg->m_param), -1, SQLITE_STATIC);
 	if( sqlite3_step(stmt) != SQLITE_DONE ) {
 		mrmailbox_log_error(mailbox, 0, "Cannot send message, cannot insert to database.", chat->m_id);
 		goto cleanup;
 	}
 
 	msg_id = sqlite3_last_insert_rowid(mailbox->m_sql->m_cobj);
+	mrsqlite3_fts_index_msg__(mailbox->m_sql, msg_id);
 
 	/* finalize message object on database, we set the chat ID late as we don't know it sooner */
 	mrmailbox_update_msg_chat_id__(mailbox, msg_id, chat->m_id);
@@ -2816,7 +3290,7 @@ cleanup:
 
 int mrmailbox_is_group_explicitly_left__(mrmailbox_t* mailbox, const char* grpid)
 {
-	sqlite3_stmt* stmt = mrsqlite3_predefine__(mailbox->m_sql, SELECT_FROM_leftgrps_WHERE_grpid, "SELECT id FROM leftgrps WHERE grpid=?;");
+	sqlite3_stmt* stmt = mrsqlite3_predefine__(mailbox->m_sql, "SELECT id FROM leftgrps WHERE grpid=?;");
 	sqlite3_bind_text (stmt, 1, grpid, -1, SQLITE_STATIC);
 	return (sqlite3_step(stmt)==SQLITE_ROW);
 }
@@ -2826,10 +3300,9 @@ void mrmailbox_set_group_explicitly_left__(mrmailbox_t* mailbox, const char* grp
 {
 	if( !mrmailbox_is_group_explicitly_left__(mailbox, grpid) )
 	{
-		sqlite3_stmt* stmt = mrsqlite3_prepare_v2_(mailbox->m_sql, "INSERT INTO leftgrps (grpid) VALUES(?);");
+		sqlite3_stmt* stmt = mrsqlite3_predefine__(mailbox->m_sql, "INSERT INTO leftgrps (grpid) VALUES(?);");
 		sqlite3_bind_text (stmt, 1, grpid, -1, SQLITE_STATIC);
 		sqlite3_step(stmt);
-		sqlite3_finalize(stmt);
 	}
 }
 
@@ -2844,7 +3317,7 @@ static int mrmailbox_real_group_exists__(mrmailbox_t* mailbox, uint32_t chat_id)
 		return 0;
 	}
 
-	stmt = mrsqlite3_predefine__(mailbox->m_sql, SELECT_id_FROM_chats_WHERE_id,
+	stmt = mrsqlite3_predefine__(mailbox->m_sql,
 		"SELECT id FROM chats WHERE id=? AND type=?;");
 	sqlite3_bind_int(stmt, 1, chat_id);
 	sqlite3_bind_int(stmt, 2, MR_CHAT_TYPE_GROUP);
@@ -2860,7 +3333,7 @@ static int mrmailbox_real_group_exists__(mrmailbox_t* mailbox, uint32_t chat_id)
 int mrmailbox_add_contact_to_chat__(mrmailbox_t* mailbox, uint32_t chat_id, uint32_t contact_id)
 {
 	/* add a contact to a chat; the function does not check the type or if any of the record exist or are already added to the chat! */
-	sqlite3_stmt* stmt = mrsqlite3_predefine__(mailbox->m_sql, INSERT_INTO_chats_contacts,
+	sqlite3_stmt* stmt = mrsqlite3_predefine__(mailbox->m_sql,
 		"INSERT INTO chats_contacts (chat_id, contact_id) VALUES(?, ?)");
 	sqlite3_bind_int(stmt, 1, chat_id);
 	sqlite3_bind_int(stmt, 2, contact_id);
@@ -2909,7 +3382,7 @@ uint32_t mrmailbox_create_group_chat(mrmailbox_t* mailbox, const char* chat_name
 		draft_txt = mrstock_str_repl_string(MR_STR_NEWGROUPDRAFT, chat_name);
 		grpid = mr_create_id();
 
-		stmt = mrsqlite3_prepare_v2_(mailbox->m_sql,
+		stmt = mrsqlite3_predefine__(mailbox->m_sql,
 			"INSERT INTO chats (type, name, draft_timestamp, draft_txt, grpid, param) VALUES(?, ?, ?, ?, ?, 'U=1');" /*U=MRP_UNPROMOTED*/ );
 		sqlite3_bind_int  (stmt, 1, MR_CHAT_TYPE_GROUP);
 		sqlite3_bind_text (stmt, 2, chat_name, -1, SQLITE_STATIC);
@@ -2930,7 +3403,6 @@ uint32_t mrmailbox_create_group_chat(mrmailbox_t* mailbox, const char* chat_name
 
 cleanup:
 	if( locked ) { mrsqlite3_unlock(mailbox->m_sql); }
-	if( stmt) { sqlite3_finalize(stmt); }
 	free(draft_txt);
 	free(grpid);
 
@@ -3096,7 +3568,7 @@ cleanup:
 
 int mrmailbox_get_chat_contact_count__(mrmailbox_t* mailbox, uint32_t chat_id)
 {
-	sqlite3_stmt* stmt = mrsqlite3_predefine__(mailbox->m_sql, SELECT_COUNT_FROM_chats_contacts_WHERE_chat_id,
+	sqlite3_stmt* stmt = mrsqlite3_predefine__(mailbox->m_sql,
 		"SELECT COUNT(*) FROM chats_contacts WHERE chat_id=?;");
 	sqlite3_bind_int(stmt, 1, chat_id);
 	if( sqlite3_step(stmt) == SQLITE_ROW ) {
@@ -3108,7 +3580,7 @@ int mrmailbox_get_chat_contact_count__(mrmailbox_t* mailbox, uint32_t chat_id)
 
 int mrmailbox_is_contact_in_chat__(mrmailbox_t* mailbox, uint32_t chat_id, uint32_t contact_id)
 {
-	sqlite3_stmt* stmt = mrsqlite3_predefine__(mailbox->m_sql, SELECT_void_FROM_chats_contacts_WHERE_chat_id_AND_contact_id,
+	sqlite3_stmt* stmt = mrsqlite3_predefine__(mailbox->m_sql,
 		"SELECT contact_id FROM chats_contacts WHERE chat_id=? AND contact_id=?;");
 	sqlite3_bind_int(stmt, 1, chat_id);
 	sqlite3_bind_int(stmt, 2, contact_id);
@@ -3343,7 +3815,7 @@ int mrmailbox_real_contact_exists__(mrmailbox_t* mailbox, uint32_t contact_id)
 		return 0;
 	}
 
-	stmt = mrsqlite3_predefine__(mailbox->m_sql, SELECT_id_FROM_contacts_WHERE_id,
+	stmt = mrsqlite3_predefine__(mailbox->m_sql,
 		"SELECT id FROM contacts WHERE id=?;");
 	sqlite3_bind_int(stmt, 1, contact_id);
 
@@ -3363,7 +3835,7 @@ size_t mrmailbox_get_real_contact_cnt__(mrmailbox_t* mailbox)
 		return 0;
 	}
 
-	stmt = mrsqlite3_predefine__(mailbox->m_sql, SELECT_COUNT_FROM_contacts, "SELECT COUNT(*) FROM contacts WHERE id>?;");
+	stmt = mrsqlite3_predefine__(mailbox->m_sql, "SELECT COUNT(*) FROM contacts WHERE id>?;");
 	sqlite3_bind_int(stmt, 1, MR_CONTACT_ID_LAST_SPECIAL);
 	if( sqlite3_step(stmt) != SQLITE_ROW ) {
 		return 0;
@@ -3406,7 +3878,7 @@ uint32_t mrmailbox_add_or_lookup_contact__( mrmailbox_t* mailbox,
 
 	/* insert email-address to database or modify the record with the given email-address.
 	we treat all email-addresses case-insensitive. */
-	stmt = mrsqlite3_predefine__(mailbox->m_sql, SELECT_inao_FROM_contacts_a,
+	stmt = mrsqlite3_predefine__(mailbox->m_sql,
 		"SELECT id, name, addr, origin, authname FROM contacts WHERE addr=? COLLATE NOCASE;");
 	sqlite3_bind_text(stmt, 1, (const char*)addr, -1, SQLITE_STATIC);
 	if( sqlite3_step(stmt) == SQLITE_ROW )
@@ -3441,7 +3913,7 @@ uint32_t mrmailbox_add_or_lookup_contact__( mrmailbox_t* mailbox,
 
 		if( update_name || update_authname || update_addr || origin>row_origin )
 		{
-			stmt = mrsqlite3_predefine__(mailbox->m_sql, UPDATE_contacts_nao_WHERE_i,
+			stmt = mrsqlite3_predefine__(mailbox->m_sql,
 				"UPDATE contacts SET name=?, addr=?, origin=?, authname=? WHERE id=?;");
 			sqlite3_bind_text(stmt, 1, update_name?       name   : row_name, -1, SQLITE_STATIC);
 			sqlite3_bind_text(stmt, 2, update_addr?       addr   : row_addr, -1, SQLITE_STATIC);
@@ -3450,11 +3922,20 @@ uint32_t mrmailbox_add_or_lookup_contact__( mrmailbox_t* mailbox,
 			sqlite3_bind_int (stmt, 5, row_id);
 			sqlite3_step     (stmt);
 
+			if( update_name && mailbox->m_sql->m_fts_version )
+			{
+				stmt = mrsqlite3_predefine__(mailbox->m_sql,
+					"UPDATE msgs_fts SET name=? WHERE rowid IN (SELECT id FROM msgs WHERE from_id=?);");
+				sqlite3_bind_text(stmt, 1, name, -1, SQLITE_STATIC);
+				sqlite3_bind_int (stmt, 2, row_id);
+				sqlite3_step     (stmt);
+			}
+
 			if( update_name )
 			{
 				/* Update the contact name also if it is used as a group name.
 				This is one of the few duplicated data, however, getting the chat list is easier this way.*/
-				stmt = mrsqlite3_predefine__(mailbox->m_sql, UPDATE_chats_SET_n_WHERE_c,
+				stmt = mrsqlite3_predefine__(mailbox->m_sql,
 					"UPDATE chats SET name=? WHERE type=? AND id IN(SELECT chat_id FROM chats_contacts WHERE contact_id=?);");
 				sqlite3_bind_text(stmt, 1, name, -1, SQLITE_STATIC);
 				sqlite3_bind_int (stmt, 2, MR_CHAT_TYPE_NORMAL);
@@ -3467,7 +3948,7 @@ uint32_t mrmailbox_add_or_lookup_contact__( mrmailbox_t* mailbox,
 	}
 	else
 	{
-		stmt = mrsqlite3_predefine__(mailbox->m_sql, INSERT_INTO_contacts_neo,
+		stmt = mrsqlite3_predefine__(mailbox->m_sql,
 			"INSERT INTO contacts (name, addr, origin) VALUES(?, ?, ?);");
 		sqlite3_bind_text(stmt, 1, name? name : "", -1, SQLITE_STATIC); /* avoid NULL-fields in column */
 		sqlite3_bind_text(stmt, 2, addr,    -1, SQLITE_STATIC);
@@ -3495,7 +3976,7 @@ void mrmailbox_scaleup_contact_origin__(mrmailbox_t* mailbox, uint32_t contact_i
 		return;
 	}
 
-	sqlite3_stmt* stmt = mrsqlite3_predefine__(mailbox->m_sql, UPDATE_contacts_SET_origin_WHERE_id,
+	sqlite3_stmt* stmt = mrsqlite3_predefine__(mailbox->m_sql,
 		"UPDATE contacts SET origin=? WHERE id=? AND origin<?;");
 	sqlite3_bind_int(stmt, 1, origin);
 	sqlite3_bind_int(stmt, 2, contact_id);
@@ -3692,7 +4173,7 @@ mrarray_t* mrmailbox_get_known_contacts(mrmailbox_t* mailbox, const char* query)
 			if( (s3strLikeCmd=sqlite3_mprintf("%%%s%%", query))==NULL ) {
 				goto cleanup;
 			}
-			stmt = mrsqlite3_predefine__(mailbox->m_sql, SELECT_id_FROM_contacts_WHERE_query_ORDER_BY,
+			stmt = mrsqlite3_predefine__(mailbox->m_sql,
 				"SELECT id FROM contacts"
 					" WHERE addr!=? AND id>" MR_STRINGIFY(MR_CONTACT_ID_LAST_SPECIAL) " AND origin>=" MR_STRINGIFY(MR_ORIGIN_MIN_CONTACT_LIST) " AND blocked=0 AND (name LIKE ? OR addr LIKE ?)" /* see comments in mrmailbox_search_msgs() about the LIKE operator */
 					" ORDER BY LOWER(name||addr),id;");
@@ -3708,7 +4189,7 @@ mrarray_t* mrmailbox_get_known_contacts(mrmailbox_t* mailbox, const char* query)
 		}
 		else
 		{
-			stmt = mrsqlite3_predefine__(mailbox->m_sql, SELECT_id_FROM_contacts_ORDER_BY,
+			stmt = mrsqlite3_predefine__(mailbox->m_sql,
 				"SELECT id FROM contacts"
 					" WHERE addr!=? AND id>" MR_STRINGIFY(MR_CONTACT_ID_LAST_SPECIAL) " AND origin>=" MR_STRINGIFY(MR_ORIGIN_MIN_CONTACT_LIST) " AND blocked=0"
 					" ORDER BY LOWER(name||addr),id;");
@@ -3760,7 +4241,7 @@ mrarray_t* mrmailbox_get_blocked_contacts(mrmailbox_t* mailbox)
 
 	mrsqlite3_lock(mailbox->m_sql);
 
-		stmt = mrsqlite3_predefine__(mailbox->m_sql, SELECT_id_FROM_contacts_WHERE_blocked,
+		stmt = mrsqlite3_predefine__(mailbox->m_sql,
 			"SELECT id FROM contacts"
 				" WHERE id>? AND blocked!=0"
 				" ORDER BY LOWER(name||addr),id;");
@@ -3795,7 +4276,7 @@ int mrmailbox_get_blocked_count(mrmailbox_t* mailbox)
 	mrsqlite3_lock(mailbox->m_sql);
 	locked = 1;
 
-		stmt = mrsqlite3_predefine__(mailbox->m_sql, SELECT_COUNT_FROM_contacts_WHERE_blocked,
+		stmt = mrsqlite3_predefine__(mailbox->m_sql,
 			"SELECT COUNT(*) FROM contacts"
 				" WHERE id>? AND blocked!=0");
 		sqlite3_bind_int(stmt, 1, MR_CONTACT_ID_LAST_SPECIAL);
@@ -3848,7 +4329,7 @@ mrcontact_t* mrmailbox_get_contact(mrmailbox_t* mailbox, uint32_t contact_id)
 
 static void marknoticed_contact__(mrmailbox_t* mailbox, uint32_t contact_id)
 {
-	sqlite3_stmt* stmt = mrsqlite3_predefine__(mailbox->m_sql, UPDATE_msgs_SET_state_WHERE_from_id_AND_state,
+	sqlite3_stmt* stmt = mrsqlite3_predefine__(mailbox->m_sql,
 		"UPDATE msgs SET state=" MR_STRINGIFY(MR_STATE_IN_NOTICED) " WHERE from_id=? AND state=" MR_STRINGIFY(MR_STATE_IN_FRESH) ";");
 	sqlite3_bind_int(stmt, 1, contact_id);
 	sqlite3_step(stmt);
@@ -3889,7 +4370,7 @@ void mrmailbox_block_chat__(mrmailbox_t* mailbox, uint32_t chat_id, int new_bloc
 		return;
 	}
 
-	stmt = mrsqlite3_predefine__(mailbox->m_sql, UPDATE_chats_SET_blocked_WHERE_chat_id,
+	stmt = mrsqlite3_predefine__(mailbox->m_sql,
 		"UPDATE chats SET blocked=? WHERE id=?;");
 	sqlite3_bind_int(stmt, 1, new_blocking);
 	sqlite3_bind_int(stmt, 2, chat_id);
@@ -3937,7 +4418,7 @@ void mrmailbox_block_contact(mrmailbox_t* mailbox, uint32_t contact_id, int new_
 			mrsqlite3_begin_transaction__(mailbox->m_sql);
 			transaction_pending = 1;
 
-				stmt = mrsqlite3_predefine__(mailbox->m_sql, UPDATE_contacts_SET_b_WHERE_i,
+				stmt = mrsqlite3_predefine__(mailbox->m_sql,
 					"UPDATE contacts SET blocked=? WHERE id=?;");
 				sqlite3_bind_int(stmt, 1, new_blocking);
 				sqlite3_bind_int(stmt, 2, contact_id);
@@ -3949,7 +4430,7 @@ void mrmailbox_block_contact(mrmailbox_t* mailbox, uint32_t contact_id, int new_
 				(Maybe, beside normal chats (type=100) we should also block group chats with only this user.
 				However, I'm not sure about this point; it may be confusing if the user wants to add other people;
 				this would result in recreating the same group...) */
-				stmt = mrsqlite3_predefine__(mailbox->m_sql, UPDATE_chats_SET_blocked_WHERE_contact_id,
+				stmt = mrsqlite3_predefine__(mailbox->m_sql,
 					"UPDATE chats SET blocked=? WHERE type=? AND id IN (SELECT chat_id FROM chats_contacts WHERE contact_id=?);");
 				sqlite3_bind_int(stmt, 1, new_blocking);
 				sqlite3_bind_int(stmt, 2, MR_CHAT_TYPE_NORMAL);
@@ -4151,14 +4632,14 @@ int mrmailbox_delete_contact(mrmailbox_t* mailbox, uint32_t contact_id)
 
 		/* we can only delete contacts that are not in use anywhere; this function is mainly for the user who has just
 		created an contact manually and wants to delete it a moment later */
-		stmt = mrsqlite3_predefine__(mailbox->m_sql, SELECT_COUNT_FROM_chats_contacts_WHERE_contact_id,
+		stmt = mrsqlite3_predefine__(mailbox->m_sql,
 			"SELECT COUNT(*) FROM chats_contacts WHERE contact_id=?;");
 		sqlite3_bind_int(stmt, 1, contact_id);
 		if( sqlite3_step(stmt) != SQLITE_ROW || sqlite3_column_int(stmt, 0) >= 1 ) {
 			goto cleanup;
 		}
 
-		stmt = mrsqlite3_predefine__(mailbox->m_sql, SELECT_COUNT_FROM_msgs_WHERE_ft,
+		stmt = mrsqlite3_predefine__(mailbox->m_sql,
 			"SELECT COUNT(*) FROM msgs WHERE from_id=? OR to_id=?;");
 		sqlite3_bind_int(stmt, 1, contact_id);
 		sqlite3_bind_int(stmt, 2, contact_id);
@@ -4166,7 +4647,7 @@ int mrmailbox_delete_contact(mrmailbox_t* mailbox, uint32_t contact_id)
 			goto cleanup;
 		}
 
-		stmt = mrsqlite3_predefine__(mailbox->m_sql, DELETE_FROM_contacts_WHERE_id,
+		stmt = mrsqlite3_predefine__(mailbox->m_sql,
 			"DELETE FROM contacts WHERE id=?;");
 		sqlite3_bind_int(stmt, 1, contact_id);
 		if( sqlite3_step(stmt) != SQLITE_DONE ) {
@@ -4210,19 +4691,64 @@ int mrmailbox_contact_addr_equals__(mrmailbox_t* mailbox, uint32_t contact_id, c
  ******************************************************************************/
 
 
+void mrmailbox_update_chat_last_msg__(mrmailbox_t* mailbox, uint32_t chat_id)
+{
+	sqlite3_stmt* stmt;
+	uint32_t      last_msg_id = 0;
+	time_t        last_timestamp = 0;
+
+	if( chat_id <= MR_CHAT_ID_LAST_SPECIAL ) {
+		return; /* special chats are not shown in the chatlist */
+	}
+
+	stmt = mrsqlite3_predefine__(mailbox->m_sql,
+		"SELECT IFNULL((SELECT id FROM msgs WHERE chat_id=?1 ORDER BY timestamp DESC, id DESC LIMIT 1),0),"
+		" IFNULL((SELECT MAX(timestamp) FROM msgs WHERE chat_id=?1),0);");
+	sqlite3_bind_int(stmt, 1, chat_id);
+	if( sqlite3_step(stmt) != SQLITE_ROW ) {
+		return;
+	}
+	last_msg_id    = sqlite3_column_int  (stmt, 0);
+	last_timestamp = sqlite3_column_int64(stmt, 1);
+
+	/* write the row only if the values change; the columns are not part of mrchat_t, so the chat stays in the cache */
+	stmt = mrsqlite3_predefine__(mailbox->m_sql,
+		"UPDATE chats SET last_msg_id=?2, last_timestamp=MAX(IFNULL(draft_timestamp,0),?3)"
+		" WHERE id=?1 AND (last_msg_id!=?2 OR last_timestamp!=MAX(IFNULL(draft_timestamp,0),?3));");
+	sqlite3_bind_int  (stmt, 1, chat_id);
+	sqlite3_bind_int  (stmt, 2, last_msg_id);
+	sqlite3_bind_int64(stmt, 3, last_timestamp);
+	mrcache_keep_chats(mailbox->m_sql->m_cache, 1);
+		sqlite3_step(stmt);
+	mrcache_keep_chats(mailbox->m_sql->m_cache, 0);
+}
+
+
 void mrmailbox_update_msg_chat_id__(mrmailbox_t* mailbox, uint32_t msg_id, uint32_t chat_id)
 {
-    sqlite3_stmt* stmt = mrsqlite3_predefine__(mailbox->m_sql, UPDATE_msgs_SET_chat_id_WHERE_id,
+	uint32_t old_chat_id = 0;
+
+	sqlite3_stmt* stmt = mrsqlite3_predefine__(mailbox->m_sql,
+		"SELECT chat_id FROM msgs WHERE id=?;");
+	sqlite3_bind_int(stmt, 1, msg_id);
+	if( sqlite3_step(stmt) == SQLITE_ROW ) {
+		old_chat_id = sqlite3_column_int(stmt, 0);
+	}
+
+    stmt = mrsqlite3_predefine__(mailbox->m_sql,
 		"UPDATE msgs SET chat_id=? WHERE id=?;");
 	sqlite3_bind_int(stmt, 1, chat_id);
 	sqlite3_bind_int(stmt, 2, msg_id);
 	sqlite3_step(stmt);
+
+	mrmailbox_update_chat_last_msg__(mailbox, old_chat_id);
+	mrmailbox_update_chat_last_msg__(mailbox, chat_id);
 }
 
 
 void mrmailbox_update_msg_state__(mrmailbox_t* mailbox, uint32_t msg_id, int state)
 {
-    sqlite3_stmt* stmt = mrsqlite3_predefine__(mailbox->m_sql, UPDATE_msgs_SET_state_WHERE_id,
+    sqlite3_stmt* stmt = mrsqlite3_predefine__(mailbox->m_sql,
 		"UPDATE msgs SET state=? WHERE id=?;");
 	sqlite3_bind_int(stmt, 1, state);
 	sqlite3_bind_int(stmt, 2, msg_id);
@@ -4236,7 +4762,7 @@ size_t mrmailbox_get_real_msg_cnt__(mrmailbox_t* mailbox)
 		return 0;
 	}
 
-	sqlite3_stmt* stmt = mrsqlite3_predefine__(mailbox->m_sql, SELECT_COUNT_FROM_msgs_WHERE_assigned,
+	sqlite3_stmt* stmt = mrsqlite3_predefine__(mailbox->m_sql,
 		"SELECT COUNT(*) "
 		" FROM msgs m "
 		" LEFT JOIN chats c ON c.id=m.chat_id "
@@ -4258,7 +4784,7 @@ size_t mrmailbox_get_deaddrop_msg_cnt__(mrmailbox_t* mailbox)
 		return 0;
 	}
 
-	sqlite3_stmt* stmt = mrsqlite3_predefine__(mailbox->m_sql, SELECT_COUNT_FROM_msgs_WHERE_unassigned,
+	sqlite3_stmt* stmt = mrsqlite3_predefine__(mailbox->m_sql,
 		"SELECT COUNT(*) FROM msgs m LEFT JOIN chats c ON c.id=m.chat_id WHERE c.blocked=2;");
 	if( sqlite3_step(stmt) != SQLITE_ROW ) {
 		return 0;
@@ -4275,7 +4801,7 @@ int mrmailbox_rfc724_mid_cnt__(mrmailbox_t* mailbox, const char* rfc724_mid)
 	}
 
 	/* check the number of messages with the same rfc724_mid */
-	sqlite3_stmt* stmt = mrsqlite3_predefine__(mailbox->m_sql, SELECT_COUNT_FROM_msgs_WHERE_rfc724_mid,
+	sqlite3_stmt* stmt = mrsqlite3_predefine__(mailbox->m_sql,
 		"SELECT COUNT(*) FROM msgs WHERE rfc724_mid=?;");
 	sqlite3_bind_text(stmt, 1, rfc724_mid, -1, SQLITE_STATIC);
 	if( sqlite3_step(stmt) != SQLITE_ROW ) {
@@ -4290,7 +4816,7 @@ int mrmailbox_rfc724_mid_cnt__(mrmailbox_t* mailbox, const char* rfc724_mid)
 so, we should even keep unuseful messages in the database (we can leave the other fields empty to save space) */
 int mrmailbox_rfc724_mid_exists__(mrmailbox_t* mailbox, const char* rfc724_mid, char** ret_server_folder, uint32_t* ret_server_uid)
 {
-	sqlite3_stmt* stmt = mrsqlite3_predefine__(mailbox->m_sql, SELECT_ss_FROM_msgs_WHERE_m,
+	sqlite3_stmt* stmt = mrsqlite3_predefine__(mailbox->m_sql,
 		"SELECT server_folder, server_uid FROM msgs WHERE rfc724_mid=?;");
 	sqlite3_bind_text(stmt, 1, rfc724_mid, -1, SQLITE_STATIC);
 	if( sqlite3_step(stmt) != SQLITE_ROW ) {
@@ -4307,7 +4833,7 @@ int mrmailbox_rfc724_mid_exists__(mrmailbox_t* mailbox, const char* rfc724_mid,
 
 void mrmailbox_update_server_uid__(mrmailbox_t* mailbox, const char* rfc724_mid, const char* server_folder, uint32_t server_uid)
 {
-	sqlite3_stmt* stmt = mrsqlite3_predefine__(mailbox->m_sql, UPDATE_msgs_SET_ss_WHERE_rfc724_mid,
+	sqlite3_stmt* stmt = mrsqlite3_predefine__(mailbox->m_sql,
 		"UPDATE msgs SET server_folder=?, server_uid=? WHERE rfc724_mid=?;"); /* we update by "rfc724_mid" instead of "id" as there may be several db-entries refering to the same "rfc724_mid" */
 	sqlite3_bind_text(stmt, 1, server_folder, -1, SQLITE_STATIC);
 	sqlite3_bind_int (stmt, 2, server_uid);
@@ -4316,6 +4842,57 @@ void mrmailbox_update_server_uid__(mrmailbox_t* mailbox, const char* rfc724_mid,
 }
 
 
+/* apply flags changed on the server by other devices, see mrimap_t::m_sync_flags.
+Seen messages are marked as seen here, without a job marking them on the server.  For messages that are deleted or
+were moved away from the folder, we only forget the server UID, so that the jobs look for the message by the Message-ID;
+we do not delete them as this is also what happens if we (or another MUA) move the messages to another folder. */
+void mrmailbox_sync_server_flags(mrmailbox_t* mailbox, const char* server_folder, const mrarray_t* seen_uids, const mrarray_t* gone_uid_ranges)
+{
+	sqlite3_stmt* stmt;
+	size_t        i, cnt;
+	int           seen_cnt = 0;
+
+	if( mailbox==NULL || mailbox->m_magic != MR_MAILBOX_MAGIC || server_folder==NULL ) {
+		return;
+	}
+
+	mrsqlite3_lock(mailbox->m_sql);
+	mrsqlite3_begin_transaction__(mailbox->m_sql);
+
+		stmt = mrsqlite3_predefine__(mailbox->m_sql,
+			"UPDATE msgs SET state=? WHERE server_folder=? AND server_uid=? AND (state=? OR state=?);");
+		cnt = mrarray_get_cnt(seen_uids);
+		for( i = 0; i < cnt; i++ ) {
+			sqlite3_reset(stmt);
+			sqlite3_bind_int (stmt, 1, MR_STATE_IN_SEEN);
+			sqlite3_bind_text(stmt, 2, server_folder, -1, SQLITE_STATIC);
+			sqlite3_bind_int (stmt, 3, mrarray_get_id(seen_uids, i));
+			sqlite3_bind_int (stmt, 4, MR_STATE_IN_FRESH);
+			sqlite3_bind_int (stmt, 5, MR_STATE_IN_NOTICED);
+			sqlite3_step(stmt);
+			seen_cnt += sqlite3_changes(mailbox->m_sql->m_cobj);
+		}
+
+		stmt = mrsqlite3_predefine__(mailbox->m_sql,
+			"UPDATE msgs SET server_uid=0 WHERE server_folder=? AND server_uid BETWEEN ? AND ?;");
+		cnt = mrarray_get_cnt(gone_uid_ranges);
+		for( i = 0; i+1 < cnt; i += 2 ) {
+			sqlite3_reset(stmt);
+			sqlite3_bind_text(stmt, 1, server_folder, -1, SQLITE_STATIC);
+			sqlite3_bind_int (stmt, 2, mrarray_get_id(gone_uid_ranges, i));
+			sqlite3_bind_int (stmt, 3, mrarray_get_id(gone_uid_ranges, i+1));
+			sqlite3_step(stmt);
+		}
+
+	mrsqlite3_commit__(mailbox->m_sql);
+	mrsqlite3_unlock(mailbox->m_sql);
+
+	if( seen_cnt ) {
+		mailbox->m_cb(mailbox, MR_EVENT_MSGS_CHANGED, 0, 0);
+	}
+}
+
+
 /**
  * Get a single message object of the type mrmsg_t.
  * For a list of messages in a chat, see mrmailbox_get_chat_msgs()
@@ -4361,6 +4938,56 @@ cleanup:
 }
 
 
+/**
+ * Get several message objects at once.  This is faster than calling
+ * mrmailbox_get_msg() for each message, eg. for the visible rows of a page
+ * returned by mrmailbox_get_chat_msgs_page().
+ *
+ * @memberof mrmailbox_t
+ *
+ * @param mailbox Mailbox object as created by mrmailbox_new()
+ *
+ * @param msg_ids The message IDs for which the message objects should be created.
+ *     Special IDs as day markers are allowed.
+ *
+ * @param msg_cnt The number of IDs in msg_ids.
+ *
+ * @return Array with msg_cnt entries, the entry at index i belongs to msg_ids[i],
+ *     get the entries using mrarray_get_ptr() and cast them to mrmsg_t*.
+ *     The entries for special IDs and for messages that do not exist are NULL.
+ *     When done, the message objects must be freed using mrmsg_unref() and the
+ *     array using mrarray_unref().  NULL on errors.
+ */
+mrarray_t* mrmailbox_get_msgs(mrmailbox_t* mailbox, const uint32_t* msg_ids, int msg_cnt)
+{
+	mrarray_t*   ret = NULL;
+	mrmsg_t**    msgs = NULL;
+	mrsqlite3_t* reader;
+	int          i;
+
+	if( mailbox == NULL || mailbox->m_magic != MR_MAILBOX_MAGIC || msg_ids == NULL || msg_cnt <= 0 ) {
+		goto cleanup;
+	}
+
+	if( (msgs=calloc(msg_cnt, sizeof(mrmsg_t*)))==NULL ) {
+		goto cleanup;
+	}
+
+	reader = mrsqlite3_lock_reader(mailbox->m_sql);
+		mrmsg_load_many_from_db__(msgs, mailbox, reader, msg_ids, msg_cnt, 0);
+	mrsqlite3_unlock_reader(mailbox->m_sql, reader);
+
+	ret = mrarray_new(mailbox, msg_cnt);
+	for( i = 0; i < msg_cnt; i++ ) {
+		mrarray_add_ptr(ret, msgs[i]);
+	}
+
+cleanup:
+	free(msgs);
+	return ret;
+}
+
+
 /**
  * Get an informational text for a single message. the text is multiline and may
  * contain eg. the raw text of the message.
@@ -4400,7 +5027,7 @@ char* mrmailbox_get_msg_info(mrmailbox_t* mailbox, uint32_t msg_id)
 
 		mrmsg_load_from_db__(msg, mailbox, msg_id);
 
-		stmt = mrsqlite3_predefine__(mailbox->m_sql, SELECT_txt_raw_FROM_msgs_WHERE_id,
+		stmt = mrsqlite3_predefine__(mailbox->m_sql,
 			"SELECT txt_raw FROM msgs WHERE id=?;");
 		sqlite3_bind_int(stmt, 1, msg_id);
 		if( sqlite3_step(stmt) != SQLITE_ROW ) {
@@ -4533,15 +5160,28 @@ cleanup:
  *
  * @return none
  */
+static int cmp_msgs_by_timestamp(const void* p1, const void* p2)
+{
+	/* sorts as `ORDER BY timestamp,id`, NULL-pointers are sorted to the end */
+	const mrmsg_t* msg1 = *(const mrmsg_t**)p1;
+	const mrmsg_t* msg2 = *(const mrmsg_t**)p2;
+	if( msg1 == NULL || msg2 == NULL ) {
+		return (msg1==NULL) - (msg2==NULL);
+	}
+	if( msg1->m_timestamp != msg2->m_timestamp ) {
+		return msg1->m_timestamp < msg2->m_timestamp? -1 : 1;
+	}
+	return msg1->m_id < msg2->m_id? -1 : (msg1->m_id > msg2->m_id? 1 : 0);
+}
+
+
 void mrmailbox_forward_msgs(mrmailbox_t* mailbox, const uint32_t* msg_ids, int msg_cnt, uint32_t chat_id)
 {
-	mrmsg_t*      msg = mrmsg_new();
+	mrmsg_t**     msgs = NULL;
 	mrchat_t*     chat = mrchat_new(mailbox);
 	mrcontact_t*  contact = mrcontact_new();
-	int           locked = 0, transaction_pending = 0;
+	int           locked = 0, transaction_pending = 0, i;
 	carray*       created_db_entries = carray_new(16);
-	char*         idsstr = NULL, *q3 = NULL;
-	sqlite3_stmt* stmt = NULL;
 	time_t        curr_timestamp;
 
 	if( mailbox == NULL || mailbox->m_magic != MR_MAILBOX_MAGIC || msg_ids==NULL || msg_cnt <= 0 || chat_id <= MR_CHAT_ID_LAST_SPECIAL ) {
@@ -4563,14 +5203,17 @@ void mrmailbox_forward_msgs(mrmailbox_t* mailbox, const uint32_t* msg_ids, int m
 
 		curr_timestamp = mr_create_smeared_timestamps__(msg_cnt);
 
-		idsstr = mr_arr_to_string(msg_ids, msg_cnt);
-		q3 = sqlite3_mprintf("SELECT id FROM msgs WHERE id IN(%s) ORDER BY timestamp,id", idsstr);
-		stmt = mrsqlite3_prepare_v2_(mailbox->m_sql, q3);
-		while( sqlite3_step(stmt)==SQLITE_ROW )
+		if( (msgs=calloc(msg_cnt, sizeof(mrmsg_t*)))==NULL ) {
+			goto cleanup;
+		}
+		mrmsg_load_many_from_db__(msgs, mailbox, mailbox->m_sql, msg_ids, msg_cnt, 0);
+		qsort(msgs, msg_cnt, sizeof(mrmsg_t*), cmp_msgs_by_timestamp);
+
+		for( i = 0; i < msg_cnt && msgs[i]; i++ )
 		{
-			int src_msg_id = sqlite3_column_int(stmt, 0);
-			if( !mrmsg_load_from_db__(msg, mailbox, src_msg_id) ) {
-				goto cleanup;
+			mrmsg_t* msg = msgs[i];
+			if( i > 0 && msgs[i-1]->m_id == msg->m_id ) {
+				continue; /* each message is forwarded only once, even if given several times */
 			}
 
 			mrparam_set_int(msg->m_param, MRP_FORWARDED, 1);
@@ -4594,11 +5237,13 @@ cleanup:
 		carray_free(created_db_entries);
 	}
 	mrcontact_unref(contact);
-	mrmsg_unref(msg);
+	if( msgs ) {
+		for( i = 0; i < msg_cnt; i++ ) {
+			mrmsg_unref(msgs[i]);
+		}
+		free(msgs);
+	}
 	mrchat_unref(chat);
-	if( stmt ) { sqlite3_finalize(stmt); }
-	free(idsstr);
-	if( q3 ) { sqlite3_free(q3); }
 }
 
 
@@ -4632,7 +5277,7 @@ void mrmailbox_star_msgs(mrmailbox_t* mailbox, const uint32_t* msg_ids, int msg_
 
 		for( i = 0; i < msg_cnt; i++ )
 		{
-			sqlite3_stmt* stmt = mrsqlite3_predefine__(mailbox->m_sql, UPDATE_msgs_SET_starred_WHERE_id,
+			sqlite3_stmt* stmt = mrsqlite3_predefine__(mailbox->m_sql,
 				"UPDATE msgs SET starred=? WHERE id=?;");
 			sqlite3_bind_int(stmt, 1, star);
 			sqlite3_bind_int(stmt, 2, msg_ids[i]);
@@ -4695,21 +5340,21 @@ void mrmailbox_delete_msg_on_imap(mrmailbox_t* mailbox, mrjob_t* job)
 	mrsqlite3_lock(mailbox->m_sql);
 	locked = 1;
 
-		sqlite3_stmt* stmt = mrsqlite3_predefine__(mailbox->m_sql, DELETE_FROM_msgs_WHERE_id, "DELETE FROM msgs WHERE id=?;");
+		sqlite3_stmt* stmt = mrsqlite3_predefine__(mailbox->m_sql, "DELETE FROM msgs WHERE id=?;");
 		sqlite3_bind_int(stmt, 1, msg->m_id);
 		sqlite3_step(stmt);
+		mrmailbox_update_chat_last_msg__(mailbox, msg->m_chat_id);
 
 		char* pathNfilename = mrparam_get(msg->m_param, MRP_FILE, NULL);
 		if( pathNfilename ) {
 			if( strncmp(mailbox->m_blobdir, pathNfilename, strlen(mailbox->m_blobdir))==0 )
 			{
 				char* strLikeFilename = mr_mprintf("%%f=%s%%", pathNfilename);
-				sqlite3_stmt* stmt2 = mrsqlite3_prepare_v2_(mailbox->m_sql, "SELECT id FROM msgs WHERE type!=? AND param LIKE ?;"); /* if this gets too slow, an index over "type" should help. */
+				sqlite3_stmt* stmt2 = mrsqlite3_predefine__(mailbox->m_sql, "SELECT id FROM msgs WHERE type!=? AND param LIKE ?;"); /* if this gets too slow, an index over "type" should help. */
 				sqlite3_bind_int (stmt2, 1, MR_MSG_TEXT);
 				sqlite3_bind_text(stmt2, 2, strLikeFilename, -1, SQLITE_STATIC);
 				int file_used_by_other_msgs = (sqlite3_step(stmt2)==SQLITE_ROW)? 1 : 0;
 				free(strLikeFilename);
-				sqlite3_finalize(stmt2);
 
 				if( !file_used_by_other_msgs )
 				{
@@ -4856,6 +5501,135 @@ cleanup:
 }
 
 
+void mrmailbox_markseen_msgs_on_imap(mrmailbox_t* mailbox, mrjob_t* jobs, int job_cnt)
+{
+	/* Same as mrmailbox_markseen_msg_on_imap() for several jobs, used by the job thread to coalesce the jobs:
+	messages are grouped by folder and by whether they should be moved, each group results in a single UID STORE and UID MOVE.
+	Messages that need the $MDNSent flag are checked one by one as before. */
+	int       locked = 0, i, j, grp_cnt, mdns_enabled;
+	uint32_t* msg_ids = NULL;
+	mrmsg_t** msgs = NULL;
+	int*      done = NULL;
+	uint32_t* grp_uids = NULL;
+	uint32_t* grp_new_uids = NULL;
+	int*      grp_jobs = NULL;
+
+	if( job_cnt <= 0 ) {
+		goto cleanup;
+	}
+
+	if( job_cnt == 1 ) {
+		mrmailbox_markseen_msg_on_imap(mailbox, &jobs[0]);
+		goto cleanup;
+	}
+
+	if( !mrimap_is_connected(mailbox->m_imap) ) {
+		mrmailbox_connect_to_imap(mailbox, NULL);
+		if( !mrimap_is_connected(mailbox->m_imap) ) {
+			for( i = 0; i < job_cnt; i++ ) {
+				mrjob_try_again_later(&jobs[i], MR_STANDARD_DELAY);
+			}
+			goto cleanup;
+		}
+	}
+
+	msg_ids      = calloc(job_cnt, sizeof(uint32_t));
+	msgs         = calloc(job_cnt, sizeof(mrmsg_t*));
+	done         = calloc(job_cnt, sizeof(int));
+	grp_uids     = calloc(job_cnt, sizeof(uint32_t));
+	grp_new_uids = calloc(job_cnt, sizeof(uint32_t));
+	grp_jobs     = calloc(job_cnt, sizeof(int));
+	if( msg_ids==NULL || msgs==NULL || done==NULL || grp_uids==NULL || grp_new_uids==NULL || grp_jobs==NULL ) {
+		goto cleanup;
+	}
+
+	mrsqlite3_lock(mailbox->m_sql);
+	locked = 1;
+
+		mdns_enabled = mrsqlite3_get_config_int__(mailbox->m_sql, "mdns_enabled", MR_MDNS_DEFAULT_ENABLED);
+		for( i = 0; i < job_cnt; i++ ) {
+			msg_ids[i] = jobs[i].m_foreign_id;
+		}
+		mrmsg_load_many_from_db__(msgs, mailbox, mailbox->m_sql, msg_ids, job_cnt, MR_MSG_LOAD_NO_TEXT);
+		for( i = 0; i < job_cnt; i++ ) {
+			if( msgs[i] == NULL
+			 || msgs[i]->m_server_folder == NULL || msgs[i]->m_server_uid == 0 ) {
+				done[i] = 1; /* job done, nothing to do on IMAP */
+			}
+			else if( mdns_enabled && mrparam_get_int(msgs[i]->m_param, MRP_WANTS_MDN, 0) ) {
+				done[i] = 2; /* needs the $MDNSent check, handled below one by one */
+			}
+		}
+
+	mrsqlite3_unlock(mailbox->m_sql);
+	locked = 0;
+
+	for( i = 0; i < job_cnt; i++ )
+	{
+		if( done[i] == 2 ) {
+			mrmailbox_markseen_msg_on_imap(mailbox, &jobs[i]);
+			done[i] = 1;
+		}
+
+		if( done[i] ) {
+			continue;
+		}
+
+		/* collect all messages in the same folder with the same move-flag */
+		grp_cnt = 0;
+		for( j = i; j < job_cnt; j++ ) {
+			if( !done[j]
+			 && strcmp(msgs[j]->m_server_folder, msgs[i]->m_server_folder)==0
+			 && (msgs[j]->m_is_msgrmsg!=0) == (msgs[i]->m_is_msgrmsg!=0) ) {
+				grp_jobs[grp_cnt] = j;
+				grp_uids[grp_cnt] = msgs[j]->m_server_uid;
+				grp_cnt++;
+				done[j] = 1;
+			}
+		}
+
+		char* new_server_folder = NULL;
+		if( mrimap_markseen_msgs(mailbox->m_imap, msgs[i]->m_server_folder, grp_uids, grp_cnt,
+		       msgs[i]->m_is_msgrmsg? MR_MS_ALSO_MOVE : 0, &new_server_folder, grp_new_uids) != 0 )
+		{
+			if( new_server_folder )
+			{
+				mrsqlite3_lock(mailbox->m_sql);
+				mrsqlite3_begin_transaction__(mailbox->m_sql);
+					for( j = 0; j < grp_cnt; j++ ) {
+						if( grp_new_uids[j] ) {
+							mrmailbox_update_server_uid__(mailbox, msgs[grp_jobs[j]]->m_rfc724_mid, new_server_folder, grp_new_uids[j]);
+						}
+					}
+				mrsqlite3_commit__(mailbox->m_sql);
+				mrsqlite3_unlock(mailbox->m_sql);
+			}
+		}
+		else
+		{
+			for( j = 0; j < grp_cnt; j++ ) {
+				mrjob_try_again_later(&jobs[grp_jobs[j]], MR_STANDARD_DELAY);
+			}
+		}
+		free(new_server_folder);
+	}
+
+cleanup:
+	if( locked ) { mrsqlite3_unlock(mailbox->m_sql); }
+	if( msgs ) {
+		for( i = 0; i < job_cnt; i++ ) {
+			mrmsg_unref(msgs[i]);
+		}
+		free(msgs);
+	}
+	free(msg_ids);
+	free(done);
+	free(grp_uids);
+	free(grp_new_uids);
+	free(grp_jobs);
+}
+
+
 void mrmailbox_markseen_mdn_on_imap(mrmailbox_t* mailbox, mrjob_t* job)
 {
 	char*    server_folder = mrparam_get    (job->m_param, MRP_SERVER_FOLDER, NULL);
@@ -4900,32 +5674,33 @@ cleanup:
  */
 void mrmailbox_markseen_msgs(mrmailbox_t* mailbox, const uint32_t* msg_ids, int msg_cnt)
 {
-	int locked = 0, transaction_pending = 0;
-	int i, send_event = 0;
-	int curr_state = 0, curr_blocked = 0;
+	int       locked = 0, transaction_pending = 0;
+	int       i, send_event = 0;
+	int       curr_state = 0, curr_blocked = 0;
+	mrmsg_t** msgs = NULL;
 
 	if( mailbox == NULL || mailbox->m_magic != MR_MAILBOX_MAGIC || msg_ids == NULL || msg_cnt <= 0 ) {
 		goto cleanup;
 	}
 
+	if( (msgs=calloc(msg_cnt, sizeof(mrmsg_t*)))==NULL ) {
+		goto cleanup;
+	}
+
 	mrsqlite3_lock(mailbox->m_sql);
 	locked = 1;
 	mrsqlite3_begin_transaction__(mailbox->m_sql);
 	transaction_pending = 1;
 
+		mrmsg_load_many_from_db__(msgs, mailbox, mailbox->m_sql, msg_ids, msg_cnt, MR_MSG_LOAD_NO_TEXT|MR_MSG_LOAD_NO_PARAM); /* we need only the state */
+
 		for( i = 0; i < msg_cnt; i++ )
 		{
-			sqlite3_stmt* stmt = mrsqlite3_predefine__(mailbox->m_sql, SELECT_state_blocked_FROM_msgs_LEFT_JOIN_chats_WHERE_id,
-				"SELECT m.state, c.blocked "
-				" FROM msgs m "
-				" LEFT JOIN chats c ON c.id=m.chat_id "
-				" WHERE m.id=? AND m.chat_id>" MR_STRINGIFY(MR_CHAT_ID_LAST_SPECIAL));
-			sqlite3_bind_int(stmt, 1, msg_ids[i]);
-			if( sqlite3_step(stmt) != SQLITE_ROW ) {
+			if( msgs[i] == NULL || msgs[i]->m_chat_id <= MR_CHAT_ID_LAST_SPECIAL ) {
 				goto cleanup;
 			}
-			curr_state   = sqlite3_column_int(stmt, 0);
-			curr_blocked = sqlite3_column_int(stmt, 1);
+			curr_state   = msgs[i]->m_state;
+			curr_blocked = msgs[i]->m_chat_blocked;
 			if( curr_blocked == 0 )
 			{
 				if( curr_state == MR_STATE_IN_FRESH || curr_state == MR_STATE_IN_NOTICED ) {
@@ -4958,6 +5733,12 @@ void mrmailbox_markseen_msgs(mrmailbox_t* mailbox, const uint32_t* msg_ids, int
 cleanup:
 	if( transaction_pending ) { mrsqlite3_rollback__(mailbox->m_sql); }
 	if( locked ) { mrsqlite3_unlock(mailbox->m_sql); }
+	if( msgs ) {
+		for( i = 0; i < msg_cnt; i++ ) {
+			mrmsg_unref(msgs[i]);
+		}
+		free(msgs);
+	}
 }
 
 
@@ -4970,7 +5751,7 @@ int mrmailbox_mdn_from_ext__(mrmailbox_t* mailbox, uint32_t from_id, const char*
 		return 0;
 	}
 
-	sqlite3_stmt* stmt = mrsqlite3_predefine__(mailbox->m_sql, SELECT_it_FROM_msgs_JOIN_chats_WHERE_rfc724,
+	sqlite3_stmt* stmt = mrsqlite3_predefine__(mailbox->m_sql,
 		"SELECT m.id, c.id, c.type, m.state FROM msgs m "
 		" LEFT JOIN chats c ON m.chat_id=c.id "
 		" WHERE rfc724_mid=? AND from_id=1 "
@@ -4997,17 +5778,17 @@ int mrmailbox_mdn_from_ext__(mrmailbox_t* mailbox, uint32_t from_id, const char*
 	}
 
 	/* group chat: collect receipt senders */
-	stmt = mrsqlite3_predefine__(mailbox->m_sql, SELECT_c_FROM_msgs_mdns_WHERE_mc, "SELECT contact_id FROM msgs_mdns WHERE msg_id=? AND contact_id=?;");
+	stmt = mrsqlite3_predefine__(mailbox->m_sql, "SELECT contact_id FROM msgs_mdns WHERE msg_id=? AND contact_id=?;");
 	sqlite3_bind_int(stmt, 1, *ret_msg_id);
 	sqlite3_bind_int(stmt, 2, from_id);
 	if( sqlite3_step(stmt) != SQLITE_ROW ) {
-		stmt = mrsqlite3_predefine__(mailbox->m_sql, INSERT_INTO_msgs_mdns, "INSERT INTO msgs_mdns (msg_id, contact_id) VALUES (?, ?);");
+		stmt = mrsqlite3_predefine__(mailbox->m_sql, "INSERT INTO msgs_mdns (msg_id, contact_id) VALUES (?, ?);");
 		sqlite3_bind_int(stmt, 1, *ret_msg_id);
 		sqlite3_bind_int(stmt, 2, from_id);
 		sqlite3_step(stmt);
 	}
 
-	stmt = mrsqlite3_predefine__(mailbox->m_sql, SELECT_COUNT_FROM_msgs_mdns_WHERE_m, "SELECT COUNT(*) FROM msgs_mdns WHERE msg_id=?;");
+	stmt = mrsqlite3_predefine__(mailbox->m_sql, "SELECT COUNT(*) FROM msgs_mdns WHERE msg_id=?;");
 	sqlite3_bind_int(stmt, 1, *ret_msg_id);
 	if( sqlite3_step(stmt) != SQLITE_ROW ) {
 		return 0; /* error */
@@ -5032,7 +5813,7 @@ int mrmailbox_mdn_from_ext__(mrmailbox_t* mailbox, uint32_t from_id, const char*
 	}
 
 	/* got enough receipts :-) */
-	stmt = mrsqlite3_predefine__(mailbox->m_sql, DELETE_FROM_msgs_mdns_WHERE_m, "DELETE FROM msgs_mdns WHERE msg_id=?;");
+	stmt = mrsqlite3_predefine__(mailbox->m_sql, "DELETE FROM msgs_mdns WHERE msg_id=?;");
 	sqlite3_bind_int(stmt, 1, *ret_msg_id);
 	sqlite3_step(stmt);
 
@@ -5051,6 +5832,7 @@ void mrmailbox_send_mdn(mrmailbox_t* mailbox, mrjob_t* job)
 	}
 
 	/* connect to SMTP server, if not yet done */
+	mrsmtp_disconnect_if_stale(mailbox->m_smtp);
 	if( !mrsmtp_is_connected(mailbox->m_smtp) )
 	{
 		mrloginparam_t* loginparam = mrloginparam_new();
@@ -5072,7 +5854,7 @@ void mrmailbox_send_mdn(mrmailbox_t* mailbox, mrjob_t* job)
 
 	//char* t1=mr_null_terminate(mimefactory.m_out->str,mimefactory.m_out->len);printf("~~~~~MDN~~~~~\n%s\n~~~~~/MDN~~~~~",t1);free(t1); // DEBUG OUTPUT
 
-	if( !mrsmtp_send_msg(mailbox->m_smtp, mimefactory.m_recipients_addr, mimefactory.m_out->str, mimefactory.m_out->len) ) {
+	if( !mrsmtp_send_msg(mailbox->m_smtp, mimefactory.m_recipients_addr, mimefactory.m_out->str, mimefactory.m_out->len, NULL) ) {
 		mrsmtp_disconnect(mailbox->m_smtp);
 		mrjob_try_again_later(job, MR_AT_ONCE); /* MR_AT_ONCE is only the _initial_ delay, if the second try failes, the delay gets larger */
 		goto cleanup;
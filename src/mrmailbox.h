@@ -238,7 +238,9 @@ uint32_t        mrmailbox_send_vcard_msg    (mrmailbox_t*, uint32_t chat_id, uin
 void            mrmailbox_set_draft         (mrmailbox_t*, uint32_t chat_id, const char*);
 
 #define         MR_GCM_ADDDAYMARKER         0x01
+#define         MR_GCM_BEFORE               0x02
 mrarray_t*      mrmailbox_get_chat_msgs     (mrmailbox_t*, uint32_t chat_id, uint32_t flags, uint32_t marker1before);
+mrarray_t*      mrmailbox_get_chat_msgs_page(mrmailbox_t*, uint32_t chat_id, uint32_t flags, uint32_t anchor_msg_id, int max_cnt);
 int             mrmailbox_get_total_msg_count (mrmailbox_t*, uint32_t chat_id);
 int             mrmailbox_get_fresh_msg_count (mrmailbox_t*, uint32_t chat_id);
 mrarray_t*      mrmailbox_get_fresh_msgs    (mrmailbox_t*);
@@ -272,6 +274,7 @@ void            mrmailbox_marknoticed_contact (mrmailbox_t*, uint32_t contact_id
 void            mrmailbox_markseen_msgs     (mrmailbox_t*, const uint32_t* msg_ids, int msg_cnt);
 void            mrmailbox_star_msgs         (mrmailbox_t*, const uint32_t* msg_ids, int msg_cnt, int star);
 mrmsg_t*        mrmailbox_get_msg           (mrmailbox_t*, uint32_t msg_id);
+mrarray_t*      mrmailbox_get_msgs          (mrmailbox_t*, const uint32_t* msg_ids, int msg_cnt);
 
 
 /* Handle contacts */
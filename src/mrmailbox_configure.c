@@ -672,6 +672,10 @@ int mrmailbox_configure_and_connect(mrmailbox_t* mailbox)
 		mrloginparam_write__(param, mailbox->m_sql, "configured_" /*the trailing underscore is correct*/);
 		mrsqlite3_set_config_int__(mailbox->m_sql, "configured", 1);
 
+		/* generate the keypair in the background, so that sending the first message does not wait for it */
+		mrjob_kill_action__(mailbox, MRJ_GENERATE_KEYPAIR);
+		mrjob_add__(mailbox, MRJ_GENERATE_KEYPAIR, 0, NULL); /* results in a call to mrmailbox_generate_keypair() */
+
 	mrsqlite3_unlock(mailbox->m_sql);
 	locked = 0;
 
@@ -26,6 +26,7 @@
 #include "mraheader.h"
 #include "mrkeyring.h"
 #include "mrmimeparser.h"
+#include "mrjob.h"
 
 
 /*******************************************************************************
@@ -280,8 +281,8 @@ cleanup:
 
 int mrmailbox_ensure_secret_key_exists(mrmailbox_t* mailbox)
 {
-	/* normally, the key is generated as soon as the first mail is send
-	(this is to gain some extra-random-seed by the message content and the timespan between program start and message sending) */
+	/* normally, the key is generated in the background after the configuration, see mrmailbox_generate_keypair(),
+	or as soon as the first mail is send if this has not happened before */
 	int      success = 0, locked = 0;
 	mrkey_t* public_key = mrkey_new();
 	char*    self_addr = NULL;
@@ -312,6 +313,39 @@ cleanup:
 }
 
 
+void mrmailbox_generate_keypair(mrmailbox_t* mailbox, mrjob_t* job)
+{
+	/* executed as a job in the local lane; the database is not locked during the generation itself,
+	see load_or_generate_self_public_key__() */
+	int      key_exists = 0;
+	mrkey_t* public_key = mrkey_new();
+	char*    self_addr = NULL;
+
+	mrsqlite3_lock(mailbox->m_sql);
+		if( (self_addr=mrsqlite3_get_config__(mailbox->m_sql, "configured_addr", NULL))!=NULL ) {
+			key_exists = mrkey_load_self_public__(public_key, self_addr, mailbox->m_sql);
+		}
+	mrsqlite3_unlock(mailbox->m_sql);
+
+	if( self_addr==NULL || key_exists ) {
+		goto cleanup;
+	}
+
+	mailbox->m_cb(mailbox, MR_EVENT_KEYGEN_PROGRESS, 0, 0);
+
+	if( !mrmailbox_ensure_secret_key_exists(mailbox) ) {
+		mrjob_try_again_later(job, MR_STANDARD_DELAY); /* eg. the key is just created by a message being sent */
+		goto cleanup;
+	}
+
+	mailbox->m_cb(mailbox, MR_EVENT_KEYGEN_PROGRESS, 1000, 0);
+
+cleanup:
+	mrkey_unref(public_key);
+	free(self_addr);
+}
+
+
 /*******************************************************************************
  * Encrypt
  ******************************************************************************/
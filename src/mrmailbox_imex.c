@@ -22,6 +22,7 @@
 
 #include <assert.h>
 #include <dirent.h>
+#include <sys/stat.h>
 #include <unistd.h> /* for sleep() */
 #include <openssl/rand.h>
 #include <libetpan/mmapstring.h>
@@ -30,6 +31,7 @@
 #include "mrmimeparser.h"
 #include "mrosnative.h"
 #include "mrloginparam.h"
+#include "mrjob.h"
 #include "mraheader.h"
 #include "mrapeerstate.h"
 #include "mrpgp.h"
@@ -876,6 +878,7 @@ static int export_backup(mrmailbox_t* mailbox, const char* dir)
 	sqlite3_stmt*  stmt = NULL;
 	int            total_files_count = 0, processed_files_count = 0;
 	int            delete_dest_file = 0;
+	struct stat    st;
 
 	/* get a fine backup file name (the name includes the date so that multiple backup instances are possible)
 	FIXME: we should write to a temporary file first and rename it on success. this would guarantee the backup is complete. however, currently it is not clear it the import exists in the long run (may be replaced by a restore-from-imap)*/
@@ -910,7 +913,7 @@ static int export_backup(mrmailbox_t* mailbox, const char* dir)
 
 	/* add all files as blobs to the database copy (this does not require the source to be locked, neigher the destination as it is used only here) */
 	if( (dest_sql=mrsqlite3_new(mailbox/*for logging only*/))==NULL
-	 || !mrsqlite3_open__(dest_sql, dest_pathNfilename, 0) ) {
+	 || !mrsqlite3_open__(dest_sql, dest_pathNfilename, MR_OPEN_NO_WAL/*the copy should be a single, self-contained file*/) ) {
 		goto cleanup; /* error already logged */
 	}
 
@@ -964,6 +967,9 @@ static int export_backup(mrmailbox_t* mailbox, const char* dir)
 			//mrmailbox_log_info(mailbox, 0, "Backup \"%s\".", name);
 			free(curr_pathNfilename);
 			curr_pathNfilename = mr_mprintf("%s/%s", mailbox->m_blobdir, name);
+			if( stat(curr_pathNfilename, &st)!=0 || !S_ISREG(st.st_mode) ) {
+				continue; /* eg. the MR_SPOOL_DIR subdirectory, messages spooled for upload are not backed up */
+			}
 			free(buf);
 			if( !mr_read_file(curr_pathNfilename, &buf, &buf_bytes, mailbox) || buf==NULL || buf_bytes<=0 ) {
 				continue;
@@ -1071,6 +1077,8 @@ static int import_backup(mrmailbox_t* mailbox, const char* backup_to_import)
 	if( !mrsqlite3_open__(mailbox->m_sql, mailbox->m_dbfile, 0) ) {
 		goto cleanup;
 	}
+	mrjob_reload__(mailbox);
+	mrmailbox_fts_start_backfill__(mailbox);
 
 	/* copy all blobs to files */
 	stmt = mrsqlite3_prepare_v2_(mailbox->m_sql, "SELECT COUNT(*) FROM backup_blobs;");
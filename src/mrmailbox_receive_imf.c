@@ -128,7 +128,7 @@ static void mrmailbox_add_or_lookup_contacts_by_address_list__(mrmailbox_t* mail
 static int is_known_rfc724_mid__(mrmailbox_t* mailbox, const char* rfc724_mid)
 {
 	if( rfc724_mid ) {
-		sqlite3_stmt* stmt = mrsqlite3_predefine__(mailbox->m_sql, SELECT_id_FROM_msgs_WHERE_cm,
+		sqlite3_stmt* stmt = mrsqlite3_predefine__(mailbox->m_sql,
 			"SELECT m.id FROM msgs m "
 			" LEFT JOIN chats c ON m.chat_id=c.id "
 			" WHERE m.rfc724_mid=? "
@@ -206,7 +206,7 @@ static int mrmailbox_is_reply_to_known_message__(mrmailbox_t* mailbox, mrmimepar
 static int is_msgrmsg_rfc724_mid__(mrmailbox_t* mailbox, const char* rfc724_mid)
 {
 	if( rfc724_mid ) {
-		sqlite3_stmt* stmt = mrsqlite3_predefine__(mailbox->m_sql, SELECT_id_FROM_msgs_WHERE_mcm,
+		sqlite3_stmt* stmt = mrsqlite3_predefine__(mailbox->m_sql,
 			"SELECT id FROM msgs "
 			" WHERE rfc724_mid=? "
 			" AND msgrmsg!=0 "
@@ -293,7 +293,7 @@ static void mrmailbox_calc_timestamps__(mrmailbox_t* mailbox, uint32_t chat_id,
 	(we do this check only for fresh messages, other messages may pop up whereever, this may happen eg. when restoring old messages or synchronizing different clients) */
 	if( is_fresh_msg )
 	{
-		sqlite3_stmt* stmt = mrsqlite3_predefine__(mailbox->m_sql, SELECT_timestamp_FROM_msgs_WHERE_timestamp,
+		sqlite3_stmt* stmt = mrsqlite3_predefine__(mailbox->m_sql,
 			"SELECT MAX(timestamp) FROM msgs WHERE chat_id=? and from_id!=? AND timestamp>=?");
 		sqlite3_bind_int  (stmt,  1, chat_id);
 		sqlite3_bind_int  (stmt,  2, from_id);
@@ -473,7 +473,7 @@ static uint32_t create_group_record__(mrmailbox_t* mailbox, const char* grpid, c
 	uint32_t      chat_id = 0;
 	sqlite3_stmt* stmt = NULL;
 
-	stmt = mrsqlite3_prepare_v2_(mailbox->m_sql,
+	stmt = mrsqlite3_predefine__(mailbox->m_sql,
 		"INSERT INTO chats (type, name, grpid, blocked) VALUES(?, ?, ?, ?);");
 	sqlite3_bind_int (stmt, 1, MR_CHAT_TYPE_GROUP);
 	sqlite3_bind_text(stmt, 2, grpname, -1, SQLITE_STATIC);
@@ -485,7 +485,6 @@ static uint32_t create_group_record__(mrmailbox_t* mailbox, const char* grpid, c
 	chat_id = sqlite3_last_insert_rowid(mailbox->m_sql->m_cobj);
 
 cleanup:
-	if( stmt) { sqlite3_finalize(stmt); }
 	return chat_id;
 }
 
@@ -678,7 +677,7 @@ static void create_or_lookup_group__(mrmailbox_t* mailbox, mrmimeparser_t* mime_
 	}
 
 	/* check, if we have a chat with this group ID */
-	stmt = mrsqlite3_predefine__(mailbox->m_sql, SELECT_id_FROM_CHATS_WHERE_grpid,
+	stmt = mrsqlite3_predefine__(mailbox->m_sql,
 		"SELECT id, blocked FROM chats WHERE grpid=?;");
 	sqlite3_bind_text (stmt, 1, grpid, -1, SQLITE_STATIC);
 	if( sqlite3_step(stmt)==SQLITE_ROW ) {
@@ -729,11 +728,10 @@ static void create_or_lookup_group__(mrmailbox_t* mailbox, mrmimeparser_t* mime_
 	}
 	else if( X_MrGrpNameChanged && grpname && strlen(grpname) < 200 )
 	{
-		stmt = mrsqlite3_prepare_v2_(mailbox->m_sql, "UPDATE chats SET name=? WHERE id=?;");
+		stmt = mrsqlite3_predefine__(mailbox->m_sql, "UPDATE chats SET name=? WHERE id=?;");
 		sqlite3_bind_text(stmt, 1, grpname, -1, SQLITE_STATIC);
 		sqlite3_bind_int (stmt, 2, chat_id);
 		sqlite3_step(stmt);
-		sqlite3_finalize(stmt);
 		mailbox->m_cb(mailbox, MR_EVENT_CHAT_MODIFIED, chat_id, 0);
 	}
 
@@ -775,10 +773,9 @@ static void create_or_lookup_group__(mrmailbox_t* mailbox, mrmimeparser_t* mime_
 	{
 		const char* skip = X_MrRemoveFromGrp? X_MrRemoveFromGrp : NULL;
 
-		stmt = mrsqlite3_prepare_v2_(mailbox->m_sql, "DELETE FROM chats_contacts WHERE chat_id=?;");
+		stmt = mrsqlite3_predefine__(mailbox->m_sql, "DELETE FROM chats_contacts WHERE chat_id=?;");
 		sqlite3_bind_int (stmt, 1, chat_id);
 		sqlite3_step(stmt);
-		sqlite3_finalize(stmt);
 
 		if( skip==NULL || strcasecmp(self_addr, skip) != 0 ) {
 			mrmailbox_add_contact_to_chat__(mailbox, chat_id, MR_CONTACT_ID_SELF);
@@ -831,10 +828,50 @@ cleanup:
  ******************************************************************************/
 
 
-void mrmailbox_receive_imf(mrmailbox_t* mailbox, const char* imf_raw_not_terminated, size_t imf_raw_bytes,
-                           const char* server_folder, uint32_t server_uid, uint32_t flags)
+/* parse the imf to mailimf_message {
+        mailimf_fields* msg_fields {
+          clist* fld_list; // list of mailimf_field
+        }
+        mailimf_body* msg_body { // != NULL
+            const char * bd_text; // != NULL
+            size_t bd_size;
+        }
+   };
+normally, this is done by mailimf_message_parse(), however, as we also need the MIME data,
+we use mailmime_parse() through MrMimeParser (both call mailimf_struct_multiple_parse() somewhen, I did not found out anything
+that speaks against this approach yet).
+
+This is the CPU-heavy part of receiving a message, it includes decryption and the simplification of the texts.
+The function does not need the database lock for longer than loading the keys and updating the peerstate,
+so it may be called from several threads at the same time, see mrimfpipe_t.  The result must be given to
+mrmailbox_receive_parsed_imf(). */
+mrmimeparser_t* mrmailbox_parse_imf(mrmailbox_t* mailbox, const char* imf_raw_not_terminated, size_t imf_raw_bytes)
+{
+	mrmimeparser_t* mime_parser = mrmimeparser_new(mailbox->m_blobdir, mailbox);
+	mrmimeparser_parse(mime_parser, imf_raw_not_terminated, imf_raw_bytes);
+	return mime_parser;
+}
+
+
+static void send_or_collect_event(mrmailbox_t* mailbox, carray* events, int event, uintptr_t data1, uintptr_t data2)
+{
+	if( events ) {
+		carray_add(events, (void*)(uintptr_t)event, NULL);
+		carray_add(events, (void*)data1, NULL);
+		carray_add(events, (void*)data2, NULL);
+	}
+	else {
+		mailbox->m_cb(mailbox, event, data1, data2);
+	}
+}
+
+
+/* add a message parsed by mrmailbox_parse_imf() to the database; the function takes the ownership of mime_parser.
+if `events` is not NULL, the events about the new messages are not sent but added to the array as triples of event, data1 and data2.
+if `caller_locked` is set, the database is locked by the caller, see mrmailbox_receive_parsed_imf__() */
+static void receive_parsed_imf(mrmailbox_t* mailbox, mrmimeparser_t* mime_parser, const char* imf_raw_not_terminated, size_t imf_raw_bytes,
+                               const char* server_folder, uint32_t server_uid, uint32_t flags, carray* events, int caller_locked)
 {
-	/* the function returns the number of created messages in the database */
 	int              incoming = 0;
 	int              incoming_origin = 0;
 	#define          outgoing (!incoming)
@@ -856,7 +893,6 @@ void mrmailbox_receive_imf(mrmailbox_t* mailbox, const char* imf_raw_not_termina
 	time_t           sort_timestamp = MR_INVALID_TIMESTAMP;
 	time_t           sent_timestamp = MR_INVALID_TIMESTAMP;
 	time_t           rcvd_timestamp = MR_INVALID_TIMESTAMP;
-	mrmimeparser_t*  mime_parser = mrmimeparser_new(mailbox->m_blobdir, mailbox);
 	int              db_locked = 0;
 	int              transaction_pending = 0;
 	const struct mailimf_field* field;
@@ -878,19 +914,6 @@ void mrmailbox_receive_imf(mrmailbox_t* mailbox, const char* imf_raw_not_termina
 		goto cleanup;
 	}
 
-	/* parse the imf to mailimf_message {
-	        mailimf_fields* msg_fields {
-	          clist* fld_list; // list of mailimf_field
-	        }
-	        mailimf_body* msg_body { // != NULL
-                const char * bd_text; // != NULL
-                size_t bd_size;
-	        }
-	   };
-	normally, this is done by mailimf_message_parse(), however, as we also need the MIME data,
-	we use mailmime_parse() through MrMimeParser (both call mailimf_struct_multiple_parse() somewhen, I did not found out anything
-	that speaks against this approach yet) */
-	mrmimeparser_parse(mime_parser, imf_raw_not_terminated, imf_raw_bytes);
 	if( mrhash_count(&mime_parser->m_header)==0 ) {
 		mrmailbox_log_info(mailbox, 0, "No header.");
 		goto cleanup; /* Error - even adding an empty record won't help as we do not know the message ID */
@@ -910,8 +933,10 @@ void mrmailbox_receive_imf(mrmailbox_t* mailbox, const char* imf_raw_not_termina
 		incoming = 1;
 	}
 
-	mrsqlite3_lock(mailbox->m_sql);
-	db_locked = 1;
+	if( !caller_locked ) {
+		mrsqlite3_lock(mailbox->m_sql);
+		db_locked = 1;
+	}
 	mrsqlite3_begin_transaction__(mailbox->m_sql);
 	transaction_pending = 1;
 
@@ -1198,7 +1223,7 @@ void mrmailbox_receive_imf(mrmailbox_t* mailbox, const char* imf_raw_not_termina
 					mrparam_set_int(part->m_param, MRP_SYSTEM_CMD, mime_parser->m_is_system_message);
 				}
 
-				stmt = mrsqlite3_predefine__(mailbox->m_sql, INSERT_INTO_msgs_msscftttsmttpb,
+				stmt = mrsqlite3_predefine__(mailbox->m_sql,
 					"INSERT INTO msgs (rfc724_mid,server_folder,server_uid,chat_id,from_id, to_id,timestamp,timestamp_sent,timestamp_rcvd,type, state,msgrmsg,txt,txt_raw,param,bytes)"
 					" VALUES (?,?,?,?,?, ?,?,?,?,?, ?,?,?,?,?,?);");
 				sqlite3_bind_text (stmt,  1, rfc724_mid, -1, SQLITE_STATIC);
@@ -1215,7 +1240,7 @@ void mrmailbox_receive_imf(mrmailbox_t* mailbox, const char* imf_raw_not_termina
 				sqlite3_bind_int  (stmt, 12, msgrmsg);
 				sqlite3_bind_text (stmt, 13, part->m_msg? part->m_msg : "", -1, SQLITE_STATIC);
 				sqlite3_bind_text (stmt, 14, txt_raw? txt_raw : "", -1, SQLITE_STATIC);
-				sqlite3_bind_text (stmt, 15, part->m_param->m_packed, -1, SQLITE_STATIC);
+				sqlite3_bind_text (stmt, 15, mrparam_get_packed(part->m_param), -1, SQLITE_STATIC);
 				sqlite3_bind_int  (stmt, 16, part->m_bytes);
 				if( sqlite3_step(stmt) != SQLITE_DONE ) {
 					mrmailbox_log_info(mailbox, 0, "Cannot write DB.");
@@ -1225,14 +1250,19 @@ void mrmailbox_receive_imf(mrmailbox_t* mailbox, const char* imf_raw_not_termina
 				free(txt_raw);
 				txt_raw = NULL;
 
+				uint32_t dblocal_id = sqlite3_last_insert_rowid(mailbox->m_sql->m_cobj);
 				if( first_dblocal_id == 0 ) {
-					first_dblocal_id = sqlite3_last_insert_rowid(mailbox->m_sql->m_cobj);
+					first_dblocal_id = dblocal_id;
 				}
 
+				mrsqlite3_fts_index_msg__(mailbox->m_sql, dblocal_id);
+
 				carray_add(created_db_entries, (void*)(uintptr_t)chat_id, NULL);
 				carray_add(created_db_entries, (void*)(uintptr_t)first_dblocal_id, NULL);
 			}
 
+			mrmailbox_update_chat_last_msg__(mailbox, chat_id);
+
 			mrmailbox_log_info(mailbox, 0, "Message has %i parts and is moved to chat #%i.", icnt, chat_id);
 
 			/* check event to send */
@@ -1368,7 +1398,12 @@ cleanup:
 	if( db_locked ) { mrsqlite3_unlock(mailbox->m_sql); }
 
 	if( is_handshake_message ) {
-		mrmailbox_oob_handle_handshake_message(mailbox, mime_parser, chat_id); /* must be called after unlocking before deletion of mime_parser */
+		if( caller_locked ) {
+			mrmailbox_log_warning(mailbox, 0, "Handshake message %s/%lu not handled.", server_folder? server_folder:"?", server_uid); /* the caller should have used mrmailbox_receive_parsed_imf() */
+		}
+		else {
+			mrmailbox_oob_handle_handshake_message(mailbox, mime_parser, chat_id); /* must be called after unlocking before deletion of mime_parser */
+		}
 	}
 
 	mrmimeparser_unref(mime_parser);
@@ -1379,7 +1414,7 @@ cleanup:
 		if( create_event_to_send ) {
 			size_t i, icnt = carray_count(created_db_entries);
 			for( i = 0; i < icnt; i += 2 ) {
-				mailbox->m_cb(mailbox, create_event_to_send, (uintptr_t)carray_get(created_db_entries, i), (uintptr_t)carray_get(created_db_entries, i+1));
+				send_or_collect_event(mailbox, events, create_event_to_send, (uintptr_t)carray_get(created_db_entries, i), (uintptr_t)carray_get(created_db_entries, i+1));
 			}
 		}
 		carray_free(created_db_entries);
@@ -1388,10 +1423,35 @@ cleanup:
 	if( rr_event_to_send ) {
 		size_t i, icnt = carray_count(rr_event_to_send);
 		for( i = 0; i < icnt; i += 2 ) {
-			mailbox->m_cb(mailbox, MR_EVENT_MSG_READ, (uintptr_t)carray_get(rr_event_to_send, i), (uintptr_t)carray_get(rr_event_to_send, i+1));
+			send_or_collect_event(mailbox, events, MR_EVENT_MSG_READ, (uintptr_t)carray_get(rr_event_to_send, i), (uintptr_t)carray_get(rr_event_to_send, i+1));
 		}
 		carray_free(rr_event_to_send);
 	}
 
 	free(txt_raw);
 }
+
+
+void mrmailbox_receive_parsed_imf(mrmailbox_t* mailbox, mrmimeparser_t* mime_parser, const char* imf_raw_not_terminated, size_t imf_raw_bytes,
+                                  const char* server_folder, uint32_t server_uid, uint32_t flags)
+{
+	receive_parsed_imf(mailbox, mime_parser, imf_raw_not_terminated, imf_raw_bytes, server_folder, server_uid, flags, NULL, 0);
+}
+
+
+/* same as mrmailbox_receive_parsed_imf(), however, the database must be locked by the caller, so several messages can be added
+in a single transaction, see mrimfpipe_t.  The events are added to `events`, see receive_parsed_imf().
+Handshake messages need the database unlocked and must be given to mrmailbox_receive_parsed_imf(), see mrmailbox_oob_is_handshake_message__(). */
+void mrmailbox_receive_parsed_imf__(mrmailbox_t* mailbox, mrmimeparser_t* mime_parser, const char* imf_raw_not_terminated, size_t imf_raw_bytes,
+                                    const char* server_folder, uint32_t server_uid, uint32_t flags, carray* events)
+{
+	receive_parsed_imf(mailbox, mime_parser, imf_raw_not_terminated, imf_raw_bytes, server_folder, server_uid, flags, events, 1);
+}
+
+
+void mrmailbox_receive_imf(mrmailbox_t* mailbox, const char* imf_raw_not_terminated, size_t imf_raw_bytes,
+                           const char* server_folder, uint32_t server_uid, uint32_t flags)
+{
+	mrmimeparser_t* mime_parser = mrmailbox_parse_imf(mailbox, imf_raw_not_terminated, imf_raw_bytes);
+	mrmailbox_receive_parsed_imf(mailbox, mime_parser, imf_raw_not_terminated, imf_raw_bytes, server_folder, server_uid, flags);
+}
@@ -133,7 +133,7 @@ int mrmimefactory_load_msg(mrmimefactory_t* factory, uint32_t msg_id)
 			}
 			else
 			{
-				sqlite3_stmt* stmt = mrsqlite3_predefine__(mailbox->m_sql, SELECT_na_FROM_chats_contacs_JOIN_contacts_WHERE_cc,
+				sqlite3_stmt* stmt = mrsqlite3_predefine__(mailbox->m_sql,
 					"SELECT c.authname, c.addr FROM chats_contacts cc LEFT JOIN contacts c ON cc.contact_id=c.id WHERE cc.chat_id=? AND cc.contact_id>?;");
 				sqlite3_bind_int(stmt, 1, factory->m_msg->m_chat_id);
 				sqlite3_bind_int(stmt, 2, MR_CONTACT_ID_LAST_SPECIAL);
@@ -182,7 +182,7 @@ int mrmimefactory_load_msg(mrmimefactory_t* factory, uint32_t msg_id)
 
 			Finally, maybe the Predecessor/In-Reply-To header is not needed for all answers but only to the first ones -
 			or after the sender has changes its email address. */
-			sqlite3_stmt* stmt = mrsqlite3_predefine__(mailbox->m_sql, SELECT_rfc724_FROM_msgs_ORDER_BY_timestamp_LIMIT_1,
+			sqlite3_stmt* stmt = mrsqlite3_predefine__(mailbox->m_sql,
 				"SELECT rfc724_mid FROM msgs WHERE timestamp=(SELECT max(timestamp) FROM msgs WHERE chat_id=? AND from_id!=?);");
 			sqlite3_bind_int  (stmt, 1, factory->m_msg->m_chat_id);
 			sqlite3_bind_int  (stmt, 2, MR_CONTACT_ID_SELF);
@@ -198,7 +198,7 @@ int mrmimefactory_load_msg(mrmimefactory_t* factory, uint32_t msg_id)
 			however one could also see this as a feature :) (there may be different contextes on different clients)
 			(also, the References-header is not the most important thing, and, at least for now, we do not want to make things too complicated.  */
 			time_t prev_msg_time = 0;
-			stmt = mrsqlite3_predefine__(mailbox->m_sql, SELECT_MAX_timestamp_FROM_msgs,
+			stmt = mrsqlite3_predefine__(mailbox->m_sql,
 				"SELECT max(timestamp) FROM msgs WHERE chat_id=? AND id!=?");
 			sqlite3_bind_int  (stmt, 1, factory->m_msg->m_chat_id);
 			sqlite3_bind_int  (stmt, 2, factory->m_msg->m_id);
@@ -493,6 +493,25 @@ struct mailmime_parameter* mailmime_find_ct_parameter(struct mailmime* mime, con
 }
 
 
+static int mailmime_get_transfer_encoding(struct mailmime* mime)
+{
+	int mime_transfer_encoding = MAILMIME_MECHANISM_BINARY;
+
+	if( mime->mm_mime_fields != NULL ) {
+		clistiter* cur;
+		for( cur = clist_begin(mime->mm_mime_fields->fld_list); cur != NULL; cur = clist_next(cur) ) {
+			struct mailmime_field* field = (struct mailmime_field*)clist_content(cur);
+			if( field && field->fld_type == MAILMIME_FIELD_TRANSFER_ENCODING && field->fld_data.fld_encoding ) {
+				mime_transfer_encoding = field->fld_data.fld_encoding->enc_type;
+				break;
+			}
+		}
+	}
+
+	return mime_transfer_encoding;
+}
+
+
 int mailmime_transfer_decode(struct mailmime* mime, const char** ret_decoded_data, size_t* ret_decoded_data_bytes, char** ret_to_mmap_string_unref)
 {
 	int                   mime_transfer_encoding = MAILMIME_MECHANISM_BINARY;
@@ -507,17 +526,7 @@ int mailmime_transfer_decode(struct mailmime* mime, const char** ret_decoded_dat
 	}
 
 	mime_data = mime->mm_data.mm_single;
-
-	if( mime->mm_mime_fields != NULL ) {
-		clistiter* cur;
-		for( cur = clist_begin(mime->mm_mime_fields->fld_list); cur != NULL; cur = clist_next(cur) ) {
-			struct mailmime_field* field = (struct mailmime_field*)clist_content(cur);
-			if( field && field->fld_type == MAILMIME_FIELD_TRANSFER_ENCODING && field->fld_data.fld_encoding ) {
-				mime_transfer_encoding = field->fld_data.fld_encoding->enc_type;
-				break;
-			}
-		}
-	}
+	mime_transfer_encoding = mailmime_get_transfer_encoding(mime);
 
 	/* regard `Content-Transfer-Encoding:` */
 	if( mime_transfer_encoding == MAILMIME_MECHANISM_7BIT
@@ -550,6 +559,141 @@ int mailmime_transfer_decode(struct mailmime* mime, const char** ret_decoded_dat
 }
 
 
+static size_t find_decode_chunk_end(const char* data, size_t data_bytes, size_t start, size_t window, int mime_transfer_encoding)
+{
+	/* we split only after a line end, so neither quoted-printable escapes nor soft line breaks are cut;
+	for base64, the number of encoded characters before the split must also be a multiple of 4 */
+	size_t i, base64_chars = 0;
+
+	if( data_bytes-start <= window ) {
+		return data_bytes;
+	}
+
+	for( i = start; i < data_bytes; i++ ) {
+		char c = data[i];
+		if( (c>='A' && c<='Z') || (c>='a' && c<='z') || (c>='0' && c<='9') || c=='+' || c=='/' || c=='=' ) {
+			base64_chars++;
+		}
+		else if( c=='\n' && i+1-start >= window
+		      && (mime_transfer_encoding!=MAILMIME_MECHANISM_BASE64 || base64_chars%4==0) ) {
+			return i+1;
+		}
+	}
+
+	return data_bytes;
+}
+
+
+static int mailmime_transfer_decode_to_file(struct mailmime* mime, const char* pathNfilename, size_t window, size_t* ret_decoded_data_bytes, mrmailbox_t* log)
+{
+	/* same as mailmime_transfer_decode(), however, the data are written to the given file and decoded in chunks of about `window` bytes,
+	so decoding a large attachment does not need a second copy of it in memory */
+	int                   success = 0, r;
+	int                   mime_transfer_encoding = mailmime_get_transfer_encoding(mime);
+	struct mailmime_data* mime_data = mime->mm_data.mm_single;
+	const char*           data = mime_data->dt_data.dt_text.dt_data;
+	size_t                data_bytes = mime_data->dt_data.dt_text.dt_length, index = 0, chunk_end;
+	char*                 chunk = NULL; /* mmap_string_unref()'d */
+	size_t                chunk_bytes;
+	FILE*                 f = NULL;
+
+	*ret_decoded_data_bytes = 0;
+
+	if( (f=fopen(pathNfilename, "wb"))==NULL ) {
+		mrmailbox_log_warning(log, 0, "Cannot open \"%s\" for writing.", pathNfilename);
+		goto cleanup;
+	}
+
+	if( mime_transfer_encoding == MAILMIME_MECHANISM_7BIT
+	 || mime_transfer_encoding == MAILMIME_MECHANISM_8BIT
+	 || mime_transfer_encoding == MAILMIME_MECHANISM_BINARY )
+	{
+		if( fwrite(data, 1, data_bytes, f) != data_bytes ) {
+			goto write_error;
+		}
+		*ret_decoded_data_bytes = data_bytes;
+	}
+	else
+	{
+		while( index < data_bytes )
+		{
+			chunk_end = find_decode_chunk_end(data, data_bytes, index, window, mime_transfer_encoding);
+
+			chunk = NULL;
+			chunk_bytes = 0;
+			r = mailmime_part_parse(data, chunk_end, &index, mime_transfer_encoding, &chunk, &chunk_bytes);
+			if( r != MAILIMF_NO_ERROR ) {
+				goto cleanup;
+			}
+
+			if( chunk ) {
+				if( chunk_bytes > 0 && fwrite(chunk, 1, chunk_bytes, f) != chunk_bytes ) {
+					mmap_string_unref(chunk);
+					goto write_error;
+				}
+				*ret_decoded_data_bytes += chunk_bytes;
+				mmap_string_unref(chunk);
+			}
+
+			index = chunk_end; /* the decoders stop at the given end, this just makes sure, we do not loop forever */
+		}
+	}
+
+	success = *ret_decoded_data_bytes > 0? 1 : 0; /* no data is no error, however, there's nothing to add then */
+	goto cleanup;
+
+write_error:
+	mrmailbox_log_warning(log, 0, "Cannot write to \"%s\".", pathNfilename);
+
+cleanup:
+	if( f ) {
+		fclose(f);
+	}
+	if( !success ) {
+		mr_delete_file(pathNfilename, log); /* the file was created before by mr_create_fine_pathNfilename() */
+	}
+	return success;
+}
+
+
+static int get_filemeta_from_file(const char* pathNfilename, uint32_t* ret_width, uint32_t* ret_height)
+{
+	/* the image dimensions are in the headers of the file, there's no need to read it completely;
+	for JPEGs, the SOF marker may follow large EXIF data or thumbnails, so the segments before are skipped, see also mr_get_filemeta() */
+	int           success = 0;
+	unsigned char buf[24];
+	FILE*         f = NULL;
+	long          pos;
+
+	if( (f=fopen(pathNfilename, "rb"))==NULL || fread(buf, 1, sizeof(buf), f)!=sizeof(buf) ) {
+		goto cleanup;
+	}
+
+	if( buf[0]==0xFF && buf[1]==0xD8 && buf[2]==0xFF )
+	{
+		pos = 2;
+		while( fseek(f, pos, SEEK_SET)==0 && fread(buf, 1, 9, f)==9 && buf[0]==0xFF )
+		{
+			if( buf[1]==0xC0 || buf[1]==0xC1 || buf[1]==0xC2 || buf[1]==0xC3 || buf[1]==0xC9 || buf[1]==0xCA || buf[1]==0xCB ) {
+				*ret_height = (buf[5]<<8) + buf[6]; /* sic! height is first */
+				*ret_width  = (buf[7]<<8) + buf[8];
+				success = 1;
+				break;
+			}
+			pos += 2+(buf[2]<<8)+buf[3];
+		}
+	}
+	else
+	{
+		success = mr_get_filemeta(buf, sizeof(buf), ret_width, ret_height);
+	}
+
+cleanup:
+	if( f ) { fclose(f); }
+	return success;
+}
+
+
 struct mailimf_fields* mailmime_find_mailimf_fields(struct mailmime* mime)
 {
 	if( mime == NULL ) {
@@ -782,13 +926,10 @@ static int mailmime_get_mime_type(struct mailmime* mime, int* msg_type)
  ******************************************************************************/
 
 
-static mrmimepart_t* mrmimepart_new(void)
+static mrmimepart_t* mrmimepart_new(mrmimeparser_t* parser)
 {
-	mrmimepart_t* ths = NULL;
-
-	if( (ths=calloc(1, sizeof(mrmimepart_t)))==NULL ) {
-		exit(33);
-	}
+	/* the part and its strings are allocated from the arena of the parser and are released by mrmimeparser_empty() */
+	mrmimepart_t* ths = mrarena_alloc(parser->m_arena, sizeof(mrmimepart_t));
 
 	ths->m_type    = MR_MSG_UNDEFINED;
 	ths->m_param   = mrparam_new();
@@ -799,22 +940,13 @@ static mrmimepart_t* mrmimepart_new(void)
 
 static void mrmimepart_unref(mrmimepart_t* ths)
 {
+	/* only the parameters are not part of the arena */
 	if( ths == NULL ) {
 		return;
 	}
 
-	if( ths->m_msg ) {
-		free(ths->m_msg);
-		ths->m_msg = NULL;
-	}
-
-	if( ths->m_msg_raw ) {
-		free(ths->m_msg_raw);
-		ths->m_msg_raw = NULL;
-	}
-
 	mrparam_unref(ths->m_param);
-	free(ths);
+	ths->m_param = NULL;
 }
 
 
@@ -848,6 +980,19 @@ mrmimeparser_t* mrmimeparser_new(const char* blobdir, mrmailbox_t* mailbox)
 
 	mrhash_init(&ths->m_header, MRHASH_STRING, 0/* do not copy key */);
 
+	/* typically, one message is parsed after another (per parse thread), so reuse the arena of a previous parser, if any */
+	if( mailbox ) {
+		pthread_mutex_lock(&mailbox->m_spare_arena_critical);
+			if( mailbox->m_spare_arena_cnt > 0 ) {
+				ths->m_arena = mailbox->m_spare_arenas[--mailbox->m_spare_arena_cnt];
+			}
+		pthread_mutex_unlock(&mailbox->m_spare_arena_critical);
+	}
+
+	if( ths->m_arena == NULL ) {
+		ths->m_arena = mrarena_new();
+	}
+
 	return ths;
 }
 
@@ -869,9 +1014,20 @@ void mrmimeparser_unref(mrmimeparser_t* ths)
 		return;
 	}
 
-	mrmimeparser_empty(ths);
+	mrmimeparser_empty(ths); /* this also resets the arena */
 	if( ths->m_parts )   { carray_free(ths->m_parts); }
 	if( ths->m_reports ) { carray_free(ths->m_reports); }
+
+	if( ths->m_mailbox ) {
+		pthread_mutex_lock(&ths->m_mailbox->m_spare_arena_critical);
+			if( ths->m_mailbox->m_spare_arena_cnt < MR_SPARE_ARENA_CNT ) {
+				ths->m_mailbox->m_spare_arenas[ths->m_mailbox->m_spare_arena_cnt++] = ths->m_arena;
+				ths->m_arena = NULL;
+			}
+		pthread_mutex_unlock(&ths->m_mailbox->m_spare_arena_critical);
+	}
+	mrarena_unref(ths->m_arena);
+
 	free(ths);
 }
 
@@ -917,8 +1073,7 @@ void mrmimeparser_empty(mrmimeparser_t* ths)
 	ths->m_is_send_by_messenger  = 0;
 	ths->m_is_system_message = 0;
 
-	free(ths->m_subject);
-	ths->m_subject = NULL;
+	ths->m_subject = NULL; /* part of the arena */
 
 	if( ths->m_mimeroot )
 	{
@@ -935,6 +1090,8 @@ void mrmimeparser_empty(mrmimeparser_t* ths)
 	ths->m_decrypted_and_validated = 0;
 	ths->m_decrypted_with_validation_errors = 0;
 	ths->m_decrypting_failed = 0;
+
+	mrarena_reset(ths->m_arena); /* the parts, their strings and the subject are gone after this */
 }
 
 
@@ -984,16 +1141,16 @@ static int mrmimeparser_add_single_part_if_known(mrmimeparser_t* ths, struct mai
 	}
 
 
-	/* regard `Content-Transfer-Encoding:` */
-	if( !mailmime_transfer_decode(mime, &decoded_data, &decoded_data_bytes, &transfer_decoding_buffer) ) {
-		goto cleanup; /* no always error - but no data */
-	}
-
 	switch( mime_type )
 	{
 		case MR_MIMETYPE_TEXT_PLAIN:
 		case MR_MIMETYPE_TEXT_HTML:
 			{
+				/* regard `Content-Transfer-Encoding:` */
+				if( !mailmime_transfer_decode(mime, &decoded_data, &decoded_data_bytes, &transfer_decoding_buffer) ) {
+					goto cleanup; /* no always error - but no data */
+				}
+
 				if( simplifier==NULL ) {
 					simplifier = mrsimplify_new();
 					if( simplifier==NULL ) {
@@ -1021,11 +1178,11 @@ static int mrmimeparser_add_single_part_if_known(mrmimeparser_t* ths, struct mai
 				char* simplified_txt = mrsimplify_simplify(simplifier, decoded_data, decoded_data_bytes, mime_type==MR_MIMETYPE_TEXT_HTML? 1 : 0);
 				if( simplified_txt && simplified_txt[0] )
 				{
-					part = mrmimepart_new();
+					part = mrmimepart_new(ths);
 					part->m_type = MR_MSG_TEXT;
 					part->m_int_mimetype = mime_type;
-					part->m_msg = simplified_txt;
-					part->m_msg_raw = strndup(decoded_data, decoded_data_bytes);
+					part->m_msg = mrarena_take_str(ths->m_arena, simplified_txt);
+					part->m_msg_raw = mrarena_strndup(ths->m_arena, decoded_data, decoded_data_bytes);
 					do_add_single_part(ths, part);
 					part = NULL;
 				}
@@ -1086,31 +1243,32 @@ static int mrmimeparser_add_single_part_if_known(mrmimeparser_t* ths, struct mai
 
 				mr_replace_bad_utf8_chars(desired_filename);
 
-				/* create a free file name to use */
-				if( (pathNfilename=mr_get_fine_pathNfilename(ths->m_blobdir, desired_filename)) == NULL ) {
+				/* create a free file name to use; the file is created at once as messages are parsed by several threads */
+				if( (pathNfilename=mr_create_fine_pathNfilename(ths->m_blobdir, desired_filename)) == NULL ) {
 					goto cleanup;
 				}
 
-				/* copy data to file */
-                if( mr_write_file(pathNfilename, decoded_data, decoded_data_bytes, ths->m_mailbox)==0 ) {
+				/* decode data to file, regarding `Content-Transfer-Encoding:` */
+				size_t window = (ths->m_mailbox && ths->m_mailbox->m_decode_window)? ths->m_mailbox->m_decode_window : MR_DECODE_WINDOW_DEFAULT;
+				if( !mailmime_transfer_decode_to_file(mime, pathNfilename, window, &decoded_data_bytes, ths->m_mailbox) ) {
 					goto cleanup;
-                }
+				}
 
-				part = mrmimepart_new();
+				part = mrmimepart_new(ths);
 				part->m_type  = msg_type;
 				part->m_int_mimetype = mime_type;
 				part->m_bytes = decoded_data_bytes;
 				mrparam_set(part->m_param, MRP_FILE, pathNfilename);
 				if( MR_MSG_MAKE_FILENAME_SEARCHABLE(msg_type) ) {
-					part->m_msg = mr_get_filename(pathNfilename);
+					part->m_msg = mrarena_take_str(ths->m_arena, mr_get_filename(pathNfilename));
 				}
 				else if( MR_MSG_MAKE_SUFFIX_SEARCHABLE(msg_type) ) {
-					part->m_msg = mr_get_filesuffix_lc(pathNfilename);
+					part->m_msg = mrarena_take_str(ths->m_arena, mr_get_filesuffix_lc(pathNfilename));
 				}
 
 				if( mime_type == MR_MIMETYPE_IMAGE ) {
 					uint32_t w = 0, h = 0;
-					if( mr_get_filemeta(decoded_data, decoded_data_bytes, &w, &h) ) {
+					if( get_filemeta_from_file(pathNfilename, &w, &h) ) {
 						mrparam_set_int(part->m_param, MRP_WIDTH, w);
 						mrparam_set_int(part->m_param, MRP_HEIGHT, h);
 					}
@@ -1233,9 +1391,9 @@ static int mrmimeparser_parse_mime_recursive(mrmimeparser_t* ths, struct mailmim
 
 				case MR_MIMETYPE_MP_NOT_DECRYPTABLE:
 					{
-						mrmimepart_t* part = mrmimepart_new();
+						mrmimepart_t* part = mrmimepart_new(ths);
 						part->m_type = MR_MSG_TEXT;
-						part->m_msg = mrstock_str(MR_STR_ENCRYPTEDMSG); /* not sure if the text "Encrypted message" is 100% sufficient here (bp) */
+						part->m_msg = mrarena_take_str(ths->m_arena, mrstock_str(MR_STR_ENCRYPTEDMSG)); /* not sure if the text "Encrypted message" is 100% sufficient here (bp) */
 						carray_add(ths->m_parts, (void*)part, NULL);
 						any_part_added = 1;
 						ths->m_decrypting_failed = 1;
@@ -1448,7 +1606,7 @@ void mrmimeparser_parse(mrmimeparser_t* ths, const char* body_not_terminated, si
 	{
 		struct mailimf_field* field = mrmimeparser_lookup_field(ths, "Subject");
 		if( field && field->fld_type == MAILIMF_FIELD_SUBJECT ) {
-			ths->m_subject = mr_decode_header_string(field->fld_data.fld_subject->sbj_value);
+			ths->m_subject = mrarena_take_str(ths->m_arena, mr_decode_header_string(field->fld_data.fld_subject->sbj_value));
 		}
 	}
 
@@ -1509,9 +1667,7 @@ void mrmimeparser_parse(mrmimeparser_t* ths, const char* body_not_terminated, si
 					mrmimepart_t* part = (mrmimepart_t*)carray_get(ths->m_parts, i);
 					if( part->m_type == MR_MSG_TEXT ) {
 						#define MR_NDASH "\xE2\x80\x93"
-						char* new_txt = mr_mprintf("%s " MR_NDASH " %s", subj, part->m_msg);
-						free(part->m_msg);
-						part->m_msg = new_txt;
+						part->m_msg = mrarena_take_str(ths->m_arena, mr_mprintf("%s " MR_NDASH " %s", subj, part->m_msg));
 						break;
 					}
 				}
@@ -1536,8 +1692,7 @@ void mrmimeparser_parse(mrmimeparser_t* ths, const char* body_not_terminated, si
 		mrmimepart_t* part = (mrmimepart_t*)carray_get(ths->m_parts, 0);
 		if( part->m_type == MR_MSG_AUDIO ) {
 			if( mrmimeparser_lookup_optional_field2(ths, "Chat-Voice-Message", "X-MrVoiceMessage") ) {
-				free(part->m_msg);
-				part->m_msg = strdup("ogg"); /* MR_MSG_AUDIO adds sets the whole filename which is useless. however, the extension is useful. */
+				part->m_msg = mrarena_strdup(ths->m_arena, "ogg"); /* MR_MSG_AUDIO adds sets the whole filename which is useless. however, the extension is useful. */
 				part->m_type = MR_MSG_VOICE;
 				mrparam_set(part->m_param, MRP_AUTHORNAME, NULL); /* remove unneeded information */
 				mrparam_set(part->m_param, MRP_TRACKNAME, NULL);
@@ -1612,9 +1767,9 @@ void mrmimeparser_parse(mrmimeparser_t* ths, const char* body_not_terminated, si
 	/* Cleanup - and try to create at least an empty part if there are no parts yet */
 cleanup:
 	if( !mrmimeparser_has_nonmeta(ths) && carray_count(ths->m_reports)==0 ) {
-		mrmimepart_t* part = mrmimepart_new();
+		mrmimepart_t* part = mrmimepart_new(ths);
 		part->m_type = MR_MSG_TEXT;
-		part->m_msg = safe_strdup(ths->m_subject? ths->m_subject : "Empty message");
+		part->m_msg = mrarena_strdup(ths->m_arena, ths->m_subject? ths->m_subject : "Empty message");
 		carray_add(ths->m_parts, (void*)part, NULL);
 	}
 }
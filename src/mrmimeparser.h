@@ -76,6 +76,8 @@ typedef struct mrmimeparser_t
 
 	int                    m_is_system_message;
 
+	mrarena_t*             m_arena;             /* the parts and their strings are allocated from here, resetted by mrmimeparser_empty() */
+
 } mrmimeparser_t;
 
 
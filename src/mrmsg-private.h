@@ -93,6 +93,10 @@ struct _mrmsg
 
 
 int             mrmsg_load_from_db__                 (mrmsg_t*, mrmailbox_t*, uint32_t id);
+#define         MR_MSGS_PER_QUERY                    32
+#define         MR_MSG_LOAD_NO_TEXT                  0x01
+#define         MR_MSG_LOAD_NO_PARAM                 0x02
+int             mrmsg_load_many_from_db__            (mrmsg_t** ret_msgs, mrmailbox_t*, mrsqlite3_t*, const uint32_t* ids, int cnt, int flags); /* one query per MR_MSGS_PER_QUERY IDs, the mrsqlite3_t may be a reader */
 int             mrmsg_is_increation__                (const mrmsg_t*);
 char*           mrmsg_get_summarytext_by_raw         (int type, const char* text, mrparam_t*, int approx_bytes); /* the returned value must be free()'d */
 void            mrmsg_save_param_to_disk__           (mrmsg_t*);
@@ -851,9 +851,11 @@ cleanup:
  ******************************************************************************/
 
 
-#define MR_MSG_FIELDS " m.id,rfc724_mid,m.server_folder,m.server_uid,m.chat_id, " \
-                      " m.from_id,m.to_id,m.timestamp,m.timestamp_sent,m.timestamp_rcvd, m.type,m.state,m.msgrmsg,m.txt, " \
-                      " m.param,m.starred,c.blocked "
+#define MR_MSG_FIELDS_PROJ(txt, param) \
+                      " m.id,rfc724_mid,m.server_folder,m.server_uid,m.chat_id, " \
+                      " m.from_id,m.to_id,m.timestamp,m.timestamp_sent,m.timestamp_rcvd, m.type,m.state,m.msgrmsg," txt ", " \
+                      " " param ",m.starred,c.blocked "
+#define MR_MSG_FIELDS MR_MSG_FIELDS_PROJ("m.txt", "m.param")
 
 
 static int mrmsg_set_from_stmt__(mrmsg_t* ths, sqlite3_stmt* row, int row_offset) /* field order must be MR_MSG_FIELDS */
@@ -905,7 +907,7 @@ int mrmsg_load_from_db__(mrmsg_t* ths, mrmailbox_t* mailbox, uint32_t id)
 		return 0;
 	}
 
-	stmt = mrsqlite3_predefine__(mailbox->m_sql, SELECT_ircftttstpb_FROM_msg_WHERE_i,
+	stmt = mrsqlite3_predefine__(mailbox->m_sql,
 		"SELECT " MR_MSG_FIELDS
 		" FROM msgs m LEFT JOIN chats c ON c.id=m.chat_id"
 		" WHERE m.id=?;");
@@ -925,6 +927,78 @@ int mrmsg_load_from_db__(mrmsg_t* ths, mrmailbox_t* mailbox, uint32_t id)
 }
 
 
+/**
+ * Library-internal.
+ *
+ * Load several messages at once, this is faster than calling mrmsg_load_from_db__()
+ * for each message as only one query per MR_MSGS_PER_QUERY IDs is needed.
+ *
+ * Calling this function is not thread-safe, locking is up to the caller.
+ *
+ * @private @memberof mrmsg_t
+ *
+ * @param ret_msgs Array of `cnt` pointers, initialized to NULL by the caller.  For each existing message,
+ *     a new mrmsg_t object is set at the index of its ID, the caller must mrmsg_unref() it.
+ *     The pointers of special or not existing IDs are not modified.
+ *
+ * @param flags MR_MSG_LOAD_NO_TEXT and/or MR_MSG_LOAD_NO_PARAM if the text or the parameters are not needed,
+ *     the corresponding fields are left empty then.
+ *
+ * @return Number of loaded messages.
+ */
+int mrmsg_load_many_from_db__(mrmsg_t** ret_msgs, mrmailbox_t* mailbox, mrsqlite3_t* sql, const uint32_t* ids, int cnt, int flags)
+{
+	sqlite3_stmt* stmt;
+	int           loaded = 0, chunk_start, chunk_cnt, i;
+	uint32_t      id;
+
+	#if MR_MSGS_PER_QUERY!=32 || MR_MSG_LOAD_NO_TEXT!=0x01 || MR_MSG_LOAD_NO_PARAM!=0x02
+		#error
+	#endif
+	#define MR_MSGS_PER_QUERY_SQL(txt, param) \
+		"SELECT " MR_MSG_FIELDS_PROJ(txt, param) \
+		" FROM msgs m LEFT JOIN chats c ON c.id=m.chat_id" \
+		" WHERE m.id IN (?,?,?,?,?,?,?,?,?,?,?,?,?,?,?,?,?,?,?,?,?,?,?,?,?,?,?,?,?,?,?,?);"
+	static const char* s_sql[4] = {
+		MR_MSGS_PER_QUERY_SQL("m.txt", "m.param"),
+		MR_MSGS_PER_QUERY_SQL("''",    "m.param"), /* MR_MSG_LOAD_NO_TEXT */
+		MR_MSGS_PER_QUERY_SQL("m.txt", "''"),      /* MR_MSG_LOAD_NO_PARAM */
+		MR_MSGS_PER_QUERY_SQL("''",    "''")
+	};
+
+	if( ret_msgs==NULL || mailbox==NULL || sql==NULL || ids==NULL ) {
+		return 0;
+	}
+
+	for( chunk_start = 0; chunk_start < cnt; chunk_start += MR_MSGS_PER_QUERY )
+	{
+		chunk_cnt = cnt-chunk_start < MR_MSGS_PER_QUERY? cnt-chunk_start : MR_MSGS_PER_QUERY;
+
+		stmt = mrsqlite3_predefine__(sql, s_sql[flags&(MR_MSG_LOAD_NO_TEXT|MR_MSG_LOAD_NO_PARAM)]);
+		for( i = 0; i < MR_MSGS_PER_QUERY; i++ ) {
+			sqlite3_bind_int(stmt, i+1, i<chunk_cnt? ids[chunk_start+i] : 0/*never used as message ID*/);
+		}
+
+		while( sqlite3_step(stmt) == SQLITE_ROW )
+		{
+			/* the same ID may be requested several times, each index gets its own object */
+			id = sqlite3_column_int(stmt, 0);
+			for( i = chunk_start; i < chunk_start+chunk_cnt; i++ ) {
+				if( ids[i] == id && ids[i] > MR_MSG_ID_LAST_SPECIAL ) {
+					mrmsg_t* msg = mrmsg_new();
+					mrmsg_set_from_stmt__(msg, stmt, 0);
+					msg->m_mailbox = mailbox;
+					ret_msgs[i] = msg;
+					loaded++;
+				}
+			}
+		}
+	}
+
+	return loaded;
+}
+
+
 /**
  * Guess message type from suffix.
  *
@@ -1122,9 +1196,9 @@ void mrmsg_save_param_to_disk__(mrmsg_t* msg)
 		return;
 	}
 
-	sqlite3_stmt* stmt = mrsqlite3_predefine__(msg->m_mailbox->m_sql, UPDATE_msgs_SET_param_WHERE_id,
+	sqlite3_stmt* stmt = mrsqlite3_predefine__(msg->m_mailbox->m_sql,
 		"UPDATE msgs SET param=? WHERE id=?;");
-	sqlite3_bind_text(stmt, 1, msg->m_param->m_packed, -1, SQLITE_STATIC);
+	sqlite3_bind_text(stmt, 1, mrparam_get_packed(msg->m_param), -1, SQLITE_STATIC);
 	sqlite3_bind_int (stmt, 2, msg->m_id);
 	sqlite3_step(stmt);
 }
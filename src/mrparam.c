@@ -27,35 +27,93 @@
 #include "mrtools.h"
 
 
-static char* find_param(char* ths, int key, char** ret_p2)
+#define IS_VALID_KEY(k) ((k)>0 && (k)<128)
+
+
+static void clear_slots(mrparam_t* param)
 {
-	char *p1, *p2;
+	int i;
+	for( i = 0; i < param->m_cnt; i++ ) {
+		param->m_index[(int)param->m_slots[i].m_key] = 0;
+		if( param->m_slots[i].m_owned ) {
+			free(param->m_slots[i].m_value);
+		}
+	}
+	param->m_cnt = 0;
+
+	free(param->m_buf);
+	param->m_buf = NULL;
+}
+
 
-	/* let p1 point to the start of the */
-	p1 = ths;
-	while( 1 ) {
-		if( p1 == NULL || *p1 == 0 ) {
-			return NULL;
+static void add_slot(mrparam_t* param, int key, char* value, int owned)
+{
+	if( param->m_cnt >= param->m_alloc ) {
+		param->m_alloc = param->m_alloc? param->m_alloc*2 : 8;
+		if( (param->m_slots=realloc(param->m_slots, sizeof(mrparam_slot_t)*param->m_alloc))==NULL ) {
+			exit(66);
 		}
-		else if( *p1 == key && p1[1] == '=' ) {
-			break;
+	}
+
+	param->m_slots[param->m_cnt].m_key   = key;
+	param->m_slots[param->m_cnt].m_owned = owned;
+	param->m_slots[param->m_cnt].m_value = value;
+	param->m_cnt++;
+	param->m_index[key] = param->m_cnt;
+}
+
+
+static void parse(mrparam_t* param)
+{
+	/* split a copy of the packed string into lines of the form `k=value`;
+	other lines are ignored and for duplicate keys, the first line wins, as this was always the case */
+	char *p, *line_end;
+	int  key;
+
+	if( param->m_state & MRPARAM_PARSED ) {
+		return;
+	}
+
+	clear_slots(param);
+	param->m_state = MRPARAM_PARSED;
+
+	if( param->m_packed[0] == 0 ) {
+		return;
+	}
+
+	param->m_buf = safe_strdup(param->m_packed);
+	p = param->m_buf;
+	while( p && *p )
+	{
+		line_end = strchr(p, '\n');
+		if( line_end ) {
+			*line_end = 0;
 		}
-		else {
-			p1 = strchr(p1, '\n'); /* if `\r\n` is used, this `\r` is also skipped by this*/
-			if( p1 ) {
-				p1++;
-			}
+
+		key = (unsigned char)p[0];
+		if( IS_VALID_KEY(key) && p[1] == '=' && param->m_index[key] == 0 ) {
+			mr_rtrim(&p[2]); /* to be safe with '\r' characters ... */
+			add_slot(param, key, &p[2], 0);
 		}
+
+		p = line_end? line_end+1 : NULL;
 	}
+}
+
 
-	/* let p2 point to the character _after_ the value - eiter `\n` or `\0` */
-	p2 = strchr(p1, '\n');
-	if( p2 == NULL ) {
-		p2 = &p1[strlen(p1)];
+static const char* get_value(mrparam_t* param, int key)
+{
+	if( param == NULL || !IS_VALID_KEY(key) ) {
+		return NULL;
 	}
 
-	*ret_p2 = p2;
-	return p1;
+	parse(param);
+
+	if( param->m_index[key] == 0 ) {
+		return NULL;
+	}
+
+	return param->m_slots[param->m_index[key]-1].m_value;
 }
 
 
@@ -75,6 +133,7 @@ mrparam_t* mrparam_new()
 	}
 
 	param->m_packed = calloc(1, 1);
+	param->m_state  = MRPARAM_PARSED;
 
     return param;
 }
@@ -94,6 +153,7 @@ void mrparam_unref(mrparam_t* param)
 	}
 
 	mrparam_empty(param);
+	free(param->m_slots);
 	free(param->m_packed);
 	free(param);
 }
@@ -114,7 +174,9 @@ void mrparam_empty(mrparam_t* param)
 		return;
 	}
 
+	clear_slots(param);
 	param->m_packed[0] = 0;
+	param->m_state = MRPARAM_PARSED;
 }
 
 
@@ -124,6 +186,9 @@ void mrparam_empty(mrparam_t* param)
  *
  * Before the new packed parameters are stored, _all_ existant parameters are deleted.
  *
+ * The string is not parsed before the parameters are accessed, so this function is cheap
+ * for objects that are loaded but never looked at.
+ *
  * @private @memberof mrparam_t
  *
  * @param param Parameter object to modify.
@@ -140,9 +205,10 @@ void mrparam_set_packed(mrparam_t* param, const char* packed)
 
 	mrparam_empty(param);
 
-	if( packed ) {
+	if( packed && packed[0] ) {
 		free(param->m_packed);
 		param->m_packed = safe_strdup(packed);
+		param->m_state  = 0;
 	}
 }
 
@@ -157,13 +223,57 @@ void mrparam_set_urlencoded(mrparam_t* param, const char* urlencoded)
 		return;
 	}
 
-	mrparam_empty(param);
+	mrparam_set_packed(param, urlencoded);
+	mr_str_replace(&param->m_packed, "&", "\n");
+}
+
+
+/**
+ * Get the parameters in the packed form as `a=value1\nb=value2`, eg. to store them
+ * to the database.  If the parameters were modified, the packed form is rebuilt.
+ *
+ * @private @memberof mrparam_t
+ *
+ * @param param Parameter object to query.
+ *
+ * @return The packed parameters.  The string is owned by the object and is valid
+ *     until the object is modified; it must not be free()'d.  Never NULL.
+ */
+const char* mrparam_get_packed(mrparam_t* param)
+{
+	size_t bytes = 1;
+	char*  p;
+	int    i;
+
+	if( param == NULL ) {
+		return "";
+	}
+
+	if( param->m_state & MRPARAM_DIRTY )
+	{
+		for( i = 0; i < param->m_cnt; i++ ) {
+			bytes += 3/*key, `=` and `\n`*/ + strlen(param->m_slots[i].m_value);
+		}
 
-	if( urlencoded ) {
 		free(param->m_packed);
-		param->m_packed = safe_strdup(urlencoded);
-		mr_str_replace(&param->m_packed, "&", "\n");
+		if( (param->m_packed=malloc(bytes))==NULL ) {
+			exit(67);
+		}
+
+		p = param->m_packed;
+		for( i = 0; i < param->m_cnt; i++ ) {
+			if( i ) { *p++ = '\n'; }
+			*p++ = param->m_slots[i].m_key;
+			*p++ = '=';
+			strcpy(p, param->m_slots[i].m_value);
+			p += strlen(p);
+		}
+		*p = 0;
+
+		param->m_state &= ~MRPARAM_DIRTY;
 	}
+
+	return param->m_packed;
 }
 
 
@@ -180,13 +290,7 @@ void mrparam_set_urlencoded(mrparam_t* param, const char* urlencoded)
  */
 int mrparam_exists(mrparam_t* param, int key)
 {
-	char *p2;
-
-	if( param == NULL || key == 0 ) {
-		return 0;
-	}
-
-	return find_param(param->m_packed, key, &p2)? 1 : 0;
+	return get_value(param, key)? 1 : 0;
 }
 
 
@@ -205,25 +309,13 @@ int mrparam_exists(mrparam_t* param, int key)
  */
 char* mrparam_get(mrparam_t* param, int key, const char* def)
 {
-	char *p1, *p2, bak, *ret;
+	const char* value = get_value(param, key);
 
-	if( param == NULL || key == 0 ) {
+	if( value == NULL ) {
 		return def? safe_strdup(def) : NULL;
 	}
 
-	p1 = find_param(param->m_packed, key, &p2);
-	if( p1 == NULL ) {
-		return def? safe_strdup(def) : NULL;
-	}
-
-	p1 += 2; /* skip key and "=" (safe as find_param checks for its existance) */
-
-	bak = *p2;
-	*p2 = 0;
-	ret = safe_strdup(p1);
-	mr_rtrim(ret); /* to be safe with '\r' characters ... */
-	*p2 = bak;
-	return ret;
+	return safe_strdup(value);
 }
 
 
@@ -242,17 +334,13 @@ char* mrparam_get(mrparam_t* param, int key, const char* def)
  */
 int32_t mrparam_get_int(mrparam_t* param, int key, int32_t def)
 {
-	if( param == NULL || key == 0 ) {
+	const char* value = get_value(param, key);
+
+	if( value == NULL ) {
 		return def;
 	}
 
-    char* str = mrparam_get(param, key, NULL);
-    if( str == NULL ) {
-		return def;
-    }
-    int32_t ret = atol(str);
-    free(str);
-    return ret;
+	return atol(value);
 }
 
 
@@ -272,53 +360,45 @@ int32_t mrparam_get_int(mrparam_t* param, int key, int32_t def)
 
 void mrparam_set(mrparam_t* param, int key, const char* value)
 {
-	char *old1, *old2, *new1 = NULL;
+	mrparam_slot_t* slot;
+	int             i;
 
-	if( param == NULL || key == 0 ) {
+	if( param == NULL || !IS_VALID_KEY(key) ) {
 		return;
 	}
 
-	old1 = param->m_packed;
-	old2 = NULL;
+	parse(param);
 
-	/* remove existing parameter from packed string, if any */
-	if( old1 ) {
-		char *p1, *p2;
-		p1 = find_param(old1, key, &p2);
-		if( p1 != NULL ) {
-			*p1 = 0;
-			old2 = p2;
-		}
-		else if( value==NULL ) {
+	if( param->m_index[key] == 0 )
+	{
+		if( value == NULL ) {
 			return; /* parameter does not exist and should be cleared -> done. */
 		}
+		add_slot(param, key, safe_strdup(value), 1);
 	}
+	else
+	{
+		slot = &param->m_slots[param->m_index[key]-1];
+		if( slot->m_owned ) {
+			free(slot->m_value);
+		}
 
-	mr_rtrim(old1); /* trim functions are null-pointer-safe */
-	mr_ltrim(old2);
-
-	if( old1 && old1[0]==0 ) { old1 = NULL; }
-	if( old2 && old2[0]==0 ) { old2 = NULL; }
-
-	/* create new string */
-	if( value ) {
-		new1 = mr_mprintf("%s%s%c=%s%s%s",
-			old1?  old1 : "",
-			old1?  "\n" : "",
-			key,
-			value,
-			old2?  "\n" : "",
-			old2?  old2 : "");
-	}
-	else {
-		new1 = mr_mprintf("%s%s%s",
-			old1?         old1 : "",
-			(old1&&old2)? "\n" : "",
-			old2?         old2 : "");
+		if( value ) {
+			slot->m_value = safe_strdup(value);
+			slot->m_owned = 1;
+		}
+		else {
+			/* remove the slot, keeping the order of the others */
+			for( i = param->m_index[key]; i < param->m_cnt; i++ ) {
+				param->m_slots[i-1] = param->m_slots[i];
+				param->m_index[(int)param->m_slots[i-1].m_key] = i;
+			}
+			param->m_cnt--;
+			param->m_index[key] = 0;
+		}
 	}
 
-	free(param->m_packed);
-	param->m_packed = new1;
+	param->m_state |= MRPARAM_DIRTY;
 }
 
 
@@ -337,14 +417,12 @@ void mrparam_set(mrparam_t* param, int key, const char* value)
  */
 void mrparam_set_int(mrparam_t* param, int key, int32_t value)
 {
+	char value_str[16];
+
 	if( param == NULL || key == 0 ) {
 		return;
 	}
 
-    char* value_str = mr_mprintf("%i", (int)value);
-    if( value_str == NULL ) {
-		return;
-    }
-    mrparam_set(param, key, value_str);
-    free(value_str);
+	snprintf(value_str, sizeof(value_str), "%i", (int)value);
+	mrparam_set(param, key, value_str);
 }
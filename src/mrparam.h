@@ -27,6 +27,20 @@ extern "C" {
 #endif
 
 
+/**
+ * Library-internal.
+ *
+ * A single parameter of mrparam_t.
+ */
+typedef struct mrparam_slot_t
+{
+	/** @privatesection */
+	char            m_key;
+	char            m_owned;     /**< 1 if m_value is allocated on its own, 0 if it points to mrparam_t::m_buf */
+	char*           m_value;
+} mrparam_slot_t;
+
+
 /**
  * An object for handling key=value parameter lists; for the key, curently only
  * a single character is allowed.
@@ -34,12 +48,24 @@ extern "C" {
  * The object is used eg. by mrchat_t or mrmsg_t, for readable paramter names,
  * these classes define some MRP_* constantats.
  *
+ * The packed form is parsed on the first access only and is rebuilt only
+ * if the parameters are needed in the packed form again, see mrparam_get_packed().
+ *
  * Only for library-internal use.
  */
 typedef struct mrparam_t
 {
 	/** @privatesection */
-	char*           m_packed;    /**< Always set, never NULL. */
+	char*           m_packed;    /**< Always set, never NULL. May be outdated after changes, use mrparam_get_packed() to read it. */
+
+	#define         MRPARAM_PARSED 0x01
+	#define         MRPARAM_DIRTY  0x02
+	int             m_state;     /**< MRPARAM_PARSED if m_slots reflect m_packed, MRPARAM_DIRTY if m_packed must be rebuilt from m_slots */
+	mrparam_slot_t* m_slots;     /**< the parameters in the order they were added */
+	int             m_cnt;
+	int             m_alloc;
+	char*           m_buf;       /**< a copy of m_packed with null-terminated values, the values of m_slots point into it */
+	uint8_t         m_index[128];/**< for each key, the index in m_slots plus one, 0 if the key is not set */
 } mrparam_t;
 
 
@@ -61,6 +87,7 @@ typedef struct mrparam_t
 #define MRP_SERVER_UID        'z'  /* for jobs */
 #define MRP_TIMES             't'  /* for jobs: times a job was tried */
 #define MRP_TIMES_INCREATION  'T'  /* for jobs: times a job was tried, used for increation */
+#define MRP_PENDING_RECIPIENTS 'P' /* for jobs: space-separated recipients that rejected a message temporarily, the message is sent again only to them */
 
 #define MRP_REFERENCES        'R'  /* for groups and chats: References-header last used for a chat */
 #define MRP_UNPROMOTED        'U'  /* for groups */
@@ -81,6 +108,7 @@ void            mrparam_empty          (mrparam_t*);
 void            mrparam_unref          (mrparam_t*);
 void            mrparam_set_packed     (mrparam_t*, const char*);
 void            mrparam_set_urlencoded (mrparam_t*, const char*);
+const char*     mrparam_get_packed     (mrparam_t*); /* the result is valid until the object is modified and must not be free()'d */
 
 
 #ifdef __cplusplus
@@ -50,6 +50,248 @@ one :-) */
 static pgp_io_t s_io;
 
 
+/*******************************************************************************
+ * Cache of parsed keys
+ ******************************************************************************/
+
+
+/* Parsing a key is expensive compared to encrypting or decrypting a typical
+message, so keys parsed for mrpgp_pk_encrypt() and mrpgp_pk_decrypt() are kept
+in a small process-wide cache.  The raw key is used as the cache key - the
+fingerprint would require parsing the key first and an updated key with the
+same fingerprint results in a new entry this way.
+
+netpgp only reads the keys while signing, encrypting or decrypting, so
+several threads may share an entry; the entries are reference counted and
+private key material is wiped when an entry is evicted.  If the own keys change,
+the whole cache is cleared, see mrpgp_forget_cached_keys().  The maximum
+number of entries, MR_PGP_KEY_CACHE_MAX, is defined in mrpgp.h. */
+
+
+typedef struct mrpgpcached_t
+{
+	uint8_t*              m_binary;       /* the raw key, also used as hash key */
+	size_t                m_bytes;
+	pgp_keyring_t         m_public_keys;
+	pgp_keyring_t         m_private_keys;
+	int                   m_refcnt;       /* one reference for the cache plus one for each caller using the keys */
+	struct mrpgpcached_t* m_prev;         /* least-recently-used list, s_cache_first is the most recently used entry */
+	struct mrpgpcached_t* m_next;
+} mrpgpcached_t;
+
+
+static pthread_mutex_t s_cache_critical = PTHREAD_MUTEX_INITIALIZER;
+static mrhash_t        s_cache_hash;
+static int             s_cache_hash_initialized = 0;
+static mrpgpcached_t*  s_cache_first = NULL;
+static mrpgpcached_t*  s_cache_last = NULL;
+static int             s_cache_count = 0;
+static int             s_cache_generation = 0; /* incremented on each clear, keys parsed before are not added to the cache */
+
+
+static void clear_free_seckey(pgp_seckey_t* seckey)
+{
+	/* netpgp frees the secret numbers using BN_free() which does not overwrite them, so we clear them before */
+	switch( seckey->pubkey.alg ) {
+		case PGP_PKA_RSA:
+		case PGP_PKA_RSA_ENCRYPT_ONLY:
+		case PGP_PKA_RSA_SIGN_ONLY:
+			BN_clear_free(seckey->key.rsa.d); seckey->key.rsa.d = NULL;
+			BN_clear_free(seckey->key.rsa.p); seckey->key.rsa.p = NULL;
+			BN_clear_free(seckey->key.rsa.q); seckey->key.rsa.q = NULL;
+			BN_clear_free(seckey->key.rsa.u); seckey->key.rsa.u = NULL;
+			break;
+
+		case PGP_PKA_DSA:
+			BN_clear_free(seckey->key.dsa.x); seckey->key.dsa.x = NULL;
+			break;
+
+		case PGP_PKA_ELGAMAL:
+		case PGP_PKA_ELGAMAL_ENCRYPT_OR_SIGN:
+			BN_clear_free(seckey->key.elgamal.x); seckey->key.elgamal.x = NULL; /* not freed by netpgp at all */
+			break;
+
+		default:
+			break;
+	}
+}
+
+
+static void wipe_keyring(pgp_keyring_t* keyring)
+{
+	unsigned i, n;
+	for( i = 0; i < keyring->keyc; i++ ) {
+		pgp_key_t* key = &keyring->keys[i];
+		if( key->type != PGP_PTAG_CT_PUBLIC_KEY ) { /* same check as in pgp_key_free() */
+			clear_free_seckey(&key->key.seckey);
+			for( n = 0; n < key->subkeyc; n++ ) {
+				clear_free_seckey(&key->subkeys[n].key.seckey);
+			}
+		}
+		pgp_key_free(key);
+		mr_wipe_secret_mem(key, sizeof(pgp_key_t));
+	}
+	pgp_keyring_free(keyring);
+}
+
+
+static void cached_keys_free__(mrpgpcached_t* entry)
+{
+	wipe_keyring(&entry->m_public_keys);
+	wipe_keyring(&entry->m_private_keys);
+	mr_wipe_secret_mem(entry->m_binary, entry->m_bytes);
+	free(entry->m_binary);
+	free(entry);
+}
+
+
+static void cached_keys_unlink__(mrpgpcached_t* entry)
+{
+	mrhash_insert(&s_cache_hash, entry->m_binary, (int)entry->m_bytes, NULL);
+
+	if( entry->m_prev ) { entry->m_prev->m_next = entry->m_next; } else { s_cache_first = entry->m_next; }
+	if( entry->m_next ) { entry->m_next->m_prev = entry->m_prev; } else { s_cache_last = entry->m_prev; }
+	entry->m_prev = NULL;
+	entry->m_next = NULL;
+	s_cache_count--;
+
+	if( --entry->m_refcnt == 0 ) {
+		cached_keys_free__(entry);
+	}
+}
+
+
+static void cached_keys_link_first__(mrpgpcached_t* entry)
+{
+	entry->m_prev = NULL;
+	entry->m_next = s_cache_first;
+	if( s_cache_first ) { s_cache_first->m_prev = entry; } else { s_cache_last = entry; }
+	s_cache_first = entry;
+}
+
+
+static mrpgpcached_t* cached_keys_find__(const mrkey_t* raw_key)
+{
+	mrpgpcached_t* entry;
+
+	if( !s_cache_hash_initialized ) {
+		mrhash_init(&s_cache_hash, MRHASH_BINARY, 0/*the key is owned by the entry*/);
+		s_cache_hash_initialized = 1;
+	}
+
+	if( (entry=(mrpgpcached_t*)mrhash_find(&s_cache_hash, raw_key->m_binary, raw_key->m_bytes)) != NULL )
+	{
+		if( entry != s_cache_first ) {
+			entry->m_prev->m_next = entry->m_next;
+			if( entry->m_next ) { entry->m_next->m_prev = entry->m_prev; } else { s_cache_last = entry->m_prev; }
+			cached_keys_link_first__(entry);
+		}
+		entry->m_refcnt++;
+	}
+
+	return entry;
+}
+
+
+static mrpgpcached_t* cached_keys_get(const mrkey_t* raw_key)
+{
+	/* returns the parsed key with an additional reference, the caller must call cached_keys_unref() */
+	mrpgpcached_t* entry = NULL, *parsed = NULL;
+	pgp_memory_t*  keysmem = NULL;
+	int            generation;
+
+	if( raw_key==NULL || raw_key->m_binary==NULL || raw_key->m_bytes<=0 ) {
+		return NULL;
+	}
+
+	pthread_mutex_lock(&s_cache_critical);
+		entry      = cached_keys_find__(raw_key);
+		generation = s_cache_generation;
+	pthread_mutex_unlock(&s_cache_critical);
+
+	if( entry ) {
+		return entry;
+	}
+
+	/* parsing takes some time, do not block other threads meanwhile */
+	if( (parsed=calloc(1, sizeof(mrpgpcached_t)))==NULL
+	 || (parsed->m_binary=malloc(raw_key->m_bytes))==NULL
+	 || (keysmem=pgp_memory_new())==NULL ) {
+		exit(76);
+	}
+	memcpy(parsed->m_binary, raw_key->m_binary, raw_key->m_bytes);
+	parsed->m_bytes  = raw_key->m_bytes;
+	parsed->m_refcnt = 1; /* the reference of the caller */
+
+	pgp_memory_add(keysmem, raw_key->m_binary, raw_key->m_bytes);
+	pgp_filter_keys_from_mem(&s_io, &parsed->m_public_keys, &parsed->m_private_keys, NULL, 0, keysmem);
+	pgp_memory_free(keysmem);
+
+	pthread_mutex_lock(&s_cache_critical);
+
+		if( (entry=cached_keys_find__(raw_key)) == NULL )
+		{
+			entry = parsed;
+			parsed = NULL;
+
+			if( generation == s_cache_generation ) /* otherwise the cache was cleared meanwhile and the key may be outdated, use it uncached */
+			{
+				mrhash_insert(&s_cache_hash, entry->m_binary, (int)entry->m_bytes, entry);
+				cached_keys_link_first__(entry);
+				s_cache_count++;
+				entry->m_refcnt++; /* the reference of the cache */
+
+				while( s_cache_count > MR_PGP_KEY_CACHE_MAX && s_cache_last != entry ) {
+					cached_keys_unlink__(s_cache_last);
+				}
+			}
+		}
+
+	pthread_mutex_unlock(&s_cache_critical);
+
+	if( parsed ) {
+		cached_keys_free__(parsed); /* another thread was faster, use its entry */
+	}
+
+	return entry;
+}
+
+
+static void cached_keys_unref(mrpgpcached_t* entry)
+{
+	if( entry == NULL ) {
+		return;
+	}
+
+	pthread_mutex_lock(&s_cache_critical);
+		if( --entry->m_refcnt == 0 ) {
+			cached_keys_free__(entry);
+		}
+	pthread_mutex_unlock(&s_cache_critical);
+}
+
+
+static void cached_keys_clear(void)
+{
+	pthread_mutex_lock(&s_cache_critical);
+		s_cache_generation++;
+		while( s_cache_last ) {
+			cached_keys_unlink__(s_cache_last); /* entries still in use are freed by the last cached_keys_unref() */
+		}
+	pthread_mutex_unlock(&s_cache_critical);
+}
+
+
+static void add_cached_keys(pgp_keyring_t* dst, const pgp_keyring_t* src)
+{
+	/* the keys are shallow copies owned by the cache, free `dst` using pgp_keyring_free(), _not_ pgp_keyring_purge() */
+	unsigned i;
+	for( i = 0; i < src->keyc; i++ ) {
+		pgp_keyring_add(dst, &src->keys[i]);
+	}
+}
+
+
 void mrpgp_init(mrmailbox_t* mailbox)
 {
 	#ifdef __APPLE__
@@ -71,6 +313,50 @@ void mrpgp_init(mrmailbox_t* mailbox)
 
 void mrpgp_exit(mrmailbox_t* mailbox)
 {
+	cached_keys_clear(); /* do not keep private keys in RAM longer than needed */
+}
+
+
+void mrpgp_forget_cached_keys(void)
+{
+	/* called if the own keys change; replaced private keys should not stay in RAM until they're evicted from the cache */
+	cached_keys_clear();
+}
+
+
+int mrpgp_cached_keys_count(void)
+{
+	int count;
+	pthread_mutex_lock(&s_cache_critical);
+		count = s_cache_count;
+	pthread_mutex_unlock(&s_cache_critical);
+	return count;
+}
+
+
+const void* mrpgp_cached_keys_id(const mrkey_t* raw_key)
+{
+	/* parses and caches the key as done for encryption; the returned pointer is only meant to be compared */
+	mrpgpcached_t* entry = cached_keys_get(raw_key);
+	cached_keys_unref(entry);
+	return entry;
+}
+
+
+int mrpgp_is_key_cached(const mrkey_t* raw_key)
+{
+	int is_cached = 0;
+
+	if( raw_key==NULL || raw_key->m_binary==NULL || raw_key->m_bytes<=0 ) {
+		return 0;
+	}
+
+	pthread_mutex_lock(&s_cache_critical);
+		if( s_cache_hash_initialized && mrhash_find(&s_cache_hash, raw_key->m_binary, raw_key->m_bytes) ) {
+			is_cached = 1;
+		}
+	pthread_mutex_unlock(&s_cache_critical);
+	return is_cached;
 }
 
 
@@ -538,14 +824,15 @@ int mrpgp_pk_encrypt(  mrmailbox_t*       mailbox,
 {
 	pgp_keyring_t*  public_keys = calloc(1, sizeof(pgp_keyring_t));
 	pgp_keyring_t*  private_keys = calloc(1, sizeof(pgp_keyring_t));
-	pgp_keyring_t*  dummy_keys = calloc(1, sizeof(pgp_keyring_t));
-	pgp_memory_t*   keysmem = pgp_memory_new();
+	mrpgpcached_t** cached = NULL; /* the last entry is used for the signing key */
+	int             cached_cnt = 0;
 	pgp_memory_t*   signedmem = NULL;
 	int             i, success = 0;
 
 	if( mailbox==NULL || plain_text==NULL || plain_bytes==0 || ret_ctext==NULL || ret_ctext_bytes==NULL
 	 || raw_public_keys_for_encryption==NULL || raw_public_keys_for_encryption->m_count<=0
-	 || keysmem==NULL || public_keys==NULL || private_keys==NULL || dummy_keys==NULL ) {
+	 || public_keys==NULL || private_keys==NULL
+	 || (cached=calloc(raw_public_keys_for_encryption->m_count+1, sizeof(mrpgpcached_t*)))==NULL ) {
 		goto cleanup;
 	}
 
@@ -554,9 +841,11 @@ int mrpgp_pk_encrypt(  mrmailbox_t*       mailbox,
 
 	/* setup keys (the keys may come from pgp_filter_keys_fileread(), see also pgp_keyring_add(rcpts, key)) */
 	for( i = 0; i < raw_public_keys_for_encryption->m_count; i++ ) {
-		pgp_memory_clear(keysmem);
-		pgp_memory_add(keysmem, raw_public_keys_for_encryption->m_keys[i]->m_binary, raw_public_keys_for_encryption->m_keys[i]->m_bytes);
-		pgp_filter_keys_from_mem(&s_io, public_keys, private_keys/*should stay empty*/, NULL, 0, keysmem);
+		if( (cached[cached_cnt]=cached_keys_get(raw_public_keys_for_encryption->m_keys[i])) != NULL ) {
+			add_cached_keys(public_keys, &cached[cached_cnt]->m_public_keys);
+			add_cached_keys(private_keys/*should stay empty*/, &cached[cached_cnt]->m_private_keys);
+			cached_cnt++;
+		}
 	}
 
 	if( public_keys->keyc <=0 || private_keys->keyc!=0 ) {
@@ -571,9 +860,10 @@ int mrpgp_pk_encrypt(  mrmailbox_t*       mailbox,
 		int         encrypt_raw_packet = 0;
 
 		if( raw_private_key_for_signing ) {
-			pgp_memory_clear(keysmem);
-			pgp_memory_add(keysmem, raw_private_key_for_signing->m_binary, raw_private_key_for_signing->m_bytes);
-			pgp_filter_keys_from_mem(&s_io, dummy_keys, private_keys, NULL, 0, keysmem);
+			if( (cached[cached_cnt]=cached_keys_get(raw_private_key_for_signing)) != NULL ) {
+				add_cached_keys(private_keys, &cached[cached_cnt]->m_private_keys);
+				cached_cnt++;
+			}
 			if( private_keys->keyc <= 0 ) {
 				mrmailbox_log_warning(mailbox, 0, "No key for signing found.");
 				goto cleanup;
@@ -609,11 +899,11 @@ int mrpgp_pk_encrypt(  mrmailbox_t*       mailbox,
 	success = 1;
 
 cleanup:
-	if( keysmem )      { pgp_memory_free(keysmem); }
 	if( signedmem )    { pgp_memory_free(signedmem); }
-	if( public_keys )  { pgp_keyring_purge(public_keys); free(public_keys); } /*pgp_keyring_free() frees the content, not the pointer itself*/
-	if( private_keys ) { pgp_keyring_purge(private_keys); free(private_keys); }
-	if( dummy_keys )   { pgp_keyring_purge(dummy_keys); free(dummy_keys); }
+	if( public_keys )  { pgp_keyring_free(public_keys); free(public_keys); } /*pgp_keyring_free() frees the content, not the pointer itself; the keys are owned by the cache*/
+	if( private_keys ) { pgp_keyring_free(private_keys); free(private_keys); }
+	for( i = 0; i < cached_cnt; i++ ) { cached_keys_unref(cached[i]); }
+	free(cached);
 	return success;
 }
 
@@ -630,16 +920,17 @@ int mrpgp_pk_decrypt(  mrmailbox_t*       mailbox,
 {
 	pgp_keyring_t*    public_keys = calloc(1, sizeof(pgp_keyring_t)); /*should be 0 after parsing*/
 	pgp_keyring_t*    private_keys = calloc(1, sizeof(pgp_keyring_t));
-	pgp_keyring_t*    dummy_keys = calloc(1, sizeof(pgp_keyring_t));
+	mrpgpcached_t**   cached = NULL; /* the last entry is used for the validation key */
+	int               cached_cnt = 0;
 	pgp_validation_t* vresult = calloc(1, sizeof(pgp_validation_t));
 	key_id_t*         recipients_key_ids = NULL;
 	unsigned          recipients_count = 0;
-	pgp_memory_t*     keysmem = pgp_memory_new();
 	int               i, success = 0;
 
 	if( mailbox==NULL || ctext==NULL || ctext_bytes==0 || ret_plain==NULL || ret_plain_bytes==NULL || ret_validation_errors==NULL
 	 || raw_private_keys_for_decryption==NULL || raw_private_keys_for_decryption->m_count<=0
-	 || vresult==NULL || keysmem==NULL || public_keys==NULL || private_keys==NULL ) {
+	 || vresult==NULL || public_keys==NULL || private_keys==NULL
+	 || (cached=calloc(raw_private_keys_for_decryption->m_count+1, sizeof(mrpgpcached_t*)))==NULL ) {
 		goto cleanup;
 	}
 
@@ -648,9 +939,11 @@ int mrpgp_pk_decrypt(  mrmailbox_t*       mailbox,
 
 	/* setup keys (the keys may come from pgp_filter_keys_fileread(), see also pgp_keyring_add(rcpts, key)) */
 	for( i = 0; i < raw_private_keys_for_decryption->m_count; i++ ) {
-		pgp_memory_clear(keysmem); /* a simple concatenate of private binary keys fails (works for public keys, however, we don't do it there either) */
-		pgp_memory_add(keysmem, raw_private_keys_for_decryption->m_keys[i]->m_binary, raw_private_keys_for_decryption->m_keys[i]->m_bytes);
-		pgp_filter_keys_from_mem(&s_io, dummy_keys/*should stay empty*/, private_keys, NULL, 0, keysmem);
+		/* each private key is parsed on its own, a simple concatenate of private binary keys fails */
+		if( (cached[cached_cnt]=cached_keys_get(raw_private_keys_for_decryption->m_keys[i])) != NULL ) {
+			add_cached_keys(private_keys, &cached[cached_cnt]->m_private_keys);
+			cached_cnt++;
+		}
 	}
 
 	if( private_keys->keyc<=0 ) {
@@ -659,9 +952,10 @@ int mrpgp_pk_decrypt(  mrmailbox_t*       mailbox,
 	}
 
 	if( raw_public_key_for_validation ) {
-		pgp_memory_clear(keysmem);
-		pgp_memory_add(keysmem, raw_public_key_for_validation->m_binary, raw_public_key_for_validation->m_bytes);
-		pgp_filter_keys_from_mem(&s_io, public_keys, dummy_keys/*should stay empty*/, NULL, 0, keysmem);
+		if( (cached[cached_cnt]=cached_keys_get(raw_public_key_for_validation)) != NULL ) {
+			add_cached_keys(public_keys, &cached[cached_cnt]->m_public_keys);
+			cached_cnt++;
+		}
 	}
 
 	/* decrypt */
@@ -703,10 +997,10 @@ int mrpgp_pk_decrypt(  mrmailbox_t*       mailbox,
 	success = 1;
 
 cleanup:
-	if( keysmem )            { pgp_memory_free(keysmem); }
-	if( public_keys )        { pgp_keyring_purge(public_keys); free(public_keys); } /*pgp_keyring_free() frees the content, not the pointer itself*/
-	if( private_keys )       { pgp_keyring_purge(private_keys); free(private_keys); }
-	if( dummy_keys )         { pgp_keyring_purge(dummy_keys); free(dummy_keys); }
+	if( public_keys )        { pgp_keyring_free(public_keys); free(public_keys); } /*pgp_keyring_free() frees the content, not the pointer itself; the keys are owned by the cache*/
+	if( private_keys )       { pgp_keyring_free(private_keys); free(private_keys); }
+	for( i = 0; i < cached_cnt; i++ ) { cached_keys_unref(cached[i]); }
+	free(cached);
 	if( vresult )            { pgp_validate_result_free(vresult); }
 	if( recipients_key_ids ) { free(recipients_key_ids); }
 	return success;
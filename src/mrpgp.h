@@ -41,6 +41,7 @@ typedef struct mrkeyring_t mrkeyring_t;
 /* misc. */
 void mrpgp_init             (mrmailbox_t*);
 void mrpgp_exit             (mrmailbox_t*);
+void mrpgp_forget_cached_keys(void);
 void mrpgp_rand_seed        (mrmailbox_t*, const void* buf, size_t bytes);
 int  mr_split_armored_data  (char* buf, char** ret_headerline, char** ret_setupcodebegin, char** ret_preferencrypt, char** ret_base64);
 
@@ -53,6 +54,12 @@ int  mrpgp_split_key        (mrmailbox_t*, const mrkey_t* private_in, mrkey_t* p
 int  mrpgp_pk_encrypt       (mrmailbox_t*, const void* plain, size_t plain_bytes, const mrkeyring_t*, const mrkey_t* sign_key, int use_armor, void** ret_ctext, size_t* ret_ctext_bytes);
 int  mrpgp_pk_decrypt       (mrmailbox_t*, const void* ctext, size_t ctext_bytes, const mrkeyring_t*, const mrkey_t* validate_key, int use_armor, void** plain, size_t* plain_bytes, int* ret_validation_errors);
 
+/* the cache of parsed keys, the functions are used for testing */
+#define MR_PGP_KEY_CACHE_MAX 64
+int         mrpgp_cached_keys_count (void);
+const void* mrpgp_cached_keys_id    (const mrkey_t*);
+int         mrpgp_is_key_cached     (const mrkey_t*);
+
 
 #ifdef __cplusplus
 } /* /extern "C" */
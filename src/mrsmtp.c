@@ -203,6 +203,9 @@ int mrsmtp_connect(mrsmtp_t* ths, const mrloginparam_t* lp)
 			mrmailbox_log_info(ths->m_mailbox, 0, "SMTP-Login ok.");
 		}
 
+		ths->m_pipelining = (ths->m_esmtp && (ths->m_hEtpan->esmtp&MAILSMTP_ESMTP_PIPELINING))? 1 : 0;
+		ths->m_last_use = time(NULL);
+
 		success = 1;
 
 cleanup:
@@ -239,14 +242,140 @@ void mrsmtp_disconnect(mrsmtp_t* ths)
 }
 
 
+void mrsmtp_disconnect_if_stale(mrsmtp_t* ths)
+{
+	/* servers close idle connections after some minutes; we check the connection with a NOOP before a batch of messages is sent,
+	so that a dropped connection results in a reconnect and not in a failed message */
+	#define MR_SMTP_NOOP_AFTER_SECONDS 60
+	int smtp_locked = 0;
+
+	if( ths == NULL ) {
+		return;
+	}
+
+	LOCK_SMTP
+
+		if( ths->m_hEtpan && time(NULL)-ths->m_last_use > MR_SMTP_NOOP_AFTER_SECONDS ) {
+			if( mailsmtp_noop(ths->m_hEtpan) != MAILSMTP_NO_ERROR ) {
+				mrmailbox_log_info(ths->m_mailbox, 0, "SMTP-connection lost while idle, we'll reconnect.");
+				mailsmtp_free(ths->m_hEtpan);
+				ths->m_hEtpan = NULL;
+			}
+			else {
+				ths->m_last_use = time(NULL);
+			}
+		}
+
+	UNLOCK_SMTP
+}
+
+
 /*******************************************************************************
  * Send a message
  ******************************************************************************/
 
 
-int mrsmtp_send_msg(mrsmtp_t* ths, const clist* recipients, const char* data_not_terminated, size_t data_bytes)
+static int read_reply(mrsmtp_t* ths)
+{
+	/* read a reply, which may span several lines, and return its code; 0 on stream errors */
+	char* line;
+	do {
+		if( (line=mailstream_read_line_remove_eol(ths->m_hEtpan->stream, ths->m_hEtpan->line_buffer))==NULL ) {
+			return 0;
+		}
+	} while( strlen(line)>3 && line[3]=='-' );
+	return atoi(line);
+}
+
+
+static int send_envelope_pipelined(mrsmtp_t* ths, const clist* recipients, int* rcpt_codes, int* ret_mail_code)
 {
-	int           success = 0, r, smtp_locked = 0;
+	/* send MAIL, all RCPT and DATA in a single write and read the replies afterwards (RFC 2920); returns the reply code of DATA */
+	int         dsn = (ths->m_hEtpan->esmtp&MAILSMTP_ESMTP_DSN)? 1 : 0, i = 0, data_code;
+	clistiter*  iter;
+	MMAPString* cmds = mmap_string_new("");
+	char*       cmd;
+
+	cmd = mr_mprintf("MAIL FROM:<%s>%s\r\n", ths->m_from, dsn? " RET=FULL ENVID=etPanSMTPTest" : "");
+	mmap_string_append(cmds, cmd);
+	free(cmd);
+
+	for( iter=clist_begin(recipients); iter!=NULL; iter=clist_next(iter)) {
+		cmd = mr_mprintf("RCPT TO:<%s>%s\r\n", (const char*)clist_content(iter), dsn? " NOTIFY=FAILURE,DELAY" : "");
+		mmap_string_append(cmds, cmd);
+		free(cmd);
+	}
+
+	mmap_string_append(cmds, "DATA\r\n");
+
+	if( mailstream_write(ths->m_hEtpan->stream, cmds->str, cmds->len)==-1
+	 || mailstream_flush(ths->m_hEtpan->stream)==-1 ) {
+		mmap_string_free(cmds);
+		*ret_mail_code = 0;
+		return 0;
+	}
+	mmap_string_free(cmds);
+
+	/* the replies come in the order of the commands */
+	*ret_mail_code = read_reply(ths);
+	for( iter=clist_begin(recipients); iter!=NULL; iter=clist_next(iter)) {
+		rcpt_codes[i++] = read_reply(ths);
+	}
+	data_code = read_reply(ths);
+
+	if( data_code == 354 && (*ret_mail_code/100!=2) ) {
+		/* should not happen, servers reject DATA without a valid MAIL; end the empty message to keep the session in sync */
+		mailstream_write(ths->m_hEtpan->stream, ".\r\n", 3);
+		mailstream_flush(ths->m_hEtpan->stream);
+		read_reply(ths);
+		data_code = 554;
+	}
+
+	return data_code;
+}
+
+
+static int send_envelope(mrsmtp_t* ths, const clist* recipients, int* rcpt_codes, int* ret_mail_code)
+{
+	/* same as send_envelope_pipelined() using one roundtrip per command; DATA is only sent if there is at least one recipient accepted */
+	int        r, i = 0, accepted = 0;
+	clistiter* iter;
+
+	r = ths->m_esmtp? mailesmtp_mail(ths->m_hEtpan, ths->m_from, 1, "etPanSMTPTest") : mailsmtp_mail(ths->m_hEtpan, ths->m_from);
+	*ret_mail_code = (r==MAILSMTP_ERROR_STREAM)? 0 : ths->m_hEtpan->response_code;
+	if( r != MAILSMTP_NO_ERROR ) {
+		return 0;
+	}
+
+	for( iter=clist_begin(recipients); iter!=NULL; iter=clist_next(iter)) {
+		const char* rcpt = clist_content(iter);
+		r = ths->m_esmtp? mailesmtp_rcpt(ths->m_hEtpan, rcpt, MAILSMTP_DSN_NOTIFY_FAILURE|MAILSMTP_DSN_NOTIFY_DELAY, NULL) : mailsmtp_rcpt(ths->m_hEtpan, rcpt);
+		if( r == MAILSMTP_ERROR_STREAM ) {
+			return 0;
+		}
+		rcpt_codes[i++] = ths->m_hEtpan->response_code;
+		if( r == MAILSMTP_NO_ERROR ) {
+			accepted++;
+		}
+	}
+
+	if( accepted == 0 ) {
+		return 554;
+	}
+
+	r = mailsmtp_data(ths->m_hEtpan);
+	return (r==MAILSMTP_ERROR_STREAM)? 0 : ths->m_hEtpan->response_code;
+}
+
+
+/* Send a message to the given recipients.  Returns 0 on errors, the message was
+not sent to anyone then.  Returns 1 if the message was handed over to the server;
+if ret_rcpt_codes is given, it must have space for one SMTP reply code per
+recipient and the message was only sent to the recipients with 2xx codes. */
+int mrsmtp_send_msg(mrsmtp_t* ths, const clist* recipients, const char* data_not_terminated, size_t data_bytes, int* ret_rcpt_codes)
+{
+	int           success = 0, r, smtp_locked = 0, i, rcpt_cnt, accepted = 0, mail_code = 0, data_code = 0;
+	int*          rcpt_codes = NULL;
 	clistiter*    iter;
 
 	if( ths == NULL ) {
@@ -257,45 +386,58 @@ int mrsmtp_send_msg(mrsmtp_t* ths, const clist* recipients, const char* data_not
 		return 1; /* "null message" send */
 	}
 
+	rcpt_cnt = clist_count(recipients);
+	if( (rcpt_codes=calloc(rcpt_cnt, sizeof(int)))==NULL ) {
+		exit(74);
+	}
+
 	LOCK_SMTP
 
 		if( ths->m_hEtpan==NULL ) {
 			goto cleanup;
 		}
 
-		/* set source */
-		if( (r=(ths->m_esmtp?
-				mailesmtp_mail(ths->m_hEtpan, ths->m_from, 1, "etPanSMTPTest") :
-				 mailsmtp_mail(ths->m_hEtpan, ths->m_from))) != MAILSMTP_NO_ERROR )
+		ths->m_last_use = time(NULL);
+
+		/* set source and recipients */
+		data_code = ths->m_pipelining? send_envelope_pipelined(ths, recipients, rcpt_codes, &mail_code) : send_envelope(ths, recipients, rcpt_codes, &mail_code);
+
+		if( mail_code/100 != 2 )
 		{
 			// this error is very usual - we've simply lost the server connection and reconnect as soon as possible.
 			// so, we do not log the first time this happens
-			mrmailbox_log_error_if(&ths->m_log_usual_error, ths->m_mailbox, 0, "mailsmtp_mail: %s, %s (%i)", ths->m_from, mailsmtp_strerror(r), (int)r);
+			mrmailbox_log_error_if(&ths->m_log_usual_error, ths->m_mailbox, 0, "mailsmtp_mail: %s, reply %i", ths->m_from, mail_code);
 			ths->m_log_usual_error = 1;
 			goto cleanup;
 		}
 
 		ths->m_log_usual_error = 0;
 
-		/* set recipients */
-		for( iter=clist_begin(recipients); iter!=NULL; iter=clist_next(iter)) {
-			const char* rcpt = clist_content(iter);
-			if( (r = (ths->m_esmtp?
-					 mailesmtp_rcpt(ths->m_hEtpan, rcpt, MAILSMTP_DSN_NOTIFY_FAILURE|MAILSMTP_DSN_NOTIFY_DELAY, NULL) :
-					  mailsmtp_rcpt(ths->m_hEtpan, rcpt))) != MAILSMTP_NO_ERROR) {
-				mrmailbox_log_error_if(&ths->m_log_connect_errors, ths->m_mailbox, 0, "mailsmtp_rcpt: %s: %s", rcpt, mailsmtp_strerror(r));
-				goto cleanup;
+		for( i = 0, iter=clist_begin(recipients); iter!=NULL; i++, iter=clist_next(iter)) {
+			if( rcpt_codes[i]/100 == 2 ) {
+				accepted++;
+			}
+			else {
+				mrmailbox_log_warning(ths->m_mailbox, 0, "mailsmtp_rcpt: %s: reply %i", (const char*)clist_content(iter), rcpt_codes[i]);
 			}
 		}
 
-		/* message */
-		if ((r = mailsmtp_data(ths->m_hEtpan)) != MAILSMTP_NO_ERROR) {
-			fprintf(stderr, "mailsmtp_data: %s\n", mailsmtp_strerror(r));
+		if( data_code != 354 ) {
+			if( data_code != 0 ) {
+				mailsmtp_reset(ths->m_hEtpan); /* the session is still usable, end the transaction */
+			}
+			if( accepted == 0 && data_code != 0 && ret_rcpt_codes ) {
+				success = 1; /* all recipients rejected; the caller decides by the reply codes */
+			}
+			else {
+				mrmailbox_log_warning(ths->m_mailbox, 0, "mailsmtp_data: reply %i", data_code);
+			}
 			goto cleanup;
 		}
 
+		/* message */
 		if ((r = mailsmtp_data_message(ths->m_hEtpan, data_not_terminated, data_bytes)) != MAILSMTP_NO_ERROR) {
-			fprintf(stderr, "mailsmtp_data_message: %s\n", mailsmtp_strerror(r));
+			mrmailbox_log_warning(ths->m_mailbox, 0, "mailsmtp_data_message: %s", mailsmtp_strerror(r));
 			goto cleanup;
 		}
 
@@ -305,6 +447,9 @@ cleanup:
 
 	UNLOCK_SMTP
 
+	if( success && ret_rcpt_codes ) {
+		memcpy(ret_rcpt_codes, rcpt_codes, rcpt_cnt*sizeof(int));
+	}
+	free(rcpt_codes);
 	return success;
 }
-
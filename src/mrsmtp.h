@@ -37,6 +37,8 @@ typedef struct mrsmtp_t
 	mailsmtp*       m_hEtpan;
 	char*           m_from;
 	int             m_esmtp;
+	int             m_pipelining;   /* the server supports PIPELINING (RFC 2920), MAIL, RCPT and DATA are sent at once */
+	time_t          m_last_use;     /* time of the last command, idle connections are checked by mrsmtp_disconnect_if_stale() */
 	pthread_mutex_t m_mutex;
 
 	int             m_log_connect_errors;
@@ -50,7 +52,8 @@ void         mrsmtp_unref        (mrsmtp_t*);
 int          mrsmtp_is_connected (const mrsmtp_t*);
 int          mrsmtp_connect      (mrsmtp_t*, const mrloginparam_t*);
 void         mrsmtp_disconnect   (mrsmtp_t*);
-int          mrsmtp_send_msg     (mrsmtp_t*, const clist* recipients, const char* data, size_t data_bytes);
+void         mrsmtp_disconnect_if_stale (mrsmtp_t*);
+int          mrsmtp_send_msg     (mrsmtp_t*, const clist* recipients, const char* data, size_t data_bytes, int* ret_rcpt_codes); /* ret_rcpt_codes may be NULL, see mrsmtp.c */
 
 
 #ifdef __cplusplus
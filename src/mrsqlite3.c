@@ -20,6 +20,7 @@
  ******************************************************************************/
 
 
+#include <ctype.h>
 #include "mrmailbox_internal.h"
 #include "mrapeerstate.h"
 
@@ -35,6 +36,16 @@
   purpose, the primary ID has to be marked using `INTEGER PRIMARY KEY`, see
   https://www.sqlite.org/c3ref/last_insert_rowid.html
 
+- If the config key `wal_mode` is set, the database is switched to
+  write-ahead-logging and some read-only connections are opened in addition
+  to the write connection, see mrsqlite3_lock_reader().  Readers see the last
+  committed state and are not blocked by a pending write transaction.
+
+- If the sqlite library supports FTS5 or FTS4, the virtual table `msgs_fts`
+  indexes msgs.txt and the name of the sender, the rowid is the message ID.
+  Rows are removed by the trigger `msgs_fts_delete` when messages are
+  deleted.
+
 - Some words to the "param" fields:  These fields contains a string with
   additonal, named parameters which must not be accessed by a search and/or
   are very seldomly used. Moreover, this allows smart minor database updates. */
@@ -108,6 +119,53 @@ cleanup:
 }
 
 
+/*******************************************************************************
+ * Statement cache, the statements are kept in a least-recently-used list
+ ******************************************************************************/
+
+
+static void stmt_cache_unlink(mrsqlite3_t* ths, mrsqlite3_stmt_t* entry)
+{
+	if( entry->m_prev ) { entry->m_prev->m_next = entry->m_next; } else { ths->m_stmt_first = entry->m_next; }
+	if( entry->m_next ) { entry->m_next->m_prev = entry->m_prev; } else { ths->m_stmt_last  = entry->m_prev; }
+	entry->m_prev = NULL;
+	entry->m_next = NULL;
+}
+
+
+static void stmt_cache_link_first(mrsqlite3_t* ths, mrsqlite3_stmt_t* entry)
+{
+	entry->m_prev = NULL;
+	entry->m_next = ths->m_stmt_first;
+	if( ths->m_stmt_first ) { ths->m_stmt_first->m_prev = entry; } else { ths->m_stmt_last = entry; }
+	ths->m_stmt_first = entry;
+}
+
+
+static void stmt_cache_remove(mrsqlite3_t* ths, mrsqlite3_stmt_t* entry)
+{
+	stmt_cache_unlink(ths, entry);
+	mrhash_insert(&ths->m_stmt_cache, entry->m_sql, strlen(entry->m_sql), NULL/*remove*/);
+	sqlite3_finalize(entry->m_stmt);
+	free(entry->m_sql);
+	free(entry);
+}
+
+
+static void stmt_cache_evict(mrsqlite3_t* ths)
+{
+	/* finalize the least recently used statement; statements that are still stepped by a caller are skipped,
+	if all statements are in use, the cache just grows a little */
+	mrsqlite3_stmt_t* entry;
+	for( entry = ths->m_stmt_last; entry; entry = entry->m_prev ) {
+		if( !sqlite3_stmt_busy(entry->m_stmt) ) {
+			stmt_cache_remove(ths, entry);
+			return;
+		}
+	}
+}
+
+
 /*******************************************************************************
  * Main interface
  ******************************************************************************/
@@ -116,7 +174,6 @@ cleanup:
 mrsqlite3_t* mrsqlite3_new(mrmailbox_t* mailbox)
 {
 	mrsqlite3_t* ths = NULL;
-	int          i;
 
 	if( (ths=calloc(1, sizeof(mrsqlite3_t)))==NULL ) {
 		exit(24); /* cannot allocate little memory, unrecoverable error */
@@ -124,11 +181,12 @@ mrsqlite3_t* mrsqlite3_new(mrmailbox_t* mailbox)
 
 	ths->m_mailbox          = mailbox;
 
-	for( i = 0; i < PREDEFINED_CNT; i++ ) {
-		ths->m_pd[i] = NULL;
-	}
+	mrhash_init(&ths->m_stmt_cache, MRHASH_BINARY, 0/*the key is owned by mrsqlite3_stmt_t*/);
 
 	pthread_mutex_init(&ths->m_critical_, NULL);
+	pthread_mutex_init(&ths->m_next_reader_critical, NULL);
+	pthread_rwlock_init(&ths->m_readers_rwlock, NULL);
+	pthread_mutex_init(&ths->m_fts_critical, NULL);
 
 	return ths;
 }
@@ -146,11 +204,139 @@ void mrsqlite3_unref(mrsqlite3_t* ths)
 		pthread_mutex_unlock(&ths->m_critical_);
 	}
 
+	mrhash_clear(&ths->m_stmt_cache);
 	pthread_mutex_destroy(&ths->m_critical_);
+	pthread_mutex_destroy(&ths->m_next_reader_critical);
+	pthread_rwlock_destroy(&ths->m_readers_rwlock);
+	pthread_mutex_destroy(&ths->m_fts_critical);
 	free(ths);
 }
 
 
+static void update_hook_cb(void* userdata, int op, const char* db_name, const char* table_name, sqlite3_int64 rowid)
+{
+	mrsqlite3_t* ths = (mrsqlite3_t*)userdata;
+	mrcache_row_changed(ths->m_cache, table_name, (uint32_t)rowid);
+}
+
+
+static void rollback_hook_cb(void* userdata)
+{
+	mrsqlite3_t* ths = (mrsqlite3_t*)userdata;
+	mrcache_clear(ths->m_cache);
+}
+
+
+static int open_readers__(mrsqlite3_t* ths, const char* dbfile)
+{
+	int i;
+
+	if( !mrsqlite3_execute__(ths, "PRAGMA journal_mode=WAL;") ) {
+		return 0;
+	}
+
+	for( i = 0; i < MR_SQL_READER_CNT; i++ )
+	{
+		mrsqlite3_t* reader = mrsqlite3_new(ths->m_mailbox);
+		if( sqlite3_open_v2(dbfile, &reader->m_cobj, SQLITE_OPEN_READONLY, NULL) != SQLITE_OK ) {
+			mrsqlite3_log_error(reader, "Cannot open reader for \"%s\".", dbfile);
+			mrsqlite3_unref(reader); /* also closes m_cobj, sqlite may return a handle on errors */
+			goto cleanup;
+		}
+		sqlite3_busy_timeout(reader->m_cobj, 10*1000);
+		ths->m_readers[ths->m_reader_cnt++] = reader;
+	}
+
+	mrmailbox_log_info(ths->m_mailbox, 0, "WAL mode enabled, %i readers opened.", ths->m_reader_cnt);
+	return 1;
+
+cleanup:
+	/* use either all readers or none */
+	for( i = 0; i < ths->m_reader_cnt; i++ ) {
+		mrsqlite3_unref(ths->m_readers[i]);
+		ths->m_readers[i] = NULL;
+	}
+	ths->m_reader_cnt = 0;
+	return 0;
+}
+
+
+static void init_fts__(mrsqlite3_t* ths)
+{
+	sqlite3_stmt* stmt = NULL;
+	int           fts_version = mrsqlite3_get_config_int__(ths, "fts_version", 0);
+	int           backfill_below, trigger_exists;
+
+	pthread_mutex_lock(&ths->m_fts_critical);
+		ths->m_fts_version        = 0;
+		ths->m_fts_backfill_below = 0;
+	pthread_mutex_unlock(&ths->m_fts_critical);
+
+	if( fts_version == 0 )
+	{
+		/* create the index; errors are expected here if the sqlite library is compiled without the FTS modules,
+		so we use sqlite3_exec() directly and do not log them */
+		if( sqlite3_exec(ths->m_cobj, "CREATE VIRTUAL TABLE msgs_fts USING fts5(txt, name, prefix='2 3');", NULL, NULL, NULL) == SQLITE_OK ) {
+			fts_version = 5;
+		}
+		else if( sqlite3_exec(ths->m_cobj, "CREATE VIRTUAL TABLE msgs_fts USING fts4(txt, name, prefix=\"2,3\", tokenize=unicode61);", NULL, NULL, NULL) == SQLITE_OK ) {
+			fts_version = 4;
+		}
+		else {
+			mrmailbox_log_info(ths->m_mailbox, 0, "Full-text search not supported, searching messages using LIKE.");
+			goto cleanup;
+		}
+
+		mrsqlite3_set_config_int__(ths, "fts_version", fts_version);
+		mrsqlite3_set_config_int__(ths, "fts_backfill_below", -1);
+	}
+	else if( sqlite3_prepare_v2(ths->m_cobj, "SELECT rowid FROM msgs_fts LIMIT 1;", -1, &stmt, NULL) != SQLITE_OK )
+	{
+		/* the index was created by a library with the FTS module but this library does not have it;
+		as we cannot update the index meanwhile, it is rebuilt when it becomes usable again */
+		mrmailbox_log_info(ths->m_mailbox, 0, "Full-text index cannot be used, searching messages using LIKE.");
+		mrsqlite3_execute__(ths, "DROP TRIGGER IF EXISTS msgs_fts_delete;"); /* otherwise, messages cannot be deleted */
+		mrsqlite3_set_config_int__(ths, "fts_backfill_below", -1);
+		goto cleanup;
+	}
+
+	/* remove the rows of deleted messages by a trigger; rows left by versions without the trigger are removed once when it is created */
+	sqlite3_finalize(stmt);
+	stmt = mrsqlite3_prepare_v2_(ths, "SELECT COUNT(*) FROM sqlite_master WHERE type='trigger' AND name='msgs_fts_delete';");
+	trigger_exists = (stmt && sqlite3_step(stmt) == SQLITE_ROW && sqlite3_column_int(stmt, 0) > 0);
+	sqlite3_finalize(stmt);
+	stmt = NULL;
+	if( !trigger_exists ) {
+		mrsqlite3_execute__(ths, "CREATE TRIGGER msgs_fts_delete AFTER DELETE ON msgs BEGIN DELETE FROM msgs_fts WHERE rowid=old.id; END;");
+		mrsqlite3_execute__(ths, "DELETE FROM msgs_fts WHERE rowid NOT IN (SELECT id FROM msgs);");
+	}
+
+	backfill_below = mrsqlite3_get_config_int__(ths, "fts_backfill_below", -1);
+	if( backfill_below < 0 )
+	{
+		/* (re-)build the index in the background: messages added from now on are indexed directly,
+		all existing messages are added by mrsqlite3_fts_backfill__() */
+		sqlite3_finalize(stmt);
+		stmt = mrsqlite3_prepare_v2_(ths, "SELECT MAX(id) FROM msgs;");
+		if( stmt == NULL || sqlite3_step(stmt) != SQLITE_ROW ) {
+			goto cleanup;
+		}
+		backfill_below = sqlite3_column_int(stmt, 0) + 1;
+
+		mrsqlite3_execute__(ths, "DELETE FROM msgs_fts;");
+		mrsqlite3_set_config_int__(ths, "fts_backfill_below", backfill_below);
+	}
+
+	pthread_mutex_lock(&ths->m_fts_critical);
+		ths->m_fts_version        = fts_version;
+		ths->m_fts_backfill_below = backfill_below;
+	pthread_mutex_unlock(&ths->m_fts_critical);
+
+cleanup:
+	if( stmt ) { sqlite3_finalize(stmt); }
+}
+
+
 int mrsqlite3_open__(mrsqlite3_t* ths, const char* dbfile, int flags)
 {
 	if( ths == NULL || dbfile == NULL ) {
@@ -371,6 +557,62 @@ int mrsqlite3_open__(mrsqlite3_t* ths, const char* dbfile, int flags)
 				mrsqlite3_set_config_int__(ths, "dbversion", NEW_DB_VERSION);
 			}
 		#undef NEW_DB_VERSION
+
+		#define NEW_DB_VERSION 28
+			if( dbversion < NEW_DB_VERSION )
+			{
+				mrsqlite3_execute__(ths, "ALTER TABLE jobs ADD COLUMN leased_until INTEGER DEFAULT 0;"); /* set while a worker executes the job; the lane is not stored, it is derived from the action by mrjob_get_lane() */
+
+				dbversion = NEW_DB_VERSION;
+				mrsqlite3_set_config_int__(ths, "dbversion", NEW_DB_VERSION);
+			}
+		#undef NEW_DB_VERSION
+
+		#define NEW_DB_VERSION 29
+			if( dbversion < NEW_DB_VERSION )
+			{
+				/* the last message of each chat is denormalized to the chats table, so that the chatlist can be read by a single index scan,
+				the columns are updated by mrmailbox_update_chat_last_msg__() whenever messages are added, moved or deleted or the draft changes */
+				mrsqlite3_execute__(ths, "ALTER TABLE chats ADD COLUMN last_msg_id INTEGER DEFAULT 0;");
+				mrsqlite3_execute__(ths, "ALTER TABLE chats ADD COLUMN last_timestamp INTEGER DEFAULT 0;"); /* the newer of the last message's timestamp and the draft's timestamp */
+				mrsqlite3_execute__(ths, "CREATE INDEX msgs_index6 ON msgs (chat_id, timestamp);"); /* msgs_index5 is already used for the starred column */
+				mrsqlite3_execute__(ths, "UPDATE chats SET"
+				                         " last_msg_id=IFNULL((SELECT id FROM msgs WHERE chat_id=chats.id ORDER BY timestamp DESC, id DESC LIMIT 1),0),"
+				                         " last_timestamp=MAX(IFNULL(draft_timestamp,0), IFNULL((SELECT MAX(timestamp) FROM msgs WHERE chat_id=chats.id),0));");
+				mrsqlite3_execute__(ths, "CREATE INDEX chats_index3 ON chats (archived, last_timestamp, last_msg_id);");
+
+				dbversion = NEW_DB_VERSION;
+				mrsqlite3_set_config_int__(ths, "dbversion", NEW_DB_VERSION);
+			}
+		#undef NEW_DB_VERSION
+
+		#define NEW_DB_VERSION 30
+			if( dbversion < NEW_DB_VERSION )
+			{
+				/* flags changed on the server are applied by the server folder and UID, see mrmailbox_sync_server_flags() */
+				mrsqlite3_execute__(ths, "CREATE INDEX msgs_index7 ON msgs (server_folder, server_uid);");
+
+				dbversion = NEW_DB_VERSION;
+				mrsqlite3_set_config_int__(ths, "dbversion", NEW_DB_VERSION);
+			}
+		#undef NEW_DB_VERSION
+
+		init_fts__(ths);
+
+		/* the object cache relies on the hooks to see all changes, so it cannot be used for read-only connections that do not see the writes of other connections */
+		ths->m_cache = mrcache_new();
+		sqlite3_update_hook(ths->m_cobj, update_hook_cb, ths);
+		sqlite3_rollback_hook(ths->m_cobj, rollback_hook_cb, ths);
+
+		/* the journal mode is persistent, so we set it explicitly on each open */
+		if( mrsqlite3_get_config_int__(ths, "wal_mode", 0) && !(flags&MR_OPEN_NO_WAL) ) {
+			pthread_rwlock_wrlock(&ths->m_readers_rwlock);
+				open_readers__(ths, dbfile); /* on errors, we just use the write connection for reading, see mrsqlite3_lock_reader() */
+			pthread_rwlock_unlock(&ths->m_readers_rwlock);
+		}
+		else {
+			mrsqlite3_execute__(ths, "PRAGMA journal_mode=DELETE;");
+		}
 	}
 
 	mrmailbox_log_info(ths->m_mailbox, 0, "Opened \"%s\" successfully.", dbfile);
@@ -390,19 +632,29 @@ void mrsqlite3_close__(mrsqlite3_t* ths)
 		return;
 	}
 
+	/* close the readers first, the last connection closed checkpoints the write-ahead-log into the database file;
+	the write lock on m_readers_rwlock waits until no reader is in use and keeps other threads away until the readers are gone */
+	pthread_rwlock_wrlock(&ths->m_readers_rwlock);
+		for( i = 0; i < ths->m_reader_cnt; i++ ) {
+			mrsqlite3_unref(ths->m_readers[i]);
+			ths->m_readers[i] = NULL;
+		}
+		ths->m_reader_cnt = 0;
+	pthread_rwlock_unlock(&ths->m_readers_rwlock);
+
 	if( ths->m_cobj )
 	{
-		for( i = 0; i < PREDEFINED_CNT; i++ ) {
-			if( ths->m_pd[i] ) {
-				sqlite3_finalize(ths->m_pd[i]);
-				ths->m_pd[i] = NULL;
-			}
+		while( ths->m_stmt_first ) {
+			stmt_cache_remove(ths, ths->m_stmt_first);
 		}
 
 		sqlite3_close(ths->m_cobj);
 		ths->m_cobj = NULL;
 	}
 
+	mrcache_unref(ths->m_cache);
+	ths->m_cache = NULL;
+
 	mrmailbox_log_info(ths->m_mailbox, 0, "Database closed."); /* We log the information even if not real closing took place; this is to detect logic errors. */
 }
 
@@ -416,46 +668,61 @@ int mrsqlite3_is_open(const mrsqlite3_t* ths)
 }
 
 
-sqlite3_stmt* mrsqlite3_predefine__(mrsqlite3_t* ths, size_t idx, const char* querystr)
+sqlite3_stmt* mrsqlite3_predefine__(mrsqlite3_t* ths, const char* querystr)
 {
-	/* predefines a statement or resets and reuses a statment.
-	Subsequent call may ommit the querystring.
-	CAVE: you must not call this function with different strings for the same index! */
+	/* returns a compiled statement for the given SQL text, the statement is reused on subsequent calls with the same text.
+	Only the least recently used statements are finalized if there are more than MR_STMT_CACHE_SIZE different texts. */
+	mrsqlite3_stmt_t* entry;
+	int               querystr_bytes;
 
-	if( ths == NULL || ths->m_cobj == NULL || idx >= PREDEFINED_CNT ) {
+	if( ths == NULL || ths->m_cobj == NULL || querystr == NULL ) {
 		return NULL;
 	}
 
-	if( ths->m_pd[idx] ) {
-		sqlite3_reset(ths->m_pd[idx]);
-		return ths->m_pd[idx]; /* fine, already prepared before */
+	querystr_bytes = strlen(querystr);
+
+	if( (entry=mrhash_find(&ths->m_stmt_cache, querystr, querystr_bytes)) != NULL )
+	{
+		ths->m_stmt_hits++;
+		stmt_cache_unlink(ths, entry);
+		stmt_cache_link_first(ths, entry);
+		sqlite3_reset(entry->m_stmt);
+		return entry->m_stmt; /* fine, already prepared before */
 	}
 
-	/*prepare for the first time - this requires the querystring*/
-	if( querystr == NULL ) {
-		return NULL;
+	/* prepare for the first time */
+	ths->m_stmt_misses++;
+
+	if( (entry=calloc(1, sizeof(mrsqlite3_stmt_t)))==NULL || (entry->m_sql=strdup(querystr))==NULL ) {
+		exit(63); /* cannot allocate little memory, unrecoverable error */
 	}
 
 	if( sqlite3_prepare_v2(ths->m_cobj,
 	         querystr, -1 /*read `sql` up to the first null-byte*/,
-	         &ths->m_pd[idx],
+	         &entry->m_stmt,
 	         NULL /*tail not interesing, we use only single statements*/) != SQLITE_OK )
 	{
 		mrsqlite3_log_error(ths, "Preparing statement \"%s\" failed.", querystr);
+		free(entry->m_sql);
+		free(entry);
 		return NULL;
 	}
 
-	return ths->m_pd[idx];
+	if( mrhash_count(&ths->m_stmt_cache) >= MR_STMT_CACHE_SIZE ) {
+		stmt_cache_evict(ths);
+	}
+
+	mrhash_insert(&ths->m_stmt_cache, entry->m_sql, querystr_bytes, entry);
+	stmt_cache_link_first(ths, entry);
+	return entry->m_stmt;
 }
 
 
 void mrsqlite3_reset_all_predefinitions(mrsqlite3_t* ths)
 {
-	int i;
-	for( i = 0; i < PREDEFINED_CNT; i++ ) {
-		if( ths->m_pd[i] ) {
-			sqlite3_reset(ths->m_pd[i]);
-		}
+	mrsqlite3_stmt_t* entry;
+	for( entry = ths->m_stmt_first; entry; entry = entry->m_next ) {
+		sqlite3_reset(entry->m_stmt);
 	}
 }
 
@@ -498,6 +765,143 @@ cleanup:
 }
 
 
+/*******************************************************************************
+ * Full-text index
+ ******************************************************************************/
+
+
+void mrsqlite3_fts_index_msg__(mrsqlite3_t* ths, uint32_t msg_id)
+{
+	sqlite3_stmt* stmt;
+
+	if( ths == NULL || ths->m_fts_version == 0 || msg_id <= MR_MSG_ID_LAST_SPECIAL ) {
+		return;
+	}
+
+	/* message IDs may be reused after the last message was deleted, so delete a possibly existing row first */
+	stmt = mrsqlite3_predefine__(ths,
+		"DELETE FROM msgs_fts WHERE rowid=?;");
+	sqlite3_bind_int(stmt, 1, msg_id);
+	sqlite3_step(stmt);
+
+	stmt = mrsqlite3_predefine__(ths,
+		"INSERT INTO msgs_fts (rowid, txt, name)"
+		" SELECT m.id, m.txt, ct.name FROM msgs m LEFT JOIN contacts ct ON ct.id=m.from_id WHERE m.id=?;");
+	sqlite3_bind_int(stmt, 1, msg_id);
+	sqlite3_step(stmt);
+}
+
+
+int mrsqlite3_fts_backfill__(mrsqlite3_t* ths, int max_rows)
+{
+	sqlite3_stmt* stmt;
+	int           lower;
+
+	if( ths == NULL || ths->m_fts_version == 0 || ths->m_fts_backfill_below <= MR_MSG_ID_LAST_SPECIAL+1 ) {
+		return 0;
+	}
+
+	/* index the range [lower, m_fts_backfill_below), starting with the newest messages, which are searched most likely */
+	lower = ths->m_fts_backfill_below - max_rows;
+	if( lower < MR_MSG_ID_LAST_SPECIAL+1 ) {
+		lower = MR_MSG_ID_LAST_SPECIAL+1;
+	}
+
+	mrsqlite3_begin_transaction__(ths);
+
+		stmt = mrsqlite3_predefine__(ths,
+			"DELETE FROM msgs_fts WHERE rowid>=? AND rowid<?;");
+		sqlite3_bind_int(stmt, 1, lower);
+		sqlite3_bind_int(stmt, 2, ths->m_fts_backfill_below);
+		sqlite3_step(stmt);
+
+		stmt = mrsqlite3_predefine__(ths,
+			"INSERT INTO msgs_fts (rowid, txt, name)"
+			" SELECT m.id, m.txt, ct.name FROM msgs m LEFT JOIN contacts ct ON ct.id=m.from_id WHERE m.id>=? AND m.id<?;");
+		sqlite3_bind_int(stmt, 1, lower);
+		sqlite3_bind_int(stmt, 2, ths->m_fts_backfill_below);
+		if( sqlite3_step(stmt) != SQLITE_DONE ) {
+			mrsqlite3_rollback__(ths);
+			mrsqlite3_log_error(ths, "Cannot add messages to the full-text index.");
+			return 0;
+		}
+
+		mrsqlite3_set_config_int__(ths, "fts_backfill_below", lower);
+
+	mrsqlite3_commit__(ths);
+
+	pthread_mutex_lock(&ths->m_fts_critical);
+		ths->m_fts_backfill_below = lower;
+	pthread_mutex_unlock(&ths->m_fts_critical);
+	if( lower <= MR_MSG_ID_LAST_SPECIAL+1 ) {
+		mrmailbox_log_info(ths->m_mailbox, 0, "Full-text index complete.");
+		return 0;
+	}
+	return 1;
+}
+
+
+char* mrsqlite3_fts_query(mrsqlite3_t* ths, const char* query)
+{
+	/* convert the user's query to a MATCH expression: every word is searched as a prefix, all words must match,
+	eg. `foo ba` results in `"foo"* "ba"*` (FTS5) or `"foo*" "ba*"` (FTS4) */
+	mrstrbuilder_t ret;
+	char*          words = NULL, *word, *p1, *p2;
+	int            word_cnt = 0, is_last;
+	int            fts_version, backfill_below;
+
+	if( ths == NULL || query == NULL ) {
+		return NULL;
+	}
+
+	pthread_mutex_lock(&ths->m_fts_critical); /* the values are changed by the backfill job; do not wait for the write object for this */
+		fts_version    = ths->m_fts_version;
+		backfill_below = ths->m_fts_backfill_below;
+	pthread_mutex_unlock(&ths->m_fts_critical);
+
+	if( fts_version == 0 || backfill_below > MR_MSG_ID_LAST_SPECIAL+1 /*index incomplete*/ ) {
+		return NULL;
+	}
+
+	mrstrbuilder_init(&ret, 0);
+
+	words = safe_strdup(query);
+	for( p1 = words, p2 = words; *p1; p1++ ) { /* quotes and stars are special in MATCH, there is no escaping in FTS4, so just remove them */
+		if( *p1 != '"' && *p1 != '*' ) {
+			*p2++ = *p1;
+		}
+	}
+	*p2 = 0;
+
+	for( p1 = words; *p1; p1++ ) {
+		if( isspace((unsigned char)*p1) ) {
+			continue;
+		}
+		word = p1;
+		while( *p1 && !isspace((unsigned char)*p1) ) {
+			p1++;
+		}
+		is_last = (*p1==0);
+		*p1 = 0;
+
+		mrstrbuilder_catf(&ret, fts_version==5? "%s\"%s\"*" : "%s\"%s*\"", word_cnt? " " : "", word);
+		word_cnt++;
+
+		if( is_last ) {
+			break;
+		}
+	}
+
+	free(words);
+
+	if( word_cnt == 0 ) {
+		free(ret.m_buf);
+		return NULL;
+	}
+	return ret.m_buf;
+}
+
+
 /*******************************************************************************
  * Handle configuration
  ******************************************************************************/
@@ -522,18 +926,18 @@ int mrsqlite3_set_config__(mrsqlite3_t* ths, const char* key, const char* value)
 	{
 		/* insert/update key=value */
 		#define SELECT_v_FROM_config_k_STATEMENT "SELECT value FROM config WHERE keyname=?;"
-		stmt = mrsqlite3_predefine__(ths, SELECT_v_FROM_config_k, SELECT_v_FROM_config_k_STATEMENT);
+		stmt = mrsqlite3_predefine__(ths, SELECT_v_FROM_config_k_STATEMENT);
 		sqlite3_bind_text (stmt, 1, key, -1, SQLITE_STATIC);
 		state=sqlite3_step(stmt);
 		if( state == SQLITE_DONE ) {
-			stmt = mrsqlite3_predefine__(ths, INSERT_INTO_config_kv, "INSERT INTO config (keyname, value) VALUES (?, ?);");
+			stmt = mrsqlite3_predefine__(ths, "INSERT INTO config (keyname, value) VALUES (?, ?);");
 			sqlite3_bind_text (stmt, 1, key,   -1, SQLITE_STATIC);
 			sqlite3_bind_text (stmt, 2, value, -1, SQLITE_STATIC);
 			state=sqlite3_step(stmt);
 
 		}
 		else if( state == SQLITE_ROW ) {
-			stmt = mrsqlite3_predefine__(ths, UPDATE_config_vk, "UPDATE config SET value=? WHERE keyname=?;");
+			stmt = mrsqlite3_predefine__(ths, "UPDATE config SET value=? WHERE keyname=?;");
 			sqlite3_bind_text (stmt, 1, value, -1, SQLITE_STATIC);
 			sqlite3_bind_text (stmt, 2, key,   -1, SQLITE_STATIC);
 			state=sqlite3_step(stmt);
@@ -546,7 +950,7 @@ int mrsqlite3_set_config__(mrsqlite3_t* ths, const char* key, const char* value)
 	else
 	{
 		/* delete key */
-		stmt = mrsqlite3_predefine__(ths, DELETE_FROM_config_k, "DELETE FROM config WHERE keyname=?;");
+		stmt = mrsqlite3_predefine__(ths, "DELETE FROM config WHERE keyname=?;");
 		sqlite3_bind_text (stmt, 1, key,   -1, SQLITE_STATIC);
 		state=sqlite3_step(stmt);
 	}
@@ -568,7 +972,7 @@ char* mrsqlite3_get_config__(mrsqlite3_t* ths, const char* key, const char* def)
 		return strdup_keep_null(def);
 	}
 
-	stmt = mrsqlite3_predefine__(ths, SELECT_v_FROM_config_k, SELECT_v_FROM_config_k_STATEMENT);
+	stmt = mrsqlite3_predefine__(ths, SELECT_v_FROM_config_k_STATEMENT);
 	sqlite3_bind_text(stmt, 1, key, -1, SQLITE_STATIC);
 	if( sqlite3_step(stmt) == SQLITE_ROW )
 	{
@@ -630,6 +1034,53 @@ void mrsqlite3_unlock(mrsqlite3_t* ths)
 }
 
 
+mrsqlite3_t* mrsqlite3_lock_reader(mrsqlite3_t* ths)
+{
+	int          i;
+	mrsqlite3_t* reader;
+
+	/* the read lock on m_readers_rwlock is held until mrsqlite3_unlock_reader() so that
+	mrsqlite3_close__() (eg. called by the backup) cannot free the reader while it is in use */
+	pthread_rwlock_rdlock(&ths->m_readers_rwlock);
+
+	if( ths->m_reader_cnt <= 0 ) {
+		/* the write object survives close/open; release the read lock before waiting for it,
+		otherwise we would deadlock with a thread closing the database while holding the write object */
+		pthread_rwlock_unlock(&ths->m_readers_rwlock);
+		mrsqlite3_lock(ths);
+		return ths;
+	}
+
+	/* take the first unused reader ... */
+	for( i = 0; i < ths->m_reader_cnt; i++ ) {
+		if( pthread_mutex_trylock(&ths->m_readers[i]->m_critical_) == 0 ) {
+			return ths->m_readers[i];
+		}
+	}
+
+	/* ... or wait for one of them */
+	pthread_mutex_lock(&ths->m_next_reader_critical);
+		i = ths->m_next_reader;
+		ths->m_next_reader = (i+1) % ths->m_reader_cnt;
+	pthread_mutex_unlock(&ths->m_next_reader_critical);
+
+	reader = ths->m_readers[i];
+	mrsqlite3_lock(reader);
+	return reader;
+}
+
+
+void mrsqlite3_unlock_reader(mrsqlite3_t* ths, mrsqlite3_t* reader)
+{
+	if( reader ) {
+		mrsqlite3_unlock(reader); /* if WAL is disabled, reader is ths */
+		if( reader != ths ) {
+			pthread_rwlock_unlock(&ths->m_readers_rwlock);
+		}
+	}
+}
+
+
 /*******************************************************************************
  * Transactions
  ******************************************************************************/
@@ -643,11 +1094,20 @@ void mrsqlite3_begin_transaction__(mrsqlite3_t* ths)
 
 	if( ths->m_transactionCount == 1 )
 	{
-		stmt = mrsqlite3_predefine__(ths, BEGIN_transaction, "BEGIN;");
+		stmt = mrsqlite3_predefine__(ths, "BEGIN;");
 		if( sqlite3_step(stmt) != SQLITE_DONE ) {
 			mrsqlite3_log_error(ths, "Cannot begin transaction.");
 		}
 	}
+	else
+	{
+		/* nested transactions are savepoints, so they can be rolled back without affecting the outer transaction;
+		savepoints with the same name are stacked, RELEASE and ROLLBACK TO refer to the innermost one */
+		stmt = mrsqlite3_predefine__(ths, "SAVEPOINT nested;");
+		if( sqlite3_step(stmt) != SQLITE_DONE ) {
+			mrsqlite3_log_error(ths, "Cannot begin nested transaction.");
+		}
+	}
 }
 
 
@@ -659,31 +1119,58 @@ void mrsqlite3_rollback__(mrsqlite3_t* ths)
 	{
 		if( ths->m_transactionCount == 1 )
 		{
-			stmt = mrsqlite3_predefine__(ths, ROLLBACK_transaction, "ROLLBACK;");
+			stmt = mrsqlite3_predefine__(ths, "ROLLBACK;");
 			if( sqlite3_step(stmt) != SQLITE_DONE ) {
 				mrsqlite3_log_error(ths, "Cannot rollback transaction.");
 			}
 		}
+		else
+		{
+			stmt = mrsqlite3_predefine__(ths, "ROLLBACK TO nested;");
+			if( sqlite3_step(stmt) != SQLITE_DONE ) {
+				mrsqlite3_log_error(ths, "Cannot rollback nested transaction.");
+			}
+
+			stmt = mrsqlite3_predefine__(ths, "RELEASE nested;"); /* ROLLBACK TO keeps the savepoint */
+			sqlite3_step(stmt);
+
+			mrcache_clear(ths->m_cache); /* the rollback hook is not called for savepoints */
+		}
 
 		ths->m_transactionCount--;
 	}
 }
 
 
-void mrsqlite3_commit__(mrsqlite3_t* ths)
+int mrsqlite3_commit__(mrsqlite3_t* ths)
 {
 	sqlite3_stmt* stmt;
+	int           success = 1;
 
 	if( ths->m_transactionCount >= 1 )
 	{
 		if( ths->m_transactionCount == 1 )
 		{
-			stmt = mrsqlite3_predefine__(ths, COMMIT_transaction, "COMMIT;");
+			stmt = mrsqlite3_predefine__(ths, "COMMIT;");
 			if( sqlite3_step(stmt) != SQLITE_DONE ) {
 				mrsqlite3_log_error(ths, "Cannot commit transaction.");
+				success = 0;
+				if( !sqlite3_get_autocommit(ths->m_cobj) ) {
+					mrsqlite3_execute__(ths, "ROLLBACK;"); /* eg. on SQLITE_BUSY, the transaction is still active, do not leave it open */
+				}
+			}
+		}
+		else
+		{
+			stmt = mrsqlite3_predefine__(ths, "RELEASE nested;");
+			if( sqlite3_step(stmt) != SQLITE_DONE ) {
+				mrsqlite3_log_error(ths, "Cannot commit nested transaction.");
+				success = 0;
 			}
 		}
 
 		ths->m_transactionCount--;
 	}
+
+	return success;
 }
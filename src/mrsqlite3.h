@@ -32,124 +32,24 @@ extern "C" {
 #include <sqlite3.h>
 #include <libetpan/libetpan.h>
 #include <pthread.h>
+#include "mrhash.h"
+#include "mrcache.h"
 typedef struct _mrmailbox mrmailbox_t;
 
 
-/* predefined statements */
-enum
+/**
+ * Library-internal.
+ *
+ * A compiled statement in the statement cache of mrsqlite3_t, see mrsqlite3_predefine__().
+ */
+typedef struct mrsqlite3_stmt_t
 {
-	 BEGIN_transaction = 0 /* must be first */
-	,ROLLBACK_transaction
-	,COMMIT_transaction
-
-	,SELECT_v_FROM_config_k
-	,INSERT_INTO_config_kv
-	,UPDATE_config_vk
-	,DELETE_FROM_config_k
-
-	,SELECT_COUNT_FROM_contacts
-	,SELECT_naob_FROM_contacts_i
-	,SELECT_inao_FROM_contacts_a
-	,SELECT_id_FROM_contacts_WHERE_id
-	,SELECT_na_FROM_chats_contacs_JOIN_contacts_WHERE_cc
-	,SELECT_p_FROM_chats_contacs_JOIN_contacts_peerstates_WHERE_cc
-	,SELECT_id_FROM_contacts_ORDER_BY
-	,SELECT_id_FROM_contacts_WHERE_query_ORDER_BY
-	,SELECT_COUNT_FROM_contacts_WHERE_blocked
-	,SELECT_id_FROM_contacts_WHERE_blocked
-	,INSERT_INTO_contacts_neo
-	,UPDATE_contacts_nao_WHERE_i
-	,UPDATE_contacts_SET_origin_WHERE_id
-	,UPDATE_contacts_SET_b_WHERE_i
-	,DELETE_FROM_contacts_WHERE_id
-
-	,SELECT_COUNT_FROM_chats
-	,SELECT_COUNT_FROM_chats_WHERE_archived
-	,SELECT_ii_FROM_chats_LEFT_JOIN_msgs_WHERE_archived
-	,SELECT_ii_FROM_chats_LEFT_JOIN_msgs_WHERE_unarchived
-	,SELECT_ii_FROM_chats_LEFT_JOIN_msgs_WHERE_query
-	,SELECT_itndd_FROM_chats_WHERE_i
-	,SELECT_id_FROM_chats_WHERE_id
-	,SELECT_id_FROM_chats_WHERE_contact_id
-	,SELECT_id_FROM_CHATS_WHERE_grpid
-	,SELECT_timestamp_FROM_msgs_WHERE_timestamp
-	,SELECT_param_FROM_msgs
-	,SELECT_it_FROM_msgs_JOIN_chats_WHERE_rfc724
-	,SELECT_MAX_timestamp_FROM_msgs
-	,SELECT_rfc724_FROM_msgs_ORDER_BY_timestamp_LIMIT_1
-	,UPDATE_chats_SET_draft_WHERE_id
-	,UPDATE_chats_SET_n_WHERE_c
-	,UPDATE_chats_SET_blocked_WHERE_chat_id
-	,UPDATE_chats_SET_blocked_WHERE_contact_id
-	,UPDATE_chats_SET_unarchived
-
-	,SELECT_a_FROM_chats_contacts_WHERE_i
-	,SELECT_COUNT_FROM_chats_contacts_WHERE_chat_id
-	,SELECT_COUNT_FROM_chats_contacts_WHERE_contact_id
-	,SELECT_c_FROM_chats_contacts_WHERE_c
-	,SELECT_c_FROM_chats_contacts_WHERE_c_ORDER_BY
-	,SELECT_void_FROM_chats_contacts_WHERE_chat_id_AND_contact_id
-	,INSERT_INTO_chats_contacts
-
-	,SELECT_COUNT_FROM_msgs_WHERE_assigned
-	,SELECT_COUNT_FROM_msgs_WHERE_unassigned
-	,SELECT_COUNT_FROM_msgs_WHERE_state_AND_chat_id
-	,SELECT_COUNT_FROM_msgs_WHERE_chat_id
-	,SELECT_COUNT_FROM_msgs_WHERE_rfc724_mid
-	,SELECT_COUNT_FROM_msgs_WHERE_ft
-	,SELECT_i_FROM_msgs_WHERE_ctt
-	,SELECT_id_FROM_msgs_WHERE_cm
-	,SELECT_id_FROM_msgs_WHERE_mcm
-	,SELECT_id_FROM_msgs_WHERE_fresh_AND_deaddrop
-	,SELECT_txt_raw_FROM_msgs_WHERE_id
-	,SELECT_ircftttstpb_FROM_msg_WHERE_i
-	,SELECT_ss_FROM_msgs_WHERE_m
-	,SELECT_i_FROM_msgs_LEFT_JOIN_contacts_WHERE_c
-	,SELECT_i_FROM_msgs_LEFT_JOIN_contacts_WHERE_starred
-	,SELECT_i_FROM_msgs_LEFT_JOIN_contacts_WHERE_fresh
-	,SELECT_i_FROM_msgs_LEFT_JOIN_chats_contacts_WHERE_blocked
-	,SELECT_i_FROM_msgs_WHERE_query
-	,SELECT_i_FROM_msgs_WHERE_chat_id_AND_query
-	,INSERT_INTO_msgs_msscftttsmttpb
-	,INSERT_INTO_msgs_mcftttstpb
-	,UPDATE_msgs_SET_chat_id_WHERE_id
-	,UPDATE_msgs_SET_state_WHERE_id
-	,SELECT_state_blocked_FROM_msgs_LEFT_JOIN_chats_WHERE_id
-	,UPDATE_msgs_SET_state_WHERE_chat_id_AND_state
-	,UPDATE_msgs_SET_state_WHERE_from_id_AND_state
-	,UPDATE_msgs_SET_ss_WHERE_rfc724_mid
-	,UPDATE_msgs_SET_param_WHERE_id
-	,UPDATE_msgs_SET_starred_WHERE_id
-	,DELETE_FROM_msgs_WHERE_id
-	,DELETE_FROM_msgs_WHERE_rfc724_mid
-
-	,SELECT_c_FROM_msgs_mdns_WHERE_mc
-	,INSERT_INTO_msgs_mdns
-	,SELECT_COUNT_FROM_msgs_mdns_WHERE_m
-	,DELETE_FROM_msgs_mdns_WHERE_m
-
-	,INSERT_INTO_jobs_aafp
-	,SELECT_MIN_d_FROM_jobs
-	,SELECT_iafp_FROM_jobs
-	,DELETE_FROM_jobs_WHERE_id
-	,DELETE_FROM_jobs_WHERE_action
-	,UPDATE_jobs_SET_dp_WHERE_id
-
-	,SELECT_FROM_leftgrps_WHERE_grpid
-
-	,INSERT_INTO_acpeerstates_a
-	,SELECT_fields_FROM_acpeerstates_WHERE_addr
-	,SELECT_fields_FROM_acpeerstates_WHERE_fingerprint
-	,UPDATE_acpeerstates_SET_l_WHERE_a
-	,UPDATE_acpeerstates_SET_lcpp_WHERE_a
-
-	,INSERT_INTO_keypairs_aippc
-	,SELECT_private_key_FROM_keypairs_WHERE_default
-	,SELECT_private_key_FROM_keypairs_ORDER_BY_default
-	,SELECT_public_key_FROM_keypairs_WHERE_default
-
-	,PREDEFINED_CNT /* must be last */
-};
+	/** @privatesection */
+	char*                    m_sql;    /**< the SQL text, used as key in mrsqlite3_t::m_stmt_cache */
+	sqlite3_stmt*            m_stmt;
+	struct mrsqlite3_stmt_t* m_prev;   /**< towards the most recently used statement */
+	struct mrsqlite3_stmt_t* m_next;   /**< towards the least recently used statement */
+} mrsqlite3_stmt_t;
 
 
 /**
@@ -163,12 +63,31 @@ enum
 typedef struct mrsqlite3_t
 {
 	/** @privatesection */
-	sqlite3_stmt* m_pd[PREDEFINED_CNT]; /**< prepared statements - this is the favourite way for the caller to use SQLite */
 	sqlite3*      m_cobj;               /**< is the database given as dbfile to Open() */
 	int           m_transactionCount;   /**< helper for transactions */
 	mrmailbox_t*  m_mailbox;            /**< used for logging and to acquire wakelocks, there may be N mrsqlite3_t objects per mrmailbox! In practise, we use 2 on backup, 1 otherwise. */
 	pthread_mutex_t m_critical_;        /**< the user must make sure, only one thread uses sqlite at the same time! for this purpose, all calls must be enclosed by a locked m_critical; use mrsqlite3_lock() for this purpose */
 
+	#define       MR_SQL_READER_CNT     2
+	struct mrsqlite3_t* m_readers[MR_SQL_READER_CNT]; /**< read-only connections, only opened in WAL mode, each with its own predefined statements and its own m_critical_; use mrsqlite3_lock_reader() to get one */
+	int           m_reader_cnt;         /**< number of opened readers, 0 if WAL mode is not enabled */
+	pthread_rwlock_t m_readers_rwlock;  /**< protects m_readers and m_reader_cnt; held for reading while a reader is in use, held for writing while the readers are opened or closed */
+	int           m_next_reader;        /**< round-robin index used if all readers are in use, protected by m_next_reader_critical */
+	pthread_mutex_t m_next_reader_critical;
+
+	int           m_fts_version;        /**< 5 or 4 if the full-text index msgs_fts is used, 0 if the sqlite library has no FTS module */
+	int           m_fts_backfill_below; /**< messages with smaller IDs are not yet in the full-text index, see mrsqlite3_fts_backfill__() */
+	pthread_mutex_t m_fts_critical;     /**< the m_fts_* values are changed with the write object locked and m_fts_critical held, mrsqlite3_fts_query() reads them holding m_fts_critical only */
+
+	#define       MR_STMT_CACHE_SIZE    128
+	mrhash_t      m_stmt_cache;         /**< prepared statements by their SQL text - this is the favourite way for the caller to use SQLite, see mrsqlite3_predefine__() */
+	mrsqlite3_stmt_t* m_stmt_first;     /**< the most recently used statement */
+	mrsqlite3_stmt_t* m_stmt_last;      /**< the least recently used statement, this is finalized first if the cache is full */
+	int           m_stmt_hits;          /**< statistics, number of mrsqlite3_predefine__() calls that could reuse a statement */
+	int           m_stmt_misses;        /**< statistics, number of statements that had to be compiled */
+
+	mrcache_t*    m_cache;              /**< decoded chats, contacts and peerstates, only used by connections opened for writing, NULL otherwise */
+
 } mrsqlite3_t;
 
 
@@ -176,6 +95,7 @@ mrsqlite3_t*  mrsqlite3_new              (mrmailbox_t*);
 void          mrsqlite3_unref            (mrsqlite3_t*);
 
 #define       MR_OPEN_READONLY           0x01
+#define       MR_OPEN_NO_WAL             0x02 /* ignore the wal_mode setting and use the rollback journal, used for backup copies */
 int           mrsqlite3_open__           (mrsqlite3_t*, const char* dbfile, int flags);
 
 void          mrsqlite3_close__          (mrsqlite3_t*);
@@ -188,7 +108,7 @@ char*         mrsqlite3_get_config__     (mrsqlite3_t*, const char* key, const c
 int32_t       mrsqlite3_get_config_int__ (mrsqlite3_t*, const char* key, int32_t def);
 
 /* tools, these functions are compatible to the corresponding sqlite3_* functions */
-sqlite3_stmt* mrsqlite3_predefine__      (mrsqlite3_t*, size_t idx, const char* sql); /*the result is resetted as needed and must not be freed. CAVE: you must not call this function with different strings for the same index!*/
+sqlite3_stmt* mrsqlite3_predefine__      (mrsqlite3_t*, const char* sql); /* the result is cached by the SQL text, resetted as needed and must not be freed; for SQL with formatted-in values, use mrsqlite3_prepare_v2_() as these would only fill the cache */
 sqlite3_stmt* mrsqlite3_prepare_v2_      (mrsqlite3_t*, const char* sql); /* the result mus be freed using sqlite3_finalize() */
 int           mrsqlite3_execute__        (mrsqlite3_t*, const char* sql);
 int           mrsqlite3_table_exists__   (mrsqlite3_t*, const char* name);
@@ -204,9 +124,24 @@ Low-level-functions, eg. the MrSqlite3-methods, do not lock. */
 void          mrsqlite3_lock             (mrsqlite3_t*); /* lock or wait; these calls must not be nested in a single thread */
 void          mrsqlite3_unlock           (mrsqlite3_t*);
 
-/* nestable transactions, only the outest is really used */
+/* in WAL mode (config key `wal_mode`, applied on the next open), read-only queries may use one of the reader connections;
+this does not block the write connection, so eg. the UI is not stalled by a long receive transaction.
+If WAL mode is disabled, mrsqlite3_lock_reader() just locks and returns the given write object.
+Functions using the returned object must not write to the database. */
+mrsqlite3_t*  mrsqlite3_lock_reader      (mrsqlite3_t*);
+void          mrsqlite3_unlock_reader    (mrsqlite3_t*, mrsqlite3_t* reader);
+
+/* full-text index over the message texts and the sender names, maintained in addition to the msgs table;
+new messages are added by mrsqlite3_fts_index_msg__(), older ones by mrsqlite3_fts_backfill__() in the background.
+mrsqlite3_fts_query() returns NULL if the index cannot be used, in this case, the caller should fall back to LIKE. */
+#define       MR_FTS_BACKFILL_ROWS       500
+void          mrsqlite3_fts_index_msg__  (mrsqlite3_t*, uint32_t msg_id);
+int           mrsqlite3_fts_backfill__   (mrsqlite3_t*, int max_rows); /* returns 1 if there are more messages to index */
+char*         mrsqlite3_fts_query        (mrsqlite3_t*, const char* query); /* the result must be free()'d; must not be called from lock */
+
+/* nestable transactions, nested ones are savepoints that can be rolled back on their own; only committing the outest makes the changes durable */
 void          mrsqlite3_begin_transaction__(mrsqlite3_t*);
-void          mrsqlite3_commit__           (mrsqlite3_t*);
+int           mrsqlite3_commit__           (mrsqlite3_t*); /* returns 0 if the changes are rolled back as they could not be committed */
 void          mrsqlite3_rollback__         (mrsqlite3_t*);
 
 #ifdef __cplusplus
@@ -22,6 +22,7 @@
 
 #include <stdarg.h>
 #include <ctype.h>
+#include <errno.h>
 #include <fcntl.h>
 #include <unistd.h>
 #include <sys/stat.h>
@@ -577,6 +578,171 @@ void mrstrbuilder_empty(mrstrbuilder_t* ths)
 }
 
 
+/*******************************************************************************
+ * Memory tools - mrarena_t
+ ******************************************************************************/
+
+
+#define MR_ARENA_ALIGN(b) (((b)+7) & ~(size_t)7)
+
+
+static mrarena_block_t* mrarena_new_block(size_t bytes, mrarena_block_t* next)
+{
+	mrarena_block_t* block;
+
+	if( (block=malloc(MR_ARENA_ALIGN(sizeof(mrarena_block_t))+bytes))==NULL ) {
+		exit(68);
+	}
+
+	block->m_next  = next;
+	block->m_bytes = bytes;
+	return block;
+}
+
+
+#define MR_ARENA_DATA(block) ((char*)(block) + MR_ARENA_ALIGN(sizeof(mrarena_block_t)))
+
+
+mrarena_t* mrarena_new()
+{
+	mrarena_t* ths;
+
+	if( (ths=calloc(1, sizeof(mrarena_t)))==NULL ) {
+		exit(69);
+	}
+
+	return ths;
+}
+
+
+void mrarena_unref(mrarena_t* ths)
+{
+	mrarena_block_t* next;
+
+	if( ths == NULL ) {
+		return;
+	}
+
+	mrarena_reset(ths);
+
+	while( ths->m_first ) {
+		next = ths->m_first->m_next;
+		free(ths->m_first);
+		ths->m_first = next;
+	}
+
+	free(ths);
+}
+
+
+void mrarena_reset(mrarena_t* ths)
+{
+	mrarena_block_t *block, *next;
+	int              i;
+
+	if( ths == NULL ) {
+		return;
+	}
+
+	while( ths->m_taken ) { /* before the blocks, the list entries are allocated from them */
+		free(ths->m_taken->m_ptr);
+		ths->m_taken = ths->m_taken->m_next;
+	}
+
+	while( ths->m_large ) {
+		next = ths->m_large->m_next;
+		free(ths->m_large);
+		ths->m_large = next;
+	}
+
+	/* keep the first standard blocks for reuse */
+	for( block = ths->m_first, i = 1; block && i < MR_ARENA_KEEP_BLOCKS; block = block->m_next, i++ ) {
+		;
+	}
+
+	if( block ) {
+		while( block->m_next ) {
+			next = block->m_next->m_next;
+			free(block->m_next);
+			block->m_next = next;
+		}
+	}
+
+	ths->m_curr = NULL;
+	ths->m_used = 0;
+}
+
+
+void* mrarena_alloc(mrarena_t* ths, size_t bytes)
+{
+	void* ret;
+
+	if( ths == NULL ) {
+		return NULL;
+	}
+
+	bytes = MR_ARENA_ALIGN(bytes? bytes : 1);
+
+	if( bytes > MR_ARENA_BLOCK_BYTES/4 )
+	{
+		ths->m_large = mrarena_new_block(bytes, ths->m_large);
+		ret = MR_ARENA_DATA(ths->m_large);
+	}
+	else
+	{
+		if( ths->m_curr == NULL || ths->m_used+bytes > ths->m_curr->m_bytes )
+		{
+			/* continue with the next standard block, allocate one if there is none left from the previous uses */
+			mrarena_block_t** next = ths->m_curr? &ths->m_curr->m_next : &ths->m_first;
+			if( *next == NULL ) {
+				*next = mrarena_new_block(MR_ARENA_BLOCK_BYTES, NULL);
+			}
+			ths->m_curr = *next;
+			ths->m_used = 0;
+		}
+
+		ret = MR_ARENA_DATA(ths->m_curr) + ths->m_used;
+		ths->m_used += bytes;
+	}
+
+	memset(ret, 0, bytes);
+	return ret;
+}
+
+
+char* mrarena_strndup(mrarena_t* ths, const char* str, size_t bytes)
+{
+	char* ret = mrarena_alloc(ths, bytes+1);
+	if( ret && str ) {
+		memcpy(ret, str, bytes);
+	}
+	return ret;
+}
+
+
+char* mrarena_strdup(mrarena_t* ths, const char* str)
+{
+	return mrarena_strndup(ths, str, str? strlen(str) : 0);
+}
+
+
+char* mrarena_take_str(mrarena_t* ths, char* str)
+{
+	mrarena_taken_t* taken;
+
+	if( str == NULL || ths == NULL ) {
+		return str;
+	}
+
+	/* remember the buffer instead of copying it, this costs only a few bytes of the current block */
+	taken = mrarena_alloc(ths, sizeof(mrarena_taken_t));
+	taken->m_ptr  = str;
+	taken->m_next = ths->m_taken;
+	ths->m_taken  = taken;
+	return str;
+}
+
+
 /*******************************************************************************
  * Decode header strings
  ******************************************************************************/
@@ -1738,12 +1904,12 @@ void mr_validate_filename(char* filename)
 }
 
 
-char* mr_get_fine_pathNfilename(const char* folder, const char* desired_filenameNsuffix__)
+static char* get_fine_pathNfilename(const char* folder, const char* desired_filenameNsuffix__, int create)
 {
 	char*       ret = NULL, *filenameNsuffix, *basename = NULL, *dotNSuffix = NULL;
 	time_t      now = time(NULL);
 	struct stat st;
-	int         i;
+	int         i, fd;
 
 	filenameNsuffix = safe_strdup(desired_filenameNsuffix__);
 	mr_validate_filename(filenameNsuffix);
@@ -1757,7 +1923,19 @@ char* mr_get_fine_pathNfilename(const char* folder, const char* desired_filename
 		else {
 			ret = mr_mprintf("%s/%s%s", folder, basename, dotNSuffix);
 		}
-		if (stat(ret, &st) == -1) {
+		if( create ) {
+			/* checking and creating the file is atomic, so other threads cannot get the same name */
+			if( (fd=open(ret, O_WRONLY|O_CREAT|O_EXCL, 0666)) >= 0 ) {
+				close(fd);
+				goto cleanup; /* fine filename found and reserved */
+			}
+			if( errno != EEXIST ) {
+				free(ret);
+				ret = NULL;
+				goto cleanup; /* eg. the folder does not exist, no need to try other names */
+			}
+		}
+		else if( stat(ret, &st) == -1 ) {
 			goto cleanup; /* fine filename found */
 		}
 		free(ret); /* try over with the next index */
@@ -1772,6 +1950,18 @@ cleanup:
 }
 
 
+char* mr_get_fine_pathNfilename(const char* folder, const char* desired_filenameNsuffix)
+{
+	return get_fine_pathNfilename(folder, desired_filenameNsuffix, 0);
+}
+
+
+char* mr_create_fine_pathNfilename(const char* folder, const char* desired_filenameNsuffix)
+{
+	return get_fine_pathNfilename(folder, desired_filenameNsuffix, 1);
+}
+
+
 int mr_write_file(const char* pathNfilename, const void* buf, size_t buf_bytes, mrmailbox_t* log)
 {
 	int success = 0;
@@ -78,6 +78,36 @@ char* mrstrbuilder_cat     (mrstrbuilder_t* ths, const char* text);
 void  mrstrbuilder_catf    (mrstrbuilder_t* ths, const char* format, ...);
 void  mrstrbuilder_empty   (mrstrbuilder_t* ths); /* set the string to a lenght of 0, does not free the buffer */
 
+/* arena, the allocations are not free()'d one by one but all at once by mrarena_reset();
+standard blocks are kept for reuse, so resetting does not touch the heap in the usual case */
+typedef struct mrarena_block_t
+{
+	struct mrarena_block_t* m_next;
+	size_t                  m_bytes; /* usable bytes following the header */
+} mrarena_block_t;
+typedef struct mrarena_taken_t
+{
+	struct mrarena_taken_t* m_next;
+	void*                   m_ptr;
+} mrarena_taken_t;
+typedef struct mrarena_t
+{
+	#define          MR_ARENA_BLOCK_BYTES 16384
+	#define          MR_ARENA_KEEP_BLOCKS 4    /* more standard blocks are free()'d on reset */
+	mrarena_block_t* m_first;  /* standard blocks */
+	mrarena_block_t* m_curr;   /* the standard block allocations are taken from, NULL if there is none yet */
+	size_t           m_used;   /* bytes used in m_curr */
+	mrarena_block_t* m_large;  /* dedicated blocks for allocations larger than a quarter of a standard block */
+	mrarena_taken_t* m_taken;  /* buffers allocated by malloc() and taken over by mrarena_take_str(), the list entries live in the arena */
+} mrarena_t;
+mrarena_t* mrarena_new      ();
+void       mrarena_unref    (mrarena_t*);
+void       mrarena_reset    (mrarena_t*);
+void*      mrarena_alloc    (mrarena_t*, size_t bytes); /* the memory is zeroed, never returns NULL */
+char*      mrarena_strndup  (mrarena_t*, const char*, size_t bytes);
+char*      mrarena_strdup   (mrarena_t*, const char*); /* a NULL-pointer results in an empty string as for safe_strdup() */
+char*      mrarena_take_str (mrarena_t*, char* str); /* take over a string allocated by malloc(), it is free()'d on reset; the string is not copied */
+
 
 /* clist tools */
 void    clist_free_content         (const clist*); /* calls free() for each item content */
@@ -118,6 +148,7 @@ char*    mr_get_filesuffix_lc       (const char* pathNfilename); /* the returned
 void     mr_split_filename          (const char* pathNfilename, char** ret_basename, char** ret_all_suffixes_incl_dot); /* the case of the suffix is preserved! */
 int      mr_get_filemeta            (const void* buf, size_t buf_bytes, uint32_t* ret_width, uint32_t *ret_height);
 char*    mr_get_fine_pathNfilename  (const char* folder, const char* desired_name);
+char*    mr_create_fine_pathNfilename(const char* folder, const char* desired_name); /* as mr_get_fine_pathNfilename(), however, an empty file is created, so concurrent callers never get the same name */
 
 
 /* macros */